@@ -28,9 +28,18 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <zlib.h>
 
 #include "gd.h"
+#include "mazecpu.h"
 
 #define LINE_WIDTH 80 /* characters */
 
@@ -48,13 +57,14 @@ static unsigned int adj_pop[] = {0, 1, 1, 2, 1, 2, 2, 3,
    maze.
  */
 
-static int s_can_move(maze_t *mp, rowcol_t r, rowcol_t c, unsigned int dir) {
+static int s_can_move(const maze_t *mp, rowcol_t r, rowcol_t c,
+                      unsigned int dir) {
   assert(0 <= dir && dir < 4);
   switch (dir) {
     case DIR_U:
       return (r > 0 && CELLV(mp, r - 1, c).b_wall == 0);
     case DIR_R:
-      return (c < mp->n_cols && CELLV(mp, r, c).r_wall == 0);
+      return (c < mp->n_cols - 1 && CELLV(mp, r, c).r_wall == 0);
     case DIR_D:
       return (r < mp->n_rows - 1 && CELLV(mp, r, c).b_wall == 0);
     default:
@@ -62,6 +72,180 @@ static int s_can_move(maze_t *mp, rowcol_t r, rowcol_t c, unsigned int dir) {
   }
 }
 
+/* s_exit_walls(n, r, c, n_rows, n_cols, exit_1, exit_2)
+
+   Return cell n, at row r and column c of a maze with the given size
+   and exits, as the writers should draw it: with its right or bottom
+   wall removed if one of the exits passes through it.  The maze
+   itself is not changed, so that mazes in read-only memory can be
+   written.
+ */
+
+static maze_node s_exit_walls(maze_node n, rowcol_t r, rowcol_t c,
+                              rowcol_t n_rows, rowcol_t n_cols,
+                              rowcol_t exit_1, rowcol_t exit_2) {
+  if (c == n_cols - 1 && (exit_1 == EXIT(r, DIR_R) || exit_2 == EXIT(r, DIR_R)))
+    n.r_wall = 0;
+  if (r == n_rows - 1 && (exit_1 == EXIT(c, DIR_D) || exit_2 == EXIT(c, DIR_D)))
+    n.b_wall = 0;
+
+  return n;
+}
+
+/* s_out_cell(*mp, r, c)
+
+   Return the cell at row r and column c as the writers should draw
+   it; see s_exit_walls().
+ */
+
+static maze_node s_out_cell(const maze_t *mp, rowcol_t r, rowcol_t c) {
+  return s_exit_walls(CELLV(mp, r, c), r, c, mp->n_rows, mp->n_cols,
+                      mp->exit_1, mp->exit_2);
+}
+
+/* s_row_cell(*wp, *row, c)
+
+   Return cell c of the row being written by a row writer as it should
+   be drawn; see s_exit_walls().
+ */
+
+static maze_node s_row_cell(const maze_rows_t *wp, const maze_node *row,
+                            rowcol_t c) {
+  return s_exit_walls(row[c], wp->row, c, wp->n_rows, wp->n_cols, wp->exit_1,
+                      wp->exit_2);
+}
+
+/* The writers assemble their output in chunks of up to EMIT_CHUNK
+   bytes before handing it to a sink.  No single piece formatted by
+   s_emit_printf() or added by s_emit_puts() may be longer than
+   EMIT_SLACK bytes.
+ */
+#define EMIT_CHUNK 65536
+#define EMIT_SLACK 1024
+
+typedef struct {
+  maze_sink_t *sink;
+  char *buf;  /* Chunk being filled: reserved space or local */
+  size_t len; /* Bytes in the chunk so far                   */
+  size_t cap; /* Size of the chunk                           */
+  int ok;     /* False once the sink has reported an error   */
+  char local[EMIT_CHUNK];
+} s_emit_t;
+
+/* s_emit_space(*ep)
+
+   Start a new, empty chunk: directly in the sink's own memory if it
+   can reserve some, otherwise in the local buffer.
+ */
+
+static void s_emit_space(s_emit_t *ep) {
+  size_t avail = 0;
+  char *p = NULL;
+
+  if (ep->ok && ep->sink->reserve != NULL)
+    p = ep->sink->reserve(ep->sink, EMIT_SLACK, &avail);
+
+  if (p != NULL) {
+    ep->buf = p;
+    ep->cap = avail;
+  } else {
+    ep->buf = ep->local;
+    ep->cap = sizeof(ep->local);
+  }
+  ep->len = 0;
+}
+
+/* s_emit_drain(*ep)
+
+   Hand the current chunk to the sink and start another.  After an
+   error, output is discarded.
+ */
+
+static void s_emit_drain(s_emit_t *ep) {
+  if (ep->len > 0 && ep->ok && !ep->sink->write(ep->sink, ep->buf, ep->len))
+    ep->ok = 0;
+  s_emit_space(ep);
+}
+
+static void s_emit_open(s_emit_t *ep, maze_sink_t *sp) {
+  ep->sink = sp;
+  ep->ok = 1;
+  s_emit_space(ep);
+}
+
+/* s_emit_close(*ep)
+
+   Write out the last chunk and flush the sink.  Returns false if the
+   sink reported an error at any point.
+ */
+
+static int s_emit_close(s_emit_t *ep) {
+  if (ep->len > 0 && ep->ok && !ep->sink->write(ep->sink, ep->buf, ep->len))
+    ep->ok = 0;
+  if (ep->ok && ep->sink->flush != NULL && !ep->sink->flush(ep->sink))
+    ep->ok = 0;
+
+  return ep->ok;
+}
+
+static void s_emit_putc(s_emit_t *ep, int ch) {
+  if (ep->len == ep->cap) s_emit_drain(ep);
+  ep->buf[ep->len++] = (char)ch;
+}
+
+static void s_emit_puts(s_emit_t *ep, const char *str) {
+  size_t n = strlen(str);
+
+  assert(n <= EMIT_SLACK);
+  if (ep->cap - ep->len < n) s_emit_drain(ep);
+  memcpy(ep->buf + ep->len, str, n);
+  ep->len += n;
+}
+
+/* s_emit_bytes(*ep, *data, len)
+
+   Add arbitrary data to the output.  Anything at least as large as a
+   chunk goes to the sink in a single write, without being copied.
+ */
+
+static void s_emit_bytes(s_emit_t *ep, const void *data, size_t len) {
+  const char *p = data;
+
+  if (len >= EMIT_CHUNK) {
+    s_emit_drain(ep);
+    if (ep->ok && !ep->sink->write(ep->sink, p, len)) ep->ok = 0;
+    s_emit_space(ep);
+    return;
+  }
+  while (len > 0) {
+    size_t n = ep->cap - ep->len;
+
+    if (n == 0) {
+      s_emit_drain(ep);
+      continue;
+    }
+    if (n > len) n = len;
+    memcpy(ep->buf + ep->len, p, n);
+    ep->len += n;
+    p += n;
+    len -= n;
+  }
+}
+
+static void s_emit_printf(s_emit_t *ep, const char *fmt, ...) {
+  va_list args;
+  int n;
+
+  if (ep->cap - ep->len < EMIT_SLACK) s_emit_drain(ep);
+
+  va_start(args, fmt);
+  n = vsnprintf(ep->buf + ep->len, ep->cap - ep->len, fmt, args);
+  va_end(args);
+
+  assert(n >= 0 && n < EMIT_SLACK);
+  ep->len += n;
+}
+
 /* s_findset(mp, pos)
 
    Find which path set the given position occupies.  Performs path
@@ -117,14 +301,21 @@ rowcol_t s_adj(maze_t *mp, rowcol_t pos) {
 /* maze_init(*mp, nr, nc)
 
    Create a new maze structure with nr rows and nc columns.  The
-   resulting maze is initialized to "all walls".
+   resulting maze is initialized to "all walls".  Returns false if
+   memory is exhausted or the maze has too many cells to address.
  */
 
 int maze_init(maze_t *mp, rowcol_t nr, rowcol_t nc) {
-  unsigned int n_cells = nr * nc;
+  unsigned int n_cells;
 
   assert(mp != NULL);
-  assert(n_cells > 0);
+  assert(nr > 0 && nc > 0);
+
+  /* The number of cells must fit in an unsigned int, and their size in
+     a size_t, or the allocation would be too small */
+  if (nr > UINT_MAX / nc || nr * nc > SIZE_MAX / sizeof(*(mp->cells)))
+    return 0;
+  n_cells = nr * nc;
 
   if ((mp->cells = malloc(n_cells * sizeof(*(mp->cells)))) == NULL)
     return 0; /* out of memory */
@@ -132,6 +323,8 @@ int maze_init(maze_t *mp, rowcol_t nr, rowcol_t nc) {
   mp->n_rows = nr;
   mp->n_cols = nc;
   mp->sets = NULL;
+  mp->map = NULL;
+  mp->map_len = 0;
   mp->exit_1 = EXIT(0, DIR_L);
   mp->exit_2 = EXIT(nr - 1, DIR_R);
   maze_reset(mp);
@@ -139,6 +332,68 @@ int maze_init(maze_t *mp, rowcol_t nr, rowcol_t nc) {
   return 1;
 }
 
+/* s_read_cells(*ifp, n, *out)
+
+   Read up to n cells in the pickled format generated by maze_store()
+   into out, skipping whitespace.  Returns the number read, which is
+   less than n only at the end of input.
+ */
+
+static rowcol_t s_read_cells(FILE *ifp, rowcol_t n, maze_node *out) {
+  rowcol_t i;
+
+  for (i = 0; i < n; ++i) {
+    maze_node cell = {0, 0, DIR_U, 0};
+    rowcol_t v;
+    int ch;
+
+    do
+      ch = fgetc(ifp);
+    while (isspace(ch));
+
+    if (ch == EOF) break;
+
+    cell.visit = isupper(ch) ? 1 : 0;
+    v = cell.visit ? (ch - 'A') : (ch - 'a');
+
+    cell.r_wall = v & 1;
+    cell.b_wall = (v >> 1) & 1;
+    cell.marker = (v >> 2) & 3;
+
+    out[i] = cell;
+  }
+  return i;
+}
+
+/* maze_load_header(*ifp, *n_rows, *n_cols, *exit_1, *exit_2)
+
+   Read the dimension line of a pickled maze.
+ */
+
+int maze_load_header(FILE *ifp, rowcol_t *n_rows, rowcol_t *n_cols,
+                     rowcol_t *exit_1, rowcol_t *exit_2) {
+  int result = fscanf(ifp, "%u %u %u %u\n", n_rows, n_cols, exit_1, exit_2);
+
+  if (result == EOF || result < 4) {
+    fprintf(stderr, "maze_load:  missing dimension line\n");
+    return 0;
+  }
+  return 1;
+}
+
+/* maze_load_row(*ifp, n_cols, *row)
+
+   Read the next row of a pickled maze.
+ */
+
+int maze_load_row(FILE *ifp, rowcol_t n_cols, maze_node *row) {
+  if (s_read_cells(ifp, n_cols, row) < n_cols) {
+    fprintf(stderr, "maze_load:  premature end of input\n");
+    return 0;
+  }
+  return 1;
+}
+
 /* maze_load(*mp, *ifp)
 
    Load a maze from the given file stream, in the pickled format
@@ -149,60 +404,38 @@ int maze_init(maze_t *mp, rowcol_t nr, rowcol_t nc) {
 int maze_load(maze_t *mp, FILE *ifp) {
   rowcol_t rows, cols, exit_1, exit_2;
   rowcol_t r, c;
-  int result, ch;
 
-  result = fscanf(ifp, "%u %u %u %u\n", &rows, &cols, &exit_1, &exit_2);
-  if (result == EOF || result < 4) {
-    fprintf(stderr, "maze_load:  missing dimension line\n");
-    return 0;
-  }
+  if (!maze_load_header(ifp, &rows, &cols, &exit_1, &exit_2)) return 0;
 
   if (!maze_init(mp, rows, cols)) return 0;
 
   mp->exit_1 = exit_1;
   mp->exit_2 = exit_2;
 
-  ch = fgetc(ifp);
   for (r = 0; r < rows; ++r) {
-    while (isspace(ch)) ch = fgetc(ifp);
-
-    for (c = 0; c < cols; ++c) {
-      maze_node cell = {0, 0, DIR_U, 0};
-      rowcol_t v;
-
-      if (ch == EOF) {
-        fprintf(stderr, "maze_load:  premature end of input at %u x %u\n", r,
-                c);
-        return 0;
-      }
-      cell.visit = isupper(ch) ? 1 : 0;
-      v = cell.visit ? (ch - 'A') : (ch - 'a');
-
-      cell.r_wall = v & 1;
-      cell.b_wall = (v >> 1) & 1;
-      cell.marker = (v >> 2) & 3;
-
-      CELLV(mp, r, c) = cell;
-
-      do
-        ch = fgetc(ifp);
-      while (isspace(ch));
+    if ((c = s_read_cells(ifp, cols, CELLP(mp, r, 0))) < cols) {
+      fprintf(stderr, "maze_load:  premature end of input at %u x %u\n", r,
+              c);
+      return 0;
     }
   }
 
   return 1;
 }
 
-/* maze_store(*mp, *ofp)
+/* maze_emit_store(*mp, *sp)
 
    Write a compact representation of the maze as text to the given
-   output file stream.
+   output sink.
  */
 
-void maze_store(maze_t *mp, FILE *ofp) {
+int maze_emit_store(const maze_t *mp, maze_sink_t *sp) {
+  s_emit_t e;
   rowcol_t r, c, pos = 0;
 
-  fprintf(ofp, "%u %u %u %u\n", mp->n_rows, mp->n_cols, mp->exit_1, mp->exit_2);
+  s_emit_open(&e, sp);
+  s_emit_printf(&e, "%u %u %u %u\n", mp->n_rows, mp->n_cols, mp->exit_1,
+                mp->exit_2);
 
   for (r = 0; r < mp->n_rows; ++r) {
     for (c = 0; c < mp->n_cols; ++c) {
@@ -214,15 +447,29 @@ void maze_store(maze_t *mp, FILE *ofp) {
       v |= cell.r_wall;
 
       if (cell.visit)
-        fputc('A' + v, ofp);
+        s_emit_putc(&e, 'A' + v);
       else
-        fputc('a' + v, ofp);
+        s_emit_putc(&e, 'a' + v);
 
       pos = (pos + 1) % LINE_WIDTH;
-      if (!pos) fputc('\n', ofp);
+      if (!pos) s_emit_putc(&e, '\n');
     }
   }
-  if (pos) fputc('\n', ofp);
+  if (pos) s_emit_putc(&e, '\n');
+
+  return s_emit_close(&e);
+}
+
+/* maze_store(*mp, *ofp)
+
+   Write a compact representation of the maze to the given output file
+   stream; see maze_emit_store().
+ */
+
+void maze_store(const maze_t *mp, FILE *ofp) {
+  maze_file_sink_t fs;
+
+  maze_emit_store(mp, maze_file_sink(&fs, ofp));
 }
 
 /* maze_clear(*mp)
@@ -234,9 +481,15 @@ void maze_store(maze_t *mp, FILE *ofp) {
 void maze_clear(maze_t *mp) {
   assert(mp != NULL);
 
-  if (mp->cells != NULL) free(mp->cells);
+  if (mp->map != NULL) {
+    if (mp->map_len > 0) munmap(mp->map, mp->map_len);
+  } else if (mp->cells != NULL) {
+    free(mp->cells);
+  }
 
   mp->cells = NULL;
+  mp->map = NULL;
+  mp->map_len = 0;
   mp->n_rows = 0;
   mp->n_cols = 0;
 }
@@ -280,22 +533,98 @@ void maze_unmark(maze_t *mp) {
   }
 }
 
-/* maze_generate(*mp, start_row, start_col, random)
+/* Blocks of a GEN_ORDER_BLOCKED generation are GEN_TILE x GEN_TILE
+   cells, enumerated tile by tile. */
+#define GEN_TILE 32
 
-   Generate a random maze, starting at th
+/* s_gen_tiles(*mp, *queue)
+
+   Fill the queue with the cells of the maze tile by tile, in scan
+   order within each tile and of the tiles.  Runs of MAZE_GEN_BLOCK
+   queue entries then cover a tile each, or a few adjacent rows of
+   tiles where the maze is not a whole number of tiles wide.
  */
 
-int maze_generate(maze_t *mp, rand_f random) {
+static void s_gen_tiles(const maze_t *mp, rowcol_t *queue) {
+  rowcol_t r0, c0, r, c, k = 0;
+
+  for (r0 = 0; r0 < mp->n_rows; r0 += GEN_TILE) {
+    for (c0 = 0; c0 < mp->n_cols; c0 += GEN_TILE) {
+      for (r = r0; r < mp->n_rows && r - r0 < GEN_TILE; ++r)
+        for (c = c0; c < mp->n_cols && c - c0 < GEN_TILE; ++c)
+          queue[k++] = OFFSET(mp, r, c);
+    }
+  }
+}
+
+/* s_gen_slots(*gp)
+
+   Return the number of positions in a scan of the queue.  A blocked
+   scan visits every block in full, skipping the positions past the
+   end of a short last block.
+ */
+
+static rowcol_t s_gen_slots(const maze_gen_t *gp) {
+  if (gp->order == GEN_ORDER_BLOCKED) return gp->n_blocks * MAZE_GEN_BLOCK;
+
+  return gp->n_cells;
+}
+
+/* s_gen_last(*gp)
+
+   Return the first position of a shuffle, which counts down to zero.
+   A blocked shuffle first shuffles the order of the blocks, at the
+   positions past the end of the queue, and then the cells within
+   each block.
+ */
+
+static rowcol_t s_gen_last(const maze_gen_t *gp) {
+  if (gp->order == GEN_ORDER_BLOCKED) return gp->n_cells + gp->n_blocks - 1;
+
+  return gp->n_cells - 1;
+}
+
+/* maze_gen_begin(*mp, *gp)
+
+   Prepare to generate a random maze in steps, examining the cells in
+   a random order; see maze_gen_begin_order().
+ */
+
+int maze_gen_begin(maze_t *mp, maze_gen_t *gp) {
+  return maze_gen_begin_order(mp, gp, GEN_ORDER_RANDOM);
+}
+
+/* maze_gen_begin_order(*mp, *gp, order)
+
+   Prepare to generate a random maze in steps.  The maze is reset to
+   all walls, every cell is put in its own path set, and the queue is
+   set up ready for the first shuffle: in scan order, or tile by tile
+   for a blocked order.
+ */
+
+int maze_gen_begin_order(maze_t *mp, maze_gen_t *gp, int order) {
   rowcol_t n_cells = mp->n_rows * mp->n_cols;
-  rowcol_t *queue;
-  rowcol_t pos, count = 0;
+  rowcol_t pos;
 
   maze_reset(mp);
 
+  /* The scan of a blocked order must not overflow a rowcol_t */
+  if (order != GEN_ORDER_BLOCKED || n_cells > UINT_MAX - MAZE_GEN_BLOCK)
+    order = GEN_ORDER_RANDOM;
+
+  gp->order = order;
+  gp->blocks = NULL;
+  gp->n_blocks = (n_cells + MAZE_GEN_BLOCK - 1) / MAZE_GEN_BLOCK;
+
   if ((mp->sets = malloc(n_cells * sizeof(*(mp->sets)))) == NULL)
     return 0; /* out of memory */
 
-  if ((queue = malloc(n_cells * sizeof(*queue))) == NULL) {
+  if ((gp->queue = malloc(n_cells * sizeof(*(gp->queue)))) == NULL ||
+      (order == GEN_ORDER_BLOCKED &&
+       (gp->blocks = malloc(gp->n_blocks * sizeof(*(gp->blocks)))) ==
+           NULL)) {
+    free(gp->queue);
+    gp->queue = NULL;
     free(mp->sets);
     mp->sets = NULL;
     return 0; /* out of memory */
@@ -304,173 +633,528 @@ int maze_generate(maze_t *mp, rand_f random) {
   /* Initially, all cells belong to their own set, and the queue is in
      scan order. */
   for (pos = 0; pos < n_cells; ++pos) {
-    queue[pos] = pos;
+    gp->queue[pos] = pos;
     mp->sets[pos] = pos;
   }
+  if (order == GEN_ORDER_BLOCKED) {
+    s_gen_tiles(mp, gp->queue);
+    for (pos = 0; pos < gp->n_blocks; ++pos) gp->blocks[pos] = pos;
+  }
+
+  gp->n_cells = n_cells;
+  gp->count = 0;
+  gp->phase = GEN_SHUFFLE;
+  gp->pos = s_gen_last(gp);
+
+  return 1;
+}
+
+/* s_gen_cell(*mp, *gp, cur, random)
+
+   Examine one cell of the queue.  If it has any adjacent cells in a
+   different path set, randomly choose one of them and kick down the
+   wall between them; otherwise, count the cell as finished.
+ */
+
+static void s_gen_cell(maze_t *mp, maze_gen_t *gp, rowcol_t cur,
+                       rand_f random) {
+  rowcol_t adj, apop, wall, r, c;
+  rowcol_t skip = 0;
 
-  while (count < n_cells) {
-    /* As long as there are cells which have neighbours not in their
-       own set, scan the queue and connect unrelated regions.
+  adj = s_adj(mp, cur);
+  apop = adj_pop[adj];
+
+  if (apop == 0) {
+    gp->count += 1;
+    return;
+  }
 
-       Each cell is examined to see if it has any adjacent cells which
-       are in a different path set.  If not, randomly choose a
-       neighbor in a different path set, and kick down the wall
-       between them.
-    */
+  if (apop > 1) skip = (rowcol_t)(random() * apop);
 
-    /* Reshuffle the queue */
-    for (pos = n_cells - 1; pos > 0; --pos) {
-      double v = random();
-      rowcol_t exch = (rowcol_t)(v * (pos + 1)), t;
+  for (wall = 0; wall < 4; ++wall) {
+    if ((adj >> wall) & 1) {
+      if (skip == 0) break;
 
-      t = queue[pos];
-      queue[pos] = queue[exch];
-      queue[exch] = t;
+      --skip;
     }
+  }
 
-    /* Scan the queue */
-    for (pos = 0; pos < n_cells; ++pos) {
-      rowcol_t cur = queue[pos];
-      rowcol_t adj, apop, wall, r, c;
-      rowcol_t skip = 0;
+  /* Now, wall is the direction of the wall to kick down */
+  r = cur / mp->n_cols;
+  c = cur % mp->n_cols;
 
-      adj = s_adj(mp, cur);
-      apop = adj_pop[adj];
+  switch (wall) {
+    case DIR_U:
+      --r;
+      CELLV(mp, r, c).b_wall = 0;
+      break;
+    case DIR_R:
+      CELLV(mp, r, c).r_wall = 0;
+      ++c;
+      break;
+    case DIR_D:
+      CELLV(mp, r, c).b_wall = 0;
+      ++r;
+      break;
+    case DIR_L:
+      --c;
+      CELLV(mp, r, c).r_wall = 0;
+      break;
+    default:
+      assert(0 &&
+             "Unreachable case in switch(wall) of "
+             "s_gen_cell(...)");
+      break;
+  }
 
-      if (apop == 0) {
-        count += 1;
-        continue;
-      }
+  /* Join this cell to the path set of the one we just connected to */
+  s_union(mp, OFFSET(mp, r, c), cur);
+}
 
-      if (apop > 1) skip = (rowcol_t)(random() * apop);
+/* maze_gen_step(*mp, *gp, random, work)
 
-      for (wall = 0; wall < 4; ++wall) {
-        if ((adj >> wall) & 1) {
-          if (skip == 0) break;
+   Advance a generation begun by maze_gen_begin() by up to work units,
+   where a unit is one exchange of a queue shuffle or one cell of a
+   queue scan.  Returns true when the maze is complete.
 
-          --skip;
-        }
-      }
+   As long as there are cells which have neighbours not in their own
+   set, the queue is reshuffled and scanned, connecting unrelated
+   regions.  Random numbers are drawn in exactly the same order
+   regardless of how the work is divided among calls, so the maze
+   depends only on the random generator.
+ */
 
-      /* Now, wall is the direction of the wall to kick down */
-      r = cur / mp->n_cols;
-      c = cur % mp->n_cols;
+int maze_gen_step(maze_t *mp, maze_gen_t *gp, rand_f random, rowcol_t work) {
+  rowcol_t *queue = gp->queue, n_slots = s_gen_slots(gp);
+  int blocked = gp->order == GEN_ORDER_BLOCKED;
+
+  while (work > 0 && gp->phase != GEN_DONE) {
+    if (gp->phase == GEN_SHUFFLE) {
+      /* Reshuffle the queue; a blocked order shuffles its blocks and
+         then the cells within each block */
+      for (; gp->pos > 0 && work > 0; --gp->pos, --work) {
+        rowcol_t *v = queue, i = gp->pos, base = 0, exch, t;
+
+        if (blocked && i >= gp->n_cells) {
+          v = gp->blocks;
+          i -= gp->n_cells;
+        } else if (blocked) {
+          base = i - i % MAZE_GEN_BLOCK;
+        }
+        if (i == base) continue;
 
-      switch (wall) {
-        case DIR_U:
-          --r;
-          CELLV(mp, r, c).b_wall = 0;
-          break;
-        case DIR_R:
-          CELLV(mp, r, c).r_wall = 0;
-          ++c;
-          break;
-        case DIR_D:
-          CELLV(mp, r, c).b_wall = 0;
-          ++r;
-          break;
-        case DIR_L:
-          --c;
-          CELLV(mp, r, c).r_wall = 0;
-          break;
-        default:
-          assert(0 &&
-                 "Unreachable case in switch(wall) of "
-                 "maze_generate(...)");
-          break;
+        exch = base + (rowcol_t)(random() * (i - base + 1));
+        t = v[i];
+        v[i] = v[exch];
+        v[exch] = t;
+      }
+      if (gp->pos == 0) gp->phase = GEN_SCAN;
+    } else {
+      /* Scan the queue, block by block for a blocked order */
+      for (; gp->pos < n_slots && work > 0; ++gp->pos, --work) {
+        rowcol_t q = gp->pos;
+
+        if (blocked) {
+          q = gp->blocks[q / MAZE_GEN_BLOCK] * MAZE_GEN_BLOCK +
+              q % MAZE_GEN_BLOCK;
+          if (q >= gp->n_cells) continue;
+        }
+        s_gen_cell(mp, gp, queue[q], random);
       }
 
-      /* Join this cell to the path set of the one we just connected to */
-      s_union(mp, OFFSET(mp, r, c), cur);
+      if (gp->pos == n_slots) {
+        if (gp->count < gp->n_cells) {
+          gp->phase = GEN_SHUFFLE;
+          gp->pos = s_gen_last(gp);
+        } else
+          gp->phase = GEN_DONE;
+      }
     }
   }
 
-  /* When finished, clean up temporary memory */
+  return gp->phase == GEN_DONE;
+}
+
+/* maze_gen_end(*mp, *gp)
+
+   Release the temporary memory used by a generation in progress.  It
+   is safe to call this whether or not the generation finished.
+ */
+
+void maze_gen_end(maze_t *mp, maze_gen_t *gp) {
   free(mp->sets);
   mp->sets = NULL;
-  free(queue);
-  return 1;
+  free(gp->queue);
+  gp->queue = NULL;
+  free(gp->blocks);
+  gp->blocks = NULL;
 }
 
-/* maze_find_path(*mp, start_row, start_col, end_row, end_col)
+/* Checkpoints begin with this tag, followed by a format version.
+   Version 2 adds the order of the generation to the header, and the
+   order of the blocks after the queue; it is only written for blocked
+   generations, so that others read the same as before. */
+static const char ckpt_magic[4] = {'M', 'Z', 'G', 'C'};
+#define CKPT_VERSION 1
+#define CKPT_VERSION_ORDER 2
 
-   Find and mark a path from the specified starting position of the
-   maze to the specified ending position, if possible.  This assumes
-   the maze is a connected graph.
+/* maze_gen_save(*mp, *gp, *ofp)
 
-   The algorithm is simple right-handed depth-first search, using the
-   markers and visited bits of the maze cells to keep track of where
-   the search has been.  It is possible this will not terminate if the
-   goal is not reachable from the start.
+   Write the complete state of a generation in progress -- the cells,
+   path sets, queue, and scan position -- to the given output stream
+   in a binary format.  The random generator's state is not included;
+   the caller must save it alongside.  Returns false on write error.
  */
 
-void maze_find_path(maze_t *mp, rowcol_t start_row, rowcol_t start_col,
-                    rowcol_t end_row, rowcol_t end_col) {
-  rowcol_t c_row, c_col;
+int maze_gen_save(const maze_t *mp, const maze_gen_t *gp, FILE *ofp) {
+  rowcol_t hdr[9], pos;
+  int blocked = gp->order == GEN_ORDER_BLOCKED;
+
+  hdr[0] = blocked ? CKPT_VERSION_ORDER : CKPT_VERSION;
+  hdr[1] = mp->n_rows;
+  hdr[2] = mp->n_cols;
+  hdr[3] = mp->exit_1;
+  hdr[4] = mp->exit_2;
+  hdr[5] = gp->phase;
+  hdr[6] = gp->pos;
+  hdr[7] = gp->count;
+  hdr[8] = gp->order;
+
+  if (fwrite(ckpt_magic, sizeof(ckpt_magic), 1, ofp) != 1 ||
+      fwrite(hdr, sizeof(*hdr), blocked ? 9 : 8, ofp) != (blocked ? 9 : 8))
+    return 0;
 
-  maze_unmark(mp);
+  for (pos = 0; pos < gp->n_cells; ++pos) {
+    maze_node cell = mp->cells[pos];
 
-  c_row = start_row;
-  c_col = start_col;
+    if (putc(cell.r_wall | (cell.b_wall << 1), ofp) == EOF) return 0;
+  }
 
-  for (;;) {
-    unsigned int c_dir, num_walls;
+  if (fwrite(mp->sets, sizeof(*(mp->sets)), gp->n_cells, ofp) != gp->n_cells ||
+      fwrite(gp->queue, sizeof(*(gp->queue)), gp->n_cells, ofp) !=
+          gp->n_cells)
+    return 0;
+  if (blocked && fwrite(gp->blocks, sizeof(*(gp->blocks)), gp->n_blocks,
+                        ofp) != gp->n_blocks)
+    return 0;
 
-    if (c_row == end_row && c_col == end_col) break; /* done, found the goal */
+  return 1;
+}
 
-    /* Find a direction to go which is a clear path */
-    c_dir = CELLV(mp, c_row, c_col).marker;
+/* s_gen_valid(*mp, *gp)
 
-    for (num_walls = 0; num_walls < 4; ++num_walls) {
-      c_dir = (c_dir + 1) % 4;
+   Check that the state read from a checkpoint is one maze_gen_step()
+   can continue from without leaving its arrays: the position fits
+   the phase, every entry of the path sets, queue, and blocks is in
+   range, and following the path sets from any cell reaches a root.
+   The marker and visit bits are used as scratch and left clear.
+ */
 
-      /* Mark which way we're about to move */
-      if (s_can_move(mp, c_row, c_col, c_dir)) {
-        CELLV(mp, c_row, c_col).marker = c_dir;
+static int s_gen_valid(maze_t *mp, const maze_gen_t *gp) {
+  rowcol_t n_cells = gp->n_cells, pos, cur;
+  int ok = 1;
+
+  if (gp->count > n_cells ||
+      gp->pos > (gp->phase == GEN_SHUFFLE ? s_gen_last(gp) : s_gen_slots(gp)))
+    return 0;
+  for (pos = 0; pos < n_cells; ++pos)
+    if (mp->sets[pos] >= n_cells || gp->queue[pos] >= n_cells) return 0;
+  for (pos = 0; gp->blocks != NULL && pos < gp->n_blocks; ++pos)
+    if (gp->blocks[pos] >= gp->n_blocks) return 0;
+
+  /* A chain of sets being followed is marked visited, and one known to
+     end at a root is marked; meeting a visited cell again is a cycle,
+     which s_findset() would never return from. */
+  for (pos = 0; ok && pos < n_cells; ++pos) {
+    for (cur = pos; !mp->cells[cur].marker && mp->sets[cur] != cur;
+         cur = mp->sets[cur]) {
+      if (mp->cells[cur].visit) {
+        ok = 0;
         break;
       }
+      mp->cells[cur].visit = 1;
     }
+    for (cur = pos; mp->cells[cur].visit; cur = mp->sets[cur]) {
+      mp->cells[cur].visit = 0;
+      mp->cells[cur].marker = 1;
+    }
+  }
+  for (pos = 0; pos < n_cells; ++pos) mp->cells[pos].marker = 0;
 
-    /* Safety check, shouldn't trigger unless you're trying to find a
-       path in an incomplete maze, which is an error. */
-    assert(num_walls < 4 ||
-           "Unescapable start position in maze_find_path(...)");
+  return ok;
+}
 
-    /* Move in that new direction, and set the new cell's marker to
-       point the way back in case we need to backtrack. */
-    switch (c_dir) {
-      case DIR_U:
-        c_row--;
-        CELLV(mp, c_row, c_col).marker = DIR_D;
-        break;
-      case DIR_R:
-        c_col++;
-        CELLV(mp, c_row, c_col).marker = DIR_L;
-        break;
-      case DIR_D:
-        c_row++;
-        CELLV(mp, c_row, c_col).marker = DIR_U;
-        break;
-      case DIR_L:
-        c_col--;
-        CELLV(mp, c_row, c_col).marker = DIR_R;
-        break;
-      default:
-        assert(0 &&
-               "Unreachable case in switch(c_dir) "
-               "of maze_find_path(...)");
-        break;
-    }
-  } /* end for(ever) */
+/* maze_gen_restore(*mp, *gp, *ifp)
 
-  /* At this point, we have found the path, and the markers point the
-     route back to the starting cell.  This loop traverses the path
-     back to the start and sets all the visited flags of the cells
-     that are on-route.
-   */
-  c_row = start_row;
-  c_col = start_col;
-  do {
+   Read a checkpoint written by maze_gen_save(), initializing both the
+   maze and the generation state.  Once the caller has restored its
+   random generator, maze_gen_step() continues exactly where the
+   saved generation left off.  Returns false in case of error,
+   including a checkpoint whose state is out of range.
+ */
+
+int maze_gen_restore(maze_t *mp, maze_gen_t *gp, FILE *ifp) {
+  char magic[sizeof(ckpt_magic)];
+  rowcol_t hdr[9], pos;
+
+  if (fread(magic, sizeof(magic), 1, ifp) != 1 ||
+      memcmp(magic, ckpt_magic, sizeof(magic)) != 0 ||
+      fread(hdr, sizeof(*hdr), 8, ifp) != 8) {
+    fprintf(stderr, "maze_gen_restore:  not a generation checkpoint\n");
+    return 0;
+  }
+  hdr[8] = GEN_ORDER_RANDOM;
+  if ((hdr[0] != CKPT_VERSION && hdr[0] != CKPT_VERSION_ORDER) ||
+      hdr[5] > GEN_DONE ||
+      (hdr[0] == CKPT_VERSION_ORDER &&
+       (fread(&hdr[8], sizeof(*hdr), 1, ifp) != 1 ||
+        hdr[8] != GEN_ORDER_BLOCKED))) {
+    fprintf(stderr, "maze_gen_restore:  unsupported checkpoint version %u\n",
+            hdr[0]);
+    return 0;
+  }
+
+  if (!maze_init(mp, hdr[1], hdr[2])) return 0;
+  if (!maze_gen_begin_order(mp, gp, hdr[8])) {
+    maze_clear(mp);
+    return 0;
+  }
+
+  mp->exit_1 = hdr[3];
+  mp->exit_2 = hdr[4];
+  gp->phase = hdr[5];
+  gp->pos = hdr[6];
+  gp->count = hdr[7];
+
+  for (pos = 0; pos < gp->n_cells; ++pos) {
+    int ch = getc(ifp);
+
+    if (ch == EOF) break;
+    mp->cells[pos].r_wall = ch & 1;
+    mp->cells[pos].b_wall = (ch >> 1) & 1;
+  }
+
+  if (pos < gp->n_cells ||
+      fread(mp->sets, sizeof(*(mp->sets)), gp->n_cells, ifp) != gp->n_cells ||
+      fread(gp->queue, sizeof(*(gp->queue)), gp->n_cells, ifp) !=
+          gp->n_cells ||
+      (gp->blocks != NULL &&
+       fread(gp->blocks, sizeof(*(gp->blocks)), gp->n_blocks, ifp) !=
+           gp->n_blocks)) {
+    fprintf(stderr, "maze_gen_restore:  premature end of checkpoint\n");
+    maze_gen_end(mp, gp);
+    maze_clear(mp);
+    return 0;
+  }
+  if (!s_gen_valid(mp, gp)) {
+    fprintf(stderr, "maze_gen_restore:  corrupt checkpoint\n");
+    maze_gen_end(mp, gp);
+    maze_clear(mp);
+    return 0;
+  }
+
+  return 1;
+}
+
+/* maze_generate(*mp, random)
+
+   Generate a random maze, using the given random number generator.
+   This runs a whole stepwise generation in one go.
+ */
+
+int maze_generate(maze_t *mp, rand_f random) {
+  return maze_generate_order(mp, random, GEN_ORDER_RANDOM);
+}
+
+/* maze_generate_order(*mp, random, order)
+
+   Generate a random maze, examining the cells in the given order.
+ */
+
+int maze_generate_order(maze_t *mp, rand_f random, int order) {
+  maze_gen_t gen;
+
+  if (!maze_gen_begin_order(mp, &gen, order)) return 0;
+
+  while (!maze_gen_step(mp, &gen, random, gen.n_cells))
+    ;
+
+  /* When finished, clean up temporary memory */
+  maze_gen_end(mp, &gen);
+  return 1;
+}
+
+/* maze_generate_tree(*mp, random, mix)
+
+   Generate a random maze by the growing tree method.  The cells that
+   have been joined to the maze but may still have unjoined neighbours
+   are kept packed in an array, newest last.  Each step takes the
+   newest of them with probability mix, or else one at random, and
+   joins it to a random unjoined neighbour, which is pushed; a cell
+   with no unjoined neighbours is removed by moving the last entry
+   into its place, so every operation on the array is constant time.
+   The visit bits of the cells mark which are joined, and are cleared
+   again when the maze is finished.
+ */
+
+int maze_generate_tree(maze_t *mp, rand_f random, double mix) {
+  rowcol_t n_cells = mp->n_rows * mp->n_cols, n_cols = mp->n_cols;
+  rowcol_t *active, n_active = 0, pos;
+  maze_node *cells = mp->cells;
+
+  maze_reset(mp);
+
+  /* Every cell is pushed exactly once, when it is joined */
+  if ((active = malloc(n_cells * sizeof(*active))) == NULL)
+    return 0; /* out of memory */
+
+  pos = (rowcol_t)(random() * n_cells);
+  cells[pos].visit = 1;
+  active[n_active++] = pos;
+
+  while (n_active > 0) {
+    rowcol_t i = n_active - 1, cur, r, c, adj = 0, skip = 0, wall, next;
+
+    if (mix < 1 && (mix <= 0 || random() >= mix))
+      i = (rowcol_t)(random() * n_active);
+    cur = active[i];
+    r = cur / n_cols;
+    c = cur % n_cols;
+
+    if (r > 0 && !cells[cur - n_cols].visit) adj |= (1 << DIR_U);
+    if (c < n_cols - 1 && !cells[cur + 1].visit) adj |= (1 << DIR_R);
+    if (r < mp->n_rows - 1 && !cells[cur + n_cols].visit)
+      adj |= (1 << DIR_D);
+    if (c > 0 && !cells[cur - 1].visit) adj |= (1 << DIR_L);
+
+    if (adj == 0) {
+      active[i] = active[--n_active];
+      continue;
+    }
+    if (adj_pop[adj] > 1) skip = (rowcol_t)(random() * adj_pop[adj]);
+
+    for (wall = 0; wall < 4; ++wall) {
+      if ((adj >> wall) & 1) {
+        if (skip == 0) break;
+
+        --skip;
+      }
+    }
+
+    switch (wall) {
+      case DIR_U:
+        next = cur - n_cols;
+        cells[next].b_wall = 0;
+        break;
+      case DIR_R:
+        next = cur + 1;
+        cells[cur].r_wall = 0;
+        break;
+      case DIR_D:
+        next = cur + n_cols;
+        cells[cur].b_wall = 0;
+        break;
+      case DIR_L:
+        next = cur - 1;
+        cells[next].r_wall = 0;
+        break;
+      default:
+        assert(0 &&
+               "Unreachable case in switch(wall) of "
+               "maze_generate_tree(...)");
+        next = cur;
+        break;
+    }
+
+    cells[next].visit = 1;
+    active[n_active++] = next;
+  }
+
+  for (pos = 0; pos < n_cells; ++pos) cells[pos].visit = 0;
+
+  free(active);
+  return 1;
+}
+
+/* maze_find_path(*mp, start_row, start_col, end_row, end_col)
+
+   Find and mark a path from the specified starting position of the
+   maze to the specified ending position, if possible.  This assumes
+   the maze is a connected graph.
+
+   The algorithm is simple right-handed depth-first search, using the
+   markers and visited bits of the maze cells to keep track of where
+   the search has been.  It is possible this will not terminate if the
+   goal is not reachable from the start.
+ */
+
+void maze_find_path(maze_t *mp, rowcol_t start_row, rowcol_t start_col,
+                    rowcol_t end_row, rowcol_t end_col) {
+  rowcol_t c_row, c_col;
+
+  maze_unmark(mp);
+
+  c_row = start_row;
+  c_col = start_col;
+
+  for (;;) {
+    unsigned int c_dir, num_walls;
+
+    if (c_row == end_row && c_col == end_col) break; /* done, found the goal */
+
+    /* Find a direction to go which is a clear path */
+    c_dir = CELLV(mp, c_row, c_col).marker;
+
+    for (num_walls = 0; num_walls < 4; ++num_walls) {
+      c_dir = (c_dir + 1) % 4;
+
+      /* Mark which way we're about to move */
+      if (s_can_move(mp, c_row, c_col, c_dir)) {
+        CELLV(mp, c_row, c_col).marker = c_dir;
+        break;
+      }
+    }
+
+    /* Safety check, shouldn't trigger unless you're trying to find a
+       path in an incomplete maze, which is an error. */
+    assert(num_walls < 4 ||
+           "Unescapable start position in maze_find_path(...)");
+
+    /* Move in that new direction, and set the new cell's marker to
+       point the way back in case we need to backtrack. */
+    switch (c_dir) {
+      case DIR_U:
+        c_row--;
+        CELLV(mp, c_row, c_col).marker = DIR_D;
+        break;
+      case DIR_R:
+        c_col++;
+        CELLV(mp, c_row, c_col).marker = DIR_L;
+        break;
+      case DIR_D:
+        c_row++;
+        CELLV(mp, c_row, c_col).marker = DIR_U;
+        break;
+      case DIR_L:
+        c_col--;
+        CELLV(mp, c_row, c_col).marker = DIR_R;
+        break;
+      default:
+        assert(0 &&
+               "Unreachable case in switch(c_dir) "
+               "of maze_find_path(...)");
+        break;
+    }
+  } /* end for(ever) */
+
+  /* At this point, we have found the path, and the markers point the
+     route back to the starting cell.  This loop traverses the path
+     back to the start and sets all the visited flags of the cells
+     that are on-route.
+   */
+  c_row = start_row;
+  c_col = start_col;
+  while (c_row != end_row || c_col != end_col) {
     CELLV(mp, c_row, c_col).visit = 1;
 
     switch (CELLV(mp, c_row, c_col).marker) {
@@ -491,21 +1175,98 @@ void maze_find_path(maze_t *mp, rowcol_t start_row, rowcol_t start_col,
                "Unreachable case in switch(marker) "
                "of maze_find_path(...)");
     }
-  } while (c_row != end_row || c_col != end_col);
+  }
 
   CELLV(mp, c_row, c_col).visit = 1;
 }
 
-/* maze_write_png(*mp, *ofp, h_res, v_res)
+/* maze_trace_path(*mp, start_row, start_col, end_row, end_col,
+                   *marks, *path)
+
+   The same right-handed depth-first search as maze_find_path(), with
+   the marker of each cell kept in marks instead of in the maze.  The
+   markers then point the way from the start to the goal, which is
+   followed to list the cells of the path.
+ */
+
+rowcol_t maze_trace_path(const maze_t *mp, rowcol_t start_row,
+                         rowcol_t start_col, rowcol_t end_row,
+                         rowcol_t end_col, unsigned char *marks,
+                         rowcol_t *path) {
+  rowcol_t n_cols = mp->n_cols, c_row = start_row, c_col = start_col, n = 0;
+
+  memset(marks, DIR_U, (size_t)mp->n_rows * n_cols);
+
+  while (c_row != end_row || c_col != end_col) {
+    unsigned int c_dir = marks[c_row * n_cols + c_col], num_walls;
+
+    for (num_walls = 0; num_walls < 4; ++num_walls) {
+      c_dir = (c_dir + 1) % 4;
+      if (s_can_move(mp, c_row, c_col, c_dir)) {
+        marks[c_row * n_cols + c_col] = c_dir;
+        break;
+      }
+    }
+    assert(num_walls < 4 ||
+           "Unescapable start position in maze_trace_path(...)");
+
+    switch (c_dir) {
+      case DIR_U:
+        c_row--;
+        break;
+      case DIR_R:
+        c_col++;
+        break;
+      case DIR_D:
+        c_row++;
+        break;
+      default:
+        c_col--;
+        break;
+    }
+    marks[c_row * n_cols + c_col] = (c_dir + 2) % 4; /* The way back */
+  }
+
+  c_row = start_row;
+  c_col = start_col;
+  while (c_row != end_row || c_col != end_col) {
+    if (path != NULL) path[n] = c_row * n_cols + c_col;
+    ++n;
+
+    switch (marks[c_row * n_cols + c_col]) {
+      case DIR_U:
+        c_row--;
+        break;
+      case DIR_R:
+        c_col++;
+        break;
+      case DIR_D:
+        c_row++;
+        break;
+      default:
+        c_col--;
+        break;
+    }
+  }
+  if (path != NULL) path[n] = c_row * n_cols + c_col;
+  return n + 1;
+}
+
+/* maze_emit_png(*mp, *sp, h_res, v_res)
 
-   Write the specified maze as a PNG file to the given output stream.
+   Write the specified maze as a PNG file to the given output sink.
    The resulting image file is h_res pixels wide and v_res pixels
-   tall.  Solutions are plotted if present.
+   tall.  Solutions are plotted if present.  GD encodes the whole
+   image into memory, which is handed to the sink in one piece; if
+   there is not room for the image, the row writer draws it instead.
  */
 
-void maze_write_png(maze_t *mp, FILE *ofp, unsigned int h_res,
-                    unsigned int v_res) {
+int maze_emit_png(const maze_t *mp, maze_sink_t *sp, unsigned int h_res,
+                  unsigned int v_res) {
+  s_emit_t e;
   gdImagePtr img;
+  void *png;
+  int png_len;
   unsigned int h_wid, v_wid;
   int clr_black, clr_white, clr_path;
   rowcol_t r, c, h_base, v_base;
@@ -513,19 +1274,12 @@ void maze_write_png(maze_t *mp, FILE *ofp, unsigned int h_res,
 
   p1 = EPOS(mp->exit_1);
   dir1 = EDIR(mp->exit_1);
-  if (dir1 == DIR_R)
-    CELLV(mp, p1, mp->n_cols - 1).r_wall = 0;
-  else if (dir1 == DIR_D)
-    CELLV(mp, mp->n_rows - 1, p1).b_wall = 0;
-
   p2 = EPOS(mp->exit_2);
   dir2 = EDIR(mp->exit_2);
-  if (dir2 == DIR_R)
-    CELLV(mp, p2, mp->n_cols - 1).r_wall = 0;
-  else if (dir2 == DIR_D)
-    CELLV(mp, mp->n_rows - 1, p2).b_wall = 0;
 
-  img = gdImageCreate(h_res + 1, v_res + 1);
+  /* Without memory for the whole image, draw it a band at a time */
+  if ((img = gdImageCreate(h_res + 1, v_res + 1)) == NULL)
+    return maze_emit_rows(mp, ROWS_PNG, sp, h_res, v_res);
 
   h_wid = h_res / mp->n_cols;
   v_wid = v_res / mp->n_rows;
@@ -558,21 +1312,23 @@ void maze_write_png(maze_t *mp, FILE *ofp, unsigned int h_res,
     v_base = r * v_wid;
 
     for (c = 0; c < mp->n_cols; ++c) {
+      maze_node n = s_out_cell(mp, r, c);
+
       h_base = c * h_wid;
 
-      if (CELLV(mp, r, c).r_wall)
+      if (n.r_wall)
         gdImageLine(img, h_base + h_wid, v_base, h_base + h_wid, v_base + v_wid,
                     clr_black);
 
-      if (CELLV(mp, r, c).b_wall)
+      if (n.b_wall)
         gdImageLine(img, h_base, v_base + v_wid, h_base + h_wid, v_base + v_wid,
                     clr_black);
 
       /* Mark path components, if present */
-      if (CELLV(mp, r, c).visit) {
+      if (n.visit) {
         rowcol_t left = 0, top = 0, width = 0, height = 0;
 
-        switch (CELLV(mp, r, c).marker) {
+        switch (n.marker) {
           case DIR_U:
           case DIR_D:
             width = h_wid - 4;
@@ -585,7 +1341,7 @@ void maze_write_png(maze_t *mp, FILE *ofp, unsigned int h_res,
             break;
         }
 
-        switch (CELLV(mp, r, c).marker) {
+        switch (n.marker) {
           case DIR_R:
           case DIR_D:
             left = h_base + 2;
@@ -608,218 +1364,1094 @@ void maze_write_png(maze_t *mp, FILE *ofp, unsigned int h_res,
     } /* end column loop */
   }   /* end row loop */
 
-  gdImagePng(img, ofp);
+  png = gdImagePngPtr(img, &png_len);
   gdImageDestroy(img);
+  if (png == NULL) return 0;
+
+  s_emit_open(&e, sp);
+  s_emit_bytes(&e, png, png_len);
+  gdFree(png);
+  return s_emit_close(&e);
 }
 
-/* maze_write_eps(*mp, *ofp, h_res, v_res)
+/* maze_write_png(*mp, *ofp, h_res, v_res)
 
-   Write an Encapsulated PostScript (EPS) version of the given maze to
-   the specified output stream.  A two-point padding is placed around
-   the bounding box of the resulting figure.
+   Write the specified maze as a PNG file to the given output stream;
+   see maze_emit_png().
  */
 
-void maze_write_eps(maze_t *mp, FILE *ofp, unsigned int h_res,
+void maze_write_png(const maze_t *mp, FILE *ofp, unsigned int h_res,
                     unsigned int v_res) {
-  static const double line_width = 1.0; /* Weight of walls */
-  static const double line_grey = 0.0;  /* Colour of walls */
-  static const double soln_grey = 0.7;  /* Colour of solution markers */
-  static const double soln_gap = 0.2;   /* % marker gap from walls */
+  maze_file_sink_t fs;
 
-  double d_hres = (double)h_res, d_vres = (double)v_res;
-  double h_wid = d_hres / mp->n_cols;
-  double v_wid = d_vres / mp->n_rows;
+  maze_emit_png(mp, maze_file_sink(&fs, ofp), h_res, v_res);
+}
 
-  rowcol_t r, c;
-  rowcol_t p1, p2, dir1, dir2;
+/* State of a row writer, private to this file.  The PNG fields hold a
+   window of ring_rows pixel rows, from y_out (the next to be encoded)
+   up to y_end (one past the last set up), which is all that the cells
+   of one row can reach.  An occupancy grid writer builds the two grid
+   rows for each row of cells in grid, one byte per square, and packs
+   them into line for the bit format.
+ */
+typedef struct {
+  s_emit_t e;
+  long h_wid, v_wid;   /* Cell size in pixels (PNG)          */
+  long width, height;  /* Image size in pixels (PNG)         */
+  long ring_rows;      /* Pixel rows in the window           */
+  long y_out, y_end;   /* Window of unfinished pixel rows    */
+  unsigned char *ring; /* Palette index of each window pixel */
+  unsigned char *line; /* One packed scanline, with filter   */
+  unsigned char *zbuf; /* Compressed data for the next IDAT  */
+  z_stream z;
+  int z_open;
+  size_t g_width;      /* Squares per grid row (grid)        */
+  size_t g_stride;     /* Bytes per grid row in the output   */
+  size_t g_len;        /* Bytes per row of grid              */
+  unsigned char *grid; /* Two rows of squares (grid)         */
+} s_rows_t;
+
+/* s_row_left(*wp, r)
+
+   Return true if row r of the maze being written has an exit on its
+   left side.
+ */
 
-  p1 = EPOS(mp->exit_1);
-  dir1 = EDIR(mp->exit_1);
-  if (dir1 == DIR_R)
-    CELLV(mp, p1, mp->n_cols - 1).r_wall = 0;
-  else if (dir1 == DIR_D)
-    CELLV(mp, mp->n_rows - 1, p1).b_wall = 0;
+static int s_row_left(const maze_rows_t *wp, rowcol_t r) {
+  return (wp->exit_1 == EXIT(r, DIR_L) || wp->exit_2 == EXIT(r, DIR_L));
+}
 
-  p2 = EPOS(mp->exit_2);
-  dir2 = EDIR(mp->exit_2);
-  if (dir2 == DIR_R)
-    CELLV(mp, p2, mp->n_cols - 1).r_wall = 0;
-  else if (dir2 == DIR_D)
-    CELLV(mp, mp->n_rows - 1, p2).b_wall = 0;
-
-  /* Emit minimal EPS header */
-  fprintf(ofp,
-          "%%!PS-Adobe-3.0 EPSF-3.0\n"
-          "%%%%BoundingBox: %d %d %u %u\n"
-          "%%%%DocumentData: Clean7Bit\n\n",
-          -2, -2, h_res + 2, v_res + 2);
-
-  /* Emit common definitions */
-  fprintf(ofp,
-          "/np  {newpath} bind def\n"
-          "/slw {setlinewidth} bind def\n"
-          "/sg  {setgray} bind def\n"
-          "/mt  {moveto} bind def\n"
-          "/rmt {rmoveto} bind def\n"
-          "/lt  {lineto} bind def\n"
-          "/rlt {rlineto} bind def\n"
-          "/stk {stroke} bind def\n"
-          "/sgrey %.1f def\n"
-          "/lgrey %.1f def\n"
-          "/lwid  %.1f def\n"
-          "/dr {lwid slw lgrey sg stk} def\n\n",
-          soln_grey, line_grey, line_width);
-
-  /* Draw top and left walls */
-  fprintf(ofp,
-          "%% Exterior walls\n"
-          "np\n%u %u mt\n",
-          0, v_res);
+/* s_text_begin(*wp, *ep)
 
-  for (c = 0; c < mp->n_cols; ++c) {
-    if ((dir1 == DIR_U && p1 == c) || (dir2 == DIR_U && p2 == c))
-      fprintf(ofp, "%.1f 0 rmt ", h_wid);
-    else
-      fprintf(ofp, "%.1f 0 rlt ", h_wid);
-  }
-  fprintf(ofp,
-          "dr\n"
-          "np\n%u %u mt\n",
-          0, v_res);
+   Draw the top border, respecting possible exits.
+ */
 
-  for (r = 0; r < mp->n_rows; ++r) {
-    if ((dir1 == DIR_L && p1 == r) || (dir2 == DIR_L && p2 == r))
-      fprintf(ofp, "0 %.1f neg rmt ", v_wid);
+static void s_text_begin(const maze_rows_t *wp, s_emit_t *ep) {
+  rowcol_t c;
+
+  for (c = 0; c < wp->n_cols; ++c) {
+    if (wp->exit_1 == EXIT(c, DIR_U) || wp->exit_2 == EXIT(c, DIR_U))
+      s_emit_puts(ep, "+   ");
     else
-      fprintf(ofp, "0 %.1f neg rlt ", v_wid);
+      s_emit_puts(ep, "+---");
   }
-  fputs("dr\n\n", ofp);
+  s_emit_putc(ep, '+');
+  s_emit_putc(ep, '\n');
+}
 
-  for (r = 0; r < mp->n_rows; ++r) {
-    double v_base = r * v_wid;
+/* s_text_row(*wp, *ep, *row)
 
-    for (c = 0; c < mp->n_cols; ++c) {
-      double h_base = c * h_wid;
-      maze_node n = CELLV(mp, r, c);
+   Draw one row of cells and the walls below them.  The left border is
+   drawn as we go, because of the line-oriented nature of stream
+   output.  Down-facing and right-facing exits are drawn as missing
+   walls in the appropriate cells; see s_exit_walls().
+ */
 
-      if (n.r_wall || n.b_wall) {
-        fprintf(ofp, "np ");
+static void s_text_row(const maze_rows_t *wp, s_emit_t *ep,
+                       const maze_node *row) {
+  rowcol_t r = wp->row, c;
 
-        if (n.r_wall)
-          fprintf(ofp, "%.1f %.1f mt 0 %.1f neg rlt ", h_base + h_wid,
-                  v_res - v_base, v_wid);
+  s_emit_putc(ep, s_row_left(wp, r) ? ' ' : '|');
 
-        if (n.b_wall)
-          fprintf(ofp, "%.1f %.1f mt %.1f 0 rlt ", h_base,
-                  v_res - v_base - v_wid, h_wid);
+  for (c = 0; c < wp->n_cols; ++c) {
+    s_emit_puts(ep, row[c].visit ? " @ " : "   ");
+    s_emit_putc(ep, s_row_cell(wp, row, c).r_wall ? '|' : ' ');
+  }
+  s_emit_putc(ep, '\n');
+  s_emit_putc(ep, '+');
 
-        fprintf(ofp, "dr\n");
-      }
+  for (c = 0; c < wp->n_cols; ++c)
+    s_emit_puts(ep, s_row_cell(wp, row, c).b_wall ? "---+" : "   +");
 
-      if (n.visit) {
-        double hp = 0., vp = 0., h_dis = 0., v_dis = 0.;
+  s_emit_putc(ep, '\n');
+}
 
-        switch (n.marker) {
-          case DIR_U:
-          case DIR_D:
-            h_dis = (1.0 - 2 * soln_gap) * h_wid;
-            v_dis = (2.0 - 2 * soln_gap) * v_wid;
-            break;
-          case DIR_L:
-          case DIR_R:
-            h_dis = (2.0 - 2 * soln_gap) * h_wid;
-            v_dis = (1.0 - 2 * soln_gap) * v_wid;
-            break;
-        }
+/* Drawing parameters for EPS output */
+static const double eps_line_width = 1.0; /* Weight of walls */
+static const double eps_line_grey = 0.0;  /* Colour of walls */
+static const double eps_soln_grey = 0.7;  /* Colour of solution markers */
+static const double eps_soln_gap = 0.2;   /* % marker gap from walls */
 
-        switch (n.marker) {
-          case DIR_U:
-            hp = h_base + soln_gap * h_wid;
-            vp = v_base - (1.0 - soln_gap) * v_wid;
-            break;
-          case DIR_D:
-          case DIR_R:
-            hp = h_base + soln_gap * h_wid;
-            vp = v_base + soln_gap * v_wid;
-            break;
-          case DIR_L:
-            hp = h_base - (1.0 - soln_gap) * h_wid;
-            vp = v_base + soln_gap * v_wid;
-            break;
-        }
+/* s_eps_begin(*wp, *ep)
+
+   Write a minimal EPS header and common definitions, and draw the top
+   and left walls.  A two-point padding is placed around the bounding
+   box of the resulting figure.
+ */
+
+static void s_eps_begin(const maze_rows_t *wp, s_emit_t *ep) {
+  double h_wid = (double)wp->h_res / wp->n_cols;
+  double v_wid = (double)wp->v_res / wp->n_rows;
+  rowcol_t r, c;
+
+  s_emit_printf(ep,
+                "%%!PS-Adobe-3.0 EPSF-3.0\n"
+                "%%%%BoundingBox: %d %d %u %u\n"
+                "%%%%DocumentData: Clean7Bit\n\n",
+                -2, -2, wp->h_res + 2, wp->v_res + 2);
+
+  s_emit_printf(ep,
+                "/np  {newpath} bind def\n"
+                "/slw {setlinewidth} bind def\n"
+                "/sg  {setgray} bind def\n"
+                "/mt  {moveto} bind def\n"
+                "/rmt {rmoveto} bind def\n"
+                "/lt  {lineto} bind def\n"
+                "/rlt {rlineto} bind def\n"
+                "/stk {stroke} bind def\n"
+                "/sgrey %.1f def\n"
+                "/lgrey %.1f def\n"
+                "/lwid  %.1f def\n"
+                "/dr {lwid slw lgrey sg stk} def\n\n",
+                eps_soln_grey, eps_line_grey, eps_line_width);
+
+  s_emit_printf(ep,
+                "%% Exterior walls\n"
+                "np\n%u %u mt\n",
+                0, wp->v_res);
+
+  for (c = 0; c < wp->n_cols; ++c) {
+    if (wp->exit_1 == EXIT(c, DIR_U) || wp->exit_2 == EXIT(c, DIR_U))
+      s_emit_printf(ep, "%.1f 0 rmt ", h_wid);
+    else
+      s_emit_printf(ep, "%.1f 0 rlt ", h_wid);
+  }
+  s_emit_printf(ep,
+                "dr\n"
+                "np\n%u %u mt\n",
+                0, wp->v_res);
+
+  for (r = 0; r < wp->n_rows; ++r) {
+    if (s_row_left(wp, r))
+      s_emit_printf(ep, "0 %.1f neg rmt ", v_wid);
+    else
+      s_emit_printf(ep, "0 %.1f neg rlt ", v_wid);
+  }
+  s_emit_puts(ep, "dr\n\n");
+}
+
+/* s_eps_row(*wp, *ep, *row)
+
+   Draw the right and bottom walls of one row of cells, and the
+   solution markers in it.
+ */
+
+static void s_eps_row(const maze_rows_t *wp, s_emit_t *ep,
+                      const maze_node *row) {
+  double h_wid = (double)wp->h_res / wp->n_cols;
+  double v_wid = (double)wp->v_res / wp->n_rows;
+  double v_base = wp->row * v_wid;
+  unsigned int v_res = wp->v_res;
+  rowcol_t c;
 
-        fprintf(ofp,
-                "np %.1f %.1f mt %.1f 0 rlt 0 %.1f neg rlt "
-                "%.1f neg 0 rlt 0 %.1f rlt ",
-                hp, v_res - vp, h_dis, v_dis, h_dis, v_dis);
-        fprintf(ofp, "sgrey sg fill\n");
+  for (c = 0; c < wp->n_cols; ++c) {
+    double h_base = c * h_wid;
+    maze_node n = s_row_cell(wp, row, c);
+
+    if (n.r_wall || n.b_wall) {
+      s_emit_puts(ep, "np ");
+
+      if (n.r_wall)
+        s_emit_printf(ep, "%.1f %.1f mt 0 %.1f neg rlt ", h_base + h_wid,
+                      v_res - v_base, v_wid);
+
+      if (n.b_wall)
+        s_emit_printf(ep, "%.1f %.1f mt %.1f 0 rlt ", h_base,
+                      v_res - v_base - v_wid, h_wid);
+
+      s_emit_puts(ep, "dr\n");
+    }
+
+    if (n.visit) {
+      double hp = 0., vp = 0., h_dis = 0., v_dis = 0.;
+
+      switch (n.marker) {
+        case DIR_U:
+        case DIR_D:
+          h_dis = (1.0 - 2 * eps_soln_gap) * h_wid;
+          v_dis = (2.0 - 2 * eps_soln_gap) * v_wid;
+          break;
+        case DIR_L:
+        case DIR_R:
+          h_dis = (2.0 - 2 * eps_soln_gap) * h_wid;
+          v_dis = (1.0 - 2 * eps_soln_gap) * v_wid;
+          break;
       }
 
-    } /* end column loop */
-  }   /* end row loop */
+      switch (n.marker) {
+        case DIR_U:
+          hp = h_base + eps_soln_gap * h_wid;
+          vp = v_base - (1.0 - eps_soln_gap) * v_wid;
+          break;
+        case DIR_D:
+        case DIR_R:
+          hp = h_base + eps_soln_gap * h_wid;
+          vp = v_base + eps_soln_gap * v_wid;
+          break;
+        case DIR_L:
+          hp = h_base - (1.0 - eps_soln_gap) * h_wid;
+          vp = v_base + eps_soln_gap * v_wid;
+          break;
+      }
+
+      s_emit_printf(ep,
+                    "np %.1f %.1f mt %.1f 0 rlt 0 %.1f neg rlt "
+                    "%.1f neg 0 rlt 0 %.1f rlt ",
+                    hp, v_res - vp, h_dis, v_dis, h_dis, v_dis);
+      s_emit_puts(ep, "sgrey sg fill\n");
+    }
+  }
 }
 
-/* maze_write_text(*mp, *ofp, h_res, v_res)
+/* Palette indices for PNG output, in the order GD allocates them */
+enum { PNG_BLACK = 0, PNG_WHITE = 1, PNG_PATH = 2 };
+
+static const unsigned char png_sig[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+static const unsigned char png_palette[9] = {0,   0,   0,   255, 255,
+                                             255, 102, 102, 255};
+#define PNG_ZBUF 32768 /* Bytes of compressed data per IDAT chunk */
+
+/* s_put_be32(*p, v)
+
+   Store v at p as a 32-bit big-endian number, as PNG requires.
+ */
+
+static void s_put_be32(unsigned char *p, unsigned long v) {
+  p[0] = (v >> 24) & 0xff;
+  p[1] = (v >> 16) & 0xff;
+  p[2] = (v >> 8) & 0xff;
+  p[3] = v & 0xff;
+}
+
+/* s_png_chunk(*ep, *type, *data, len)
+
+   Write a PNG chunk: its length, type, data, and CRC.
+ */
+
+static void s_png_chunk(s_emit_t *ep, const char *type, const void *data,
+                        size_t len) {
+  unsigned char buf[4];
+  uLong crc = crc32(0L, (const Bytef *)type, 4);
+
+  if (len > 0) crc = crc32(crc, data, len);
+
+  s_put_be32(buf, len);
+  s_emit_bytes(ep, buf, 4);
+  s_emit_bytes(ep, type, 4);
+  s_emit_bytes(ep, data, len);
+  s_put_be32(buf, crc);
+  s_emit_bytes(ep, buf, 4);
+}
+
+/* s_png_deflate(*st, flush)
+
+   Compress whatever input is pending, writing an IDAT chunk each time
+   the output buffer fills, and at the end if flush is Z_FINISH.
+ */
+
+static int s_png_deflate(s_rows_t *st, int flush) {
+  int res;
+
+  do {
+    res = deflate(&st->z, flush);
+    if (res == Z_STREAM_ERROR) return 0;
+
+    if (st->z.avail_out == 0 || (flush == Z_FINISH && res == Z_STREAM_END)) {
+      s_png_chunk(&st->e, "IDAT", st->zbuf, PNG_ZBUF - st->z.avail_out);
+      st->z.next_out = st->zbuf;
+      st->z.avail_out = PNG_ZBUF;
+    }
+  } while (st->z.avail_in > 0 || (flush == Z_FINISH && res != Z_STREAM_END));
+
+  return 1;
+}
+
+/* s_png_box(*st, x1, y1, x2, y2, clr)
+
+   Set every pixel of the rectangle with corners (x1, y1) and (x2, y2)
+   that lies within the image.  This is how GD draws both the lines
+   and the filled rectangles used here, so the result matches
+   maze_write_png() exactly.  The rows touched must be in the window.
+ */
+
+static void s_png_box(s_rows_t *st, long x1, long y1, long x2, long y2,
+                      int clr) {
+  long y, t;
+
+  if (x1 > x2) {
+    t = x1;
+    x1 = x2;
+    x2 = t;
+  }
+  if (y1 > y2) {
+    t = y1;
+    y1 = y2;
+    y2 = t;
+  }
+  if (x1 < 0) x1 = 0;
+  if (x2 >= st->width) x2 = st->width - 1;
+  if (y1 < 0) y1 = 0;
+  if (y2 >= st->height) y2 = st->height - 1;
+  if (x1 > x2 || y1 > y2) return;
+
+  assert(y1 >= st->y_out && y2 < st->y_end);
+  for (y = y1; y <= y2; ++y)
+    memset(st->ring + (y % st->ring_rows) * st->width + x1, clr, x2 - x1 + 1);
+}
+
+/* s_png_setup(*wp, *st, y)
+
+   Add pixel rows to the window up to and including y, each starting
+   as the background with the top and left walls drawn on it.
+ */
+
+static void s_png_setup(const maze_rows_t *wp, s_rows_t *st, long y) {
+  if (y >= st->height) y = st->height - 1;
+
+  while (st->y_end <= y) {
+    long ny = st->y_end++, r, lo, hi;
+    rowcol_t c;
+
+    assert(st->y_end - st->y_out <= st->ring_rows);
+    memset(st->ring + (ny % st->ring_rows) * st->width, PNG_WHITE, st->width);
+
+    if (ny == 0) {
+      for (c = 0; c < wp->n_cols; ++c)
+        if (wp->exit_1 != EXIT(c, DIR_U) && wp->exit_2 != EXIT(c, DIR_U))
+          s_png_box(st, c * st->h_wid, 0, c * st->h_wid + st->h_wid, 0,
+                    PNG_BLACK);
+    }
+
+    /* The left wall of row r spans pixel rows r * v_wid to
+       (r + 1) * v_wid inclusive; find the rows that reach ny. */
+    if (st->v_wid == 0) {
+      lo = 0;
+      hi = (ny == 0) ? (long)wp->n_rows - 1 : -1;
+    } else {
+      hi = ny / st->v_wid;
+      lo = (ny % st->v_wid == 0 && hi > 0) ? hi - 1 : hi;
+    }
+    for (r = lo; r <= hi && r < (long)wp->n_rows; ++r) {
+      if (!s_row_left(wp, r)) {
+        s_png_box(st, 0, ny, 0, ny, PNG_BLACK);
+        break;
+      }
+    }
+  }
+}
+
+/* s_png_flush(*wp, *st, y)
+
+   Encode and compress the pixel rows of the window before y, which
+   nothing more will be drawn on.
+ */
+
+static int s_png_flush(const maze_rows_t *wp, s_rows_t *st, long y) {
+  if (y > st->height) y = st->height;
+
+  for (; st->y_out < y; ++st->y_out) {
+    const unsigned char *px;
+    long x;
+
+    s_png_setup(wp, st, st->y_out);
+    px = st->ring + (st->y_out % st->ring_rows) * st->width;
+
+    /* Filter type none, then four 2-bit pixels per byte */
+    memset(st->line, 0, 1 + (st->width + 3) / 4);
+    for (x = 0; x < st->width; ++x)
+      st->line[1 + x / 4] |= px[x] << (6 - 2 * (x % 4));
+
+    st->z.next_in = st->line;
+    st->z.avail_in = 1 + (st->width + 3) / 4;
+    if (!s_png_deflate(st, Z_NO_FLUSH)) return 0;
+  }
+  return 1;
+}
+
+/* s_png_begin(*wp, *st)
+
+   Set up the pixel window and compressor, and write the PNG header
+   and palette.  Returns false if memory is exhausted.
+ */
+
+static int s_png_begin(const maze_rows_t *wp, s_rows_t *st) {
+  unsigned char ihdr[13];
+
+  st->h_wid = wp->h_res / wp->n_cols;
+  st->v_wid = wp->v_res / wp->n_rows;
+  st->width = (long)wp->h_res + 1;
+  st->height = (long)wp->v_res + 1;
+  st->ring_rows = 3 * st->v_wid + 5;
+  st->y_out = st->y_end = 0;
+
+  st->ring = malloc(st->ring_rows * st->width);
+  st->line = malloc(1 + (st->width + 3) / 4);
+  st->zbuf = malloc(PNG_ZBUF);
+  if (st->ring == NULL || st->line == NULL || st->zbuf == NULL) return 0;
+
+  memset(&st->z, 0, sizeof(st->z));
+  if (deflateInit(&st->z, Z_DEFAULT_COMPRESSION) != Z_OK) return 0;
+  st->z_open = 1;
+  st->z.next_out = st->zbuf;
+  st->z.avail_out = PNG_ZBUF;
+
+  s_put_be32(ihdr, st->width);
+  s_put_be32(ihdr + 4, st->height);
+  ihdr[8] = 2;  /* Bit depth */
+  ihdr[9] = 3;  /* Colour type: palette */
+  ihdr[10] = 0; /* Compression, filter, and interlace methods */
+  ihdr[11] = 0;
+  ihdr[12] = 0;
+
+  s_emit_bytes(&st->e, png_sig, sizeof(png_sig));
+  s_png_chunk(&st->e, "IHDR", ihdr, sizeof(ihdr));
+  s_png_chunk(&st->e, "PLTE", png_palette, sizeof(png_palette));
+  return 1;
+}
+
+/* s_png_row(*wp, *st, *row)
+
+   Draw the walls and solution markers of one row of cells, in the
+   same order as maze_write_png().  Pixel rows above any the row can
+   reach are finished first, and the window extended to the lowest
+   one it can reach.
+ */
+
+static int s_png_row(const maze_rows_t *wp, s_rows_t *st,
+                     const maze_node *row) {
+  long h_wid = st->h_wid, v_wid = st->v_wid;
+  long v_base = (long)wp->row * v_wid, h_base;
+  rowcol_t c;
+
+  if (!s_png_flush(wp, st, v_base - v_wid - 2)) return 0;
+  s_png_setup(wp, st, v_base + 2 * v_wid + 2);
+
+  for (c = 0; c < wp->n_cols; ++c) {
+    maze_node n = s_row_cell(wp, row, c);
+
+    h_base = (long)c * h_wid;
+
+    if (n.r_wall)
+      s_png_box(st, h_base + h_wid, v_base, h_base + h_wid, v_base + v_wid,
+                PNG_BLACK);
+
+    if (n.b_wall)
+      s_png_box(st, h_base, v_base + v_wid, h_base + h_wid, v_base + v_wid,
+                PNG_BLACK);
+
+    if (n.visit) {
+      long left = 0, top = 0, width = 0, height = 0;
+
+      switch (n.marker) {
+        case DIR_U:
+        case DIR_D:
+          width = h_wid - 4;
+          height = 2 * v_wid - 4;
+          break;
+        case DIR_L:
+        case DIR_R:
+          width = 2 * h_wid - 4;
+          height = v_wid - 4;
+          break;
+      }
+
+      switch (n.marker) {
+        case DIR_R:
+        case DIR_D:
+          left = h_base + 2;
+          top = v_base + 2;
+          break;
+        case DIR_L:
+          left = h_base - h_wid + 2;
+          top = v_base + 2;
+          break;
+        case DIR_U:
+          left = h_base + 2;
+          top = v_base - v_wid + 2;
+          break;
+      }
+
+      s_png_box(st, left, top, left + width, top + height, PNG_PATH);
+    }
+  }
+  return 1;
+}
+
+/* s_png_end(*wp, *st)
+
+   Finish the remaining pixel rows and the compressed stream, and
+   write the end of the PNG.
+ */
+
+static int s_png_end(const maze_rows_t *wp, s_rows_t *st) {
+  if (!s_png_flush(wp, st, st->height) || !s_png_deflate(st, Z_FINISH))
+    return 0;
+
+  s_png_chunk(&st->e, "IEND", NULL, 0);
+  return 1;
+}
+
+/* Tag and version at the start of an occupancy grid file */
+static const char grid_magic[4] = {'M', 'Z', 'O', 'G'};
+#define GRID_VERSION 1
+
+/* s_grid_put(*wp, *st, *sq)
+
+   Clear the padding after one grid row of squares and write it out in
+   the writer's format.
+ */
+
+static void s_grid_put(const maze_rows_t *wp, s_rows_t *st,
+                       unsigned char *sq) {
+  memset(sq + st->g_width, 0, st->g_len - st->g_width);
+
+  if (wp->format == ROWS_GRID_BITS) {
+    maze_kernels()->pack(sq, 8 * st->g_stride, st->line);
+    s_emit_bytes(&st->e, st->line, st->g_stride);
+  } else {
+    s_emit_bytes(&st->e, sq, st->g_stride);
+  }
+}
+
+/* s_grid_begin(*wp, *st)
+
+   Write the header and the top border, respecting possible exits.
+ */
+
+static int s_grid_begin(const maze_rows_t *wp, s_rows_t *st) {
+  uint32_t version = GRID_VERSION, bits, pad = 0;
+  uint64_t dims[3];
+  rowcol_t c;
+
+  st->g_width = 2 * (size_t)wp->n_cols + 1;
+  if (wp->format == ROWS_GRID_BITS) {
+    bits = 1;
+    st->g_stride = (st->g_width + 63) / 64 * 8;
+  } else {
+    bits = 8;
+    st->g_stride = (st->g_width + 7) / 8 * 8;
+  }
+  st->g_len = (st->g_width + 63) / 64 * 64;
+
+  st->grid = malloc(2 * st->g_len);
+  st->line = malloc(st->g_stride);
+  if (st->grid == NULL || st->line == NULL) return 0;
+
+  dims[0] = 2 * (uint64_t)wp->n_rows + 1;
+  dims[1] = st->g_width;
+  dims[2] = st->g_stride;
+  s_emit_bytes(&st->e, grid_magic, sizeof(grid_magic));
+  s_emit_bytes(&st->e, &version, sizeof(version));
+  s_emit_bytes(&st->e, &bits, sizeof(bits));
+  s_emit_bytes(&st->e, &pad, sizeof(pad));
+  s_emit_bytes(&st->e, dims, sizeof(dims));
+
+  memset(st->grid, 1, st->g_width);
+  for (c = 0; c < wp->n_cols; ++c) {
+    if (wp->exit_1 == EXIT(c, DIR_U) || wp->exit_2 == EXIT(c, DIR_U))
+      st->grid[2 * c + 1] = 0;
+  }
+  s_grid_put(wp, st, st->grid);
+  return 1;
+}
+
+/* s_grid_row(*wp, *st, *row)
+
+   Write the two grid rows for one row of cells.  The walls are
+   expanded straight from the cells, after the left border, by the
+   expand kernel (see mazecpu.h), and exits on the left, right, and
+   bottom edges opened afterward; see s_exit_walls().
+ */
+
+static void s_grid_row(const maze_rows_t *wp, s_rows_t *st,
+                       const maze_node *row) {
+  unsigned char *cell_sq = st->grid, *wall_sq = st->grid + st->g_len;
+  rowcol_t c, last = wp->n_cols - 1;
+
+  cell_sq[0] = !s_row_left(wp, wp->row);
+  wall_sq[0] = 1;
+  maze_kernels()->expand(row, wp->n_cols, cell_sq + 1, wall_sq + 1);
+
+  cell_sq[2 * last + 2] = s_row_cell(wp, row, last).r_wall;
+  if (wp->row == wp->n_rows - 1) {
+    for (c = 0; c < wp->n_cols; ++c)
+      wall_sq[2 * c + 1] = s_row_cell(wp, row, c).b_wall;
+  }
+
+  s_grid_put(wp, st, cell_sq);
+  s_grid_put(wp, st, wall_sq);
+}
+
+/* s_rows_free(*st)
+
+   Release a row writer's state.
+ */
+
+static void s_rows_free(s_rows_t *st) {
+  if (st->z_open) deflateEnd(&st->z);
+  free(st->ring);
+  free(st->line);
+  free(st->zbuf);
+  free(st->grid);
+  free(st);
+}
+
+/* maze_rows_begin(*wp, format, *sp, n_rows, n_cols, exit_1, exit_2,
+                   h_res, v_res)
+
+   Set up a row writer and write whatever precedes the first row.
+ */
+
+int maze_rows_begin(maze_rows_t *wp, int format, maze_sink_t *sp,
+                    rowcol_t n_rows, rowcol_t n_cols, rowcol_t exit_1,
+                    rowcol_t exit_2, unsigned int h_res, unsigned int v_res) {
+  s_rows_t *st;
+
+  if (n_rows == 0 || n_cols == 0) {
+    fprintf(stderr, "maze_rows_begin:  a maze must have rows and columns\n");
+    return 0;
+  }
+  if ((st = calloc(1, sizeof(*st))) == NULL) return 0;
+
+  wp->format = format;
+  wp->n_rows = n_rows;
+  wp->n_cols = n_cols;
+  wp->exit_1 = exit_1;
+  wp->exit_2 = exit_2;
+  wp->h_res = h_res;
+  wp->v_res = v_res;
+  wp->row = 0;
+  wp->state = st;
+
+  s_emit_open(&st->e, sp);
+  switch (format) {
+    case ROWS_TEXT:
+      s_text_begin(wp, &st->e);
+      break;
+    case ROWS_EPS:
+      s_eps_begin(wp, &st->e);
+      break;
+    case ROWS_PNG:
+      if (!s_png_begin(wp, st)) {
+        s_rows_free(st);
+        return 0;
+      }
+      break;
+    case ROWS_GRID:
+    case ROWS_GRID_BITS:
+      if (!s_grid_begin(wp, st)) {
+        s_rows_free(st);
+        return 0;
+      }
+      break;
+    default:
+      assert(0 &&
+             "Unknown format code in switch(format) "
+             "of maze_rows_begin(...)");
+      break;
+  }
+  return 1;
+}
+
+/* maze_rows_push(*wp, *row)
+
+   Write the next row of cells.
+ */
+
+int maze_rows_push(maze_rows_t *wp, const maze_node *row) {
+  s_rows_t *st = wp->state;
+
+  if (wp->row >= wp->n_rows) {
+    fprintf(stderr, "maze_rows_push:  the maze has only %u rows\n",
+            wp->n_rows);
+    return 0;
+  }
+
+  switch (wp->format) {
+    case ROWS_TEXT:
+      s_text_row(wp, &st->e, row);
+      break;
+    case ROWS_EPS:
+      s_eps_row(wp, &st->e, row);
+      break;
+    case ROWS_PNG:
+      if (!s_png_row(wp, st, row)) st->e.ok = 0;
+      break;
+    case ROWS_GRID:
+    case ROWS_GRID_BITS:
+      s_grid_row(wp, st, row);
+      break;
+  }
+  ++wp->row;
+
+  return st->e.ok;
+}
+
+/* maze_rows_end(*wp)
+
+   Finish the output and release the writer's state.
+ */
+
+int maze_rows_end(maze_rows_t *wp) {
+  s_rows_t *st = wp->state;
+  int ok;
+
+  if (wp->row < wp->n_rows) {
+    fprintf(stderr, "maze_rows_end:  only %u of %u rows were written\n",
+            wp->row, wp->n_rows);
+    st->e.ok = 0;
+  }
+  if (wp->format == ROWS_PNG && !s_png_end(wp, st)) st->e.ok = 0;
+
+  ok = s_emit_close(&st->e);
+  s_rows_free(st);
+  wp->state = NULL;
+  return ok;
+}
+
+/* maze_emit_rows(*mp, format, *sp, h_res, v_res)
+
+   Write a whole maze through a row writer.
+ */
+
+int maze_emit_rows(const maze_t *mp, int format, maze_sink_t *sp,
+                   unsigned int h_res, unsigned int v_res) {
+  maze_rows_t w;
+  rowcol_t r;
+
+  if (!maze_rows_begin(&w, format, sp, mp->n_rows, mp->n_cols, mp->exit_1,
+                       mp->exit_2, h_res, v_res))
+    return 0;
+
+  for (r = 0; r < mp->n_rows; ++r) maze_rows_push(&w, CELLP(mp, r, 0));
+
+  return maze_rows_end(&w);
+}
+
+/* maze_emit_eps(*mp, *sp, h_res, v_res)
+
+   Write an Encapsulated PostScript (EPS) version of the given maze to
+   the specified output sink.
+ */
+
+int maze_emit_eps(const maze_t *mp, maze_sink_t *sp, unsigned int h_res,
+                  unsigned int v_res) {
+  return maze_emit_rows(mp, ROWS_EPS, sp, h_res, v_res);
+}
+
+/* maze_write_eps(*mp, *ofp, h_res, v_res)
+
+   Write an Encapsulated PostScript (EPS) version of the given maze to
+   the specified output stream; see maze_emit_eps().
+ */
+
+void maze_write_eps(const maze_t *mp, FILE *ofp, unsigned int h_res,
+                    unsigned int v_res) {
+  maze_file_sink_t fs;
+
+  maze_emit_eps(mp, maze_file_sink(&fs, ofp), h_res, v_res);
+}
+
+/* maze_emit_text(*mp, *sp, h_res, v_res)
 
    Write a maze in a plain-text format.  The h_res and v_res
    parameters are ignored (they are accepted so that the write
    functions will have a uniform interface).
  */
 
-void maze_write_text(maze_t *mp, FILE *ofp, unsigned int h_res,
+int maze_emit_text(const maze_t *mp, maze_sink_t *sp, unsigned int h_res,
+                   unsigned int v_res) {
+  return maze_emit_rows(mp, ROWS_TEXT, sp, h_res, v_res);
+}
+
+/* maze_write_text(*mp, *ofp, h_res, v_res)
+
+   Write a maze in a plain-text format to the given output stream; see
+   maze_emit_text().
+ */
+
+void maze_write_text(const maze_t *mp, FILE *ofp, unsigned int h_res,
                      unsigned int v_res) {
-  rowcol_t r, c, p1, dir1, p2, dir2;
+  maze_file_sink_t fs;
 
-  /* Down-facing and right-facing exits can be modelled by editing the
-     maze to kick out the walls in the appropriate cells. */
-  p1 = EPOS(mp->exit_1);
-  dir1 = EDIR(mp->exit_1);
-  if (dir1 == DIR_D)
-    CELLV(mp, mp->n_rows - 1, p1).b_wall = 0;
-  else if (dir1 == DIR_R)
-    CELLV(mp, p1, mp->n_cols - 1).r_wall = 0;
+  maze_emit_text(mp, maze_file_sink(&fs, ofp), h_res, v_res);
+}
 
-  p2 = EPOS(mp->exit_2);
-  dir2 = EDIR(mp->exit_2);
-  if (dir2 == DIR_D)
-    CELLV(mp, mp->n_rows - 1, p2).b_wall = 0;
-  else if (dir2 == DIR_R)
-    CELLV(mp, p2, mp->n_cols - 1).r_wall = 0;
-
-  /* Draw the top border, respecting possible exits */
-  for (r = 0; r < mp->n_cols; ++r) {
-    if ((dir1 == DIR_U && p1 == r) || (dir2 == DIR_U && p2 == r)) {
-      fprintf(ofp, "+   ");
-    } else
-      fprintf(ofp, "+---");
-  }
-  fputc('+', ofp);
-  fputc('\n', ofp);
-
-  /* Draw all the cells.  The left border is drawn as we go, because
-     of the line-oriented nature of stream output. */
-  for (r = 0; r < mp->n_rows; ++r) {
-    if ((dir1 == DIR_L && p1 == r) || (dir2 == DIR_L && p2 == r))
-      fputc(' ', ofp);
-    else
-      fputc('|', ofp);
+/* Tag and version at the start of a CSR graph file */
+static const char csr_magic[4] = {'M', 'Z', 'C', 'S'};
+#define CSR_VERSION 1
 
-    for (c = 0; c < mp->n_cols; ++c) {
-      if (CELLV(mp, r, c).visit)
-        fprintf(ofp, " @ ");
-      else
-        fprintf(ofp, "   ");
+/* maze_emit_csr(*mp, *sp, edges)
 
-      fputc(CELLV(mp, r, c).r_wall ? '|' : ' ', ofp);
+   The offsets and neighbors are built together in one pass over the
+   cells in row major order.  Each cell's neighbors are appended in the
+   order up, left, right, down, which is also ascending vertex order,
+   so the end of the neighbor array so far is the next offset.  The
+   neighbor array is grown as needed, starting from the size for a
+   perfect maze.  The edge list, if wanted, is read back out of the
+   CSR arrays rather than the cells.
+ */
+
+int maze_emit_csr(const maze_t *mp, maze_sink_t *sp, int edges) {
+  s_emit_t e;
+  uint64_t n_cells = (uint64_t)mp->n_rows * mp->n_cols, n_arcs = 0, cap, v;
+  uint64_t hdr[5], *offsets;
+  uint32_t version = CSR_VERSION, *nbrs;
+  rowcol_t r, c;
+  int ok;
+
+  cap = 2 * n_cells + 4;
+  offsets = malloc((n_cells + 1) * sizeof(*offsets));
+  nbrs = malloc(cap * sizeof(*nbrs));
+  if (offsets == NULL || nbrs == NULL) {
+    free(offsets);
+    free(nbrs);
+    return 0;
+  }
+
+  for (r = 0, v = 0; r < mp->n_rows; ++r) {
+    for (c = 0; c < mp->n_cols; ++c, ++v) {
+      if (n_arcs + 4 > cap) {
+        uint32_t *tmp = realloc(nbrs, 2 * cap * sizeof(*nbrs));
+
+        if (tmp == NULL) {
+          free(offsets);
+          free(nbrs);
+          return 0;
+        }
+        nbrs = tmp;
+        cap *= 2;
+      }
+
+      offsets[v] = n_arcs;
+      if (r > 0 && !mp->cells[v - mp->n_cols].b_wall)
+        nbrs[n_arcs++] = (uint32_t)(v - mp->n_cols);
+      if (c > 0 && !mp->cells[v - 1].r_wall) nbrs[n_arcs++] = (uint32_t)(v - 1);
+      if (c < mp->n_cols - 1 && !mp->cells[v].r_wall)
+        nbrs[n_arcs++] = (uint32_t)(v + 1);
+      if (r < mp->n_rows - 1 && !mp->cells[v].b_wall)
+        nbrs[n_arcs++] = (uint32_t)(v + mp->n_cols);
     }
-    fputc('\n', ofp);
-    fputc('+', ofp);
+  }
+  offsets[n_cells] = n_arcs;
+
+  hdr[0] = mp->n_rows;
+  hdr[1] = mp->n_cols;
+  hdr[2] = n_cells;
+  hdr[3] = n_arcs;
+  hdr[4] = edges ? n_arcs / 2 : 0;
+
+  s_emit_open(&e, sp);
+  s_emit_bytes(&e, csr_magic, sizeof(csr_magic));
+  s_emit_bytes(&e, &version, sizeof(version));
+  s_emit_bytes(&e, hdr, sizeof(hdr));
+  s_emit_bytes(&e, offsets, (n_cells + 1) * sizeof(*offsets));
+  s_emit_bytes(&e, nbrs, n_arcs * sizeof(*nbrs));
+
+  /* Each edge once, as the pair (u, v) with u < v */
+  for (v = 0; e.ok && edges && v < n_cells; ++v) {
+    uint64_t k;
+
+    for (k = offsets[v]; k < offsets[v + 1]; ++k) {
+      uint32_t pair[2];
+
+      if (nbrs[k] < v) continue;
+      pair[0] = (uint32_t)v;
+      pair[1] = nbrs[k];
+      s_emit_bytes(&e, pair, sizeof(pair));
+    }
+  }
+  ok = s_emit_close(&e);
+
+  free(offsets);
+  free(nbrs);
+  return ok;
+}
+
+/* maze_emit_grid(*mp, *sp, bits)
 
-    for (c = 0; c < mp->n_cols; ++c)
-      fputs(CELLV(mp, r, c).b_wall ? "---+" : "   +", ofp);
+   Write a maze as an occupancy grid to the specified output sink,
+   through a row writer.
+ */
+
+int maze_emit_grid(const maze_t *mp, maze_sink_t *sp, int bits) {
+  return maze_emit_rows(mp, bits ? ROWS_GRID_BITS : ROWS_GRID, sp, 0, 0);
+}
+
+/* maze_write_grid(*mp, *ofp, bits)
+
+   Write a maze as an occupancy grid to the given output stream; see
+   maze_emit_grid().
+ */
 
-    fputc('\n', ofp);
+int maze_write_grid(const maze_t *mp, FILE *ofp, int bits) {
+  maze_file_sink_t fs;
+
+  return maze_emit_grid(mp, maze_file_sink(&fs, ofp), bits);
+}
+
+/* maze_write_csr(*mp, *ofp, edges)
+
+   Write the passage graph of a maze in CSR form to the given output
+   stream; see maze_emit_csr().
+ */
+
+int maze_write_csr(const maze_t *mp, FILE *ofp, int edges) {
+  maze_file_sink_t fs;
+
+  return maze_emit_csr(mp, maze_file_sink(&fs, ofp), edges);
+}
+
+static int s_file_write(maze_sink_t *sp, const void *data, size_t len) {
+  maze_file_sink_t *fs = (maze_file_sink_t *)sp;
+
+  return fwrite(data, 1, len, fs->fp) == len;
+}
+
+static int s_file_flush(maze_sink_t *sp) {
+  return fflush(((maze_file_sink_t *)sp)->fp) == 0;
+}
+
+/* maze_file_sink(*fs, *fp)
+
+   Set up a sink for a stdio stream.  The stream is flushed at the
+   end of each writer but not closed.
+ */
+
+maze_sink_t *maze_file_sink(maze_file_sink_t *fs, FILE *fp) {
+  fs->sink.write = s_file_write;
+  fs->sink.flush = s_file_flush;
+  fs->sink.reserve = NULL;
+  fs->fp = fp;
+
+  return &fs->sink;
+}
+
+/* s_mem_grow(*ms, want)
+
+   Make sure the buffer of a memory sink has room for want more bytes,
+   at least doubling it when it must grow.
+ */
+
+static int s_mem_grow(maze_mem_sink_t *ms, size_t want) {
+  size_t cap = ms->cap ? ms->cap : 4096;
+  char *tmp;
+
+  if (ms->cap - ms->len >= want) return 1;
+  while (cap - ms->len < want) {
+    if (cap > (size_t)-1 / 2) return 0;
+    cap *= 2;
   }
+  if ((tmp = realloc(ms->buf, cap)) == NULL) return 0;
+
+  ms->buf = tmp;
+  ms->cap = cap;
+  return 1;
+}
+
+static int s_mem_write(maze_sink_t *sp, const void *data, size_t len) {
+  maze_mem_sink_t *ms = (maze_mem_sink_t *)sp;
+
+  /* Data written into reserved space is already in place */
+  if (data != ms->buf + ms->len) {
+    if (!s_mem_grow(ms, len)) return 0;
+    memcpy(ms->buf + ms->len, data, len);
+  }
+  ms->len += len;
+  return 1;
+}
+
+static void *s_mem_reserve(maze_sink_t *sp, size_t min, size_t *avail) {
+  maze_mem_sink_t *ms = (maze_mem_sink_t *)sp;
+
+  if (!s_mem_grow(ms, min)) return NULL;
+
+  *avail = ms->cap - ms->len;
+  return ms->buf + ms->len;
+}
+
+/* maze_mem_sink(*ms)
+
+   Set up a sink that collects its output in a buffer on the heap,
+   grown as needed.  The caller must free ms->buf.
+ */
+
+maze_sink_t *maze_mem_sink(maze_mem_sink_t *ms) {
+  ms->sink.write = s_mem_write;
+  ms->sink.flush = NULL;
+  ms->sink.reserve = s_mem_reserve;
+  ms->buf = NULL;
+  ms->len = ms->cap = 0;
+
+  return &ms->sink;
+}
+
+static int s_buf_write(maze_sink_t *sp, const void *data, size_t len) {
+  maze_buf_sink_t *bs = (maze_buf_sink_t *)sp;
+
+  if (bs->cap - bs->len < len) return 0;
+  if (data != bs->buf + bs->len) memcpy(bs->buf + bs->len, data, len);
+  bs->len += len;
+  return 1;
+}
+
+static void *s_buf_reserve(maze_sink_t *sp, size_t min, size_t *avail) {
+  maze_buf_sink_t *bs = (maze_buf_sink_t *)sp;
+
+  if (bs->cap - bs->len < min) return NULL;
+
+  *avail = bs->cap - bs->len;
+  return bs->buf + bs->len;
+}
+
+/* maze_buf_sink(*bs, *buf, cap)
+
+   Set up a sink that writes into a buffer belonging to the caller.
+   Output that would not fit is an error; bs->len counts the bytes
+   actually stored.
+ */
+
+maze_sink_t *maze_buf_sink(maze_buf_sink_t *bs, void *buf, size_t cap) {
+  bs->sink.write = s_buf_write;
+  bs->sink.flush = NULL;
+  bs->sink.reserve = s_buf_reserve;
+  bs->buf = buf;
+  bs->len = 0;
+  bs->cap = cap;
+
+  return &bs->sink;
+}
+
+static int s_fd_write(maze_sink_t *sp, const void *data, size_t len) {
+  maze_fd_sink_t *ds = (maze_fd_sink_t *)sp;
+  const char *p = data;
+
+  while (len > 0) {
+    ssize_t n = write(ds->fd, p, len);
+
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return 0;
+    }
+    p += n;
+    len -= n;
+  }
+  return 1;
+}
+
+/* maze_fd_sink(*ds, fd)
+
+   Set up a sink for a file descriptor.  Each chunk is passed to
+   write(2) directly; short writes are continued.
+ */
+
+maze_sink_t *maze_fd_sink(maze_fd_sink_t *ds, int fd) {
+  ds->sink.write = s_fd_write;
+  ds->sink.flush = NULL;
+  ds->sink.reserve = NULL;
+  ds->fd = fd;
+
+  return &ds->sink;
 }
 
 /* Here there be dragons */
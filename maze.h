@@ -27,8 +27,13 @@
 #ifndef MAZE_H_
 #define MAZE_H_
 
+#include <stddef.h>
 #include <stdio.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /** Directional constants for navigating and constructing a maze grid. */
 enum { DIR_U = 0, DIR_R = 1, DIR_D = 2, DIR_L = 3 };
 
@@ -47,7 +52,11 @@ typedef struct {
 /** Represents a single row or column index. */
 typedef unsigned int rowcol_t;
 
-/** A maze. */
+/** A maze.  The cells are normally on the heap, but they may instead
+    lie in a memory mapping, starting at map and map_len bytes long,
+    which maze_clear() unmaps.  A map_len of zero means the mapping
+    belongs to something else and is left alone.
+ */
 typedef struct {
   maze_node *cells;
   rowcol_t *sets;
@@ -55,6 +64,8 @@ typedef struct {
   rowcol_t n_cols;
   rowcol_t exit_1; /* Bottom 2 bits indicate direction */
   rowcol_t exit_2;
+  void *map;      /* Mapping holding the cells, or NULL */
+  size_t map_len; /* Length of the mapping to release   */
 } maze_t;
 
 /** A random number generator, uniform distribution over 0,..1 */
@@ -68,7 +79,8 @@ typedef double (*rand_f)(void);
 #define EPOS(EXIT) ((EXIT) >> 2)
 #define EDIR(EXIT) ((EXIT)&0x3)
 
-/** Initialize a new empty maze structure.
+/** Initialize a new empty maze structure.  Returns false if memory
+    is exhausted, or if nr * nc does not fit in an unsigned int.
 
     @param nr    The number of rows the maze should have.
     @param nc    The number of columns the maze should have.
@@ -90,7 +102,7 @@ int maze_load(maze_t *mp, FILE *ifp);
     @param mp    Pointer to an initialized maze structure.
     @param ofp   Output stream to write data to.
  */
-void maze_store(maze_t *mp, FILE *ofp);
+void maze_store(const maze_t *mp, FILE *ofp);
 
 /** Release the storage used by an existing maze structure. */
 void maze_clear(maze_t *mp);
@@ -110,6 +122,113 @@ void maze_unmark(maze_t *mp);
  */
 int maze_generate(maze_t *mp, rand_f random);
 
+/** Generate a maze at random, examining the cells in the given order
+    (GEN_ORDER_RANDOM or GEN_ORDER_BLOCKED; see maze_gen_begin_order()).
+    maze_generate() is the same as the GEN_ORDER_RANDOM order.
+
+    @param mp     Pointer to an initialized maze structure.
+    @param random A random generator function (see rand_f).
+    @param order  The order in which cells are examined.
+ */
+int maze_generate_order(maze_t *mp, rand_f random, int order);
+
+/** Generate a maze at random by the growing tree method, which grows
+    a single passage tree outward from a random cell.  At each step
+    the newest cell of the tree that can still grow is extended with
+    probability mix, and otherwise a random one.  A mix of 1 gives the
+    long winding passages of a depth-first search; a mix of 0 gives
+    the short branches of a randomized Prim's algorithm.  Needs one
+    rowcol_t per cell of temporary storage.  Returns false if memory
+    is exhausted.
+
+    @param mp     Pointer to an initialized maze structure.
+    @param random A random generator function (see rand_f).
+    @param mix    Probability, from 0 to 1, of extending the newest cell.
+ */
+int maze_generate_tree(maze_t *mp, rand_f random, double mix);
+
+/** Phases of a stepwise generation; see maze_gen_t. */
+enum { GEN_SHUFFLE = 0, GEN_SCAN = 1, GEN_DONE = 2 };
+
+/** Orders in which a generation examines the cells. */
+enum { GEN_ORDER_RANDOM = 0, GEN_ORDER_BLOCKED = 1 };
+
+/** Cells in each block of a GEN_ORDER_BLOCKED generation. */
+#define MAZE_GEN_BLOCK 1024
+
+/** The state of a maze generation in progress.  Together with the
+    maze's cells and path sets, and the state of the random generator,
+    this is everything needed to continue the generation later.
+ */
+typedef struct {
+  rowcol_t *queue;  /* Order in which cells are examined      */
+  rowcol_t n_cells; /* Length of the queue                    */
+  rowcol_t count;   /* Cells found to have nothing to join    */
+  rowcol_t pos;     /* Next queue position in the phase       */
+  rowcol_t phase;   /* GEN_SHUFFLE, GEN_SCAN, or GEN_DONE     */
+  rowcol_t order;   /* GEN_ORDER_RANDOM or GEN_ORDER_BLOCKED  */
+  rowcol_t *blocks; /* Order of the blocks, or NULL           */
+  rowcol_t n_blocks;
+} maze_gen_t;
+
+/** Begin generating a maze at random in steps.  The maze is reset and
+    the temporary storage for generation is allocated.  Returns false
+    if memory is exhausted.
+
+    @param mp     Pointer to an initialized maze structure.
+    @param gp     Pointer to an uninitialized generation state.
+ */
+int maze_gen_begin(maze_t *mp, maze_gen_t *gp);
+
+/** Like maze_gen_begin(), but examining the cells in the given order.
+    GEN_ORDER_RANDOM shuffles the whole maze on every pass, so that
+    consecutive cells lie anywhere in memory.  GEN_ORDER_BLOCKED
+    instead cuts the maze into square tiles of MAZE_GEN_BLOCK cells,
+    shuffles the cells within each tile and the order of the tiles,
+    and examines one tile at a time, which keeps the cells and path
+    sets in use in cache on mazes too large for it.  The two orders
+    make different mazes from the same random sequence.  Mazes of
+    nearly 2^32 cells always use GEN_ORDER_RANDOM.
+
+    @param mp     Pointer to an initialized maze structure.
+    @param gp     Pointer to an uninitialized generation state.
+    @param order  The order in which cells are examined.
+ */
+int maze_gen_begin_order(maze_t *mp, maze_gen_t *gp, int order);
+
+/** Continue a generation by up to the given amount of work.  The
+    result is the same however the work is divided into steps.
+    Returns true when the maze is complete.
+
+    @param mp     Pointer to the maze being generated.
+    @param gp     Pointer to the generation state.
+    @param random A random generator function (see rand_f).
+    @param work   The number of units of work (cells) to perform.
+ */
+int maze_gen_step(maze_t *mp, maze_gen_t *gp, rand_f random, rowcol_t work);
+
+/** Release the temporary storage used by a generation. */
+void maze_gen_end(maze_t *mp, maze_gen_t *gp);
+
+/** Write a checkpoint of a generation in progress to a file.  The
+    state of the random generator is not included.  Returns false in
+    case of a write error.
+
+    @param mp     Pointer to the maze being generated.
+    @param gp     Pointer to the generation state.
+    @param ofp    Output stream to write the checkpoint to.
+ */
+int maze_gen_save(const maze_t *mp, const maze_gen_t *gp, FILE *ofp);
+
+/** Restore a checkpoint written by maze_gen_save().  Initializes both
+    the maze and the generation state as a side-effect.
+
+    @param mp     Pointer to an uninitialized maze structure.
+    @param gp     Pointer to an uninitialized generation state.
+    @param ifp    Input stream to read the checkpoint from.
+ */
+int maze_gen_restore(maze_t *mp, maze_gen_t *gp, FILE *ifp);
+
 /** Find a path between two vertices in a maze.  The path is recorded
     by marking the vertices of the maze.  Row and column indices are
     zero indexed.
@@ -126,14 +245,37 @@ int maze_generate(maze_t *mp, rand_f random);
 void maze_find_path(maze_t *mp, rowcol_t start_row, rowcol_t start_col,
                     rowcol_t end_row, rowcol_t end_col);
 
-/** Write a maze in PNG format to the specified output file.
+/** Find a path between two vertices in a maze without changing it, so
+    that a maze in read-only memory, such as a view from
+    maze_pack_view(), can be solved in place, and by several threads at
+    once.  The search is the one maze_find_path() makes, with its
+    markers kept in marks instead of in the maze.  Returns the number of
+    vertices on the path, counting both ends.
+
+    @param mp         Pointer to an initialized maze structure.
+    @param start_row  Row number of starting vertex.
+    @param start_col  Column number of starting vertex.
+    @param end_row    Row number of ending vertex.
+    @param end_col    Column number of ending vertex.
+    @param marks      Room for n_rows * n_cols bytes, for the search.
+    @param path       Room for n_rows * n_cols vertices, where those on
+                      the path are stored as r * n_cols + c, from the
+                      start to the end; or NULL.
+ */
+rowcol_t maze_trace_path(const maze_t *mp, rowcol_t start_row,
+                         rowcol_t start_col, rowcol_t end_row,
+                         rowcol_t end_col, unsigned char *marks,
+                         rowcol_t *path);
+
+/** Write a maze in PNG format to the specified output file.  None of
+    the writers modify the maze.
 
     @param mp         Pointer to an initialized maze structure.
     @param ofp        Output stream to write the PNG to.
     @param h_res      Width of generated image, in pixels.
     @param v_res      Height of generated image, in pixels.
  */
-void maze_write_png(maze_t *mp, FILE *ofp, unsigned int h_res,
+void maze_write_png(const maze_t *mp, FILE *ofp, unsigned int h_res,
                     unsigned int v_res);
 
 /** Write a maze in Encapsulated PostScript (EPS) format.
@@ -143,7 +285,7 @@ void maze_write_png(maze_t *mp, FILE *ofp, unsigned int h_res,
     @param h_res      Width of generated image, in points.
     @param v_res      Height of generated image, in points.
  */
-void maze_write_eps(maze_t *mp, FILE *ofp, unsigned int h_res,
+void maze_write_eps(const maze_t *mp, FILE *ofp, unsigned int h_res,
                     unsigned int v_res);
 
 /** Write a maze in ASCII text format.
@@ -153,7 +295,239 @@ void maze_write_eps(maze_t *mp, FILE *ofp, unsigned int h_res,
     @param h_res      Ignored in this function (width).
     @param v_res      Ignored in this function (height).
  */
-void maze_write_text(maze_t *mp, FILE *ofp, unsigned int h_res,
+void maze_write_text(const maze_t *mp, FILE *ofp, unsigned int h_res,
                      unsigned int v_res);
 
+/** Write the passage graph of a maze in compressed sparse row (CSR)
+    form, for use by graph analysis tools.  Vertex v is the cell in row
+    v / n_cols and column v % n_cols, and there is an edge between two
+    adjacent cells whenever there is no wall between them.  Exits are
+    not included.  Returns false if memory is exhausted or in case of a
+    write error.
+
+    The output is binary, in the native byte order, and laid out so
+    that every array is naturally aligned when the file is mapped into
+    memory as it stands:
+
+      bytes 0-3     the tag "MZCS"
+      bytes 4-7     uint32 format version (1)
+      bytes 8-47    uint64 n_rows, n_cols, n_vertices, n_arcs, n_edges
+      then          uint64 offsets[n_vertices + 1]
+      then          uint32 neighbors[n_arcs]
+      then          uint32 edges[n_edges][2]
+
+    The neighbors of vertex v are neighbors[offsets[v]] up to but not
+    including neighbors[offsets[v + 1]], in ascending order.  Every
+    edge appears as two arcs, one in each direction.  If requested,
+    the edge list gives each edge once as a pair (u, v) with u < v,
+    otherwise n_edges is zero.
+
+    @param mp         Pointer to an initialized maze structure.
+    @param ofp        Output stream to write the graph to.
+    @param edges      If true, include the edge list.
+ */
+int maze_write_csr(const maze_t *mp, FILE *ofp, int edges);
+
+/** Write a maze as an occupancy grid of (2 * n_rows + 1) by (2 * n_cols
+    + 1) squares, for simulations and games.  Square (y, x) is cell (y
+    / 2, x / 2) when y and x are both odd; a wall between two cells
+    when one is odd; and a post where walls meet when both are even.
+    Walls and posts are occupied (1), and cells, missing walls, and
+    exits are open (0).  Returns false if memory is exhausted or in
+    case of a write error.
+
+    The output is binary, in the native byte order, and each row starts
+    on an 8-byte boundary so that the grid can be used directly when
+    the file is mapped into memory:
+
+      bytes 0-3     the tag "MZOG"
+      bytes 4-7     uint32 format version (1)
+      bytes 8-11    uint32 bits per square (8 or 1)
+      bytes 12-15   zero
+      bytes 16-39   uint64 height, width, stride
+      then          height rows of stride bytes
+
+    With 8 bits per square, square x of a row is byte x; with 1, it is
+    bit x % 8 of byte x / 8.  Each row is padded with zeros to the
+    stride, a multiple of 8 bytes.
+
+    @param mp         Pointer to an initialized maze structure.
+    @param ofp        Output stream to write the grid to.
+    @param bits       If true, one bit per square; otherwise a byte.
+ */
+int maze_write_grid(const maze_t *mp, FILE *ofp, int bits);
+
+/** An output sink, to which the writers deliver their output.  A
+    concrete sink is a structure whose first member is a maze_sink_t;
+    the library provides sinks for stdio streams, growable and fixed
+    memory buffers, and file descriptors, and callers may define their
+    own.  The functions receive a pointer to the maze_sink_t member.
+
+    write()   Append len bytes of data; return false on error.
+    flush()   Pass buffered output along at the end of each writer;
+              return false on error.  May be NULL.
+    reserve() Return a pointer to at least min free bytes inside the
+              sink, setting *avail to the number actually free, or
+              NULL if that much space is not available.  A write()
+              whose data begins at that pointer, before any other call
+              to the sink, takes the data in place.  May be NULL.
+
+    The writers assemble their output in chunks of up to 64 KiB, in
+    space reserved from the sink when it allows so that nothing is
+    copied, and pass each chunk to write() in a single call.
+ */
+typedef struct maze_sink maze_sink_t;
+struct maze_sink {
+  int (*write)(maze_sink_t *sp, const void *data, size_t len);
+  int (*flush)(maze_sink_t *sp);
+  void *(*reserve)(maze_sink_t *sp, size_t min, size_t *avail);
+};
+
+/** A sink writing to a stdio stream. */
+typedef struct {
+  maze_sink_t sink;
+  FILE *fp;
+} maze_file_sink_t;
+
+/** A sink collecting output in a heap buffer, grown as needed.  The
+    caller must free buf when finished with it. */
+typedef struct {
+  maze_sink_t sink;
+  char *buf;
+  size_t len; /* Bytes of output in buf */
+  size_t cap; /* Allocated size of buf  */
+} maze_mem_sink_t;
+
+/** A sink writing into a fixed buffer supplied by the caller.  Output
+    that does not fit makes the writer fail. */
+typedef struct {
+  maze_sink_t sink;
+  char *buf;
+  size_t len; /* Bytes of output in buf */
+  size_t cap; /* Size of buf            */
+} maze_buf_sink_t;
+
+/** A sink writing to a file descriptor with write(2). */
+typedef struct {
+  maze_sink_t sink;
+  int fd;
+} maze_fd_sink_t;
+
+/** Set up a sink for the given stream, returning its maze_sink_t. */
+maze_sink_t *maze_file_sink(maze_file_sink_t *fs, FILE *fp);
+
+/** Set up an empty memory sink, returning its maze_sink_t. */
+maze_sink_t *maze_mem_sink(maze_mem_sink_t *ms);
+
+/** Set up a sink for cap bytes at buf, returning its maze_sink_t. */
+maze_sink_t *maze_buf_sink(maze_buf_sink_t *bs, void *buf, size_t cap);
+
+/** Set up a sink for the given descriptor, returning its maze_sink_t. */
+maze_sink_t *maze_fd_sink(maze_fd_sink_t *ds, int fd);
+
+/** Write a pickled representation of a maze to a sink, in the format
+    of maze_store().  Returns false in case of a write error.
+ */
+int maze_emit_store(const maze_t *mp, maze_sink_t *sp);
+
+/** Write a maze to a sink in PNG, EPS, or text format, or as a CSR
+    graph.  These are the same as maze_write_png(), maze_write_eps(),
+    maze_write_text(), and maze_write_csr(), which are in fact written
+    in terms of them, except that they return false in case of a write
+    error.  If there is no memory for the whole image, maze_emit_png()
+    draws it with a row writer instead.
+ */
+int maze_emit_png(const maze_t *mp, maze_sink_t *sp, unsigned int h_res,
+                  unsigned int v_res);
+int maze_emit_eps(const maze_t *mp, maze_sink_t *sp, unsigned int h_res,
+                  unsigned int v_res);
+int maze_emit_text(const maze_t *mp, maze_sink_t *sp, unsigned int h_res,
+                   unsigned int v_res);
+int maze_emit_csr(const maze_t *mp, maze_sink_t *sp, int edges);
+
+/** Write a maze to a sink as an occupancy grid; see maze_write_grid().
+ */
+int maze_emit_grid(const maze_t *mp, maze_sink_t *sp, int bits);
+
+/** Output formats for the row writers.  ROWS_GRID and ROWS_GRID_BITS
+    are the occupancy grids of maze_write_grid(), with a byte and a
+    bit per square. */
+enum {
+  ROWS_TEXT = 0,
+  ROWS_EPS = 1,
+  ROWS_PNG = 2,
+  ROWS_GRID = 3,
+  ROWS_GRID_BITS = 4
+};
+
+/** A row writer, which writes a maze in text, EPS, PNG, or occupancy
+    grid format from its rows one at a time, so that the whole maze
+    never needs to be in memory.  It keeps the state for a few rows at
+    most; for PNG, the pixel rows the cells of one row can reach.  The
+    text, EPS, and grid output is the same as from maze_emit_text(),
+    maze_emit_eps(), and maze_emit_grid(), which are built on the row
+    writers.  The PNG output is the same image as from maze_emit_png(),
+    encoded directly with zlib.
+ */
+typedef struct {
+  int format;      /* One of the ROWS_ formats           */
+  rowcol_t n_rows; /* Size and exits of the whole maze   */
+  rowcol_t n_cols;
+  rowcol_t exit_1;
+  rowcol_t exit_2;
+  unsigned int h_res; /* Output area, as for the writers */
+  unsigned int v_res;
+  rowcol_t row; /* Number of rows written so far */
+  void *state;  /* Private to the writer          */
+} maze_rows_t;
+
+/** Begin writing a maze of the given size and exits one row at a
+    time.  Returns false if memory is exhausted.
+
+    @param wp      Pointer to an uninitialized row writer.
+    @param format  One of the ROWS_ formats.
+    @param sp      Sink to write the output to.
+    @param h_res   Width of the output, as for the writers.
+    @param v_res   Height of the output, as for the writers.
+ */
+int maze_rows_begin(maze_rows_t *wp, int format, maze_sink_t *sp,
+                    rowcol_t n_rows, rowcol_t n_cols, rowcol_t exit_1,
+                    rowcol_t exit_2, unsigned int h_res, unsigned int v_res);
+
+/** Write the next row of a maze, given its n_cols cells in order.
+    Returns false in case of a write error. */
+int maze_rows_push(maze_rows_t *wp, const maze_node *row);
+
+/** Finish writing a maze and release the row writer.  Returns false
+    in case of a write error, or if fewer rows were pushed than the
+    maze has. */
+int maze_rows_end(maze_rows_t *wp);
+
+/** A function to receive the rows of a maze in order, for example
+    maze_rows_push() adapted to this signature.  It returns false to
+    stop the rows early. */
+typedef int (*maze_row_f)(const maze_node *row, void *arg);
+
+/** Write a whole maze to a sink through a row writer, in one of the
+    ROWS_ formats.  For PNG, this takes memory for a band of pixel rows
+    rather than the whole image.  Returns false in case of error.
+ */
+int maze_emit_rows(const maze_t *mp, int format, maze_sink_t *sp,
+                   unsigned int h_res, unsigned int v_res);
+
+/** Read the dimension line of a maze stored by maze_store(), so that
+    its rows can be read one at a time with maze_load_row() rather
+    than loading the whole maze.  Returns false in case of error.
+ */
+int maze_load_header(FILE *ifp, rowcol_t *n_rows, rowcol_t *n_cols,
+                     rowcol_t *exit_1, rowcol_t *exit_2);
+
+/** Read the next row of n_cols cells of a maze stored by maze_store()
+    into row.  Returns false in case of error. */
+int maze_load_row(FILE *ifp, rowcol_t n_cols, maze_node *row);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* end MAZE_H_ */
@@ -0,0 +1,381 @@
+/*
+  Name:     maze.hpp
+  Purpose:  C++ ownership, views, and writers for the maze library.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#ifndef MAZE_HPP_
+#define MAZE_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "maze.h"
+
+/* A thin C++ layer over the C interface, in this header alone.  An
+   owner holds a maze_t and releases it with maze_clear() when it goes
+   out of scope; it can be moved but not copied.  A view refers to a
+   maze_t owned by something else -- an owner, a pack, shared memory --
+   and reads its cells where they lie.  Nothing here copies cells, and
+   every call goes straight through to the C function it wraps, so
+   there is nothing to pay for using it (see mazecxx.cc).  Failures
+   that the C functions report by returning false are thrown as
+   std::bad_alloc where the cause is memory, and std::runtime_error
+   otherwise. */
+
+namespace maze {
+
+/** The cells of one row of a maze, for range-for loops. */
+class row_view {
+ public:
+  row_view(const maze_node *cells, rowcol_t n) : cells_(cells), n_(n) {}
+
+  const maze_node *begin() const { return cells_; }
+  const maze_node *end() const { return cells_ + n_; }
+  const maze_node &operator[](rowcol_t c) const { return cells_[c]; }
+  rowcol_t size() const { return n_; }
+
+ private:
+  const maze_node *cells_;
+  rowcol_t n_;
+};
+
+/** An iterator over the rows of a maze, top to bottom. */
+class row_iterator {
+ public:
+  typedef std::random_access_iterator_tag iterator_category;
+  typedef row_view value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef const row_view *pointer;
+  typedef row_view reference;
+
+  row_iterator(const maze_node *cells, rowcol_t n) : cells_(cells), n_(n) {}
+
+  row_view operator*() const { return row_view(cells_, n_); }
+  row_view operator[](difference_type k) const { return *(*this + k); }
+  row_iterator &operator++() {
+    cells_ += n_;
+    return *this;
+  }
+  row_iterator operator++(int) {
+    row_iterator old = *this;
+    cells_ += n_;
+    return old;
+  }
+  row_iterator &operator--() {
+    cells_ -= n_;
+    return *this;
+  }
+  row_iterator operator--(int) {
+    row_iterator old = *this;
+    cells_ -= n_;
+    return old;
+  }
+  row_iterator &operator+=(difference_type k) {
+    cells_ += k * (difference_type)n_;
+    return *this;
+  }
+  row_iterator &operator-=(difference_type k) { return *this += -k; }
+  row_iterator operator+(difference_type k) const {
+    return row_iterator(*this) += k;
+  }
+  row_iterator operator-(difference_type k) const {
+    return row_iterator(*this) -= k;
+  }
+  difference_type operator-(const row_iterator &o) const {
+    return (cells_ - o.cells_) / (difference_type)n_;
+  }
+  bool operator==(const row_iterator &o) const { return cells_ == o.cells_; }
+  bool operator!=(const row_iterator &o) const { return cells_ != o.cells_; }
+  bool operator<(const row_iterator &o) const { return cells_ < o.cells_; }
+
+ private:
+  const maze_node *cells_;
+  rowcol_t n_;
+};
+
+/** A read-only view of a maze owned elsewhere, which must outlive
+    it.  A view converts implicitly from a maze_t, so a maze from
+    maze_pack_view() or maze_attach() can be passed as it is. */
+class view {
+ public:
+  view(const maze_t &m) : mp_(&m) {}
+
+  rowcol_t rows() const { return mp_->n_rows; }
+  rowcol_t cols() const { return mp_->n_cols; }
+  std::size_t size() const { return (std::size_t)rows() * cols(); }
+  rowcol_t exit_1() const { return mp_->exit_1; }
+  rowcol_t exit_2() const { return mp_->exit_2; }
+
+  /** The cells in row major order. */
+  const maze_node *data() const { return mp_->cells; }
+  const maze_node &operator()(rowcol_t r, rowcol_t c) const {
+    return *CELLP(mp_, r, c);
+  }
+  row_view row(rowcol_t r) const { return row_view(CELLP(mp_, r, 0), cols()); }
+
+  /** The rows, top to bottom. */
+  row_iterator begin() const { return row_iterator(data(), cols()); }
+  row_iterator end() const { return row_iterator(data() + size(), cols()); }
+
+  /** Find a path between two cells without marking the maze, as
+      maze_trace_path() does, leaving in path its cells, r * cols() + c
+      from start to end.  Both vectors are resized as needed, so they
+      can be reused from one call to the next. */
+  void trace(rowcol_t sr, rowcol_t sc, rowcol_t er, rowcol_t ec,
+             std::vector<rowcol_t> &path,
+             std::vector<unsigned char> &marks) const {
+    marks.resize(size());
+    path.resize(size());
+    path.resize(
+        maze_trace_path(mp_, sr, sc, er, ec, marks.data(), path.data()));
+  }
+
+  /** The maze, for calling the C interface directly. */
+  const maze_t *get() const { return mp_; }
+
+ private:
+  const maze_t *mp_;
+};
+
+/** A maze that releases itself.  It can be moved, which leaves the
+    source empty, but not copied. */
+class owner {
+ public:
+  /** A maze of the given size with every wall in place. */
+  owner(rowcol_t nr, rowcol_t nc) {
+    if (!maze_init(&m_, nr, nc)) throw std::bad_alloc();
+  }
+
+  /** Take over a maze made with the C interface, leaving m empty. */
+  explicit owner(maze_t &m) : m_(m) { s_empty(m); }
+
+  owner(owner &&o) noexcept : m_(o.m_) { s_empty(o.m_); }
+  owner &operator=(owner &&o) noexcept {
+    if (this != &o) {
+      maze_clear(&m_);
+      m_ = o.m_;
+      s_empty(o.m_);
+    }
+    return *this;
+  }
+  owner(const owner &) = delete;
+  owner &operator=(const owner &) = delete;
+  ~owner() { maze_clear(&m_); }
+
+  /** Read a maze written by maze_store(). */
+  static owner load(FILE *ifp) {
+    maze_t m;
+
+    if (!maze_load(&m, ifp)) throw std::runtime_error("maze_load failed");
+    return owner(m);
+  }
+
+  /** True unless the maze has been moved away. */
+  explicit operator bool() const { return m_.cells != NULL; }
+
+  rowcol_t rows() const { return m_.n_rows; }
+  rowcol_t cols() const { return m_.n_cols; }
+  std::size_t size() const { return (std::size_t)rows() * cols(); }
+
+  maze_node *data() { return m_.cells; }
+  const maze_node *data() const { return m_.cells; }
+  maze_node &operator()(rowcol_t r, rowcol_t c) { return *CELLP(&m_, r, c); }
+  const maze_node &operator()(rowcol_t r, rowcol_t c) const {
+    return *CELLP(&m_, r, c);
+  }
+  row_view row(rowcol_t r) const { return view(m_).row(r); }
+  row_iterator begin() const { return view(m_).begin(); }
+  row_iterator end() const { return view(m_).end(); }
+
+  /** Set the entrance and exit; see EXIT() in maze.h. */
+  void set_exits(rowcol_t exit_1, rowcol_t exit_2) {
+    m_.exit_1 = exit_1;
+    m_.exit_2 = exit_2;
+  }
+
+  /** Generate the maze; see maze_generate_order(). */
+  void generate(rand_f random, int order = GEN_ORDER_RANDOM) {
+    if (!maze_generate_order(&m_, random, order)) throw std::bad_alloc();
+  }
+
+  /** Mark a path between two cells; see maze_find_path(). */
+  void find_path(rowcol_t sr, rowcol_t sc, rowcol_t er, rowcol_t ec) {
+    maze_find_path(&m_, sr, sc, er, ec);
+  }
+
+  /** Remove the markers left by find_path(). */
+  void unmark() { maze_unmark(&m_); }
+
+  operator view() const { return view(m_); }
+  maze_t *get() { return &m_; }
+  const maze_t *get() const { return &m_; }
+
+ private:
+  static void s_empty(maze_t &m) {
+    m.cells = NULL;
+    m.sets = NULL;
+    m.map = NULL;
+    m.map_len = 0;
+    m.n_rows = m.n_cols = 0;
+  }
+
+  maze_t m_;
+};
+
+/** Output formats for write(). */
+enum format { TEXT, EPS, PNG, STORE, CSR, CSR_EDGES, GRID, GRID_BITS };
+
+namespace detail {
+
+/* Copy len bytes at p to an output iterator, advancing it */
+template <class OutIt>
+inline void put(OutIt &out, const char *p, std::size_t len) {
+  out = std::copy(p, p + len, out);
+}
+
+/* A back_insert_iterator keeps its container in a protected member,
+   reached here through a member pointer taken in a derived class. */
+template <class C>
+struct back_access : std::back_insert_iterator<C> {
+  static C &of(std::back_insert_iterator<C> &it) {
+    return *(it.*(&back_access::container));
+  }
+};
+
+/* Append to the container of a back_insert_iterator in one call, rather
+   than a byte at a time */
+template <class C>
+inline void put(std::back_insert_iterator<C> &out, const char *p,
+                std::size_t len) {
+  C &c = back_access<C>::of(out);
+
+  c.insert(c.end(), p, p + len);
+}
+
+/* A sink passing its output to an output iterator.  The iterator may
+   make the whole not standard-layout, so the sink the writers are given
+   sits in a small standard-layout link, where it is first, alongside a
+   pointer back to its owner. */
+template <class OutIt>
+struct iter_sink {
+  struct link {
+    maze_sink_t sink;
+    iter_sink *self;
+  };
+  static_assert(std::is_standard_layout<link>::value,
+                "the sink must start its link");
+
+  link ln;
+  OutIt out;
+
+  explicit iter_sink(OutIt it) : out(it) {
+    ln.sink.write = s_write;
+    ln.sink.flush = NULL;
+    ln.sink.reserve = NULL;
+    ln.self = this;
+  }
+  iter_sink(const iter_sink &) = delete;
+  iter_sink &operator=(const iter_sink &) = delete;
+
+  maze_sink_t *sink() { return &ln.sink; }
+
+  static int s_write(maze_sink_t *sp, const void *data, std::size_t len) {
+    iter_sink *is = reinterpret_cast<link *>(sp)->self;
+
+    put(is->out, static_cast<const char *>(data), len);
+    return 1;
+  }
+};
+
+inline bool emit(view v, format f, maze_sink_t *sp, unsigned int h_res,
+                 unsigned int v_res) {
+  switch (f) {
+    case TEXT:
+      return maze_emit_text(v.get(), sp, h_res, v_res) != 0;
+    case EPS:
+      return maze_emit_eps(v.get(), sp, h_res, v_res) != 0;
+    case PNG:
+      return maze_emit_png(v.get(), sp, h_res, v_res) != 0;
+    case STORE:
+      return maze_emit_store(v.get(), sp) != 0;
+    case CSR:
+    case CSR_EDGES:
+      return maze_emit_csr(v.get(), sp, f == CSR_EDGES) != 0;
+    case GRID:
+    case GRID_BITS:
+      return maze_emit_grid(v.get(), sp, f == GRID_BITS) != 0;
+  }
+  return false;
+}
+
+}  // namespace detail
+
+/** Write a maze to an output iterator over char, for example a
+    std::back_inserter() on a std::string, returning the iterator past
+    the output.  The area is used as by the C writers.  A pointer has
+    no end to stop at, so it is refused; use write_to() to fill a
+    buffer.  Throws std::runtime_error if the writer fails. */
+template <class OutIt>
+OutIt write(view v, format f, OutIt out, unsigned int h_res = 612,
+            unsigned int v_res = 612) {
+  static_assert(!std::is_pointer<OutIt>::value,
+                "maze::write() to a pointer is unbounded; use write_to()");
+  detail::iter_sink<OutIt> is(out);
+
+  if (!detail::emit(v, f, is.sink(), h_res, v_res))
+    throw std::runtime_error("maze writer failed");
+  return is.out;
+}
+
+/** Write a maze into a buffer of cap bytes, where the writers put it
+    directly.  Returns the length of the output, or 0 if it does not
+    fit or the writer fails. */
+inline std::size_t write_to(view v, format f, char *buf, std::size_t cap,
+                            unsigned int h_res = 612,
+                            unsigned int v_res = 612) {
+  maze_buf_sink_t bs;
+
+  return detail::emit(v, f, maze_buf_sink(&bs, buf, cap), h_res, v_res)
+             ? bs.len
+             : 0;
+}
+
+/** Write a maze to a stdio stream.  Throws std::runtime_error if the
+    writer fails. */
+inline void write(view v, format f, FILE *ofp, unsigned int h_res = 612,
+                  unsigned int v_res = 612) {
+  maze_file_sink_t fs;
+
+  if (!detail::emit(v, f, maze_file_sink(&fs, ofp), h_res, v_res))
+    throw std::runtime_error("maze writer failed");
+}
+
+}  // namespace maze
+
+#endif /* end MAZE_HPP_ */
@@ -0,0 +1,495 @@
+/*
+  Name:     mazebatch.c
+  Purpose:  Generating many small mazes at once.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#include "mazebatch.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mazecpu.h"
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define BATCH_SSE2 1
+#endif
+
+/* The lanes of a batch are interleaved at a fixed stride, whatever
+   their number, so that indexing is by shifts. */
+#define STRIDE MAZE_BATCH_LANES
+
+/* Population count for adjacent cell values */
+static const unsigned char adj_pop[16] = {0, 1, 1, 2, 1, 2, 2, 3,
+                                          1, 2, 2, 3, 2, 3, 3, 4};
+
+/* adj_pick[adj][k] is the direction of the k-th set bit of adj, which
+   is the wall maze_generate() kicks down when it skips k of them. */
+static const unsigned char adj_pick[16][4] = {
+    {0, 0, 0, 0}, {0, 0, 0, 0}, {1, 0, 0, 0}, {0, 1, 0, 0},
+    {2, 0, 0, 0}, {0, 2, 0, 0}, {1, 2, 0, 0}, {0, 1, 2, 0},
+    {3, 0, 0, 0}, {0, 3, 0, 0}, {1, 3, 0, 0}, {0, 1, 3, 0},
+    {2, 3, 0, 0}, {0, 2, 3, 0}, {1, 2, 3, 0}, {0, 1, 2, 3}};
+
+/* s_xorshift(x)
+
+   Return the successor of x in the random sequence of a lane.
+ */
+
+static uint32_t s_xorshift(uint32_t x) {
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+/* s_next(*bp, *next)
+
+   Compute the next random value of every lane, without consuming it.
+   With SSE2, four lanes are advanced by each instruction.
+ */
+
+static void s_next(const maze_batch_t *bp, uint32_t *next) {
+  unsigned int l = 0;
+
+#ifdef BATCH_SSE2
+  for (; l < bp->lanes; l += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(bp->rng + l));
+
+    v = _mm_xor_si128(v, _mm_slli_epi32(v, 13));
+    v = _mm_xor_si128(v, _mm_srli_epi32(v, 17));
+    v = _mm_xor_si128(v, _mm_slli_epi32(v, 5));
+    _mm_storeu_si128((__m128i *)(next + l), v);
+  }
+#else
+  for (; l < bp->lanes; ++l) next[l] = s_xorshift(bp->rng[l]);
+#endif
+}
+
+/* s_scale(*bp, *u, k, *out)
+
+   Scale the random value of every lane to an integer below k, as
+   (rowcol_t)(u / 2^32 * k) would; the two agree exactly because k is
+   at most MAZE_BATCH_CELLS.  With SSE2, the high halves of the 64-bit
+   products are gathered two lanes at a time.
+ */
+
+static void s_scale(const maze_batch_t *bp, const uint32_t *u, rowcol_t k,
+                    uint32_t *out) {
+  unsigned int l = 0;
+
+#ifdef BATCH_SSE2
+  const __m128i kv = _mm_set1_epi32((int)k);
+  const __m128i odd = _mm_set_epi32(-1, 0, -1, 0);
+
+  for (; l < bp->lanes; l += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(u + l));
+    __m128i lo = _mm_srli_epi64(_mm_mul_epu32(v, kv), 32);
+    __m128i hi = _mm_mul_epu32(_mm_srli_epi64(v, 32), kv);
+
+    _mm_storeu_si128((__m128i *)(out + l),
+                     _mm_or_si128(lo, _mm_and_si128(hi, odd)));
+  }
+#else
+  for (; l < bp->lanes; ++l) out[l] = (uint32_t)(((uint64_t)u[l] * k) >> 32);
+#endif
+}
+
+/* s_find(*sets, x)
+
+   Find the path set of the cell at index x, halving the path as it
+   goes.  Indices are of the interleaved arrays, so each lane's sets
+   refer only to its own cells.
+ */
+
+static rowcol_t s_find(rowcol_t *sets, rowcol_t x) {
+  while (sets[x] != x) {
+    sets[x] = sets[sets[x]];
+    x = sets[x];
+  }
+  return x;
+}
+
+/* maze_batch_init(*bp, lanes, nr, nc)
+
+   The border table is shared by every lane, since the mazes are all
+   the same size; it replaces the division into row and column that
+   maze_generate() does for each cell.
+ */
+
+int maze_batch_init(maze_batch_t *bp, unsigned int lanes, rowcol_t nr,
+                    rowcol_t nc) {
+  rowcol_t n_cells, pos;
+  unsigned int l;
+
+  if (lanes == 0 || lanes > MAZE_BATCH_LANES) {
+    fprintf(stderr, "maze_batch_init:  a batch has 1 to %u lanes\n",
+            MAZE_BATCH_LANES);
+    return 0;
+  }
+  if (nr == 0 || nc == 0 || nr > MAZE_BATCH_CELLS / nc) {
+    fprintf(stderr, "maze_batch_init:  mazes must have 1 to %u cells\n",
+            MAZE_BATCH_CELLS);
+    return 0;
+  }
+  n_cells = nr * nc;
+
+  bp->lanes = lanes;
+  bp->n_rows = nr;
+  bp->n_cols = nc;
+  bp->cells = malloc((size_t)n_cells * STRIDE * sizeof(*bp->cells));
+  bp->sets = malloc((size_t)n_cells * STRIDE * sizeof(*bp->sets));
+  bp->queue = malloc((size_t)n_cells * STRIDE * sizeof(*bp->queue));
+  bp->border = malloc(n_cells);
+  if (bp->cells == NULL || bp->sets == NULL || bp->queue == NULL ||
+      bp->border == NULL) {
+    maze_batch_clear(bp);
+    return 0;
+  }
+
+  for (pos = 0; pos < n_cells; ++pos) {
+    rowcol_t r = pos / nc, c = pos % nc;
+
+    bp->border[pos] = ((r > 0) << DIR_U) | ((c < nc - 1) << DIR_R) |
+                      ((r < nr - 1) << DIR_D) | ((c > 0) << DIR_L);
+  }
+  for (l = 0; l < MAZE_BATCH_LANES; ++l) maze_batch_seed(bp, l, l);
+
+  return 1;
+}
+
+/* maze_batch_seed(*bp, lane, seed)
+
+   Scramble the seed with the MurmurHash3 finalizer, so that nearby
+   seeds give unrelated sequences.  Zero is a fixed point of xorshift,
+   so it is avoided.
+ */
+
+void maze_batch_seed(maze_batch_t *bp, unsigned int lane, unsigned long seed) {
+  uint32_t x = (uint32_t)seed ^ (uint32_t)(seed >> 16 >> 16);
+
+  x += 0x9e3779b9U;
+  x = (x ^ (x >> 16)) * 0x85ebca6bU;
+  x = (x ^ (x >> 13)) * 0xc2b2ae35U;
+  x ^= x >> 16;
+  bp->rng[lane] = x ? x : 0x6d2b79f5U;
+}
+
+/* maze_batch_generate(*bp)
+
+   This runs the algorithm of maze_gen_step() in every lane at once.
+   The lanes stay in step because the mazes are the same size: every
+   shuffle exchanges the same queue positions in all of them, drawing
+   one number per lane, and every scan examines the same queue
+   position in all of them.  Only a scan's draws depend on the lane,
+   so the next number of every lane is computed for each position and
+   consumed by the lanes that need it.  A lane whose maze is finished
+   sits out the remaining passes.
+
+   The queues and path sets hold indices of the interleaved arrays
+   rather than cell positions, so that neighbours are found by adding
+   a fixed step, and a cell's position is its index divided by STRIDE.
+ */
+
+void maze_batch_generate(maze_batch_t *bp) {
+  const unsigned int lanes = bp->lanes;
+  const rowcol_t n_cells = bp->n_rows * bp->n_cols;
+  const rowcol_t up = bp->n_cols * STRIDE, n_idx = n_cells * STRIDE;
+  uint32_t next[MAZE_BATCH_LANES], exch[MAZE_BATCH_LANES];
+  rowcol_t count[MAZE_BATCH_LANES] = {0}, x, pos;
+  unsigned char done[MAZE_BATCH_LANES] = {0};
+  rowcol_t *const sets = bp->sets, *const queue = bp->queue;
+  maze_node *const cells = bp->cells;
+  unsigned int l, n_live = lanes;
+  maze_node def;
+
+  def.r_wall = 1;
+  def.b_wall = 1;
+  def.marker = DIR_U;
+  def.visit = 0;
+
+  for (x = 0; x < n_idx; ++x) {
+    cells[x] = def;
+    sets[x] = queue[x] = x;
+  }
+
+  while (n_live > 0) {
+    /* Reshuffle the queues */
+    for (pos = n_cells - 1; pos > 0; --pos) {
+      rowcol_t *row = queue + pos * STRIDE;
+
+      s_next(bp, next);
+      s_scale(bp, next, pos + 1, exch);
+      for (l = 0; l < lanes; ++l) {
+        rowcol_t t, *other = queue + exch[l] * STRIDE + l;
+
+        if (done[l]) continue;
+        bp->rng[l] = next[l];
+        t = row[l];
+        row[l] = *other;
+        *other = t;
+      }
+    }
+
+    /* Scan the queues */
+    for (pos = 0; pos < n_cells; ++pos) {
+      const rowcol_t *row = queue + pos * STRIDE;
+
+      s_next(bp, next);
+      for (l = 0; l < lanes; ++l) {
+        rowcol_t root[4], set, cur = row[l];
+        unsigned int bd = bp->border[cur / STRIDE], adj, skip;
+
+        if (done[l]) continue;
+
+        /* A missing neighbour counts as being in the same set */
+        set = s_find(sets, cur);
+        root[DIR_U] = (bd & (1 << DIR_U)) ? s_find(sets, cur - up) : set;
+        root[DIR_R] = (bd & (1 << DIR_R)) ? s_find(sets, cur + STRIDE) : set;
+        root[DIR_D] = (bd & (1 << DIR_D)) ? s_find(sets, cur + up) : set;
+        root[DIR_L] = (bd & (1 << DIR_L)) ? s_find(sets, cur - STRIDE) : set;
+        adj = ((root[DIR_U] != set) << DIR_U) |
+              ((root[DIR_R] != set) << DIR_R) |
+              ((root[DIR_D] != set) << DIR_D) |
+              ((root[DIR_L] != set) << DIR_L);
+
+        if (adj == 0) {
+          ++count[l];
+          continue;
+        }
+        /* Only a choice among several walls consumes a number */
+        skip = (unsigned int)(((uint64_t)next[l] * adj_pop[adj]) >> 32);
+        if (adj_pop[adj] > 1) bp->rng[l] = next[l];
+
+        switch (adj_pick[adj][skip]) {
+          case DIR_U:
+            cells[cur - up].b_wall = 0;
+            sets[root[DIR_U]] = set;
+            break;
+          case DIR_R:
+            cells[cur].r_wall = 0;
+            sets[root[DIR_R]] = set;
+            break;
+          case DIR_D:
+            cells[cur].b_wall = 0;
+            sets[root[DIR_D]] = set;
+            break;
+          default:
+            cells[cur - STRIDE].r_wall = 0;
+            sets[root[DIR_L]] = set;
+            break;
+        }
+      }
+    }
+
+    for (l = 0; l < lanes; ++l) {
+      if (!done[l] && count[l] >= n_cells) {
+        done[l] = 1;
+        --n_live;
+      }
+    }
+  }
+}
+
+/* maze_batch_get(*bp, lane, *mp)
+
+   Copy one lane's cells out of the batch.
+ */
+
+int maze_batch_get(const maze_batch_t *bp, unsigned int lane, maze_t *mp) {
+  rowcol_t n_cells = bp->n_rows * bp->n_cols, pos;
+  const maze_node *src = bp->cells + lane;
+
+  if (lane >= bp->lanes || mp->n_rows != bp->n_rows ||
+      mp->n_cols != bp->n_cols)
+    return 0;
+
+  for (pos = 0; pos < n_cells; ++pos) mp->cells[pos] = src[pos * STRIDE];
+  return 1;
+}
+
+/* maze_batch_clear(*bp)
+
+   Release the storage used by a batch.
+ */
+
+void maze_batch_clear(maze_batch_t *bp) {
+  free(bp->cells);
+  free(bp->sets);
+  free(bp->queue);
+  free(bp->border);
+  bp->cells = NULL;
+  bp->sets = bp->queue = NULL;
+  bp->border = NULL;
+}
+
+/* maze_batch_draw(*state)
+
+   Advance a random state and return it scaled to [0, 1).
+ */
+
+double maze_batch_draw(unsigned int *state) {
+  *state = s_xorshift(*state);
+  return *state / 4294967296.0;
+}
+
+/* A solver's planes are each a guard row of zeros, n_rows rows of
+   STRIDE words, and another guard row, so that the rows above and
+   below any row can be read without tests. */
+#define PLANE_RIGHT 0 /* Cell is open to the right */
+#define PLANE_DOWN 1  /* Cell is open below        */
+#define PLANE_REACH 2 /* Two planes of cells reached, alternately */
+#define N_PLANES 4
+
+/* s_plane(*sp, k, r)
+
+   Return the words of row r of plane k, with r from -1 to n_rows.
+ */
+
+static unsigned long long *s_plane(const maze_solver_t *sp, int k, long r) {
+  return sp->planes + ((size_t)k * (sp->n_rows + 2) + r + 1) * STRIDE;
+}
+
+/* maze_solve_init(*sp, lanes, nr, nc)
+
+   Allocate the planes, all zero.
+ */
+
+int maze_solve_init(maze_solver_t *sp, unsigned int lanes, rowcol_t nr,
+                    rowcol_t nc) {
+  if (lanes == 0 || lanes > MAZE_BATCH_LANES) {
+    fprintf(stderr, "maze_solve_init:  a batch has 1 to %u lanes\n",
+            MAZE_BATCH_LANES);
+    return 0;
+  }
+  if (nr == 0 || nc == 0 || nc > MAZE_SOLVE_COLS ||
+      nr > MAZE_BATCH_CELLS / nc) {
+    fprintf(stderr,
+            "maze_solve_init:  mazes must have 1 to %u columns "
+            "and at most %u cells\n",
+            MAZE_SOLVE_COLS, MAZE_BATCH_CELLS);
+    return 0;
+  }
+
+  sp->lanes = lanes;
+  sp->n_rows = nr;
+  sp->n_cols = nc;
+  sp->planes = calloc((size_t)N_PLANES * (nr + 2) * STRIDE,
+                      sizeof(*sp->planes));
+  return sp->planes != NULL;
+}
+
+/* maze_solve_load(*sp, lane, *mp)
+
+   Walls on the outside of the maze are treated as closed whatever the
+   cells say, as they are by maze_find_path().
+ */
+
+int maze_solve_load(maze_solver_t *sp, unsigned int lane, const maze_t *mp) {
+  const maze_kernels_t *kp = maze_kernels();
+  unsigned long long inner, all, right, below;
+  rowcol_t r;
+
+  if (lane >= sp->lanes || mp->n_rows != sp->n_rows ||
+      mp->n_cols != sp->n_cols)
+    return 0;
+
+  /* All the columns but the last */
+  inner = (sp->n_cols == MAZE_SOLVE_COLS) ? ~0ULL >> 1
+                                          : (1ULL << (sp->n_cols - 1)) - 1;
+  all = inner | (1ULL << (sp->n_cols - 1));
+
+  for (r = 0; r < sp->n_rows; ++r) {
+    right = kp->walls(CELLP(mp, r, 0), sp->n_cols, &below);
+    s_plane(sp, PLANE_RIGHT, r)[lane] = ~right & inner;
+    s_plane(sp, PLANE_DOWN, r)[lane] = (r < sp->n_rows - 1) ? ~below & all : 0;
+  }
+  return 1;
+}
+
+/* maze_solve_run(*sp, sr, sc, er, ec, *length)
+
+   Each step can reach at most one row further up and down, so only the
+   band of rows from the start out to the step count is worked on; the
+   rows outside it stay empty in both reach planes.  A lane is done
+   when its end is reached, or when a step reaches nothing new.
+ */
+
+unsigned int maze_solve_run(maze_solver_t *sp, rowcol_t sr, rowcol_t sc,
+                            rowcol_t er, rowcol_t ec, rowcol_t *length) {
+  unsigned long long *cur = s_plane(sp, PLANE_REACH, 0);
+  unsigned long long *nxt = s_plane(sp, PLANE_REACH + 1, 0), *tmp;
+  const unsigned long long *right = s_plane(sp, PLANE_RIGHT, 0);
+  const unsigned long long *down = s_plane(sp, PLANE_DOWN, 0);
+  unsigned long long diff[MAZE_BATCH_LANES], goal = 1ULL << ec;
+  unsigned char done[MAZE_BATCH_LANES] = {0};
+  unsigned int l, n_live = sp->lanes, n_found = 0;
+  long lo = sr, hi = sr;
+  rowcol_t step;
+
+  memset(s_plane(sp, PLANE_REACH, -1), 0,
+         2 * (sp->n_rows + 2) * STRIDE * sizeof(*sp->planes));
+  for (l = 0; l < sp->lanes; ++l) cur[sr * STRIDE + l] = 1ULL << sc;
+
+  for (step = 1; n_live > 0; ++step) {
+    for (l = 0; l < sp->lanes; ++l) {
+      if (done[l]) continue;
+      if (cur[er * STRIDE + l] & goal) {
+        length[l] = step;
+        ++n_found;
+      } else if (step > 1 && diff[l] == 0) {
+        length[l] = 0;
+      } else {
+        continue;
+      }
+      done[l] = 1;
+      --n_live;
+    }
+    if (n_live == 0) break;
+
+    if (lo > 0) --lo;
+    if (hi < (long)sp->n_rows - 1) ++hi;
+    maze_kernels()->spread(cur + lo * STRIDE, right + lo * STRIDE,
+                           down + lo * STRIDE, nxt + lo * STRIDE, STRIDE,
+                           hi - lo + 1, sp->lanes, diff);
+    tmp = cur;
+    cur = nxt;
+    nxt = tmp;
+  }
+  return n_found;
+}
+
+/* maze_solve_clear(*sp)
+
+   Release the storage used by a solver.
+ */
+
+void maze_solve_clear(maze_solver_t *sp) {
+  free(sp->planes);
+  sp->planes = NULL;
+}
+
+/* Here there be dragons */
@@ -0,0 +1,151 @@
+/*
+  Name:     mazebatch.h
+  Purpose:  Generating many small mazes at once.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#ifndef MAZEBATCH_H_
+#define MAZEBATCH_H_
+
+#include "maze.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A batch generates up to MAZE_BATCH_LANES mazes of the same size at
+   once, one in each lane.  The cells, path sets, and queues of all the
+   lanes are interleaved, so that the lanes advance through the same
+   steps of the algorithm together: the random numbers for every lane
+   are drawn with vector instructions, and the per-maze costs of
+   allocation and setup are paid once for the whole batch.
+
+   Each lane has its own random generator, a 32-bit xorshift whose
+   value u is used as u / 2^32.  Lane l of a batch produces exactly the
+   maze maze_generate() would, given maze_batch_draw() on the same
+   state as its random generator. */
+
+#define MAZE_BATCH_LANES 16         /* Most mazes in one batch      */
+#define MAZE_BATCH_CELLS (1U << 20) /* Most cells in each maze      */
+
+/** A batch of mazes being generated together; see maze_batch_init().
+    The random state of each lane may be read or set directly. */
+typedef struct {
+  unsigned int lanes; /* Number of mazes in the batch */
+  rowcol_t n_rows;
+  rowcol_t n_cols;
+  unsigned int rng[MAZE_BATCH_LANES]; /* Random state of each lane */
+  maze_node *cells;      /* Lanes interleaved MAZE_BATCH_LANES apart */
+  rowcol_t *sets;        /* Path sets, interleaved the same way      */
+  rowcol_t *queue;       /* Queues, interleaved the same way         */
+  unsigned char *border; /* Directions each cell has neighbours in   */
+} maze_batch_t;
+
+/** Set up a batch of mazes of the given size.  Each lane is seeded
+    with its own number.  Returns false with a diagnostic if the size is
+    out of range, or if memory is exhausted.
+
+    @param bp      Pointer to an uninitialized batch.
+    @param lanes   Number of mazes, 1 to MAZE_BATCH_LANES.
+    @param nr      Number of rows in each maze.
+    @param nc      Number of columns in each maze.
+ */
+int maze_batch_init(maze_batch_t *bp, unsigned int lanes, rowcol_t nr,
+                    rowcol_t nc);
+
+/** Seed the random generator of one lane of a batch. */
+void maze_batch_seed(maze_batch_t *bp, unsigned int lane, unsigned long seed);
+
+/** Generate a new maze in every lane of a batch, continuing from the
+    current state of each lane's random generator. */
+void maze_batch_generate(maze_batch_t *bp);
+
+/** Copy the maze in one lane of a batch into mp, which must have been
+    set up by maze_init() with the same size as the batch; its cells
+    are overwritten, so the same maze can be reused for every lane.
+    Returns false if the sizes do not match.
+ */
+int maze_batch_get(const maze_batch_t *bp, unsigned int lane, maze_t *mp);
+
+/** Release the storage used by a batch. */
+void maze_batch_clear(maze_batch_t *bp);
+
+/** Advance a lane's random generator as the batch does, and return
+    its new value as a double in [0, 1).  With the state held in a
+    variable, this serves as the rand_f for maze_generate().
+ */
+double maze_batch_draw(unsigned int *state);
+
+/* A solver finds the shortest path through up to MAZE_BATCH_LANES
+   mazes of the same size at once, from the same start to the same
+   end in each.  Each maze is held as bit planes, one 64-bit word per
+   row: which cells are open to the right, which are open below, and
+   which have been reached.  A breadth-first search then advances by
+   one step in every direction for a whole row of every maze with a
+   few shifts and masks, up to eight mazes to a vector register (see
+   mazecpu.h), so the number of steps is the length of the shortest
+   path. */
+
+#define MAZE_SOLVE_COLS 64 /* Most columns in a batch solve */
+
+/** A batch of mazes held for solving; see maze_solve_init(). */
+typedef struct {
+  unsigned int lanes; /* Number of mazes in the batch */
+  rowcol_t n_rows;
+  rowcol_t n_cols;
+  unsigned long long *planes; /* Bit planes, lanes interleaved */
+} maze_solver_t;
+
+/** Set up a solver for mazes of the given size, which may have at most
+    MAZE_SOLVE_COLS columns and MAZE_BATCH_CELLS cells.  Every lane
+    starts out as a maze with no open walls.  Returns false with a
+    diagnostic if the size is out of range, or if memory is exhausted.
+
+    @param sp      Pointer to an uninitialized solver.
+    @param lanes   Number of mazes, 1 to MAZE_BATCH_LANES.
+    @param nr      Number of rows in each maze.
+    @param nc      Number of columns in each maze.
+ */
+int maze_solve_init(maze_solver_t *sp, unsigned int lanes, rowcol_t nr,
+                    rowcol_t nc);
+
+/** Load the walls of a maze into one lane of a solver.  The maze need
+    not be perfect.  Returns false if the sizes do not match. */
+int maze_solve_load(maze_solver_t *sp, unsigned int lane, const maze_t *mp);
+
+/** Find the shortest path from (sr, sc) to (er, ec) in every lane of a
+    solver, and store its length in cells in length[lane], or zero if
+    the end cannot be reached.  Returns the number of lanes in which
+    it can.  The mazes are not marked.
+ */
+unsigned int maze_solve_run(maze_solver_t *sp, rowcol_t sr, rowcol_t sc,
+                            rowcol_t er, rowcol_t ec, rowcol_t *length);
+
+/** Release the storage used by a solver. */
+void maze_solve_clear(maze_solver_t *sp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end MAZEBATCH_H_ */
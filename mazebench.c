@@ -0,0 +1,3861 @@
+/*
+    Name:    mazebench.c
+    Purpose: Benchmark driver for the maze generation library.
+    Author:  M. J. Fromberger <http://github.com/creachadair>
+
+    Copyright (C) 1998, 2004 M. J. Fromberger, All Rights Reserved
+
+    Permission is hereby granted, free of charge, to any person obtaining a
+    copy of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom the
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+    DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h> /* for getopt() */
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "gd.h"
+#include "maze.h"
+#include "mazebatch.h"
+#include "mazecpu.h"
+#include "mazediff.h"
+#include "mazefb.h"
+#include "mazehash.h"
+#include "mazepack.h"
+#include "mazeplan.h"
+#include "mazeshard.h"
+#include "mazeshm.h"
+#include "mazesnap.h"
+#include "mazeview.h"
+
+typedef struct {
+  unsigned int x;
+  unsigned int y;
+} dims_t;
+
+/* Hardware event counters sampled around each benchmark.  The order
+   here is the order in which they are reported. */
+enum { CTR_CYCLES, CTR_INSNS, CTR_L1_MISS, CTR_LLC_MISS, CTR_BR_MISS, N_CTRS };
+
+static const char *ctr_names[N_CTRS] = {"cycles", "insns", "L1d-miss",
+                                        "LLC-miss", "br-miss"};
+
+/* Descriptors for the open counters; -1 means unavailable. */
+static int ctr_fd[N_CTRS] = {-1, -1, -1, -1, -1};
+
+/* One measurement of a single benchmark run. */
+typedef struct {
+  double nsec;
+  double ctr[N_CTRS]; /* negative if the counter was unavailable */
+} sample_t;
+
+/* The operations measured, in the order they are run. */
+enum {
+  B_GENERATE,
+  B_SOLVE,
+  B_TEXT,
+  B_EPS,
+  B_PNG,
+  B_STORE,
+  B_CSR,
+  B_GRID,
+  B_HASH,
+  B_GEN_BLOCKED,
+  B_GEN_TREE,
+  N_BENCH
+};
+
+static const char *bench_names[N_BENCH] = {
+    "generate", "solve", "write_text", "write_eps", "write_png", "store",
+    "write_csr", "write_grid", "hash", "gen_blocked", "gen_tree"};
+
+/* Summary statistics for one benchmark over all runs, per cell. */
+typedef struct {
+  double med;         /* median time, ns per cell */
+  double mad;         /* median absolute deviation of time */
+  double ctr[N_CTRS]; /* median counter values; negative if missing */
+} result_t;
+
+/* parse_dims(*str, *out)
+
+   Parse a string of dimensions in the form A x B, with whitespace
+   allowed.  Returns true if the parse was successful, otherwise
+   false indicating a syntax error.
+ */
+
+static int parse_dims(const char *str, dims_t *out) {
+  char *divider = strchr(str, 'x');
+  unsigned long v;
+
+  if (divider == NULL) return 0;
+
+  if ((v = strtoul(str, NULL, 10)) == ULONG_MAX || (v == 0 && errno == EINVAL))
+    return 0;
+
+  out->x = (unsigned int)v;
+
+  if ((v = strtoul(divider + 1, NULL, 10)) == ULONG_MAX ||
+      (v == 0 && errno == EINVAL))
+    return 0;
+
+  out->y = (unsigned int)v;
+
+  return 1;
+}
+
+/* randomizer()
+
+   Return a pseudo-random double precision value in the half-open
+   interval [0, 1).
+ */
+
+static double randomizer(void) {
+  static const double w = (double)INT_MAX + 1.0;
+  double v = random();
+
+  return v / w;
+}
+
+/* now_nsec()
+
+   Return the value of the monotonic clock in nanoseconds.
+ */
+
+static double now_nsec(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* ctr_open()
+
+   Open whichever hardware counters the kernel will give us.  Each
+   counter is opened on its own rather than as a group, so that one
+   unsupported event (common on virtual machines) does not cost us
+   the others.  Returns the number of counters opened.
+ */
+
+static int ctr_open(void) {
+#ifdef __linux__
+  static const struct {
+    unsigned int type;
+    unsigned long long config;
+  } events[N_CTRS] = {
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HW_CACHE,
+       PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  };
+  int i, n_open = 0;
+
+  for (i = 0; i < N_CTRS; ++i) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    ctr_fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (ctr_fd[i] >= 0) ++n_open;
+  }
+  return n_open;
+#else
+  return 0;
+#endif
+}
+
+/* ctr_close()
+
+   Release any counters opened by ctr_open().
+ */
+
+static void ctr_close(void) {
+  int i;
+
+  for (i = 0; i < N_CTRS; ++i) {
+    if (ctr_fd[i] >= 0) close(ctr_fd[i]);
+    ctr_fd[i] = -1;
+  }
+}
+
+/* ctr_start()
+
+   Zero and enable all open counters.
+ */
+
+static void ctr_start(void) {
+#ifdef __linux__
+  int i;
+
+  for (i = 0; i < N_CTRS; ++i) {
+    if (ctr_fd[i] < 0) continue;
+    ioctl(ctr_fd[i], PERF_EVENT_IOC_RESET, 0);
+    ioctl(ctr_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+#endif
+}
+
+/* ctr_stop(*out)
+
+   Disable all open counters and record their values in out.
+   Counters which are not available are recorded as -1.
+ */
+
+static void ctr_stop(sample_t *out) {
+  int i;
+
+  for (i = 0; i < N_CTRS; ++i) {
+    unsigned long long v;
+
+    out->ctr[i] = -1.0;
+    if (ctr_fd[i] < 0) continue;
+#ifdef __linux__
+    ioctl(ctr_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    if (read(ctr_fd[i], &v, sizeof(v)) == sizeof(v)) out->ctr[i] = (double)v;
+  }
+}
+
+/* cmp_double(*a, *b)
+
+   Comparison function for sorting doubles with qsort().
+ */
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* median(*v, n)
+
+   Return the median of the n values in v, reordering v as a side
+   effect.  Returns a negative value if any input is negative, which
+   is how missing counter readings are represented.
+ */
+
+static double median(double *v, int n) {
+  int i;
+
+  for (i = 0; i < n; ++i)
+    if (v[i] < 0) return -1.0;
+
+  qsort(v, n, sizeof(*v), cmp_double);
+  if (n % 2) return v[n / 2];
+
+  return (v[n / 2 - 1] + v[n / 2]) / 2.0;
+}
+
+/* summarize(*samples, n_runs, n_cells, *out)
+
+   Reduce the samples of one benchmark to medians per cell.  The
+   spread of the timings is recorded as the median absolute
+   deviation, which unlike the standard deviation is not thrown off
+   by the occasional run that gets descheduled.
+ */
+
+static int summarize(const sample_t *samples, int n_runs, double n_cells,
+                     result_t *out) {
+  double *tmp = malloc(n_runs * sizeof(double));
+  int i, k;
+
+  if (tmp == NULL) return 0;
+
+  for (i = 0; i < n_runs; ++i) tmp[i] = samples[i].nsec / n_cells;
+  out->med = median(tmp, n_runs);
+
+  for (i = 0; i < n_runs; ++i) {
+    tmp[i] = samples[i].nsec / n_cells - out->med;
+    if (tmp[i] < 0) tmp[i] = -tmp[i];
+  }
+  out->mad = median(tmp, n_runs);
+
+  for (k = 0; k < N_CTRS; ++k) {
+    for (i = 0; i < n_runs; ++i) tmp[i] = samples[i].ctr[k];
+    out->ctr[k] = median(tmp, n_runs);
+    if (out->ctr[k] >= 0) out->ctr[k] /= n_cells;
+  }
+
+  free(tmp);
+  return 1;
+}
+
+/* write_json(*ofp, *cells, seed, n_runs, *res)
+
+   Write benchmark results in the JSON format read back by
+   load_baseline().  Missing counters are written as null.
+ */
+
+static void write_json(FILE *ofp, const dims_t *cells, unsigned long seed,
+                       int n_runs, const result_t *res) {
+  int b, k;
+
+  fprintf(ofp,
+          "{\n"
+          "  \"dims\": \"%ux%u\",\n"
+          "  \"seed\": %lu,\n"
+          "  \"runs\": %d,\n"
+          "  \"kernels\": \"%s\",\n"
+          "  \"benchmarks\": [\n",
+          cells->x, cells->y, seed, n_runs, maze_cpu_name(maze_cpu_isa()));
+
+  for (b = 0; b < N_BENCH; ++b) {
+    fprintf(ofp,
+            "    {\"name\": \"%s\", \"median_ns_per_cell\": %.6f, "
+            "\"mad_ns_per_cell\": %.6f",
+            bench_names[b], res[b].med, res[b].mad);
+
+    for (k = 0; k < N_CTRS; ++k) {
+      if (res[b].ctr[k] < 0)
+        fprintf(ofp, ", \"%s\": null", ctr_names[k]);
+      else
+        fprintf(ofp, ", \"%s\": %.6f", ctr_names[k], res[b].ctr[k]);
+    }
+    fprintf(ofp, "}%s\n", (b + 1 < N_BENCH) ? "," : "");
+  }
+  fputs("  ]\n}\n", ofp);
+}
+
+/* json_number(*obj, *key, *out)
+
+   Find "key": NUMBER within the text at obj, stopping at the end of
+   the enclosing object.  Returns true if the key was found with a
+   numeric value.
+ */
+
+static int json_number(const char *obj, const char *key, double *out) {
+  const char *end = strchr(obj, '}');
+  char pat[64];
+  const char *p;
+  char *tail;
+
+  snprintf(pat, sizeof(pat), "\"%s\":", key);
+  if ((p = strstr(obj, pat)) == NULL || (end != NULL && p > end)) return 0;
+
+  *out = strtod(p + strlen(pat), &tail);
+  return tail != p + strlen(pat);
+}
+
+/* load_baseline(*path, *cells, *base)
+
+   Read a baseline written by write_json() into base.  Benchmarks
+   missing from the baseline have their median set negative.  The
+   dimensions recorded in the baseline must match cells, since
+   per-cell costs are not comparable across sizes.  Returns false
+   with a diagnostic on error.
+ */
+
+static int load_baseline(const char *path, const dims_t *cells,
+                         result_t *base) {
+  FILE *ifp;
+  char *text, *p, pat[64];
+  long len;
+  dims_t dims;
+  int b;
+
+  if ((ifp = fopen(path, "rb")) == NULL) {
+    fprintf(stderr,
+            "Error:  Unable to open baseline file '%s'\n"
+            "  -- %s\n\n",
+            path, strerror(errno));
+    return 0;
+  }
+
+  fseek(ifp, 0, SEEK_END);
+  len = ftell(ifp);
+  rewind(ifp);
+  if (len < 0 || (text = malloc(len + 1)) == NULL) {
+    fclose(ifp);
+    return 0;
+  }
+  len = (long)fread(text, 1, len, ifp);
+  text[len] = '\0';
+  fclose(ifp);
+
+  if ((p = strstr(text, "\"dims\":")) == NULL ||
+      (p = strchr(p + 7, '"')) == NULL || !parse_dims(p + 1, &dims)) {
+    fprintf(stderr, "Error:  Baseline '%s' has no dimensions\n\n", path);
+    free(text);
+    return 0;
+  }
+  if (dims.x != cells->x || dims.y != cells->y) {
+    fprintf(stderr,
+            "Error:  Baseline '%s' was recorded at %ux%u\n"
+            "  -- rerun with -d %ux%u or record a new baseline\n\n",
+            path, dims.x, dims.y, dims.x, dims.y);
+    free(text);
+    return 0;
+  }
+
+  /* Kernels for another instruction set are not a regression, but say
+     so; baselines from before kernels were recorded are taken as is */
+  snprintf(pat, sizeof(pat), "\"kernels\": \"%s\"",
+           maze_cpu_name(maze_cpu_isa()));
+  if ((p = strstr(text, "\"kernels\": \"")) != NULL &&
+      strncmp(p, pat, strlen(pat)) != 0) {
+    p += strlen("\"kernels\": \"");
+    fprintf(stderr,
+            "Note:  Baseline '%s' was recorded with %.*s kernels\n"
+            "  -- set MAZE_ISA=%.*s to compare like with like\n\n",
+            path, (int)strcspn(p, "\""), p, (int)strcspn(p, "\""), p);
+  }
+
+  for (b = 0; b < N_BENCH; ++b) {
+    base[b].med = base[b].mad = -1.0;
+
+    snprintf(pat, sizeof(pat), "\"name\": \"%s\"", bench_names[b]);
+    if ((p = strstr(text, pat)) == NULL) continue;
+
+    if (!json_number(p, "median_ns_per_cell", &base[b].med) ||
+        !json_number(p, "mad_ns_per_cell", &base[b].mad))
+      base[b].med = -1.0;
+  }
+
+  free(text);
+  return 1;
+}
+
+/* check_baseline(*res, *base, thresh, z_score)
+
+   Compare results against a baseline and print a verdict for each
+   benchmark.  A benchmark fails only if its median got slower by
+   more than the relative threshold, and the slowdown is also larger
+   than z_score times the combined noise of the two runs (estimated
+   from their median absolute deviations).  A slowdown past the
+   threshold that does not clear the noise is reported as NOISY but
+   does not fail.  Returns the number of failures.
+ */
+
+static int check_baseline(const result_t *res, const result_t *base,
+                          double thresh, double z_score) {
+  static const double mad_sigma = 1.4826; /* MAD to std. dev., normal */
+  int b, n_fail = 0;
+
+  printf("\n%-12s %12s %12s %8s  %s\n", "benchmark", "base ns/cell",
+         "ns/cell", "change", "verdict");
+
+  for (b = 0; b < N_BENCH; ++b) {
+    double delta, noise;
+    const char *verdict;
+
+    if (base[b].med <= 0) {
+      printf("%-12s %12s %12.3f %8s  %s\n", bench_names[b], "-", res[b].med,
+             "-", "SKIP");
+      continue;
+    }
+
+    delta = res[b].med - base[b].med;
+    noise = z_score * mad_sigma * (res[b].mad + base[b].mad);
+
+    if (delta <= thresh * base[b].med)
+      verdict = "PASS";
+    else if (delta <= noise)
+      verdict = "NOISY";
+    else {
+      verdict = "FAIL";
+      ++n_fail;
+    }
+
+    printf("%-12s %12.3f %12.3f %+7.1f%%  %s\n", bench_names[b], base[b].med,
+           res[b].med, 100.0 * delta / base[b].med, verdict);
+  }
+
+  printf("\n%s: %d of %d benchmarks regressed beyond %.1f%%\n",
+         n_fail ? "FAIL" : "PASS", n_fail, N_BENCH, 100.0 * thresh);
+  return n_fail;
+}
+
+/* run_once(*mp, which, *null_fp, *out)
+
+   Run a single benchmark against the maze, recording time and
+   counter values in out.  The maze must already be generated for
+   everything except the generators.
+ */
+
+static int run_once(maze_t *mp, int which, FILE *null_fp, sample_t *out) {
+  unsigned long long hash[2];
+  double start;
+  int ok = 1;
+
+  ctr_start();
+  start = now_nsec();
+
+  switch (which) {
+    case B_GENERATE:
+      ok = maze_generate(mp, randomizer);
+      break;
+    case B_SOLVE:
+      maze_find_path(mp, 0, 0, mp->n_rows - 1, mp->n_cols - 1);
+      break;
+    case B_TEXT:
+      maze_write_text(mp, null_fp, 0, 0);
+      break;
+    case B_EPS:
+      maze_write_eps(mp, null_fp, 612, 612);
+      break;
+    case B_PNG:
+      maze_write_png(mp, null_fp, 612, 612);
+      break;
+    case B_STORE:
+      maze_store(mp, null_fp);
+      break;
+    case B_CSR:
+      ok = maze_write_csr(mp, null_fp, 0);
+      break;
+    case B_GRID:
+      ok = maze_write_grid(mp, null_fp, 0);
+      break;
+    case B_HASH:
+      maze_hash(mp, hash);
+      ok = (hash[0] | hash[1]) != 0;
+      break;
+    case B_GEN_BLOCKED:
+      ok = maze_generate_order(mp, randomizer, GEN_ORDER_BLOCKED);
+      break;
+    case B_GEN_TREE:
+      ok = maze_generate_tree(mp, randomizer, 0.5);
+      break;
+    default:
+      assert(0 &&
+             "Unknown benchmark code in switch(which) "
+             "of run_once(...)");
+      break;
+  }
+  fflush(null_fp);
+
+  out->nsec = now_nsec() - start;
+  ctr_stop(out);
+
+  return ok;
+}
+
+/* A single case for the differential checks: a maze of the given
+   size, generated from the given seed, with a pair of endpoints for
+   path finding. */
+typedef struct {
+  rowcol_t rows, cols;
+  unsigned long seed;
+  rowcol_t sr, sc, er, ec;
+} trial_t;
+
+/* A differential check runs a fast path and its reference on one
+   trial.  It returns 1 if they agree, 0 if not (describing the first
+   difference in why), or -1 if the trial could not be run. */
+typedef int (*check_f)(const trial_t *tp, char *why, size_t len);
+
+/* trial_maze(*tp, *mp)
+
+   Generate the maze for a trial exactly as mazegen would for the
+   same seed and dimensions.
+ */
+
+static int trial_maze(const trial_t *tp, maze_t *mp) {
+  if (!maze_init(mp, tp->rows, tp->cols)) return 0;
+
+  srandom(tp->seed);
+  if (!maze_generate(mp, randomizer)) {
+    maze_clear(mp);
+    return 0;
+  }
+  return 1;
+}
+
+/* cell_code(n)
+
+   Return the meaningful bits of a cell in the same encoding used by
+   maze_store().  Cells are compared this way rather than as raw
+   bytes because the unused bits of a maze_node are indeterminate.
+ */
+
+static unsigned int cell_code(maze_node n) {
+  return n.r_wall | (n.b_wall << 1) | (n.marker << 2) | (n.visit << 4);
+}
+
+/* diff_cells(*a, *b, *why, len)
+
+   Compare the cells of two mazes of the same size, describing the
+   first difference in why.  Returns true if they are identical.
+ */
+
+static int diff_cells(const maze_t *a, const maze_t *b, char *why,
+                      size_t len) {
+  rowcol_t pos, n_cells = a->n_rows * a->n_cols;
+
+  for (pos = 0; pos < n_cells; ++pos) {
+    if (cell_code(a->cells[pos]) != cell_code(b->cells[pos])) {
+      snprintf(why, len, "cell %ux%u differs ('%c' vs. '%c')",
+               pos / a->n_cols + 1, pos % a->n_cols + 1,
+               'a' + cell_code(a->cells[pos]), 'a' + cell_code(b->cells[pos]));
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* diff_bytes(*a, alen, *b, blen, *what, *why, len)
+
+   Compare two byte strings, describing the first difference in why.
+   Returns true if they are identical.
+ */
+
+static int diff_bytes(const void *a, size_t alen, const void *b, size_t blen,
+                      const char *what, char *why, size_t len) {
+  const unsigned char *pa = a, *pb = b;
+  size_t i;
+
+  for (i = 0; i < alen && i < blen; ++i) {
+    if (pa[i] != pb[i]) {
+      snprintf(why, len, "%s differ at byte %zu (0x%02x vs. 0x%02x)", what, i,
+               pa[i], pb[i]);
+      return 0;
+    }
+  }
+  if (alen != blen) {
+    snprintf(why, len, "%s differ in length (%zu vs. %zu)", what, alen, blen);
+    return 0;
+  }
+  return 1;
+}
+
+/* ref_path(*mp, sr, sc, er, ec, *on_path)
+
+   Reference path finder: breadth-first search from the start, then
+   walk the parent links back from the end, flagging every cell on
+   the route in on_path.  This shares no code with the library's
+   solver.  Returns false if the end is unreachable or memory runs
+   out.
+ */
+
+static int ref_path(const maze_t *mp, rowcol_t sr, rowcol_t sc, rowcol_t er,
+                    rowcol_t ec, unsigned char *on_path) {
+  rowcol_t n_cells = mp->n_rows * mp->n_cols;
+  rowcol_t *parent, *queue, head = 0, tail = 0, pos;
+  rowcol_t start = OFFSET(mp, sr, sc), goal = OFFSET(mp, er, ec);
+  int found = 0;
+
+  parent = malloc(n_cells * sizeof(*parent));
+  queue = malloc(n_cells * sizeof(*queue));
+  if (parent == NULL || queue == NULL) {
+    free(parent);
+    free(queue);
+    return 0;
+  }
+
+  for (pos = 0; pos < n_cells; ++pos) parent[pos] = n_cells;
+  parent[start] = start;
+  queue[tail++] = start;
+
+  while (head < tail) {
+    rowcol_t cur = queue[head++], r = cur / mp->n_cols, c = cur % mp->n_cols;
+    rowcol_t next[4], k, n_next = 0;
+
+    if (cur == goal) {
+      found = 1;
+      break;
+    }
+    if (r > 0 && !mp->cells[cur - mp->n_cols].b_wall)
+      next[n_next++] = cur - mp->n_cols;
+    if (r < mp->n_rows - 1 && !mp->cells[cur].b_wall)
+      next[n_next++] = cur + mp->n_cols;
+    if (c > 0 && !mp->cells[cur - 1].r_wall) next[n_next++] = cur - 1;
+    if (c < mp->n_cols - 1 && !mp->cells[cur].r_wall) next[n_next++] = cur + 1;
+
+    for (k = 0; k < n_next; ++k) {
+      if (parent[next[k]] == n_cells) {
+        parent[next[k]] = cur;
+        queue[tail++] = next[k];
+      }
+    }
+  }
+
+  memset(on_path, 0, n_cells);
+  if (found) {
+    for (pos = goal; pos != start; pos = parent[pos]) on_path[pos] = 1;
+    on_path[start] = 1;
+  }
+
+  free(parent);
+  free(queue);
+  return found;
+}
+
+/* check_perfect(*mp, *why, len)
+
+   A perfect maze has exactly one fewer passage than it has cells,
+   and every cell is reachable from the first.  Returns 1 if the maze
+   is perfect, 0 if not, or -1 if memory runs out.
+ */
+
+static int check_perfect(const maze_t *mp, char *why, size_t len) {
+  rowcol_t n_cells = mp->n_rows * mp->n_cols, pos, n_open = 0;
+  unsigned char *on_path;
+  int ok = 1;
+
+  if ((on_path = malloc(n_cells)) == NULL) return -1;
+
+  for (pos = 0; pos < n_cells; ++pos) {
+    if (pos % mp->n_cols < mp->n_cols - 1 && !mp->cells[pos].r_wall) ++n_open;
+    if (pos / mp->n_cols < mp->n_rows - 1 && !mp->cells[pos].b_wall) ++n_open;
+  }
+  if (n_open != n_cells - 1) {
+    snprintf(why, len, "%u passages for %u cells", n_open, n_cells);
+    ok = 0;
+  } else {
+    for (pos = 0; ok && pos < n_cells; ++pos) {
+      if (!ref_path(mp, 0, 0, pos / mp->n_cols, pos % mp->n_cols, on_path)) {
+        snprintf(why, len, "cell %ux%u unreachable", pos / mp->n_cols + 1,
+                 pos % mp->n_cols + 1);
+        ok = 0;
+      }
+      if (n_cells > 64) pos += n_cells / 64; /* sample large mazes */
+    }
+  }
+
+  free(on_path);
+  return ok;
+}
+
+/* check_generate(*tp, *why, len)
+
+   Generated mazes must be perfect.
+ */
+
+static int check_generate(const trial_t *tp, char *why, size_t len) {
+  maze_t m;
+  int ok;
+
+  if (!trial_maze(tp, &m)) return -1;
+  ok = check_perfect(&m, why, len);
+  maze_clear(&m);
+  return ok;
+}
+
+/* State of the random generator for batch_draw() */
+static unsigned int batch_state;
+
+/* batch_draw()
+
+   Draw from the random sequence of one lane of a batch, for use as
+   the generator of maze_generate().
+ */
+
+static double batch_draw(void) { return maze_batch_draw(&batch_state); }
+
+/* check_batch(*tp, *why, len)
+
+   Every lane of a batch must hold the maze that maze_generate() makes
+   from the lane's random sequence, and must leave the sequence where
+   maze_generate() does.  A second batch from the same lanes checks
+   that each lane continues its own sequence.  The number of lanes is
+   derived from the seed.
+ */
+
+static int check_batch(const trial_t *tp, char *why, size_t len) {
+  unsigned int lanes = 1 + tp->seed % MAZE_BATCH_LANES, l;
+  unsigned int start[MAZE_BATCH_LANES];
+  maze_batch_t b;
+  maze_t got, want;
+  int ok = 1, round;
+
+  if (!maze_batch_init(&b, lanes, tp->rows, tp->cols)) return -1;
+  if (!maze_init(&got, tp->rows, tp->cols)) {
+    maze_batch_clear(&b);
+    return -1;
+  }
+  if (!maze_init(&want, tp->rows, tp->cols)) {
+    maze_clear(&got);
+    maze_batch_clear(&b);
+    return -1;
+  }
+  for (l = 0; l < lanes; ++l)
+    maze_batch_seed(&b, l, tp->seed * MAZE_BATCH_LANES + l);
+
+  for (round = 0; ok > 0 && round < 2; ++round) {
+    memcpy(start, b.rng, sizeof(start));
+    maze_batch_generate(&b);
+
+    for (l = 0; ok > 0 && l < lanes; ++l) {
+      batch_state = start[l];
+      if (!maze_generate(&want, batch_draw) || !maze_batch_get(&b, l, &got)) {
+        ok = -1;
+      } else if (!diff_cells(&want, &got, why, len)) {
+        ok = 0;
+      } else if (batch_state != b.rng[l]) {
+        snprintf(why, len, "lane %u of %u drew a different number of values",
+                 l + 1, lanes);
+        ok = 0;
+      }
+    }
+  }
+
+  maze_clear(&want);
+  maze_clear(&got);
+  maze_batch_clear(&b);
+  return ok;
+}
+
+/* check_solve(*tp, *why, len)
+
+   A batch solve must find a path of the same length as the reference
+   search in every lane, or agree that there is none.  The lanes hold
+   the mazes of consecutive seeds.  Every third one has random walls
+   knocked down, making loops and openings in the outside walls, which
+   the solver must ignore.  Every third one after that has its end
+   walled in.  Mazes too wide for a solver pass trivially.
+ */
+
+static int check_solve(const trial_t *tp, char *why, size_t len) {
+  unsigned int lanes = 1 + tp->seed % MAZE_BATCH_LANES, l, n_want = 0, n_got;
+  rowcol_t n_cells = tp->rows * tp->cols, pos, k;
+  rowcol_t want[MAZE_BATCH_LANES], got[MAZE_BATCH_LANES];
+  unsigned char *on_path;
+  maze_solver_t s;
+  int ok = 1;
+
+  if (tp->cols > MAZE_SOLVE_COLS) return 1;
+  if (!maze_solve_init(&s, lanes, tp->rows, tp->cols)) return -1;
+  if ((on_path = malloc(n_cells)) == NULL) {
+    maze_solve_clear(&s);
+    return -1;
+  }
+
+  for (l = 0; ok > 0 && l < lanes; ++l) {
+    trial_t t = *tp;
+    maze_t m;
+
+    t.seed = tp->seed + l;
+    if (!trial_maze(&t, &m)) {
+      ok = -1;
+      break;
+    }
+    if (l % 3 == 0) {
+      /* Marks left by a solve must make no difference */
+      maze_find_path(&m, t.er, t.ec, t.sr, t.sc);
+    } else if (l % 3 == 1) {
+      for (k = 0; k < n_cells / 8 + 1; ++k) {
+        maze_node *np = CELLP(&m, random() % m.n_rows, random() % m.n_cols);
+
+        if (random() & 1)
+          np->r_wall = 0;
+        else
+          np->b_wall = 0;
+      }
+    } else {
+      CELLV(&m, t.er, t.ec).r_wall = 1;
+      CELLV(&m, t.er, t.ec).b_wall = 1;
+      if (t.ec > 0) CELLV(&m, t.er, t.ec - 1).r_wall = 1;
+      if (t.er > 0) CELLV(&m, t.er - 1, t.ec).b_wall = 1;
+    }
+
+    want[l] = 0;
+    if (ref_path(&m, t.sr, t.sc, t.er, t.ec, on_path)) {
+      for (pos = 0; pos < n_cells; ++pos) want[l] += on_path[pos];
+      ++n_want;
+    }
+    if (!maze_solve_load(&s, l, &m)) ok = -1;
+    maze_clear(&m);
+  }
+
+  if (ok > 0) {
+    n_got = maze_solve_run(&s, tp->sr, tp->sc, tp->er, tp->ec, got);
+
+    for (l = 0; ok > 0 && l < lanes; ++l) {
+      if (got[l] != want[l]) {
+        snprintf(why, len, "lane %u of %u has path length %u, want %u",
+                 l + 1, lanes, got[l], want[l]);
+        ok = 0;
+      }
+    }
+    if (ok > 0 && n_got != n_want) {
+      snprintf(why, len, "%u lanes solved, want %u", n_got, n_want);
+      ok = 0;
+    }
+  }
+
+  free(on_path);
+  maze_solve_clear(&s);
+  return ok;
+}
+
+/* make_shards(*tp, *dir, *lay)
+
+   Generate and stitch a sharded maze for a trial in a new temporary
+   directory, whose name is written to dir.  The shard grid is derived
+   from the seed.  Returns 1 on success, 0 if the shards could not be
+   stitched, or -1 if the directory could not be made.
+ */
+
+static int make_shards(const trial_t *tp, char *dir, maze_layout_t *lay) {
+  rowcol_t i, j;
+  int ok = 1;
+
+  strcpy(dir, "/tmp/mazebench-XXXXXX");
+  if (mkdtemp(dir) == NULL) return -1;
+
+  lay->n_rows = tp->rows;
+  lay->n_cols = tp->cols;
+  lay->sh_rows = 1 + tp->seed % (tp->rows < 4 ? tp->rows : 4);
+  lay->sh_cols = 1 + (tp->seed / 4) % (tp->cols < 4 ? tp->cols : 4);
+  lay->exit_1 = EXIT(0, DIR_L);
+  lay->exit_2 = EXIT(tp->rows - 1, DIR_R);
+
+  srandom(tp->seed);
+  for (i = 0; ok && i < lay->sh_rows; ++i)
+    for (j = 0; ok && j < lay->sh_cols; ++j)
+      ok = maze_shard_generate(lay, i, j, randomizer, dir);
+
+  return ok && maze_shard_stitch(dir, randomizer);
+}
+
+/* remove_shards(*dir, *lay)
+
+   Remove the shard files made by make_shards(), and their directory.
+ */
+
+static void remove_shards(const char *dir, const maze_layout_t *lay) {
+  rowcol_t i, j;
+
+  for (i = 0; i < lay->sh_rows; ++i) {
+    for (j = 0; j < lay->sh_cols; ++j) {
+      char *path = maze_shard_path(dir, i, j);
+
+      if (path != NULL) remove(path);
+      free(path);
+    }
+  }
+  rmdir(dir);
+}
+
+/* Rows read by maze_shard_rows(), for check_shards(). */
+typedef struct {
+  maze_t m;
+  rowcol_t row;
+} shard_rows_t;
+
+static int shard_row(const maze_node *row, void *arg) {
+  shard_rows_t *sp = arg;
+
+  if (sp->row >= sp->m.n_rows) return 0;
+  memcpy(CELLP(&sp->m, sp->row, 0), row, sp->m.n_cols * sizeof(*row));
+  sp->row++;
+  return 1;
+}
+
+/* diff_shard_rows(*dir, *mp, *why, len)
+
+   Reading the shards in dir row by row must give the same cells as
+   the assembled maze mp.
+ */
+
+static int diff_shard_rows(const char *dir, const maze_t *mp, char *why,
+                           size_t len) {
+  shard_rows_t sr;
+  int ok;
+
+  if (!maze_init(&sr.m, mp->n_rows, mp->n_cols)) return -1;
+
+  sr.row = 0;
+  if (!maze_shard_rows(dir, shard_row, &sr) || sr.row != mp->n_rows) {
+    snprintf(why, len, "maze_shard_rows() failed after %u rows", sr.row);
+    ok = 0;
+  } else {
+    ok = diff_cells(mp, &sr.m, why, len);
+  }
+  maze_clear(&sr.m);
+  return ok;
+}
+
+/* seam_walls(*mp, *lay, *n_open)
+
+   Return the number of walls of the assembled maze mp that lie across
+   the seams between its shards, storing in n_open how many are open.
+ */
+
+static rowcol_t seam_walls(const maze_t *mp, const maze_layout_t *lay,
+                           rowcol_t *n_open) {
+  rowcol_t i, k, n = 0;
+  maze_shard_t sh;
+
+  *n_open = 0;
+  for (i = 1; i < lay->sh_cols; ++i) {
+    maze_shard_extent(lay, 0, i, &sh);
+    for (k = 0; k < mp->n_rows; ++k, ++n)
+      *n_open += !CELLV(mp, k, sh.col0 - 1).r_wall;
+  }
+  for (i = 1; i < lay->sh_rows; ++i) {
+    maze_shard_extent(lay, i, 0, &sh);
+    for (k = 0; k < mp->n_cols; ++k, ++n)
+      *n_open += !CELLV(mp, sh.row0 - 1, k).b_wall;
+  }
+  return n;
+}
+
+/* check_shards(*tp, *why, len)
+
+   Generating a maze as a grid of shards and stitching them together
+   must give a perfect maze, which reads the same row by row as when
+   assembled.  The seams must be about as open as the rest of the
+   maze, where half the walls are open: once there are enough walls
+   across them to judge, at least a fifth of those must be open.
+ */
+
+static int check_shards(const trial_t *tp, char *why, size_t len) {
+  char dir[32];
+  maze_layout_t lay;
+  maze_t m;
+  int ok = make_shards(tp, dir, &lay);
+
+  if (ok < 0) return -1;
+  if (!ok || !maze_shard_assemble(dir, &m)) {
+    snprintf(why, len, "%ux%u shards could not be stitched", lay.sh_rows,
+             lay.sh_cols);
+    ok = 0;
+  } else {
+    rowcol_t n_open, n_seam = seam_walls(&m, &lay, &n_open);
+
+    ok = check_perfect(&m, why, len);
+    if (ok > 0 && n_seam >= 48 && 5 * n_open < n_seam) {
+      snprintf(why, len, "only %u of %u walls across the seams are open",
+               n_open, n_seam);
+      ok = 0;
+    }
+    if (ok > 0) ok = diff_shard_rows(dir, &m, why, len);
+    maze_clear(&m);
+  }
+
+  remove_shards(dir, &lay);
+  return ok;
+}
+
+/* Cells of a route found by maze_shard_route(), for check_route(). */
+typedef struct {
+  rowcol_t *cells, n, max;
+} route_t;
+
+static void route_cell(rowcol_t r, rowcol_t c, void *arg) {
+  route_t *rp = arg;
+
+  if (rp->n < rp->max) {
+    rp->cells[2 * rp->n] = r;
+    rp->cells[2 * rp->n + 1] = c;
+  }
+  rp->n++;
+}
+
+/* check_route(*tp, *why, len)
+
+   The route planned across stitched shards from their portal
+   summaries must be the same as the reference path through the
+   assembled maze, step by step.
+ */
+
+static int check_route(const trial_t *tp, char *why, size_t len) {
+  rowcol_t n_cells = tp->rows * tp->cols, n_path = 0, k;
+  unsigned char *on_path = NULL;
+  route_t rt = {NULL, 0, 0};
+  char dir[32];
+  maze_layout_t lay;
+  maze_t m;
+  int ok = make_shards(tp, dir, &lay);
+
+  if (ok < 0) return -1;
+  if (!ok || !maze_shard_assemble(dir, &m)) {
+    remove_shards(dir, &lay);
+    snprintf(why, len, "%ux%u shards could not be stitched", lay.sh_rows,
+             lay.sh_cols);
+    return 0;
+  }
+
+  if ((on_path = malloc(n_cells)) == NULL ||
+      (rt.cells = malloc(2 * n_cells * sizeof(*rt.cells))) == NULL) {
+    ok = -1;
+    goto CLEANUP;
+  }
+  rt.max = n_cells;
+
+  if (!ref_path(&m, tp->sr, tp->sc, tp->er, tp->ec, on_path)) {
+    snprintf(why, len, "reference found no path");
+    ok = 0;
+    goto CLEANUP;
+  }
+  for (k = 0; k < n_cells; ++k) n_path += on_path[k];
+
+  if (!maze_shard_route(dir, tp->sr, tp->sc, tp->er, tp->ec, route_cell, &rt,
+                        NULL)) {
+    snprintf(why, len, "no route across %ux%u shards", lay.sh_rows,
+             lay.sh_cols);
+    ok = 0;
+  } else if (rt.n != n_path) {
+    snprintf(why, len, "route has %u cells, reference %u", rt.n, n_path);
+    ok = 0;
+  } else if (rt.cells[0] != tp->sr || rt.cells[1] != tp->sc ||
+             rt.cells[2 * n_path - 2] != tp->er ||
+             rt.cells[2 * n_path - 1] != tp->ec) {
+    snprintf(why, len, "route has the wrong endpoints");
+    ok = 0;
+  } else {
+    for (k = 0; ok && k < n_path; ++k) {
+      rowcol_t r = rt.cells[2 * k], c = rt.cells[2 * k + 1], pr, pc;
+
+      if (!on_path[OFFSET(&m, r, c)]) {
+        snprintf(why, len, "route step %u at %ux%u is off the path", k + 1,
+                 r + 1, c + 1);
+        ok = 0;
+        break;
+      }
+      if (k == 0) continue;
+
+      pr = rt.cells[2 * k - 2];
+      pc = rt.cells[2 * k - 1];
+      if ((r > pr ? r - pr : pr - r) + (c > pc ? c - pc : pc - c) != 1) {
+        snprintf(why, len, "route jumps to %ux%u at step %u", r + 1, c + 1,
+                 k + 1);
+        ok = 0;
+      }
+    }
+  }
+
+CLEANUP:
+  free(on_path);
+  free(rt.cells);
+  maze_clear(&m);
+  remove_shards(dir, &lay);
+  return ok;
+}
+
+/* check_find_path(*tp, *why, len)
+
+   maze_find_path() must mark exactly the cells of the unique route
+   found by the reference breadth-first search.
+ */
+
+static int check_find_path(const trial_t *tp, char *why, size_t len) {
+  rowcol_t n_cells = tp->rows * tp->cols, pos;
+  unsigned char *on_path;
+  maze_t m;
+  int ok = 1;
+
+  if (!trial_maze(tp, &m)) return -1;
+  if ((on_path = malloc(n_cells)) == NULL) {
+    maze_clear(&m);
+    return -1;
+  }
+
+  if (!ref_path(&m, tp->sr, tp->sc, tp->er, tp->ec, on_path)) {
+    snprintf(why, len, "reference found no path");
+    ok = 0;
+  } else {
+    maze_find_path(&m, tp->sr, tp->sc, tp->er, tp->ec);
+
+    for (pos = 0; pos < n_cells; ++pos) {
+      if (m.cells[pos].visit != on_path[pos]) {
+        snprintf(why, len, "cell %ux%u %s the solution", pos / m.n_cols + 1,
+                 pos % m.n_cols + 1,
+                 on_path[pos] ? "missing from" : "wrongly added to");
+        ok = 0;
+        break;
+      }
+    }
+  }
+
+  free(on_path);
+  maze_clear(&m);
+  return ok;
+}
+
+/* capture(*mp, which, **buf, *len)
+
+   Run one of the writers into a memory buffer, which the caller must
+   free.  Returns false if memory runs out.
+ */
+
+static int capture(const maze_t *mp, int which, char **buf, size_t *len) {
+  FILE *ofp = open_memstream(buf, len);
+
+  if (ofp == NULL) return 0;
+
+  switch (which) {
+    case B_TEXT:
+      maze_write_text(mp, ofp, 0, 0);
+      break;
+    case B_EPS:
+      maze_write_eps(mp, ofp, 612, 612);
+      break;
+    case B_PNG:
+      maze_write_png(mp, ofp, 612, 612);
+      break;
+    case B_STORE:
+      maze_store(mp, ofp);
+      break;
+    case B_CSR:
+      maze_write_csr(mp, ofp, 1);
+      break;
+    case B_GRID:
+      maze_write_grid(mp, ofp, 0);
+      break;
+    default:
+      assert(0 &&
+             "Unknown writer code in switch(which) "
+             "of capture(...)");
+      break;
+  }
+  return fclose(ofp) == 0;
+}
+
+/* emit(*mp, which, *sp)
+
+   Run one of the writers into a sink, returning its result.
+ */
+
+static int emit(const maze_t *mp, int which, maze_sink_t *sp) {
+  switch (which) {
+    case B_TEXT:
+      return maze_emit_text(mp, sp, 0, 0);
+    case B_EPS:
+      return maze_emit_eps(mp, sp, 612, 612);
+    case B_PNG:
+      return maze_emit_png(mp, sp, 612, 612);
+    case B_STORE:
+      return maze_emit_store(mp, sp);
+    case B_CSR:
+      return maze_emit_csr(mp, sp, 1);
+    case B_GRID:
+      return maze_emit_grid(mp, sp, 0);
+    default:
+      assert(0 &&
+             "Unknown writer code in switch(which) "
+             "of emit(...)");
+      return 0;
+  }
+}
+
+/* check_sinks(*tp, *why, len)
+
+   Every writer must produce the same bytes through a memory sink, a
+   fixed buffer of exactly the right size, and a file descriptor as
+   through a stdio stream, and must fail when the fixed buffer is one
+   byte too small.
+ */
+
+static int check_sinks(const trial_t *tp, char *why, size_t len) {
+  static const int writers[] = {B_TEXT, B_EPS,  B_PNG,
+                                B_STORE, B_CSR, B_GRID};
+  char *obuf = NULL, *fbuf = NULL;
+  size_t olen;
+  maze_t m;
+  int i, ok = 1;
+
+  if (!trial_maze(tp, &m)) return -1;
+  maze_find_path(&m, tp->sr, tp->sc, tp->er, tp->ec);
+
+  for (i = 0; ok > 0 && i < (int)(sizeof(writers) / sizeof(*writers)); ++i) {
+    const char *name = bench_names[writers[i]];
+    maze_mem_sink_t ms;
+    maze_buf_sink_t bs;
+    maze_fd_sink_t ds;
+    FILE *tfp;
+    size_t flen;
+
+    if (!capture(&m, writers[i], &obuf, &olen)) {
+      ok = -1;
+      break;
+    }
+
+    /* Growable memory buffer */
+    if (!emit(&m, writers[i], maze_mem_sink(&ms)))
+      ok = -1;
+    else
+      ok = diff_bytes(obuf, olen, ms.buf, ms.len, name, why, len);
+    free(ms.buf);
+
+    /* Fixed buffer, just big enough and then one byte short */
+    if (ok > 0 && (fbuf = malloc(olen + 1)) == NULL) ok = -1;
+    if (ok > 0) {
+      if (!emit(&m, writers[i], maze_buf_sink(&bs, fbuf, olen))) {
+        snprintf(why, len, "%s: fixed buffer of %zu bytes rejected", name,
+                 olen);
+        ok = 0;
+      } else {
+        ok = diff_bytes(obuf, olen, bs.buf, bs.len, name, why, len);
+      }
+    }
+    if (ok > 0 && emit(&m, writers[i], maze_buf_sink(&bs, fbuf, olen - 1))) {
+      snprintf(why, len, "%s: overflowing fixed buffer accepted", name);
+      ok = 0;
+    }
+
+    /* File descriptor, read back through the stream */
+    if (ok > 0 && (tfp = tmpfile()) != NULL) {
+      if (!emit(&m, writers[i], maze_fd_sink(&ds, fileno(tfp))) ||
+          fseek(tfp, 0, SEEK_SET) != 0) {
+        ok = -1;
+      } else {
+        flen = fread(fbuf, 1, olen + 1, tfp);
+        ok = diff_bytes(obuf, olen, fbuf, flen, name, why, len);
+      }
+      fclose(tfp);
+    } else if (ok > 0) {
+      ok = -1;
+    }
+
+    free(obuf);
+    free(fbuf);
+    obuf = fbuf = NULL;
+  }
+
+  maze_clear(&m);
+  return ok;
+}
+
+/* stream_rows(*pickle, plen, format, h_res, v_res, *ms)
+
+   Read a pickled maze one row at a time and write it with a row
+   writer into a memory sink.  Returns false on error.
+ */
+
+static int stream_rows(char *pickle, size_t plen, int format,
+                       unsigned int h_res, unsigned int v_res,
+                       maze_mem_sink_t *ms) {
+  rowcol_t n_rows, n_cols, exit_1, exit_2, r;
+  maze_node *row = NULL;
+  maze_rows_t w;
+  FILE *ifp;
+  int ok;
+
+  maze_mem_sink(ms);
+  if ((ifp = fmemopen(pickle, plen, "r")) == NULL) return 0;
+
+  ok = maze_load_header(ifp, &n_rows, &n_cols, &exit_1, &exit_2) &&
+       (row = malloc(n_cols * sizeof(*row))) != NULL &&
+       maze_rows_begin(&w, format, &ms->sink, n_rows, n_cols, exit_1, exit_2,
+                       h_res, v_res);
+  if (ok) {
+    for (r = 0; ok && r < n_rows; ++r)
+      ok = maze_load_row(ifp, n_cols, row) && maze_rows_push(&w, row);
+    ok = maze_rows_end(&w) && ok;
+  }
+
+  free(row);
+  fclose(ifp);
+  return ok;
+}
+
+/* png_size_is(im, w, h)
+
+   Return true if an image is w pixels wide and h pixels tall.
+ */
+
+static int png_size_is(gdImagePtr im, int w, int h) {
+  return gdImageBoundsSafe(im, w - 1, h - 1) && !gdImageBoundsSafe(im, w, 0) &&
+         !gdImageBoundsSafe(im, 0, h);
+}
+
+/* diff_images(*a, alen, *b, blen, w, h, *why, len)
+
+   Decode two PNG images, which should be w by h pixels, and compare
+   the colour of every pixel, describing the first difference in why.
+   Returns true if they are the same, or -1 if either could not be
+   decoded.
+ */
+
+static int diff_images(void *a, size_t alen, void *b, size_t blen, int w,
+                       int h, char *why, size_t len) {
+  gdImagePtr ia = gdImageCreateFromPngPtr((int)alen, a);
+  gdImagePtr ib = gdImageCreateFromPngPtr((int)blen, b);
+  int x, y, ok = 1;
+
+  if (ia == NULL || ib == NULL) {
+    ok = -1;
+  } else if (!png_size_is(ia, w, h) || !png_size_is(ib, w, h)) {
+    snprintf(why, len, "PNG images are not %dx%d", w, h);
+    ok = 0;
+  }
+
+  for (y = 0; ok > 0 && y < h; ++y) {
+    for (x = 0; ok > 0 && x < w; ++x) {
+      if (gdImageGetTrueColorPixel(ia, x, y) !=
+          gdImageGetTrueColorPixel(ib, x, y)) {
+        snprintf(why, len, "PNG pixel %d,%d differs", x, y);
+        ok = 0;
+      }
+    }
+  }
+
+  if (ia != NULL) gdImageDestroy(ia);
+  if (ib != NULL) gdImageDestroy(ib);
+  return ok;
+}
+
+/* check_rows(*tp, *why, len)
+
+   A solved maze read back from maze_store() output one row at a time
+   and written with the row writers must give the same text and EPS
+   output as the whole-maze writers, and the same PNG image.  The PNG
+   size is derived from the seed, so that cells of a few pixels, where
+   the solution markers overlap their neighbours, are covered too.
+ */
+
+static int check_rows(const trial_t *tp, char *why, size_t len) {
+  static const int writers[] = {B_TEXT, B_EPS, B_GRID};
+  static const int formats[] = {ROWS_TEXT, ROWS_EPS, ROWS_GRID};
+  unsigned int h_res = 612, v_res = 612;
+  char *pickle = NULL, *obuf = NULL;
+  size_t plen, olen;
+  maze_mem_sink_t ms, gs;
+  maze_t m;
+  int i, ok = 1;
+
+  if (!trial_maze(tp, &m)) return -1;
+  maze_find_path(&m, tp->sr, tp->sc, tp->er, tp->ec);
+  if (!capture(&m, B_STORE, &pickle, &plen)) {
+    maze_clear(&m);
+    return -1;
+  }
+
+  for (i = 0; ok > 0 && i < (int)(sizeof(writers) / sizeof(*writers)); ++i) {
+    if (!capture(&m, writers[i], &obuf, &olen) ||
+        !stream_rows(pickle, plen, formats[i], h_res, v_res, &ms))
+      ok = -1;
+    else
+      ok = diff_bytes(obuf, olen, ms.buf, ms.len, bench_names[writers[i]],
+                      why, len);
+    free(obuf);
+    free(ms.buf);
+    obuf = NULL;
+  }
+
+  if (tp->seed % 3 != 0) {
+    h_res = tp->cols * (tp->seed % 7) + tp->seed % 5;
+    v_res = tp->rows * (tp->seed / 7 % 7) + tp->seed / 5 % 5;
+    if (h_res == 0) h_res = 1;
+    if (v_res == 0) v_res = 1;
+  }
+  if (ok > 0) {
+    if (!maze_emit_png(&m, maze_mem_sink(&gs), h_res, v_res) ||
+        !stream_rows(pickle, plen, ROWS_PNG, h_res, v_res, &ms))
+      ok = -1;
+    else
+      ok = diff_images(gs.buf, gs.len, ms.buf, ms.len, h_res + 1, v_res + 1,
+                       why, len);
+    free(gs.buf);
+    free(ms.buf);
+  }
+
+  free(pickle);
+  maze_clear(&m);
+  return ok;
+}
+
+/* check_store_load(*tp, *why, len)
+
+   A maze passed through maze_store() and maze_load() must come back
+   with identical cells and exits, and must render identically.
+ */
+
+static int check_store_load(const trial_t *tp, char *why, size_t len) {
+  static const int writers[] = {B_TEXT, B_EPS};
+  char *buf = NULL, *obuf = NULL, *lbuf = NULL;
+  size_t blen, olen, llen;
+  maze_t m, l;
+  FILE *ifp;
+  int i, ok;
+
+  if (!trial_maze(tp, &m)) return -1;
+  maze_find_path(&m, tp->sr, tp->sc, tp->er, tp->ec);
+
+  if (!capture(&m, B_STORE, &buf, &blen) ||
+      (ifp = fmemopen(buf, blen, "r")) == NULL) {
+    free(buf);
+    maze_clear(&m);
+    return -1;
+  }
+  ok = maze_load(&l, ifp);
+  fclose(ifp);
+  free(buf);
+
+  if (!ok) {
+    snprintf(why, len, "maze_load() rejected maze_store() output");
+    maze_clear(&m);
+    return 0;
+  }
+
+  if (l.n_rows != m.n_rows || l.n_cols != m.n_cols ||
+      l.exit_1 != m.exit_1 || l.exit_2 != m.exit_2) {
+    snprintf(why, len, "header differs after reload");
+    ok = 0;
+  } else {
+    ok = diff_cells(&m, &l, why, len);
+  }
+
+  for (i = 0; ok > 0 && i < (int)(sizeof(writers) / sizeof(*writers)); ++i) {
+    if (!capture(&m, writers[i], &obuf, &olen) ||
+        !capture(&l, writers[i], &lbuf, &llen))
+      ok = -1;
+    else
+      ok = diff_bytes(obuf, olen, lbuf, llen, bench_names[writers[i]], why,
+                      len);
+    free(obuf);
+    free(lbuf);
+    obuf = lbuf = NULL;
+  }
+
+  maze_clear(&m);
+  maze_clear(&l);
+  return ok;
+}
+
+/* check_csr(*tp, *why, len)
+
+   The CSR graph written by maze_write_csr() must have, for every cell,
+   exactly the neighbors that can be reached through an open wall, in
+   ascending order, and its edge list must give each of them once.
+ */
+
+static int check_csr(const trial_t *tp, char *why, size_t len) {
+  rowcol_t n_cells = tp->rows * tp->cols, v, n_open = 0;
+  const unsigned long long *hdr, *offsets;
+  const unsigned int *nbrs, *edges;
+  char *buf = NULL;
+  size_t blen, need;
+  maze_t m;
+  int ok = 1;
+
+  if (!trial_maze(tp, &m)) return -1;
+  if (!capture(&m, B_CSR, &buf, &blen)) {
+    maze_clear(&m);
+    return -1;
+  }
+
+  for (v = 0; v < n_cells; ++v) {
+    if (v % m.n_cols < m.n_cols - 1 && !m.cells[v].r_wall) ++n_open;
+    if (v / m.n_cols < m.n_rows - 1 && !m.cells[v].b_wall) ++n_open;
+  }
+
+  /* open_memstream() buffers are malloc'd, so suitably aligned */
+  hdr = (const unsigned long long *)(buf + 8);
+  need = 48 + 8 * (n_cells + 1) + 4 * 2 * n_open + 8 * n_open;
+  if (blen != need || memcmp(buf, "MZCS", 4) != 0 || hdr[0] != m.n_rows ||
+      hdr[1] != m.n_cols || hdr[2] != n_cells || hdr[3] != 2 * n_open ||
+      hdr[4] != n_open) {
+    snprintf(why, len, "CSR header or size is wrong (%zu bytes, want %zu)",
+             blen, need);
+    ok = 0;
+  }
+  offsets = hdr + 5;
+  nbrs = (const unsigned int *)(offsets + n_cells + 1);
+  edges = nbrs + 2 * n_open;
+
+  for (v = 0; ok && v < n_cells; ++v) {
+    rowcol_t r = v / m.n_cols, c = v % m.n_cols, want[4], n_want = 0, k;
+
+    if (r > 0 && !m.cells[v - m.n_cols].b_wall) want[n_want++] = v - m.n_cols;
+    if (c > 0 && !m.cells[v - 1].r_wall) want[n_want++] = v - 1;
+    if (c < m.n_cols - 1 && !m.cells[v].r_wall) want[n_want++] = v + 1;
+    if (r < m.n_rows - 1 && !m.cells[v].b_wall) want[n_want++] = v + m.n_cols;
+
+    if (offsets[v + 1] - offsets[v] != n_want) {
+      snprintf(why, len, "cell %ux%u has %llu neighbors, want %u", r + 1,
+               c + 1, offsets[v + 1] - offsets[v], n_want);
+      ok = 0;
+    }
+    for (k = 0; ok && k < n_want; ++k) {
+      if (nbrs[offsets[v] + k] != want[k]) {
+        snprintf(why, len, "cell %ux%u neighbor %u is %u, want %u", r + 1,
+                 c + 1, k + 1, nbrs[offsets[v] + k], want[k]);
+        ok = 0;
+      }
+    }
+  }
+
+  for (v = 0; ok && v < n_open; ++v) {
+    unsigned int a = edges[2 * v], b = edges[2 * v + 1];
+
+    if (a >= b || b >= n_cells ||
+        !((b == a + 1 && !m.cells[a].r_wall && a % m.n_cols < m.n_cols - 1) ||
+          (b == a + m.n_cols && !m.cells[a].b_wall)) ||
+        (v > 0 && (a < edges[2 * v - 2] ||
+                   (a == edges[2 * v - 2] && b <= edges[2 * v - 1])))) {
+      snprintf(why, len, "edge %u (%u, %u) is wrong or out of order", v + 1,
+               a, b);
+      ok = 0;
+    }
+  }
+
+  free(buf);
+  maze_clear(&m);
+  return ok;
+}
+
+/* check_grid(*tp, *why, len)
+
+   Both occupancy grids must match the text output, read as a grid:
+   square (y, x) is line y of the text, at column 2x for even x and
+   2x - 1 for odd x, and is occupied unless that is a space.  The
+   maze has a path marked, which must not show in the grid.
+ */
+
+static int check_grid(const trial_t *tp, char *why, size_t len) {
+  char *text = NULL, *gbuf[2] = {NULL, NULL};
+  size_t tlen, glen[2];
+  unsigned long long height = 2ULL * tp->rows + 1, width = 2ULL * tp->cols + 1;
+  unsigned long long y, x;
+  maze_t m;
+  int ok = 1, bits;
+
+  if (!trial_maze(tp, &m)) return -1;
+  maze_find_path(&m, tp->sr, tp->sc, tp->er, tp->ec);
+
+  if (!capture(&m, B_TEXT, &text, &tlen)) ok = -1;
+  for (bits = 0; ok > 0 && bits < 2; ++bits) {
+    FILE *ofp = open_memstream(&gbuf[bits], &glen[bits]);
+
+    if (ofp == NULL) {
+      ok = -1;
+      break;
+    }
+    if (!maze_write_grid(&m, ofp, bits)) ok = -1;
+    if (fclose(ofp) != 0) ok = -1;
+  }
+
+  for (bits = 0; ok > 0 && bits < 2; ++bits) {
+    /* open_memstream() buffers are malloc'd, so suitably aligned */
+    const unsigned int *tag = (const unsigned int *)(gbuf[bits] + 4);
+    const unsigned long long *dims =
+        (const unsigned long long *)(gbuf[bits] + 16);
+    unsigned long long stride = bits ? (width + 63) / 64 * 8
+                                     : (width + 7) / 8 * 8;
+    const unsigned char *rows = (const unsigned char *)gbuf[bits] + 40;
+    const char *line = text;
+
+    if (glen[bits] != 40 + height * stride ||
+        memcmp(gbuf[bits], "MZOG", 4) != 0 || tag[0] != 1 ||
+        tag[1] != (bits ? 1U : 8U) || tag[2] != 0 || dims[0] != height ||
+        dims[1] != width || dims[2] != stride) {
+      snprintf(why, len, "%s grid header or size is wrong",
+               bits ? "bit" : "byte");
+      ok = 0;
+    }
+    for (y = 0; ok > 0 && y < height; ++y) {
+      const unsigned char *row = rows + y * stride;
+
+      for (x = 0; ok > 0 && x < 8 * stride / (bits ? 1 : 8); ++x) {
+        int got = bits ? (row[x / 8] >> (x % 8)) & 1 : row[x];
+        int want = x < width && line[x % 2 ? 2 * x - 1 : 2 * x] != ' ';
+
+        if (got != want) {
+          snprintf(why, len, "%s grid square %llux%llu is %d, want %d",
+                   bits ? "bit" : "byte", y, x, got, want);
+          ok = 0;
+        }
+      }
+      line = strchr(line, '\n') + 1;
+    }
+  }
+
+  free(text);
+  free(gbuf[0]);
+  free(gbuf[1]);
+  maze_clear(&m);
+  return ok;
+}
+
+/* ref_mix(x)
+
+   The SplitMix64 finalizer, as documented in mazehash.h.
+ */
+
+static unsigned long long ref_mix(unsigned long long x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/* ref_hash(*mp, out)
+
+   Compute the structural hash one cell at a time, straight from the
+   description in mazehash.h.
+ */
+
+static void ref_hash(const maze_t *mp, unsigned long long out[2]) {
+  static const unsigned long long key[2] = {0x9e3779b97f4a7c15ULL,
+                                            0xc2b2ae3d27d4eb4fULL};
+  unsigned long long sum[2] = {0, 0}, n_cells, pos, w = 0, dims, exits;
+  int j;
+
+  n_cells = (unsigned long long)mp->n_rows * mp->n_cols;
+  for (pos = 0; pos < n_cells; ++pos) {
+    w |= (unsigned long long)mp->cells[pos].r_wall << (pos % 16);
+    w |= (unsigned long long)mp->cells[pos].b_wall << (16 + pos % 16);
+
+    if (pos % 16 == 15 || pos == n_cells - 1) {
+      for (j = 0; j < 2; ++j)
+        sum[j] += ref_mix(((pos / 16) << 32 | w) ^ key[j]);
+      w = 0;
+    }
+  }
+
+  dims = (unsigned long long)mp->n_rows << 32 | mp->n_cols;
+  exits = (unsigned long long)mp->exit_1 << 32 | mp->exit_2;
+  for (j = 0; j < 2; ++j)
+    out[j] = ref_mix(sum[j] + ref_mix(dims ^ key[j]) + ref_mix(exits + key[j]));
+}
+
+/* check_hash(*tp, *why, len)
+
+   maze_hash() must agree with the reference, must not change when a
+   path is marked, and after random wall edits, a hash kept up to date
+   with maze_hash_edit() must agree with one computed from scratch.
+ */
+
+static int check_hash(const trial_t *tp, char *why, size_t len) {
+  unsigned long long got[2], want[2];
+  maze_hash_t h;
+  maze_t m;
+  int ok = 1, k;
+
+  if (!trial_maze(tp, &m)) return -1;
+
+  maze_hash(&m, got);
+  ref_hash(&m, want);
+  if (got[0] != want[0] || got[1] != want[1]) {
+    snprintf(why, len, "hash %016llx%016llx, want %016llx%016llx", got[0],
+             got[1], want[0], want[1]);
+    ok = 0;
+  }
+
+  maze_find_path(&m, tp->sr, tp->sc, tp->er, tp->ec);
+  maze_hash(&m, got);
+  if (ok && (got[0] != want[0] || got[1] != want[1])) {
+    snprintf(why, len, "hash changed when the path was marked");
+    ok = 0;
+  }
+
+  maze_hash_init(&m, &h);
+  for (k = 0; ok && k < 64; ++k) {
+    rowcol_t r = random() % m.n_rows, c = random() % m.n_cols;
+    maze_node *np = CELLP(&m, r, c), old = *np;
+
+    if (random() & 1)
+      np->r_wall = !np->r_wall;
+    else
+      np->b_wall = !np->b_wall;
+    maze_hash_edit(&m, &h, r, c, old);
+
+    maze_hash_digest(&m, &h, got);
+    ref_hash(&m, want);
+    if (got[0] != want[0] || got[1] != want[1]) {
+      snprintf(why, len, "hash wrong after edit %d at cell %ux%u", k + 1,
+               r + 1, c + 1);
+      ok = 0;
+    }
+  }
+
+  maze_clear(&m);
+  return ok;
+}
+
+/* check_shm(*tp, *why, len)
+
+   A maze generated into shared memory must be published with an even
+   sequence number, and a read-only attachment to it must have the
+   same cells as a maze generated on the heap, and render identically.
+ */
+
+static int check_shm(const trial_t *tp, char *why, size_t len) {
+  static const int writers[] = {B_TEXT, B_EPS, B_STORE};
+  char name[64], *obuf = NULL, *abuf = NULL;
+  size_t olen, alen;
+  maze_t m, s, a;
+  unsigned long long seq;
+  int i, ok;
+
+  snprintf(name, sizeof(name), "/mazebench-%ld", (long)getpid());
+  if (!trial_maze(tp, &m)) return -1;
+  if (!maze_shm_create(&s, name, tp->rows, tp->cols)) {
+    maze_clear(&m);
+    return -1;
+  }
+
+  srandom(tp->seed);
+  ok = maze_generate(&s, randomizer);
+  maze_shm_publish(&s);
+  maze_clear(&s);
+  if (!ok || !maze_attach(&a, name)) {
+    maze_shm_remove(name);
+    maze_clear(&m);
+    return -1;
+  }
+
+  if ((seq = maze_shm_sync(&a)) & 1) {
+    snprintf(why, len, "sequence %llu still odd after publishing", seq);
+    ok = 0;
+  } else if (a.exit_1 != m.exit_1 || a.exit_2 != m.exit_2) {
+    snprintf(why, len, "exits differ after attaching");
+    ok = 0;
+  } else {
+    ok = diff_cells(&m, &a, why, len);
+  }
+
+  for (i = 0; ok > 0 && i < (int)(sizeof(writers) / sizeof(*writers)); ++i) {
+    if (!capture(&m, writers[i], &obuf, &olen) ||
+        !capture(&a, writers[i], &abuf, &alen))
+      ok = -1;
+    else
+      ok = diff_bytes(obuf, olen, abuf, alen, bench_names[writers[i]], why,
+                      len);
+    free(obuf);
+    free(abuf);
+    obuf = abuf = NULL;
+  }
+
+  maze_clear(&a);
+  maze_clear(&m);
+  maze_shm_remove(name);
+  return ok;
+}
+
+/* same_path(*mp, *vp, *tp, *why, len)
+
+   The path maze_trace_path() finds on vp between the trial's cells
+   must be the one marked on mp by maze_find_path(): the same number
+   of cells, every one of them marked, running from start to end.
+ */
+
+static int same_path(const maze_t *mp, const maze_t *vp, const trial_t *tp,
+                     char *why, size_t len) {
+  rowcol_t n_cells = mp->n_rows * mp->n_cols, n_path, n_marked = 0, i;
+  unsigned char *marks = malloc(n_cells);
+  rowcol_t *path = malloc(n_cells * sizeof(*path));
+  int ok = 1;
+
+  if (marks == NULL || path == NULL) {
+    free(marks);
+    free(path);
+    return -1;
+  }
+
+  n_path = maze_trace_path(vp, tp->sr, tp->sc, tp->er, tp->ec, marks, path);
+  for (i = 0; i < n_cells; ++i) n_marked += mp->cells[i].visit;
+
+  if (n_path != n_marked) {
+    snprintf(why, len, "traced path has %u cells, marked path %u", n_path,
+             n_marked);
+    ok = 0;
+  } else if (path[0] != tp->sr * mp->n_cols + tp->sc ||
+             path[n_path - 1] != tp->er * mp->n_cols + tp->ec) {
+    snprintf(why, len, "traced path does not join its ends");
+    ok = 0;
+  }
+  for (i = 0; ok && i < n_path; ++i) {
+    if (!mp->cells[path[i]].visit) {
+      snprintf(why, len, "traced path crosses unmarked cell %ux%u",
+               path[i] / mp->n_cols, path[i] % mp->n_cols);
+      ok = 0;
+    }
+  }
+
+  free(marks);
+  free(path);
+  return ok;
+}
+
+/* check_pack(*tp, *why, len)
+
+   Mazes written to a pack file and read back as views of the mapped
+   pack must have the same cells as the originals and render
+   identically.  Copies of them must solve identically, and the views
+   must give the same path when traced in place.
+ */
+
+static int check_pack(const trial_t *tp, char *why, size_t len) {
+  static const int writers[] = {B_TEXT, B_EPS, B_STORE};
+  char path[] = "/tmp/mazebench-XXXXXX", *obuf = NULL, *vbuf = NULL;
+  size_t olen, vlen;
+  maze_pack_writer_t pw;
+  maze_pack_t pack;
+  trial_t t = *tp;
+  maze_t m, v, c;
+  int fd, i, k, ok = 1;
+
+  if ((fd = mkstemp(path)) < 0) return -1;
+  close(fd);
+
+  /* Three mazes with consecutive seeds, added in order of seed */
+  if (!maze_pack_begin(&pw, path)) return -1;
+  for (k = 0; ok && k < 3; ++k) {
+    t.seed = tp->seed + k;
+    if (!trial_maze(&t, &m)) {
+      ok = -1;
+      break;
+    }
+    if (!maze_pack_add(&pw, t.seed, &m)) ok = -1;
+    maze_clear(&m);
+  }
+  if (!maze_pack_end(&pw) || ok < 0 || !maze_pack_open(&pack, path)) {
+    remove(path);
+    return -1;
+  }
+
+  for (k = 2; ok == 1 && k >= 0; --k) {
+    unsigned long long pos = maze_pack_find(&pack, tp->seed + k);
+
+    t.seed = tp->seed + k;
+    if (pos == pack.n_mazes || maze_pack_id(&pack, pos) != t.seed) {
+      snprintf(why, len, "maze %lu missing from pack", t.seed);
+      ok = 0;
+      break;
+    }
+    if (!trial_maze(&t, &m)) {
+      ok = -1;
+      break;
+    }
+    maze_pack_view(&pack, pos, &v);
+
+    if (v.exit_1 != m.exit_1 || v.exit_2 != m.exit_2) {
+      snprintf(why, len, "exits of maze %lu differ", t.seed);
+      ok = 0;
+    } else {
+      ok = diff_cells(&m, &v, why, len);
+    }
+
+    for (i = 0; ok == 1 && i < (int)(sizeof(writers) / sizeof(*writers));
+         ++i) {
+      if (!capture(&m, writers[i], &obuf, &olen) ||
+          !capture(&v, writers[i], &vbuf, &vlen))
+        ok = -1;
+      else
+        ok = diff_bytes(obuf, olen, vbuf, vlen, bench_names[writers[i]], why,
+                        len);
+      free(obuf);
+      free(vbuf);
+      obuf = vbuf = NULL;
+    }
+
+    /* The view is read-only, so it is solved from a copy */
+    if (ok == 1 && !maze_pack_copy(&pack, pos, &c)) {
+      ok = -1;
+    } else if (ok == 1) {
+      maze_find_path(&m, tp->sr, tp->sc, tp->er, tp->ec);
+      maze_find_path(&c, tp->sr, tp->sc, tp->er, tp->ec);
+      ok = diff_cells(&m, &c, why, len);
+      maze_clear(&c);
+    }
+    if (ok == 1) ok = same_path(&m, &v, tp, why, len);
+    maze_clear(&v);
+    maze_clear(&m);
+  }
+
+  maze_pack_close(&pack);
+  remove(path);
+  return ok;
+}
+
+/* gen_steps(*tp, order, *why, len)
+
+   Generating in uneven steps in the given order, with a round trip
+   through maze_gen_save() and maze_gen_restore() part way, must give
+   the same maze as a single call to maze_generate_order().
+ */
+
+static int gen_steps(const trial_t *tp, int order, char *why, size_t len) {
+  rowcol_t n_cells = tp->rows * tp->cols, work = 1 + (tp->seed % 7);
+  char *buf = NULL;
+  size_t blen;
+  maze_t ref, m, l;
+  maze_gen_t gen, lgen;
+  FILE *fp;
+  int ok;
+
+  if (!maze_init(&ref, tp->rows, tp->cols)) return -1;
+  srandom(tp->seed);
+  if (!maze_generate_order(&ref, randomizer, order)) {
+    maze_clear(&ref);
+    return -1;
+  }
+  if (!maze_init(&m, tp->rows, tp->cols) ||
+      !maze_gen_begin_order(&m, &gen, order)) {
+    maze_clear(&ref);
+    return -1;
+  }
+
+  srandom(tp->seed);
+  while (!maze_gen_step(&m, &gen, randomizer, work) && work < n_cells)
+    work *= 2;
+
+  if ((fp = open_memstream(&buf, &blen)) == NULL) {
+    ok = -1;
+  } else {
+    ok = maze_gen_save(&m, &gen, fp);
+    ok = (fclose(fp) == 0 && ok) ? 1 : -1;
+  }
+  maze_gen_end(&m, &gen);
+  maze_clear(&m);
+
+  if (ok > 0) {
+    if ((fp = fmemopen(buf, blen, "r")) == NULL) {
+      ok = -1;
+    } else if (!maze_gen_restore(&l, &lgen, fp)) {
+      snprintf(why, len, "maze_gen_restore() rejected checkpoint");
+      ok = 0;
+    } else {
+      while (!maze_gen_step(&l, &lgen, randomizer, work))
+        ;
+      maze_gen_end(&l, &lgen);
+      ok = diff_cells(&ref, &l, why, len);
+      maze_clear(&l);
+    }
+    if (fp != NULL) fclose(fp);
+  }
+
+  free(buf);
+  maze_clear(&ref);
+  return ok;
+}
+
+/* check_gen_steps(*tp, *why, len)
+
+   Stepwise generation must match maze_generate(); see gen_steps().
+ */
+
+static int check_gen_steps(const trial_t *tp, char *why, size_t len) {
+  return gen_steps(tp, GEN_ORDER_RANDOM, why, len);
+}
+
+/* check_gen_blocked(*tp, *why, len)
+
+   Mazes generated in blocked order must be perfect, and stepwise
+   generation in that order must match generating in one go.
+ */
+
+static int check_gen_blocked(const trial_t *tp, char *why, size_t len) {
+  maze_t m;
+  int ok;
+
+  if (!maze_init(&m, tp->rows, tp->cols)) return -1;
+  srandom(tp->seed);
+  if (!maze_generate_order(&m, randomizer, GEN_ORDER_BLOCKED)) {
+    maze_clear(&m);
+    return -1;
+  }
+  ok = check_perfect(&m, why, len);
+  maze_clear(&m);
+
+  return ok > 0 ? gen_steps(tp, GEN_ORDER_BLOCKED, why, len) : ok;
+}
+
+/* check_gen_tree(*tp, *why, len)
+
+   Mazes grown as a tree must be perfect, with their visit bits left
+   clear, at either end of the mix and in between; the same seed must
+   grow the same maze.
+ */
+
+static int check_gen_tree(const trial_t *tp, char *why, size_t len) {
+  const double mixes[4] = {0.0, 1.0, 0.5, (tp->seed % 100) / 100.0};
+  maze_t m, again;
+  rowcol_t pos, n_cells = tp->rows * tp->cols;
+  int k, ok = 1;
+
+  if (!maze_init(&m, tp->rows, tp->cols)) return -1;
+  if (!maze_init(&again, tp->rows, tp->cols)) {
+    maze_clear(&m);
+    return -1;
+  }
+
+  for (k = 0; ok > 0 && k < 4; ++k) {
+    srandom(tp->seed + k);
+    if (!maze_generate_tree(&m, randomizer, mixes[k])) {
+      ok = -1;
+      break;
+    }
+    if ((ok = check_perfect(&m, why, len)) <= 0) break;
+
+    for (pos = 0; pos < n_cells; ++pos) {
+      if (m.cells[pos].visit) {
+        snprintf(why, len, "mix %.2f: cell %ux%u left visited", mixes[k],
+                 pos / m.n_cols + 1, pos % m.n_cols + 1);
+        ok = 0;
+        break;
+      }
+    }
+
+    srandom(tp->seed + k);
+    if (ok && !maze_generate_tree(&again, randomizer, mixes[k]))
+      ok = -1;
+    else if (ok)
+      ok = diff_cells(&m, &again, why, len);
+  }
+
+  maze_clear(&again);
+  maze_clear(&m);
+  return ok;
+}
+
+/* A maze being filled in a row at a time from a snapshot */
+typedef struct {
+  maze_t *mp;
+  rowcol_t row;
+} snap_rows_t;
+
+/* snap_row(*row, *arg)
+
+   Row function for check_snap(), copying each row into the next row
+   of the maze.
+ */
+
+static int snap_row(const maze_node *row, void *arg) {
+  snap_rows_t *sp = arg;
+
+  memcpy(CELLP(sp->mp, sp->row++, 0), row, sp->mp->n_cols * sizeof(*row));
+  return 1;
+}
+
+/* check_snap(*tp, *why, len)
+
+   Take a series of snapshots of a maze being edited, with a round of
+   random wall changes after each, and compare every snapshot with a
+   full copy of the maze made at the same point.  A page must be
+   copied exactly once in each round that changes it, and consecutive
+   snapshots must share every page the round between them left alone.
+ */
+
+#define SNAP_ROUNDS 4
+
+static int check_snap(const trial_t *tp, char *why, size_t len) {
+  rowcol_t n_cells = tp->rows * tp->cols, pos, k, plen;
+  rowcol_t n_pages = (n_cells + MAZE_SNAP_PAGE - 1) / MAZE_SNAP_PAGE;
+  unsigned long n_copied = 0;
+  maze_t m, ref[SNAP_ROUNDS], out;
+  maze_snap_t snap[SNAP_ROUNDS];
+  snap_rows_t rows;
+  char *touched;
+  maze_edit_t e;
+  int i, s, n_taken, ok = 1;
+
+  if (!trial_maze(tp, &m)) return -1;
+  if ((touched = calloc(SNAP_ROUNDS, n_pages)) == NULL ||
+      !maze_edit_init(&e, &m)) {
+    free(touched);
+    maze_clear(&m);
+    return -1;
+  }
+
+  for (n_taken = 0; ok > 0 && n_taken < SNAP_ROUNDS; ++n_taken) {
+    s = n_taken;
+    if (!maze_init(&ref[s], tp->rows, tp->cols)) {
+      ok = -1;
+      break;
+    }
+    memcpy(ref[s].cells, m.cells, n_cells * sizeof(maze_node));
+    ref[s].exit_1 = m.exit_1;
+    ref[s].exit_2 = m.exit_2;
+    maze_snap_take(&snap[s], &e);
+
+    /* The oldest snapshot goes while later ones are still held */
+    if (s == 2) maze_snap_release(&snap[0]);
+
+    for (i = 0; ok > 0 && i < 1 + (int)(n_cells / 20); ++i) {
+      pos = random() % n_cells;
+      if (random() & 1)
+        m.cells[pos].r_wall ^= 1;
+      else
+        m.cells[pos].b_wall ^= 1;
+      if (!maze_edit_set(&e, pos / tp->cols, pos % tp->cols, m.cells[pos]))
+        ok = -1;
+      touched[s * n_pages + pos / MAZE_SNAP_PAGE] = 1;
+    }
+    if (ok > 0 && s == 1) {
+      m.exit_1 ^= 4;
+      if (!maze_edit_exits(&e, m.exit_1, m.exit_2)) ok = -1;
+    }
+  }
+  maze_edit_clear(&e);
+
+  for (k = 0; k < SNAP_ROUNDS * n_pages; ++k) n_copied += touched[k];
+  if (ok > 0 && e.n_copied != n_copied) {
+    snprintf(why, len, "%lu pages copied, expected %lu", e.n_copied,
+             n_copied);
+    ok = 0;
+  }
+
+  for (s = 1; ok > 0 && s < SNAP_ROUNDS; ++s) {
+    if (snap[s].exit_1 != ref[s].exit_1 || snap[s].exit_2 != ref[s].exit_2) {
+      snprintf(why, len, "exits of snapshot %d differ", s);
+      ok = 0;
+    } else if (!maze_snap_copy(&snap[s], &out)) {
+      ok = -1;
+    } else {
+      ok = diff_cells(&ref[s], &out, why, len);
+
+      /* The rows of the snapshot, written over its copy */
+      memset(out.cells, 0, n_cells * sizeof(maze_node));
+      rows.mp = &out;
+      rows.row = 0;
+      if (ok > 0 && !maze_snap_rows(&snap[s], snap_row, &rows))
+        ok = -1;
+      else if (ok > 0)
+        ok = diff_cells(&ref[s], &out, why, len);
+      maze_clear(&out);
+    }
+
+    for (k = 0; ok > 0 && s + 1 < SNAP_ROUNDS && k < n_pages; ++k) {
+      int same = maze_snap_page(&snap[s], k, &plen) ==
+                 maze_snap_page(&snap[s + 1], k, &plen);
+
+      if (same == touched[s * n_pages + k]) {
+        snprintf(why, len, "page %u of snapshot %d %s", k, s,
+                 same ? "not copied" : "copied needlessly");
+        ok = 0;
+      }
+    }
+  }
+
+  for (s = 0; s < n_taken; ++s) {
+    if (snap[s].root != NULL) maze_snap_release(&snap[s]);
+    maze_clear(&ref[s]);
+  }
+  free(touched);
+  maze_clear(&m);
+  return ok;
+}
+
+/* check_diff(*tp, *why, len)
+
+   Change a few walls and the exits of a copy of a maze, and check
+   that a diff between the two brings the original up to date, and
+   that its size goes with the number of changes, not of cells.
+ */
+
+static int check_diff(const trial_t *tp, char *why, size_t len) {
+  rowcol_t n_cells = tp->rows * tp->cols, pos;
+  int i, n_edits = 1 + (int)(random() % 16), ok;
+  maze_mem_sink_t ms;
+  maze_t m, v;
+
+  if (!trial_maze(tp, &m)) return -1;
+  if (!maze_init(&v, tp->rows, tp->cols)) {
+    maze_clear(&m);
+    return -1;
+  }
+  memcpy(v.cells, m.cells, n_cells * sizeof(maze_node));
+  v.exit_1 = m.exit_2;
+  v.exit_2 = m.exit_1;
+  for (i = 0; i < n_edits; ++i) {
+    pos = random() % n_cells;
+    v.cells[pos].r_wall ^= 1;
+    v.cells[pos].b_wall ^= random() & 1;
+  }
+
+  if (!maze_diff(&m, &v, maze_mem_sink(&ms))) {
+    ok = -1;
+  } else if (ms.len > 58 + 8 * (size_t)n_edits) {
+    snprintf(why, len, "diff of %d changes is %lu bytes", n_edits,
+             (unsigned long)ms.len);
+    ok = 0;
+  } else if (!maze_patch(&m, ms.buf, ms.len)) {
+    snprintf(why, len, "diff of %d changes did not apply", n_edits);
+    ok = 0;
+  } else if (m.exit_1 != v.exit_1 || m.exit_2 != v.exit_2) {
+    snprintf(why, len, "exits differ after patch");
+    ok = 0;
+  } else {
+    ok = diff_cells(&v, &m, why, len);
+  }
+
+  free(ms.buf);
+  maze_clear(&v);
+  maze_clear(&m);
+  return ok;
+}
+
+/* diff_fb(*fp, *png, plen, *why, len)
+
+   Decode a PNG image and compare the colour of every pixel with a
+   framebuffer, describing the first difference in why.  Returns true
+   if they are the same, or -1 if the image could not be decoded.
+ */
+
+static int diff_fb(const maze_fb_t *fp, void *png, size_t plen, char *why,
+                   size_t len) {
+  gdImagePtr im = gdImageCreateFromPngPtr((int)plen, png);
+  unsigned int x, y;
+  int ok = 1;
+
+  if (im == NULL) return -1;
+  if (!png_size_is(im, fp->width, fp->height)) {
+    snprintf(why, len, "PNG image is not %ux%u", fp->width, fp->height);
+    ok = 0;
+  }
+  for (y = 0; ok > 0 && y < fp->height; ++y) {
+    for (x = 0; ok > 0 && x < fp->width; ++x) {
+      const unsigned char *rgb =
+          maze_fb_palette + 3 * fp->pixels[(size_t)y * fp->width + x];
+      int clr = (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+
+      if ((gdImageGetTrueColorPixel(im, x, y) & 0xffffff) != clr) {
+        snprintf(why, len, "framebuffer pixel %u,%u differs", x, y);
+        ok = 0;
+      }
+    }
+  }
+  gdImageDestroy(im);
+  return ok;
+}
+
+/* check_fb(*tp, *why, len)
+
+   A framebuffer must match the PNG image of its maze when it is set
+   up, and again after the maze is solved, a few walls and an exit
+   are changed, and it is updated.  Every pixel the update changed
+   must lie in one of the rectangles it reports.  The image size is
+   derived from the seed as in check_rows().
+ */
+
+static int check_fb(const trial_t *tp, char *why, size_t len) {
+  unsigned int h_res = 612, v_res = 612, n_rects, k, x, y;
+  const maze_rect_t *rects;
+  unsigned char *before = NULL;
+  maze_mem_sink_t gs;
+  rowcol_t pos;
+  maze_fb_t fb;
+  maze_t m;
+  int i, ok;
+
+  if (tp->seed % 3 != 0) {
+    h_res = tp->cols * (tp->seed % 7) + tp->seed % 5;
+    v_res = tp->rows * (tp->seed / 7 % 7) + tp->seed / 5 % 5;
+    if (h_res == 0) h_res = 1;
+    if (v_res == 0) v_res = 1;
+  }
+  if (!trial_maze(tp, &m)) return -1;
+  if (!maze_fb_init(&fb, &m, h_res, v_res)) {
+    maze_clear(&m);
+    return -1;
+  }
+
+  if (!maze_emit_png(&m, maze_mem_sink(&gs), h_res, v_res))
+    ok = -1;
+  else
+    ok = diff_fb(&fb, gs.buf, gs.len, why, len);
+  free(gs.buf);
+
+  if (ok > 0 && (before = malloc((size_t)fb.width * fb.height)) == NULL)
+    ok = -1;
+  if (ok > 0) {
+    memcpy(before, fb.pixels, (size_t)fb.width * fb.height);
+
+    maze_find_path(&m, tp->sr, tp->sc, tp->er, tp->ec);
+    maze_fb_scan(&fb, &m);
+    for (i = 0; i < 3; ++i) {
+      pos = random() % (tp->rows * tp->cols);
+      m.cells[pos].r_wall ^= 1;
+      m.cells[pos].b_wall ^= random() & 1;
+      maze_fb_touch(&fb, pos / tp->cols, pos % tp->cols);
+    }
+    if (tp->seed % 2) m.exit_2 = EXIT(tp->cols - 1, DIR_U);
+    n_rects = maze_fb_update(&fb, &m, &rects);
+
+    if (!maze_emit_png(&m, maze_mem_sink(&gs), h_res, v_res))
+      ok = -1;
+    else
+      ok = diff_fb(&fb, gs.buf, gs.len, why, len);
+    free(gs.buf);
+  }
+
+  for (y = 0; ok > 0 && y < fb.height; ++y) {
+    for (x = 0; ok > 0 && x < fb.width; ++x) {
+      size_t p = (size_t)y * fb.width + x;
+
+      if (fb.pixels[p] == before[p]) continue;
+      for (k = 0; k < n_rects; ++k) {
+        if (x >= rects[k].x && x - rects[k].x < rects[k].w && y >= rects[k].y &&
+            y - rects[k].y < rects[k].h)
+          break;
+      }
+      if (k == n_rects) {
+        snprintf(why, len, "pixel %u,%u changed outside the %u rectangles", x,
+                 y, n_rects);
+        ok = 0;
+      }
+    }
+  }
+
+  free(before);
+  maze_fb_clear(&fb);
+  maze_clear(&m);
+  return ok;
+}
+
+/* A terminal for check_view(): its characters, its scrolling region
+   from row top to row bot, and its cursor. */
+typedef struct {
+  char *chars;
+  unsigned int rows, cols;
+  unsigned int top, bot;
+  unsigned int y, x;
+} term_t;
+
+/* term_scroll(*tp, n)
+
+   Scroll the region of a terminal up n rows, or down -n rows,
+   clearing the rows uncovered.
+ */
+
+static void term_scroll(term_t *tp, long n) {
+  size_t cols = tp->cols, h = tp->bot - tp->top + 1, d;
+  char *base = tp->chars + tp->top * cols;
+
+  d = (size_t)(n < 0 ? -n : n);
+  if (d > h) d = h;
+  if (n > 0) {
+    memmove(base, base + d * cols, (h - d) * cols);
+    memset(base + (h - d) * cols, ' ', d * cols);
+  } else {
+    memmove(base + d * cols, base, (h - d) * cols);
+    memset(base, ' ', d * cols);
+  }
+}
+
+/* term_apply(*tp, *buf, len)
+
+   Carry out the output of maze_view_draw() on a terminal: characters,
+   and the few escape sequences the viewer uses.  Returns false if the
+   output has anything else, or would write past the right edge.
+ */
+
+static int term_apply(term_t *tp, const char *buf, size_t len) {
+  size_t i = 0;
+
+  while (i < len) {
+    unsigned long p[2] = {0, 0};
+    int np = 0;
+
+    if (buf[i] != '\033') {
+      if (buf[i] < ' ' || tp->x >= tp->cols || tp->y >= tp->rows) return 0;
+      tp->chars[tp->y * tp->cols + tp->x++] = buf[i++];
+      continue;
+    }
+    if (++i == len || buf[i++] != '[') return 0;
+    for (; i < len && (buf[i] == ';' || (buf[i] >= '0' && buf[i] <= '9'));
+         ++i) {
+      if (buf[i] == ';') {
+        if (++np > 1) return 0;
+      } else {
+        p[np] = 10 * p[np] + (buf[i] - '0');
+      }
+    }
+    if (i == len) return 0;
+
+    switch (buf[i++]) {
+      case 'H':
+        tp->y = p[0] ? p[0] - 1 : 0;
+        tp->x = p[1] ? p[1] - 1 : 0;
+        break;
+      case 'J':
+        if (p[0] != 2) return 0;
+        memset(tp->chars, ' ', (size_t)tp->rows * tp->cols);
+        break;
+      case 'r':
+        if (p[0] < 1 || p[1] < p[0] || p[1] > tp->rows) return 0;
+        tp->top = p[0] - 1;
+        tp->bot = p[1] - 1;
+        tp->y = tp->x = 0;
+        break;
+      case 'S':
+        term_scroll(tp, p[0] ? (long)p[0] : 1);
+        break;
+      case 'T':
+        term_scroll(tp, p[0] ? -(long)p[0] : -1);
+        break;
+      default:
+        return 0;
+    }
+  }
+  return 1;
+}
+
+/* view_cell(r, c, *arg)
+
+   Add a cell of a route to a list of cells r * n_cols + c, for
+   maze_view_path().
+ */
+
+typedef struct {
+  unsigned long long *cells;
+  size_t n, max;
+  rowcol_t n_cols;
+} view_path_t;
+
+static void view_cell(rowcol_t r, rowcol_t c, void *arg) {
+  view_path_t *pp = arg;
+
+  if (pp->n < pp->max)
+    pp->cells[pp->n++] = (unsigned long long)r * pp->n_cols + c;
+}
+
+static int cmp_ull(const void *a, const void *b) {
+  unsigned long long x = *(const unsigned long long *)a;
+  unsigned long long y = *(const unsigned long long *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* view_frames(*views, n, *why, len)
+
+   Move n viewers of the same maze around together at random, and
+   draw them: they must show the same characters, and the output of
+   the first must bring a terminal to what it shows.  Zoomed out past
+   VIEW_GRID, a frame drawn again must not read the maze again.
+ */
+
+static int view_frames(maze_view_t *views, int n, char *why, size_t len) {
+  term_t term = {NULL, 0, 0, 0, 0, 0, 0};
+  maze_mem_sink_t ms;
+  unsigned int rows = 0, cols = 0;
+  unsigned long long n_read;
+  int step, k, ok = 1;
+
+  maze_mem_sink(&ms);
+  for (step = 0; ok > 0 && step < 24; ++step) {
+    long long dy, dx;
+    int op = step == 0 ? 0 : (int)(random() % 6);
+
+    if (op == 0) {
+      rows = 3 + random() % 30;
+      cols = 5 + random() % 90;
+      free(term.chars);
+      if ((term.chars = malloc((size_t)(rows + 1) * cols)) == NULL) {
+        ok = -1;
+        break;
+      }
+      memset(term.chars, '?', (size_t)(rows + 1) * cols);
+      term.rows = rows + 1;
+      term.cols = cols;
+      term.top = 0;
+      term.bot = rows;
+      term.y = term.x = 0;
+    }
+    dy = (long long)(random() % (2 * rows + 5)) - rows - 2;
+    dx = (random() % 2) ? 0 : (long long)(random() % (2 * cols + 5)) - cols - 2;
+    for (k = 0; ok > 0 && k < n; ++k) {
+      maze_view_t *vp = views + k;
+
+      switch (op) {
+        case 0:
+          if (!maze_view_resize(vp, rows, cols)) ok = -1;
+          break;
+        case 1:
+          maze_view_scroll(vp, dy, dx);
+          break;
+        case 2:
+          maze_view_zoom(vp, (int)(step * 7 % (vp->max_level + 2)));
+          break;
+        case 3:
+          vp->show_path = !vp->show_path;
+          break;
+        case 4:
+          maze_view_goto(vp, (rowcol_t)(step * 31 % vp->n_rows),
+                         (rowcol_t)(step * 17 % vp->n_cols));
+          break;
+        default:
+          maze_view_scroll(vp, dy % 3, 0);
+          break;
+      }
+    }
+
+    for (k = 0; ok > 0 && k < n; ++k) {
+      ms.len = 0;
+      if (!maze_view_draw(views + k, &ms.sink)) {
+        snprintf(why, len, "viewer %d could not draw step %d", k, step);
+        ok = 0;
+      } else if (k == 0 && !term_apply(&term, ms.buf, ms.len)) {
+        snprintf(why, len, "unexpected output at step %d", step);
+        ok = 0;
+      } else if (k == 0 && memcmp(term.chars, views[0].screen,
+                                  (size_t)rows * cols) != 0) {
+        snprintf(why, len, "terminal differs from screen at step %d", step);
+        ok = 0;
+      } else if (k > 0 && (views[k].top != views[0].top ||
+                           views[k].left != views[0].left ||
+                           memcmp(views[k].screen, views[0].screen,
+                                  (size_t)rows * cols) != 0)) {
+        snprintf(why, len, "viewer %d differs at step %d (level %d)", k, step,
+                 views[0].level);
+        ok = 0;
+      } else if (views[k].level > VIEW_GRID) {
+        n_read = views[k].n_read;
+        ms.len = 0;
+        if (!maze_view_draw(views + k, &ms.sink)) {
+          snprintf(why, len, "viewer %d could not redraw step %d", k, step);
+          ok = 0;
+        } else if (views[k].n_read != n_read) {
+          snprintf(why, len, "viewer %d read %llu cells again at level %d", k,
+                   views[k].n_read - n_read, views[k].level);
+          ok = 0;
+        }
+      }
+    }
+  }
+  free(ms.buf);
+  free(term.chars);
+  return ok;
+}
+
+/* view_whole(*vp, *text, *why, len)
+
+   With a screen big enough for the whole maze, a viewer must show the
+   text output of the maze at VIEW_TEXT, and its occupancy grid at
+   VIEW_GRID, read from the text output as in check_grid().
+ */
+
+static int view_whole(maze_view_t *vp, const char *text, char *why,
+                      size_t len) {
+  unsigned int rows = 2 * vp->n_rows + 1, cols = 4 * vp->n_cols + 1, y, x;
+  maze_mem_sink_t ms;
+  const char *line;
+  int ok = 1;
+
+  if (!maze_view_resize(vp, rows, cols)) return -1;
+  maze_mem_sink(&ms);
+  if (!maze_view_draw(vp, &ms.sink)) ok = -1;
+  for (y = 0, line = text; ok > 0 && y < rows; ++y) {
+    if (memcmp(vp->screen + (size_t)y * cols, line, cols) != 0) {
+      snprintf(why, len, "text view differs from text output in line %u", y);
+      ok = 0;
+    }
+    line = strchr(line, '\n') + 1;
+  }
+
+  maze_view_zoom(vp, VIEW_GRID);
+  if (ok > 0 && !maze_view_draw(vp, &ms.sink)) ok = -1;
+  for (y = 0, line = text; ok > 0 && y < rows; ++y) {
+    for (x = 0; ok > 0 && x < 2 * vp->n_cols + 1; ++x) {
+      char got = vp->screen[(size_t)y * cols + x];
+      char want = line[x % 2 ? 2 * x - 1 : 2 * x];
+
+      if ((got == '#') != (want != ' ') ||
+          (x % 2 && y % 2 && (got == '@') != (line[2 * x] == '@'))) {
+        snprintf(why, len, "grid view square %ux%u is '%c'", y, x, got);
+        ok = 0;
+      }
+    }
+    line = strchr(line, '\n') + 1;
+  }
+  free(ms.buf);
+  return ok;
+}
+
+/* check_view(*tp, *why, len)
+
+   A viewer reading a stored maze from a file must show the same as
+   one reading the maze in memory, and a viewer reading shards, with
+   the route across them given as its path, the same as one reading
+   the assembled shards with the path marked.  All of them must keep
+   a terminal showing what they show, and show the whole maze as the
+   writers do.  Exits on the top and bottom are tried as well.
+ */
+
+static int check_view(const trial_t *tp, char *why, size_t len) {
+  maze_view_t views[2];
+  char *text = NULL, *buf = NULL, dir[32];
+  size_t tlen, blen;
+  view_path_t pv = {NULL, 0, 0, tp->cols};
+  maze_layout_t lay;
+  rowcol_t r0, c0, r1, c1;
+  FILE *ifp = NULL;
+  maze_t m;
+  int ok;
+
+  if (!trial_maze(tp, &m)) return -1;
+  maze_find_path(&m, tp->sr, tp->sc, tp->er, tp->ec);
+  if (tp->seed % 3 == 1) {
+    m.exit_1 = EXIT(tp->seed % tp->cols, DIR_U);
+    m.exit_2 = EXIT(tp->seed / 3 % tp->cols, DIR_D);
+  }
+
+  if (!capture(&m, B_TEXT, &text, &tlen) ||
+      !capture(&m, B_STORE, &buf, &blen) ||
+      (ifp = fmemopen(buf, blen, "r")) == NULL ||
+      !maze_load_header(ifp, &r0, &c0, &r1, &c1)) {
+    ok = -1;
+  } else {
+    maze_view_init(views, &m);
+    if (!maze_view_store(views + 1, ifp, r0, c0, r1, c1)) {
+      snprintf(why, len, "maze_view_store() failed");
+      ok = 0;
+    } else {
+      ok = view_whole(views, text, why, len);
+      if (ok > 0) ok = view_whole(views + 1, text, why, len);
+      if (ok > 0) ok = view_frames(views, 2, why, len);
+      maze_view_clear(views + 1);
+    }
+    maze_view_clear(views);
+  }
+  if (ifp != NULL) fclose(ifp);
+  free(text);
+  free(buf);
+  maze_clear(&m);
+  if (ok <= 0) return ok;
+
+  if ((ok = make_shards(tp, dir, &lay)) < 0) return -1;
+  if (!ok || !maze_shard_assemble(dir, &m)) {
+    remove_shards(dir, &lay);
+    snprintf(why, len, "%ux%u shards could not be stitched", lay.sh_rows,
+             lay.sh_cols);
+    return 0;
+  }
+  maze_find_path(&m, tp->sr, tp->sc, tp->er, tp->ec);
+
+  pv.max = (size_t)tp->rows * tp->cols;
+  if ((pv.cells = malloc(pv.max * sizeof(*pv.cells))) == NULL) {
+    ok = -1;
+  } else if (!maze_shard_route(dir, tp->sr, tp->sc, tp->er, tp->ec,
+                               view_cell, &pv, NULL)) {
+    snprintf(why, len, "no route across %ux%u shards", lay.sh_rows,
+             lay.sh_cols);
+    ok = 0;
+  } else if (!maze_view_shards(views + 1, dir)) {
+    snprintf(why, len, "maze_view_shards() failed");
+    ok = 0;
+  } else {
+    qsort(pv.cells, pv.n, sizeof(*pv.cells), cmp_ull);
+    maze_view_path(views + 1, pv.cells, pv.n);
+    maze_view_init(views, &m);
+    ok = view_frames(views, 2, why, len);
+    maze_view_clear(views);
+    maze_view_clear(views + 1);
+  }
+
+  free(pv.cells);
+  maze_clear(&m);
+  remove_shards(dir, &lay);
+  return ok;
+}
+
+/* check_isa(*tp, *why, len)
+
+   The checks of the hash, the grid writers, and the batch solver must
+   pass with the kernels of every instruction set this processor runs,
+   not only the ones chosen for it (see mazecpu.h).
+ */
+
+static int check_isa(const trial_t *tp, char *why, size_t len) {
+  static const check_f kernel_checks[3] = {check_hash, check_grid,
+                                           check_solve};
+  int isa, saved = maze_cpu_isa(), ok = 1, k;
+  char sub[200];
+
+  for (isa = MAZE_ISA_SCALAR; ok > 0 && isa <= maze_cpu_best(); ++isa) {
+    if (!maze_cpu_force(isa)) continue;
+
+    for (k = 0; ok > 0 && k < 3; ++k) {
+      if ((ok = kernel_checks[k](tp, sub, sizeof(sub))) == 0)
+        snprintf(why, len, "%s: %s", maze_cpu_name(isa), sub);
+    }
+  }
+
+  maze_cpu_force(saved);
+  return ok;
+}
+
+/* The differential checks, run in order on every trial. */
+static const struct {
+  const char *name;
+  check_f check;
+} checks[] = {
+    {"generate", check_generate},
+    {"gen_steps", check_gen_steps},
+    {"gen_blocked", check_gen_blocked},
+    {"gen_tree", check_gen_tree},
+    {"batch", check_batch},
+    {"shards", check_shards},
+    {"route", check_route},
+    {"find_path", check_find_path},
+    {"solve", check_solve},
+    {"store_load", check_store_load},
+    {"csr", check_csr},
+    {"grid", check_grid},
+    {"hash", check_hash},
+    {"sinks", check_sinks},
+    {"rows", check_rows},
+    {"shm", check_shm},
+    {"pack", check_pack},
+    {"snap", check_snap},
+    {"diff", check_diff},
+    {"fb", check_fb},
+    {"view", check_view},
+    {"isa", check_isa},
+};
+
+#define N_CHECKS (int)(sizeof(checks) / sizeof(*checks))
+
+/* make_trial(rows, cols, seed, *out)
+
+   Fill in a trial, deriving the path endpoints from the seed so that
+   a trial is completely determined by its size and seed.
+ */
+
+static void make_trial(rowcol_t rows, rowcol_t cols, unsigned long seed,
+                       trial_t *out) {
+  unsigned long h = seed * 2654435761UL + 1;
+
+  out->rows = rows;
+  out->cols = cols;
+  out->seed = seed;
+  out->sr = (h >> 3) % rows;
+  out->sc = (h >> 11) % cols;
+  out->er = (h >> 19) % rows;
+  out->ec = (h >> 27) % cols;
+}
+
+/* shrink(k, *tp, *why, len)
+
+   Given a trial that fails check k, greedily look for a smaller one
+   that still fails: fewer rows or columns first, then a smaller
+   seed.  On return tp holds the smallest failing trial found and why
+   its failure.
+ */
+
+static void shrink(int k, trial_t *tp, char *why, size_t len) {
+  char tmp[256];
+  int progress = 1;
+
+  while (progress) {
+    rowcol_t cand[4][2];
+    unsigned long seeds[3];
+    int i;
+
+    progress = 0;
+
+    cand[0][0] = tp->rows / 2, cand[0][1] = tp->cols;
+    cand[1][0] = tp->rows, cand[1][1] = tp->cols / 2;
+    cand[2][0] = tp->rows - 1, cand[2][1] = tp->cols;
+    cand[3][0] = tp->rows, cand[3][1] = tp->cols - 1;
+
+    for (i = 0; i < 4 && !progress; ++i) {
+      trial_t t;
+
+      if (cand[i][0] == 0 || cand[i][1] == 0) continue;
+
+      make_trial(cand[i][0], cand[i][1], tp->seed, &t);
+      if (checks[k].check(&t, tmp, sizeof(tmp)) == 0) {
+        *tp = t;
+        snprintf(why, len, "%s", tmp);
+        progress = 1;
+      }
+    }
+
+    seeds[0] = 0, seeds[1] = tp->seed / 2, seeds[2] = tp->seed - 1;
+    for (i = 0; i < 3 && !progress; ++i) {
+      trial_t t;
+
+      if (seeds[i] >= tp->seed) continue;
+
+      make_trial(tp->rows, tp->cols, seeds[i], &t);
+      if (checks[k].check(&t, tmp, sizeof(tmp)) == 0) {
+        *tp = t;
+        snprintf(why, len, "%s", tmp);
+        progress = 1;
+      }
+    }
+  }
+}
+
+/* run_checks(n_trials, *max, seed)
+
+   Run every differential check on n_trials random trials, with
+   dimensions drawn uniformly up to max.  Failures are shrunk and
+   reported as a mazegen command line reproducing the input.
+   Returns the number of checks that failed.
+ */
+
+static int run_checks(int n_trials, const dims_t *max, unsigned long seed) {
+  int fails[N_CHECKS] = {0};
+  int i, k, n_fail = 0;
+  unsigned long h = seed;
+
+  for (i = 0; i < n_trials; ++i) {
+    trial_t t;
+
+    h = h * 6364136223846793005UL + 1442695040888963407UL;
+    make_trial(1 + (rowcol_t)((h >> 33) % max->x),
+               1 + (rowcol_t)((h >> 17) % max->y), seed + i, &t);
+
+    for (k = 0; k < N_CHECKS; ++k) {
+      char why[256];
+      int res;
+
+      if (fails[k]) continue; /* one reproducer per check is enough */
+
+      if ((res = checks[k].check(&t, why, sizeof(why))) < 0) {
+        fprintf(stderr, "Error:  Insufficient memory for %ux%u trial\n\n",
+                t.rows, t.cols);
+        return n_fail + 1;
+      } else if (res == 0) {
+        fails[k] = 1;
+        ++n_fail;
+        shrink(k, &t, why, sizeof(why));
+        printf("FAIL %-12s %s\n"
+               "     reproduce: mazegen -d %ux%u -r %lu -m %ux%u-%ux%u\n",
+               checks[k].name, why, t.rows, t.cols, t.seed, t.sr + 1,
+               t.sc + 1, t.er + 1, t.ec + 1);
+      }
+    }
+  }
+
+  for (k = 0; k < N_CHECKS; ++k)
+    if (!fails[k]) printf("ok   %-12s %d trials\n", checks[k].name, n_trials);
+
+  return n_fail;
+}
+
+/* run_batch(*cells, lanes, n_runs, seed)
+
+   Time the generation of many small mazes, first one at a time with
+   maze_generate() and then lanes at a time with a batch, copying each
+   maze out as a caller would; then time solving them corner to corner,
+   one at a time with maze_find_path() and lanes at a time with a batch
+   solver, loading each maze into it.  The same lanes mazes are solved
+   over and over.  Reports the median throughput of each in mazes per
+   second.  Returns false if memory runs out.
+ */
+
+static int run_batch(const dims_t *cells, unsigned int lanes, int n_runs,
+                     unsigned long seed) {
+  static const char *names[4] = {"generate", "gen_batch", "find_path",
+                                 "solve_batch"};
+  unsigned long n_mazes, k, n_cells = (unsigned long)cells->x * cells->y;
+  rowcol_t length[MAZE_BATCH_LANES];
+  maze_t m[MAZE_BATCH_LANES];
+  double *t[4], start;
+  int solve = cells->y <= MAZE_SOLVE_COLS;
+  maze_solver_t sv;
+  maze_batch_t b;
+  unsigned int l, n_init = 0;
+  int i, ok = 1;
+
+  n_mazes = (1UL << 22) / n_cells;
+  n_mazes = (n_mazes + lanes - 1) / lanes * lanes;
+
+  for (i = 0; i < 4; ++i) ok = (t[i] = malloc(n_runs * sizeof(double))) && ok;
+  for (; ok && n_init < lanes; ++n_init)
+    ok = maze_init(&m[n_init], cells->x, cells->y);
+  if (ok && !maze_batch_init(&b, lanes, cells->x, cells->y)) ok = 0;
+  if (ok && solve && !maze_solve_init(&sv, lanes, cells->x, cells->y)) {
+    maze_batch_clear(&b);
+    ok = 0;
+  }
+  if (!ok) {
+    for (l = 0; l < n_init; ++l) maze_clear(&m[l]);
+    for (i = 0; i < 4; ++i) free(t[i]);
+    return 0;
+  }
+
+  fprintf(stderr,
+          "Batch parameters:\n"
+          "  Dimensions:  %ux%u\n"
+          " Random seed:  %lu\n"
+          "        Runs:  %d\n"
+          "       Lanes:  %u\n"
+          "   Mazes/run:  %lu\n"
+          "     Kernels:  %s\n",
+          cells->x, cells->y, seed, n_runs, lanes, n_mazes,
+          maze_cpu_name(maze_cpu_isa()));
+
+  for (i = 0; ok && i < n_runs; ++i) {
+    srandom(seed + i);
+    start = now_nsec();
+    for (k = 0; ok && k < n_mazes; ++k)
+      ok = maze_generate(&m[k % lanes], randomizer);
+    t[0][i] = now_nsec() - start;
+
+    for (l = 0; l < lanes; ++l)
+      maze_batch_seed(&b, l, (seed + i) * MAZE_BATCH_LANES + l);
+    start = now_nsec();
+    for (k = 0; k < n_mazes; k += lanes) {
+      maze_batch_generate(&b);
+      for (l = 0; l < lanes; ++l) maze_batch_get(&b, l, &m[l]);
+    }
+    t[1][i] = now_nsec() - start;
+    if (!solve) continue;
+
+    start = now_nsec();
+    for (k = 0; k < n_mazes; ++k)
+      maze_find_path(&m[k % lanes], 0, 0, cells->x - 1, cells->y - 1);
+    t[2][i] = now_nsec() - start;
+
+    start = now_nsec();
+    for (k = 0; k < n_mazes; k += lanes) {
+      for (l = 0; l < lanes; ++l) maze_solve_load(&sv, l, &m[l]);
+      maze_solve_run(&sv, 0, 0, cells->x - 1, cells->y - 1, length);
+    }
+    t[3][i] = now_nsec() - start;
+  }
+
+  if (ok) {
+    printf("%-12s %12s %8s\n", "benchmark", "mazes/s", "speedup");
+    for (i = 0; i < (solve ? 4 : 2); ++i) {
+      double rate = n_mazes * 1e9 / median(t[i], n_runs);
+      double base = n_mazes * 1e9 / median(t[i & ~1], n_runs);
+
+      printf("%-12s %12.0f %8.2f\n", names[i], rate, rate / base);
+    }
+  }
+
+  for (l = 0; l < lanes; ++l) maze_clear(&m[l]);
+  for (i = 0; i < 4; ++i) free(t[i]);
+  maze_batch_clear(&b);
+  if (solve) maze_solve_clear(&sv);
+  return ok;
+}
+
+/* Statistics of the texture of a maze, compared by run_texture(). */
+enum {
+  T_DEAD_END,
+  T_STRAIGHT,
+  T_TURN,
+  T_JUNCTION,
+  T_CROSS,
+  T_ACROSS,
+  T_SEAM,
+  T_PATH,
+  N_TEX
+};
+
+/* The side of the square tiles of MAZE_GEN_BLOCK cells */
+#define TEX_TILE 32
+
+static const char *tex_names[N_TEX] = {
+    "dead_end", "straight", "turn", "junction", "crossing", "across",
+    "seam", "path"};
+
+/* texture(*mp, *on_path, out)
+
+   Measure the texture of a maze: the fractions of its cells that are
+   dead ends, straight corridors, turns, three-way junctions, and
+   crossings; the fraction of its passages that run across (from a
+   cell to the one on its right); the ratio of the fraction of walls
+   open on the seams between tiles to the fraction open
+   elsewhere, which is near 1 unless the tiles show; and the length
+   of the path from corner to corner per cell.  Returns false if
+   memory runs out.
+ */
+
+static int texture(const maze_t *mp, unsigned char *on_path,
+                   double out[N_TEX]) {
+  rowcol_t r, c, n_cells = mp->n_rows * mp->n_cols, pos;
+  double seam_open = 0, seam_walls = 0, open = 0, walls = 0, across = 0;
+  int k;
+
+  for (k = 0; k < N_TEX; ++k) out[k] = 0;
+
+  for (r = 0; r < mp->n_rows; ++r) {
+    for (c = 0; c < mp->n_cols; ++c) {
+      int rt = c < mp->n_cols - 1 && !CELLV(mp, r, c).r_wall;
+      int dn = r < mp->n_rows - 1 && !CELLV(mp, r, c).b_wall;
+      int lt = c > 0 && !CELLV(mp, r, c - 1).r_wall;
+      int up = r > 0 && !CELLV(mp, r - 1, c).b_wall;
+
+      switch (rt + dn + lt + up) {
+        case 1:
+          out[T_DEAD_END] += 1;
+          break;
+        case 2:
+          out[(rt && lt) || (up && dn) ? T_STRAIGHT : T_TURN] += 1;
+          break;
+        case 3:
+          out[T_JUNCTION] += 1;
+          break;
+        case 4:
+          out[T_CROSS] += 1;
+          break;
+      }
+      across += rt;
+
+      if (c < mp->n_cols - 1) {
+        if ((c + 1) % TEX_TILE == 0) {
+          seam_open += rt;
+          seam_walls += 1;
+        } else {
+          open += rt;
+          walls += 1;
+        }
+      }
+      if (r < mp->n_rows - 1) {
+        if ((r + 1) % TEX_TILE == 0) {
+          seam_open += dn;
+          seam_walls += 1;
+        } else {
+          open += dn;
+          walls += 1;
+        }
+      }
+    }
+  }
+
+  for (k = T_DEAD_END; k <= T_CROSS; ++k) out[k] /= n_cells;
+  out[T_ACROSS] = n_cells > 1 ? across / (n_cells - 1) : 0;
+  if (seam_walls > 0 && open > 0)
+    out[T_SEAM] = (seam_open / seam_walls) / (open / walls);
+
+  if (!ref_path(mp, 0, 0, mp->n_rows - 1, mp->n_cols - 1, on_path)) return 0;
+  for (pos = 0; pos < n_cells; ++pos) out[T_PATH] += on_path[pos];
+  out[T_PATH] /= n_cells;
+
+  return 1;
+}
+
+/* run_texture(*cells, n_mazes, n_runs, seed, thresh, z_score)
+
+   Compare the texture of mazes generated in the random and blocked
+   orders, over n_mazes mazes of each from consecutive seeds, and time
+   the generation of one maze of each order n_runs times with
+   hardware counters.  As with check_baseline(), a statistic fails
+   only if its mean in blocked order differs from that in random order
+   by more than the relative threshold, and also by more than z_score
+   standard errors; past the threshold but within the noise, it is
+   NOISY.  Returns the number of failures, or -1 if memory runs out.
+ */
+
+static int run_texture(const dims_t *cells, int n_mazes, int n_runs,
+                       unsigned long seed, double thresh, double z_score) {
+  static const int orders[2] = {GEN_ORDER_RANDOM, GEN_ORDER_BLOCKED};
+  double sum[2][N_TEX], sq[2][N_TEX], tex[N_TEX];
+  sample_t *samples[2];
+  unsigned char *on_path;
+  result_t res[2];
+  maze_t m;
+  int i, k, o, n_diff = 0, ok = 1;
+
+  if (!maze_init(&m, cells->x, cells->y)) return -1;
+  if ((on_path = malloc((size_t)cells->x * cells->y)) == NULL) {
+    maze_clear(&m);
+    return -1;
+  }
+  samples[0] = calloc(n_runs, sizeof(sample_t));
+  samples[1] = calloc(n_runs, sizeof(sample_t));
+  if (samples[0] == NULL || samples[1] == NULL) ok = 0;
+
+  fprintf(stderr,
+          "Texture parameters:\n"
+          "  Dimensions:  %ux%u\n"
+          " Random seed:  %lu\n"
+          "       Mazes:  %d\n"
+          "        Runs:  %d\n",
+          cells->x, cells->y, seed, n_mazes, n_runs);
+
+  memset(sum, 0, sizeof(sum));
+  memset(sq, 0, sizeof(sq));
+  for (o = 0; ok && o < 2; ++o) {
+    for (i = 0; ok && i < n_mazes; ++i) {
+      srandom(seed + i);
+      ok = maze_generate_order(&m, randomizer, orders[o]) &&
+           texture(&m, on_path, tex);
+      for (k = 0; k < N_TEX; ++k) {
+        sum[o][k] += tex[k];
+        sq[o][k] += tex[k] * tex[k];
+      }
+    }
+    for (i = 0; ok && i < n_runs; ++i) {
+      srandom(seed + i);
+      ctr_start();
+      samples[o][i].nsec = now_nsec();
+      ok = maze_generate_order(&m, randomizer, orders[o]);
+      samples[o][i].nsec = now_nsec() - samples[o][i].nsec;
+      ctr_stop(&samples[o][i]);
+    }
+    ok = ok && summarize(samples[o], n_runs, (double)cells->x * cells->y,
+                         &res[o]);
+  }
+
+  if (ok) {
+    printf("%-12s %10s %10s %10s %10s %8s %8s  %s\n", "statistic", "random",
+           "+/-", "blocked", "+/-", "change", "sigmas", "verdict");
+    for (k = 0; k < N_TEX; ++k) {
+      double mean[2], sd[2], delta, se, z;
+      const char *verdict;
+
+      for (o = 0; o < 2; ++o) {
+        mean[o] = sum[o][k] / n_mazes;
+        sd[o] = sq[o][k] / n_mazes - mean[o] * mean[o];
+        sd[o] = sd[o] > 0 ? sqrt(sd[o] * n_mazes / (n_mazes - 1)) : 0;
+      }
+      delta = mean[1] - mean[0];
+      se = sqrt((sd[0] * sd[0] + sd[1] * sd[1]) / n_mazes);
+      z = se > 0 ? delta / se : 0;
+
+      if (fabs(delta) <= thresh * fabs(mean[0]))
+        verdict = "PASS";
+      else if (fabs(z) <= z_score)
+        verdict = "NOISY";
+      else {
+        verdict = "FAIL";
+        ++n_diff;
+      }
+
+      printf("%-12s %10.5f %10.5f %10.5f %10.5f %+7.1f%% %8.2f  %s\n",
+             tex_names[k], mean[0], sd[0], mean[1], sd[1],
+             mean[0] != 0 ? 100.0 * delta / mean[0] : 0.0, z, verdict);
+    }
+
+    printf("\n%-12s %10s %10s", "benchmark", "ns/cell", "+/-");
+    for (k = 0; k < N_CTRS; ++k) printf(" %10s", ctr_names[k]);
+    printf("\n");
+    for (o = 0; o < 2; ++o) {
+      printf("%-12s %10.3f %10.3f", o ? "gen_blocked" : "generate",
+             res[o].med, res[o].mad);
+      for (k = 0; k < N_CTRS; ++k) {
+        if (res[o].ctr[k] < 0)
+          printf(" %10s", "-");
+        else
+          printf(" %10.3f", res[o].ctr[k]);
+      }
+      printf("\n");
+    }
+  }
+
+  free(samples[0]);
+  free(samples[1]);
+  free(on_path);
+  maze_clear(&m);
+  return ok ? n_diff : -1;
+}
+
+/* time_gen(rows, cols, order, n_runs, seed)
+
+   Return the median time in nanoseconds per cell to generate a maze
+   of the given size in the given order, or -1 if memory runs out.
+ */
+
+static double time_gen(rowcol_t rows, rowcol_t cols, int order, int n_runs,
+                       unsigned long seed) {
+  double *t, med = -1;
+  maze_t m;
+  int i, ok = 1;
+
+  if ((t = malloc(n_runs * sizeof(double))) == NULL) return -1;
+  if (!maze_init(&m, rows, cols)) {
+    free(t);
+    return -1;
+  }
+  for (i = 0; ok && i < n_runs; ++i) {
+    srandom(seed + i);
+    t[i] = now_nsec();
+    ok = maze_generate_order(&m, randomizer, order);
+    t[i] = (now_nsec() - t[i]) / ((double)rows * cols);
+  }
+  if (ok) med = median(t, n_runs);
+
+  maze_clear(&m);
+  free(t);
+  return med;
+}
+
+/* time_batch(n_runs, seed)
+
+   Return the median time in nanoseconds per cell to generate 32x32
+   mazes in batches of MAZE_BATCH_LANES, or -1 if memory runs out.
+ */
+
+static double time_batch(int n_runs, unsigned long seed) {
+  double *t, med = -1;
+  maze_batch_t b;
+  maze_t m;
+  unsigned int l;
+  int i, k;
+
+  if ((t = malloc(n_runs * sizeof(double))) == NULL) return -1;
+  if (!maze_init(&m, 32, 32) ||
+      !maze_batch_init(&b, MAZE_BATCH_LANES, 32, 32)) {
+    maze_clear(&m);
+    free(t);
+    return -1;
+  }
+  for (i = 0; i < n_runs; ++i) {
+    for (l = 0; l < MAZE_BATCH_LANES; ++l)
+      maze_batch_seed(&b, l, (seed + i) * MAZE_BATCH_LANES + l);
+    t[i] = now_nsec();
+    for (k = 0; k < 64; ++k) {
+      maze_batch_generate(&b);
+      for (l = 0; l < MAZE_BATCH_LANES; ++l) maze_batch_get(&b, l, &m);
+    }
+    t[i] = (now_nsec() - t[i]) / (64.0 * MAZE_BATCH_LANES * 32 * 32);
+  }
+  med = median(t, n_runs);
+
+  maze_batch_clear(&b);
+  maze_clear(&m);
+  free(t);
+  return med;
+}
+
+/* Rows read back by time_shards(), which are thrown away */
+static int drop_row(const maze_node *row, void *arg) {
+  (void)row;
+  return arg == NULL;
+}
+
+/* time_shards(*cp, side, seed)
+
+   Return the time in nanoseconds spent on shards beyond generating
+   them, for a side x side maze made in 2x2 shards in a temporary
+   directory: writing them out, stitching them, and reading the maze
+   back a row at a time.  The expected time to generate the shards,
+   according to cp, is subtracted.  Returns -1 on error.
+ */
+
+static double time_shards(const maze_costs_t *cp, rowcol_t side,
+                          unsigned long seed) {
+  maze_layout_t lay = {side, side, 2, 2, EXIT(0, DIR_L), EXIT(0, DIR_R)};
+  double t, quarter = (double)(side / 2) * (side / 2);
+  char dir[32];
+  rowcol_t i, j;
+  int ok = 1;
+
+  strcpy(dir, "/tmp/mazebench-XXXXXX");
+  if (mkdtemp(dir) == NULL) return -1;
+
+  lay.exit_2 = EXIT(side - 1, DIR_R);
+  srandom(seed);
+  t = now_nsec();
+  for (i = 0; ok && i < lay.sh_rows; ++i)
+    for (j = 0; ok && j < lay.sh_cols; ++j)
+      ok = maze_shard_generate(&lay, i, j, randomizer, dir);
+  ok = ok && maze_shard_stitch(dir, randomizer) &&
+       maze_shard_rows(dir, drop_row, NULL);
+  t = now_nsec() - t - 4 * maze_costs_gen(cp, GEN_ORDER_RANDOM, quarter);
+  remove_shards(dir, &lay);
+
+  return ok ? t : -1;
+}
+
+/* time_fork()
+
+   Return the time in nanoseconds to start a process which exits at
+   once and wait for it, as mazegen does for each shard, or -1 on
+   error.
+ */
+
+static double time_fork(void) {
+  double t = now_nsec();
+  int i, status;
+
+  for (i = 0; i < 16; ++i) {
+    pid_t pid = fork();
+
+    if (pid < 0) return -1;
+    if (pid == 0) _exit(0);
+    if (waitpid(pid, &status, 0) < 0) return -1;
+  }
+  return (now_nsec() - t) / 16;
+}
+
+/* time_emit(*mp, which, side, n_runs, fd)
+
+   Return the median time in nanoseconds to write a maze to the given
+   descriptor in the way given by a PLAN_OUT_ value, text for
+   PLAN_OUT_CELLS, on a side x side area, or -1 on error.
+ */
+
+static double time_emit(const maze_t *mp, int which, unsigned int side,
+                        int n_runs, int fd) {
+  maze_fd_sink_t ds;
+  double *t, med = -1;
+  int i, ok = 1;
+
+  if ((t = malloc(n_runs * sizeof(double))) == NULL) return -1;
+  for (i = 0; ok && i < n_runs; ++i) {
+    maze_sink_t *sp = maze_fd_sink(&ds, fd);
+
+    t[i] = now_nsec();
+    switch (which) {
+      case PLAN_OUT_CELLS:
+        ok = maze_emit_text(mp, sp, 0, 0);
+        break;
+      case PLAN_OUT_EPS:
+        ok = maze_emit_eps(mp, sp, side, side);
+        break;
+      case PLAN_OUT_GRAPH:
+        ok = maze_emit_csr(mp, sp, 0);
+        break;
+      case PLAN_OUT_IMAGE:
+        ok = maze_emit_png(mp, sp, side, side);
+        break;
+      default:
+        ok = maze_emit_rows(mp, ROWS_PNG, sp, side, side);
+        break;
+    }
+    t[i] = now_nsec() - t[i];
+  }
+  if (ok) med = median(t, n_runs);
+
+  free(t);
+  return med;
+}
+
+/* time_output(*cp, n_runs, seed)
+
+   Measure the costs of writing mazes out into cp.  Each image is
+   drawn at the same size for a large and a small maze, which
+   separates the cost of drawing the walls, per pixel of wall as
+   maze_costs_output() counts them, from that of filling and encoding
+   each pixel.  The row writer is taken to draw walls at the same
+   cost as GD.  Returns false on error.
+ */
+
+static int time_output(maze_costs_t *cp, int n_runs, unsigned long seed) {
+  static const unsigned int side = 4096;
+  double px = (side + 1.0) * (side + 1), big, small, w_big, w_small;
+  maze_t m, s;
+  int fd, ok, k;
+
+  if ((fd = open("/dev/null", O_WRONLY)) < 0) return 0;
+  if (!maze_init(&m, 1024, 1024) || !maze_init(&s, 128, 128)) {
+    close(fd);
+    return 0;
+  }
+  srandom(seed);
+  ok = maze_generate(&m, randomizer) && maze_generate(&s, randomizer);
+  w_big = (double)m.n_rows * m.n_cols * (2 * (side / m.n_rows) + 1);
+  w_small = (double)s.n_rows * s.n_cols * (2 * (side / s.n_rows) + 1);
+
+  if (ok && (big = time_emit(&m, PLAN_OUT_CELLS, side, n_runs, fd)) > 0)
+    cp->write_ns = big / (1024.0 * 1024);
+  if (ok && (big = time_emit(&m, PLAN_OUT_EPS, side, n_runs, fd)) > 0)
+    cp->eps_ns = big / (1024.0 * 1024);
+  if (ok && (big = time_emit(&m, PLAN_OUT_GRAPH, side, n_runs, fd)) > 0)
+    cp->graph_ns = big / (1024.0 * 1024);
+
+  for (k = 0; ok && k < 2; ++k) {
+    int which = k == 0 ? PLAN_OUT_IMAGE : PLAN_OUT_ROWS;
+
+    if ((big = time_emit(&m, which, side, n_runs, fd)) < 0 ||
+        (small = time_emit(&s, which, side, n_runs, fd)) < 0) {
+      ok = 0;
+      break;
+    }
+    if (k == 0 && big > small) cp->draw_ns = (big - small) / (w_big - w_small);
+    if (small > w_small * cp->draw_ns) {
+      if (k == 0)
+        cp->pixel_ns = (small - w_small * cp->draw_ns) / px;
+      else
+        cp->band_ns = (small - w_small * cp->draw_ns) / px;
+    }
+  }
+
+  maze_clear(&m);
+  maze_clear(&s);
+  close(fd);
+  return ok;
+}
+
+/* run_calibrate(*path, n_runs, seed)
+
+   Measure the costs used by maze_plan() and write them to the given
+   file.  Generation in random order is timed at three sizes, one
+   well within cache and two beyond, and the cost model's out of cache
+   cost and effective cache size are fitted to them, since what the
+   system says of its cache is often far off.  If the fit fails, the
+   default cache size is kept.  The writers are timed as well, for
+   estimating the cost of the output.  Returns false on error.
+ */
+
+static int run_calibrate(const char *path, int n_runs, unsigned long seed) {
+  static const double w_mid = 1024.0 * 1024 * MAZE_PLAN_CELL_BYTES;
+  static const double w_big = 3072.0 * 3072 * MAZE_PLAN_CELL_BYTES;
+  double small, mid, big, b_small, b_big, s_small, s_big, dc, d, miss;
+  maze_costs_t c;
+  FILE *ofp;
+
+  maze_costs_default(&c);
+  fprintf(stderr,
+          "Calibration parameters:\n"
+          " Random seed:  %lu\n"
+          "        Runs:  %d\n"
+          "       Costs:  %s\n",
+          seed, n_runs, path);
+
+  if ((small = time_gen(256, 256, GEN_ORDER_RANDOM, n_runs, seed)) < 0 ||
+      (mid = time_gen(1024, 1024, GEN_ORDER_RANDOM, n_runs, seed)) < 0 ||
+      (big = time_gen(3072, 3072, GEN_ORDER_RANDOM, n_runs, seed)) < 0 ||
+      (b_small = time_gen(256, 256, GEN_ORDER_BLOCKED, n_runs, seed)) < 0 ||
+      (b_big = time_gen(3072, 3072, GEN_ORDER_BLOCKED, n_runs, seed)) < 0 ||
+      (c.batch_ns = time_batch(n_runs, seed)) < 0)
+    return 0;
+
+  /* With d the extra cost out of cache and C the cache size, the model
+     gives t - small = d (1 - C / w) at each size w beyond cache. */
+  dc = (big - mid) / (1.0 / w_mid - 1.0 / w_big);
+  d = (big - small) + dc / w_big;
+  c.random_ns = small;
+  if (big > mid && d > 0 && dc / d < w_big) {
+    c.cache_bytes = dc / d;
+    c.random_big_ns = small + d;
+  } else if (w_big > c.cache_bytes && big > small) {
+    c.random_big_ns = small + (big - small) / (1.0 - c.cache_bytes / w_big);
+  }
+
+  c.blocked_ns = b_small;
+  miss = w_big > c.cache_bytes ? 1.0 - c.cache_bytes / w_big : 0;
+  if (miss > 0.1 && b_big > b_small)
+    c.blocked_big_ns = b_small + (b_big - b_small) / miss;
+
+  /* Shards cost t = 4 F + cells S, at two sizes, plus a process each */
+  if ((s_small = time_shards(&c, 64, seed)) < 0 ||
+      (s_big = time_shards(&c, 1024, seed)) < 0)
+    return 0;
+  c.shard_ns = (s_big - s_small) / (1024.0 * 1024 - 64.0 * 64);
+  if (c.shard_ns < 1.0) c.shard_ns = 1.0;
+  c.shard_fixed_ns = (s_small - 64.0 * 64 * c.shard_ns) / 4;
+  if (c.shard_fixed_ns < 1.0) c.shard_fixed_ns = 1.0;
+  if ((d = time_fork()) < 0) return 0;
+  c.shard_fixed_ns += d;
+
+  if (!time_output(&c, n_runs, seed)) return 0;
+
+  if (!maze_costs_save(&c, stdout)) return 0;
+  if ((ofp = fopen(path, "w")) == NULL) {
+    fprintf(stderr,
+            "Error:  Unable to open cost file '%s'\n"
+            "  -- %s\n\n",
+            path, strerror(errno));
+    return 0;
+  }
+  if (!maze_costs_save(&c, ofp) || fclose(ofp) != 0) return 0;
+
+  return 1;
+}
+
+static const char *g_usage = "Usage: mazebench [options]\n";
+
+extern char *optarg;
+extern int optind;
+
+int main(int argc, char *argv[]) {
+  int opt, use_ctrs = 1, n_runs = 5, n_open = 0, n_fail = 0;
+  int n_trials = 0, set_dims = 0, lanes = 0, n_mazes = 0, set_thresh = 0;
+  const char *json_out = NULL, *json_base = NULL, *cost_out = NULL;
+  double thresh = 0.05, z_score = 3.0;
+  result_t res[N_BENCH], base[N_BENCH];
+  dims_t cells = {1000, 1000}; /* default maze dimensions, RRxCC */
+  unsigned long rnd_seed = 1;
+  sample_t *samples[N_BENCH];
+  FILE *null_fp;
+  maze_t the_maze;
+  double n_cells;
+  int b, i, k;
+
+  while ((opt = getopt(argc, argv, "d:r:n:o:b:T:Z:V:B:S:P:ch")) != EOF) {
+    switch (opt) {
+      case 'd':
+        if (parse_dims(optarg, &cells) == 0) {
+          fprintf(stderr,
+                  "Error:  Incorrect format for maze dimensions\n"
+                  "  -- use RRxCC format\n\n");
+          return 1;
+        }
+        set_dims = 1;
+        break;
+      case 'r':
+        if ((rnd_seed = strtoul(optarg, NULL, 0)) == ULONG_MAX ||
+            (rnd_seed == 0 && errno == EINVAL)) {
+          fprintf(stderr,
+                  "Error:  Incorrect format for random seed\n"
+                  "  -- value must be an unsigned long integer\n\n");
+          return 1;
+        }
+        break;
+      case 'n':
+        if ((n_runs = atoi(optarg)) <= 0) {
+          fprintf(stderr,
+                  "Error:  Number of runs must be a positive integer\n\n");
+          return 1;
+        }
+        break;
+      case 'o':
+        json_out = optarg;
+        break;
+      case 'b':
+        json_base = optarg;
+        break;
+      case 'T':
+        set_thresh = 1;
+        if ((thresh = strtod(optarg, NULL) / 100.0) <= 0) {
+          fprintf(stderr,
+                  "Error:  Regression threshold must be a positive "
+                  "percentage\n\n");
+          return 1;
+        }
+        break;
+      case 'Z':
+        if ((z_score = strtod(optarg, NULL)) < 0) {
+          fprintf(stderr, "Error:  Noise factor must not be negative\n\n");
+          return 1;
+        }
+        break;
+      case 'V':
+        if ((n_trials = atoi(optarg)) <= 0) {
+          fprintf(stderr,
+                  "Error:  Number of trials must be a positive integer\n\n");
+          return 1;
+        }
+        break;
+      case 'B':
+        if ((lanes = atoi(optarg)) <= 0 || lanes > MAZE_BATCH_LANES) {
+          fprintf(stderr,
+                  "Error:  Number of lanes must be from 1 to %u\n\n",
+                  MAZE_BATCH_LANES);
+          return 1;
+        }
+        break;
+      case 'S':
+        if ((n_mazes = atoi(optarg)) < 2) {
+          fprintf(stderr, "Error:  Number of mazes must be at least 2\n\n");
+          return 1;
+        }
+        break;
+      case 'P':
+        cost_out = optarg;
+        break;
+      case 'c':
+        use_ctrs = 0;
+        break;
+      case 'h':
+        fputs(g_usage, stderr);
+        fprintf(
+            stderr,
+            "\nCommand line options include:\n"
+            "  -d RxC     : specify maze dimensions (default 1000x1000)\n"
+            "  -r seed    : specify random seed (default: 1)\n"
+            "  -n runs    : number of runs of each benchmark (default 5)\n"
+            "  -o file    : write results to file as JSON\n"
+            "  -b file    : compare results to a baseline JSON file\n"
+            "  -T pct     : regression threshold in percent (default 5)\n"
+            "  -Z factor  : noise factor for regressions (default 3)\n"
+            "  -V trials  : run differential checks instead of benchmarks\n"
+            "  -B lanes   : time batches of small mazes instead\n"
+            "  -S mazes   : compare the texture of generation orders instead\n"
+            "  -P file    : measure costs for automatic plans into file\n"
+            "  -c         : do not read hardware performance counters\n"
+            "  -h         : display this help message\n\n"
+
+            "Each run generates a maze, solves it corner to corner, and\n"
+            "writes it in every output format to /dev/null.  The median\n"
+            "over all runs is reported, normalized per cell.  Hardware\n"
+            "counters are read via perf_event_open(2) where available;\n"
+            "counters the kernel will not provide are shown as '-'.\n\n"
+
+            "With -b, each benchmark is checked against the baseline.  A\n"
+            "benchmark fails if its median is slower by more than the\n"
+            "threshold and by more than factor times the combined noise\n"
+            "(median absolute deviation) of the two runs.  The exit status\n"
+            "is nonzero if any benchmark fails.\n\n"
+
+            "With -V, each library fast path is compared against its\n"
+            "reference on the given number of random seeds and sizes (up\n"
+            "to the -d dimensions, default 48x48).  Failing cases are shrunk\n"
+            "and printed as a mazegen command line.\n\n"
+
+            "With -B, many mazes of the -d dimensions (default 32x32) are\n"
+            "generated and solved one at a time and then in batches of the\n"
+            "given number of lanes, and the throughput of each is reported\n"
+            "in mazes per second.  Batch solving needs at most 64\n"
+            "columns.\n\n"
+
+            "With -S, the given number of mazes of the -d dimensions\n"
+            "(default 256x256) are generated in both the random and the\n"
+            "blocked order, and statistics of their texture compared.  As\n"
+            "with -b, a statistic fails if it differs by more than the\n"
+            "threshold (default 10 here) and by more than factor standard\n"
+            "errors, and the exit status is nonzero if any fails.\n"
+            "Generation in each order is timed as well.\n\n"
+
+            "With -P, the costs of the generation engines are measured and\n"
+            "written to the given file, for `mazegen --auto --costs file'\n"
+            "to plan with.  Mazes of up to 3072x3072 are generated, -n times\n"
+            "each.\n\n"
+
+            "The vector kernels are chosen for the processor at run time;\n"
+            "set MAZE_ISA to scalar, sse2, avx2, or avx512 to force a\n"
+            "narrower set.  With -V, the checks of the kernels are\n"
+            "repeated with every set the processor supports.\n\n");
+        return 0;
+      default:
+        fputs(g_usage, stderr);
+        fputs("  [use `mazebench -h' for help with options]\n", stderr);
+        return 1;
+    }
+  }
+
+  if (cells.x == 0 || cells.y == 0) {
+    fprintf(stderr,
+            "Error:  A maze must have at least one row "
+            "and one column\n\n");
+    return 1;
+  }
+  if (n_trials > 0) {
+    dims_t max = {48, 48};
+
+    return run_checks(n_trials, set_dims ? &cells : &max, rnd_seed) ? 1 : 0;
+  }
+  if (lanes > 0) {
+    dims_t small = {32, 32};
+
+    if (!run_batch(set_dims ? &cells : &small, lanes, n_runs, rnd_seed)) {
+      fprintf(stderr, "Error:  Unable to run batch generation\n\n");
+      return 1;
+    }
+    return 0;
+  }
+  if (cost_out != NULL) {
+    if (!run_calibrate(cost_out, n_runs, rnd_seed)) {
+      fprintf(stderr, "Error:  Unable to measure costs\n\n");
+      return 1;
+    }
+    return 0;
+  }
+  if (n_mazes > 0) {
+    dims_t tex = {256, 256};
+
+    if (use_ctrs) ctr_open();
+    n_fail = run_texture(set_dims ? &cells : &tex, n_mazes, n_runs, rnd_seed,
+                         set_thresh ? thresh : 0.1, z_score);
+    ctr_close();
+    if (n_fail < 0) {
+      fprintf(stderr, "Error:  Unable to compare generation orders\n\n");
+      return 1;
+    }
+    return n_fail ? 1 : 0;
+  }
+  if (json_base != NULL && !load_baseline(json_base, &cells, base)) return 1;
+
+  if ((null_fp = fopen("/dev/null", "wb")) == NULL) {
+    fprintf(stderr, "Error:  Unable to open /dev/null\n  -- %s\n\n",
+            strerror(errno));
+    return 1;
+  }
+
+  if (!maze_init(&the_maze, cells.x, cells.y)) {
+    fprintf(stderr, "Error:  Insufficient memory to create %u x %u maze\n\n",
+            cells.x, cells.y);
+    return 1;
+  }
+
+  for (b = 0; b < N_BENCH; ++b) {
+    if ((samples[b] = calloc(n_runs, sizeof(sample_t))) == NULL) {
+      fprintf(stderr, "Error:  Insufficient memory for samples\n\n");
+      return 1;
+    }
+  }
+
+  if (use_ctrs) n_open = ctr_open();
+
+  fprintf(stderr,
+          "Benchmark parameters:\n"
+          "  Dimensions:  %ux%u\n"
+          " Random seed:  %lu\n"
+          "        Runs:  %d\n"
+          "    Counters:  %d of %d available\n"
+          "     Kernels:  %s\n",
+          cells.x, cells.y, rnd_seed, n_runs, n_open, N_CTRS,
+          maze_cpu_name(maze_cpu_isa()));
+
+  for (i = 0; i < n_runs; ++i) {
+    srandom(rnd_seed + i);
+
+    for (b = 0; b < N_BENCH; ++b) {
+      if (!run_once(&the_maze, b, null_fp, &samples[b][i])) {
+        fprintf(stderr,
+                "Error:  Insufficient memory to generate %u x %u maze\n\n",
+                cells.x, cells.y);
+        return 1;
+      }
+    }
+  }
+
+  /* Report medians, normalized per cell */
+  n_cells = (double)cells.x * cells.y;
+  printf("%-12s %10s %10s", "benchmark", "ns/cell", "+/-");
+  for (k = 0; k < N_CTRS; ++k) printf(" %10s", ctr_names[k]);
+  printf(" %6s\n", "IPC");
+
+  for (b = 0; b < N_BENCH; ++b) {
+    if (!summarize(samples[b], n_runs, n_cells, &res[b])) return 1;
+
+    printf("%-12s %10.3f %10.3f", bench_names[b], res[b].med, res[b].mad);
+    for (k = 0; k < N_CTRS; ++k) {
+      if (res[b].ctr[k] < 0)
+        printf(" %10s", "-");
+      else
+        printf(" %10.3f", res[b].ctr[k]);
+    }
+
+    if (res[b].ctr[CTR_CYCLES] > 0 && res[b].ctr[CTR_INSNS] >= 0)
+      printf(" %6.2f\n", res[b].ctr[CTR_INSNS] / res[b].ctr[CTR_CYCLES]);
+    else
+      printf(" %6s\n", "-");
+  }
+
+  if (json_out != NULL) {
+    FILE *ofp = fopen(json_out, "w");
+
+    if (ofp == NULL) {
+      fprintf(stderr,
+              "Error:  Unable to open output file '%s'\n"
+              "  -- %s\n\n",
+              json_out, strerror(errno));
+      return 1;
+    }
+    write_json(ofp, &cells, rnd_seed, n_runs, res);
+    fclose(ofp);
+  }
+
+  if (json_base != NULL) n_fail = check_baseline(res, base, thresh, z_score);
+
+  ctr_close();
+  for (b = 0; b < N_BENCH; ++b) free(samples[b]);
+  maze_clear(&the_maze);
+  fclose(null_fp);
+
+  return n_fail ? 1 : 0;
+}
+
+/* Here there be dragons */
@@ -0,0 +1,715 @@
+/*
+  Name:     mazecpu.c
+  Purpose:  Vector kernels chosen for the processor at run time.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#include "mazecpu.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The vector variants are compiled for their own instruction sets
+   whatever the flags of the build, and only called once the processor
+   is known to support them. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CPU_X86 1
+#define TARGET(T) __attribute__((target(T)))
+#endif
+
+static const char *cpu_names[MAZE_ISA_COUNT] = {"scalar", "sse2", "avx2",
+                                                "avx512"};
+
+/* s_walls_scalar(*cells, n, *below)
+
+   Gather the walls of n cells one at a time.  Missing cells at the end
+   count as having no walls.
+ */
+
+static unsigned long long s_walls_scalar(const maze_node *cells,
+                                         unsigned int n,
+                                         unsigned long long *below) {
+  unsigned long long right = 0, bottom = 0;
+  unsigned int i;
+
+  for (i = 0; i < n; ++i) {
+    right |= (unsigned long long)cells[i].r_wall << i;
+    bottom |= (unsigned long long)cells[i].b_wall << i;
+  }
+  *below = bottom;
+  return right;
+}
+
+/* s_blocks_scalar(*cells, n, *out)
+
+   Pack the walls of blocks of cells a cell at a time.
+ */
+
+static void s_blocks_scalar(const maze_node *cells, size_t n,
+                            unsigned int *out) {
+  size_t k;
+  unsigned int i, w;
+
+  for (k = 0; k < n; ++k, cells += 16) {
+    for (i = 0, w = 0; i < 16; ++i)
+      w |= ((unsigned int)cells[i].r_wall << i) |
+           ((unsigned int)cells[i].b_wall << (16 + i));
+    out[k] = w;
+  }
+}
+
+/* s_expand_scalar(*row, n, *cell_sq, *wall_sq)
+
+   Expand a row of cells into grid squares one cell at a time.
+ */
+
+static void s_expand_scalar(const maze_node *row, size_t n,
+                            unsigned char *cell_sq, unsigned char *wall_sq) {
+  size_t c;
+
+  for (c = 0; c < n; ++c) {
+    cell_sq[2 * c] = 0;
+    cell_sq[2 * c + 1] = row[c].r_wall;
+    wall_sq[2 * c] = row[c].b_wall;
+    wall_sq[2 * c + 1] = 1;
+  }
+}
+
+/* s_pack_scalar(*sq, n, *out)
+
+   Pack squares into bits a byte at a time.
+ */
+
+static void s_pack_scalar(const unsigned char *sq, size_t n,
+                          unsigned char *out) {
+  size_t x;
+
+  for (x = 0; x < n; x += 8) {
+    unsigned int k, b = 0;
+
+    for (k = 0; k < 8; ++k) b |= (unsigned int)(sq[x + k] & 1) << k;
+    out[x / 8] = (unsigned char)b;
+  }
+}
+
+/* s_spread_scalar(*cur, *right, *down, *nxt, stride, n_rows, lanes,
+                   *diff)
+
+   Spread the reached cells of each lane a word at a time.
+ */
+
+static void s_spread_scalar(const unsigned long long *cur,
+                            const unsigned long long *right,
+                            const unsigned long long *down,
+                            unsigned long long *nxt, size_t stride,
+                            size_t n_rows, unsigned int lanes,
+                            unsigned long long *diff) {
+  const unsigned long long *cur_up = cur - stride, *cur_dn = cur + stride;
+  const unsigned long long *down_up = down - stride;
+  size_t r, x;
+  unsigned int l;
+
+  for (l = 0; l < lanes; ++l) diff[l] = 0;
+  for (r = 0; r < n_rows; ++r) {
+    for (l = 0; l < lanes; ++l) {
+      unsigned long long c, e, n;
+
+      x = r * stride + l;
+      c = cur[x];
+      e = right[x];
+      n = c | ((c & e) << 1) | ((c >> 1) & e) | (cur_up[x] & down_up[x]) |
+          (cur_dn[x] & down[x]);
+      nxt[x] = n;
+      diff[l] |= n ^ c;
+    }
+  }
+}
+
+#ifdef CPU_X86
+/* s_walls_sse2(*cells, n, *below)
+
+   Gather the walls of sixteen cells at a time.  Shifting each 16-bit
+   lane left by 7 (or 6) moves bit 0 (or 1) of both of its bytes to
+   the top of the byte, where movemask collects it.
+ */
+
+TARGET("sse2")
+static unsigned long long s_walls_sse2(const maze_node *cells, unsigned int n,
+                                       unsigned long long *below) {
+  unsigned long long right = 0, bottom = 0, tail_b, tail_r;
+  unsigned int i = 0;
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(cells + i));
+
+    right |= (unsigned long long)(unsigned int)_mm_movemask_epi8(
+                 _mm_slli_epi16(v, 7))
+             << i;
+    bottom |= (unsigned long long)(unsigned int)_mm_movemask_epi8(
+                  _mm_slli_epi16(v, 6))
+              << i;
+  }
+  if (i < n) {
+    tail_r = s_walls_scalar(cells + i, n - i, &tail_b);
+    right |= tail_r << i;
+    bottom |= tail_b << i;
+  }
+  *below = bottom;
+  return right;
+}
+
+/* s_blocks_sse2(*cells, n, *out)
+
+   Pack the walls of one block at a time, with a movemask for each
+   kind of wall.
+ */
+
+TARGET("sse2")
+static void s_blocks_sse2(const maze_node *cells, size_t n,
+                          unsigned int *out) {
+  size_t k;
+
+  for (k = 0; k < n; ++k) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(cells + 16 * k));
+    unsigned int r = (unsigned int)_mm_movemask_epi8(_mm_slli_epi16(v, 7));
+    unsigned int b = (unsigned int)_mm_movemask_epi8(_mm_slli_epi16(v, 6));
+
+    out[k] = r | (b << 16);
+  }
+}
+
+/* s_expand_sse2(*row, n, *cell_sq, *wall_sq)
+
+   Expand sixteen cells at a time: the walls of each are isolated, and
+   interleaved with zeros or ones into the squares.
+ */
+
+TARGET("sse2")
+static void s_expand_sse2(const maze_node *row, size_t n,
+                          unsigned char *cell_sq, unsigned char *wall_sq) {
+  const __m128i one = _mm_set1_epi8(1), zero = _mm_setzero_si128();
+  size_t c = 0;
+
+  for (; c + 16 <= n; c += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(row + c));
+    __m128i rw = _mm_and_si128(v, one);
+    __m128i bw = _mm_and_si128(_mm_srli_epi16(v, 1), one);
+
+    _mm_storeu_si128((__m128i *)(cell_sq + 2 * c),
+                     _mm_unpacklo_epi8(zero, rw));
+    _mm_storeu_si128((__m128i *)(cell_sq + 2 * c + 16),
+                     _mm_unpackhi_epi8(zero, rw));
+    _mm_storeu_si128((__m128i *)(wall_sq + 2 * c),
+                     _mm_unpacklo_epi8(bw, one));
+    _mm_storeu_si128((__m128i *)(wall_sq + 2 * c + 16),
+                     _mm_unpackhi_epi8(bw, one));
+  }
+  s_expand_scalar(row + c, n - c, cell_sq + 2 * c, wall_sq + 2 * c);
+}
+
+/* s_pack_sse2(*sq, n, *out)
+
+   Pack sixteen squares at a time with movemask.
+ */
+
+TARGET("sse2")
+static void s_pack_sse2(const unsigned char *sq, size_t n,
+                        unsigned char *out) {
+  size_t x = 0;
+
+  for (; x + 16 <= n; x += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(sq + x));
+    unsigned int m = (unsigned int)_mm_movemask_epi8(_mm_slli_epi16(v, 7));
+
+    out[x / 8] = (unsigned char)m;
+    out[x / 8 + 1] = (unsigned char)(m >> 8);
+  }
+  s_pack_scalar(sq + x, n - x, out + x / 8);
+}
+
+/* s_spread_sse2(*cur, *right, *down, *nxt, stride, n_rows, lanes,
+                 *diff)
+
+   Spread the reached cells of two lanes at a time.
+ */
+
+TARGET("sse2")
+static void s_spread_sse2(const unsigned long long *cur,
+                          const unsigned long long *right,
+                          const unsigned long long *down,
+                          unsigned long long *nxt, size_t stride,
+                          size_t n_rows, unsigned int lanes,
+                          unsigned long long *diff) {
+  const unsigned long long *cur_up = cur - stride, *cur_dn = cur + stride;
+  const unsigned long long *down_up = down - stride;
+  size_t r, x;
+  unsigned int l;
+
+#define LOAD2(P) _mm_loadu_si128((const __m128i *)(P))
+  for (l = 0; l < lanes; l += 2) {
+    __m128i acc = _mm_setzero_si128();
+
+    for (r = 0, x = l; r < n_rows; ++r, x += stride) {
+      __m128i c = LOAD2(cur + x), e = LOAD2(right + x), n;
+
+      n = _mm_or_si128(c, _mm_slli_epi64(_mm_and_si128(c, e), 1));
+      n = _mm_or_si128(n, _mm_and_si128(_mm_srli_epi64(c, 1), e));
+      n = _mm_or_si128(
+          n, _mm_or_si128(_mm_and_si128(LOAD2(cur_up + x), LOAD2(down_up + x)),
+                          _mm_and_si128(LOAD2(cur_dn + x), LOAD2(down + x))));
+      _mm_storeu_si128((__m128i *)(nxt + x), n);
+      acc = _mm_or_si128(acc, _mm_xor_si128(n, c));
+    }
+    _mm_storeu_si128((__m128i *)(diff + l), acc);
+  }
+#undef LOAD2
+}
+
+/* s_walls_avx2(*cells, n, *below)
+
+   Gather the walls of 32 cells at a time, as s_walls_sse2() does.
+ */
+
+TARGET("avx2")
+static unsigned long long s_walls_avx2(const maze_node *cells, unsigned int n,
+                                       unsigned long long *below) {
+  unsigned long long right = 0, bottom = 0, tail_b, tail_r;
+  unsigned int i = 0;
+
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(cells + i));
+
+    right |= (unsigned long long)(unsigned int)_mm256_movemask_epi8(
+                 _mm256_slli_epi16(v, 7))
+             << i;
+    bottom |= (unsigned long long)(unsigned int)_mm256_movemask_epi8(
+                  _mm256_slli_epi16(v, 6))
+              << i;
+  }
+  if (i < n) {
+    tail_r = s_walls_sse2(cells + i, n - i, &tail_b);
+    right |= tail_r << i;
+    bottom |= tail_b << i;
+  }
+  *below = bottom;
+  return right;
+}
+
+/* s_blocks_avx2(*cells, n, *out)
+
+   Pack the walls of two blocks at a time; each mask holds one kind of
+   wall for both blocks, which are then split between their words.
+ */
+
+TARGET("avx2")
+static void s_blocks_avx2(const maze_node *cells, size_t n,
+                          unsigned int *out) {
+  size_t k = 0;
+
+  for (; k + 2 <= n; k += 2) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(cells + 16 * k));
+    unsigned int r =
+        (unsigned int)_mm256_movemask_epi8(_mm256_slli_epi16(v, 7));
+    unsigned int b =
+        (unsigned int)_mm256_movemask_epi8(_mm256_slli_epi16(v, 6));
+
+    out[k] = (r & 0xffffU) | (b << 16);
+    out[k + 1] = (r >> 16) | (b & 0xffff0000U);
+  }
+  s_blocks_sse2(cells + 16 * k, n - k, out + k);
+}
+
+/* s_expand_avx2(*row, n, *cell_sq, *wall_sq)
+
+   Expand 32 cells at a time.  The unpacks work within each 128-bit
+   half, so the halves of their results are put back in order with a
+   permute.
+ */
+
+TARGET("avx2")
+static void s_expand_avx2(const maze_node *row, size_t n,
+                          unsigned char *cell_sq, unsigned char *wall_sq) {
+  const __m256i one = _mm256_set1_epi8(1), zero = _mm256_setzero_si256();
+  size_t c = 0;
+
+  for (; c + 32 <= n; c += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(row + c));
+    __m256i rw = _mm256_and_si256(v, one);
+    __m256i bw = _mm256_and_si256(_mm256_srli_epi16(v, 1), one);
+    __m256i lo = _mm256_unpacklo_epi8(zero, rw);
+    __m256i hi = _mm256_unpackhi_epi8(zero, rw);
+
+    _mm256_storeu_si256((__m256i *)(cell_sq + 2 * c),
+                        _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i *)(cell_sq + 2 * c + 32),
+                        _mm256_permute2x128_si256(lo, hi, 0x31));
+    lo = _mm256_unpacklo_epi8(bw, one);
+    hi = _mm256_unpackhi_epi8(bw, one);
+    _mm256_storeu_si256((__m256i *)(wall_sq + 2 * c),
+                        _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i *)(wall_sq + 2 * c + 32),
+                        _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  s_expand_sse2(row + c, n - c, cell_sq + 2 * c, wall_sq + 2 * c);
+}
+
+/* s_pack_avx2(*sq, n, *out)
+
+   Pack 32 squares at a time with movemask.  The bytes of the mask are
+   stored in little-endian order, which is the order of the squares.
+ */
+
+TARGET("avx2")
+static void s_pack_avx2(const unsigned char *sq, size_t n,
+                        unsigned char *out) {
+  size_t x = 0;
+
+  for (; x + 32 <= n; x += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(sq + x));
+    unsigned int m =
+        (unsigned int)_mm256_movemask_epi8(_mm256_slli_epi16(v, 7));
+
+    memcpy(out + x / 8, &m, 4);
+  }
+  s_pack_sse2(sq + x, n - x, out + x / 8);
+}
+
+/* s_spread_avx2(*cur, *right, *down, *nxt, stride, n_rows, lanes,
+                 *diff)
+
+   Spread the reached cells of four lanes at a time.
+ */
+
+TARGET("avx2")
+static void s_spread_avx2(const unsigned long long *cur,
+                          const unsigned long long *right,
+                          const unsigned long long *down,
+                          unsigned long long *nxt, size_t stride,
+                          size_t n_rows, unsigned int lanes,
+                          unsigned long long *diff) {
+  const unsigned long long *cur_up = cur - stride, *cur_dn = cur + stride;
+  const unsigned long long *down_up = down - stride;
+  size_t r, x;
+  unsigned int l;
+
+#define LOAD4(P) _mm256_loadu_si256((const __m256i *)(P))
+  for (l = 0; l < lanes; l += 4) {
+    __m256i acc = _mm256_setzero_si256();
+
+    for (r = 0, x = l; r < n_rows; ++r, x += stride) {
+      __m256i c = LOAD4(cur + x), e = LOAD4(right + x), n;
+
+      n = _mm256_or_si256(c, _mm256_slli_epi64(_mm256_and_si256(c, e), 1));
+      n = _mm256_or_si256(n, _mm256_and_si256(_mm256_srli_epi64(c, 1), e));
+      n = _mm256_or_si256(
+          n, _mm256_or_si256(
+                 _mm256_and_si256(LOAD4(cur_up + x), LOAD4(down_up + x)),
+                 _mm256_and_si256(LOAD4(cur_dn + x), LOAD4(down + x))));
+      _mm256_storeu_si256((__m256i *)(nxt + x), n);
+      acc = _mm256_or_si256(acc, _mm256_xor_si256(n, c));
+    }
+    _mm256_storeu_si256((__m256i *)(diff + l), acc);
+  }
+#undef LOAD4
+}
+
+/* s_walls_avx512(*cells, n, *below)
+
+   Gather the walls of up to 64 cells at once.  A masked load reads
+   only the n cells asked for, and zeroes the rest; a byte test then
+   collects each wall bit.
+ */
+
+TARGET("avx512f,avx512bw")
+static unsigned long long s_walls_avx512(const maze_node *cells,
+                                         unsigned int n,
+                                         unsigned long long *below) {
+  __mmask64 m = n >= 64 ? ~(__mmask64)0 : ((__mmask64)1 << n) - 1;
+  __m512i v = _mm512_maskz_loadu_epi8(m, cells);
+
+  *below = _mm512_test_epi8_mask(v, _mm512_set1_epi8(2));
+  return _mm512_test_epi8_mask(v, _mm512_set1_epi8(1));
+}
+
+/* s_blocks_avx512(*cells, n, *out)
+
+   Pack the walls of four blocks at a time from two byte tests.
+ */
+
+TARGET("avx512f,avx512bw")
+static void s_blocks_avx512(const maze_node *cells, size_t n,
+                            unsigned int *out) {
+  const __m512i one = _mm512_set1_epi8(1), two = _mm512_set1_epi8(2);
+  size_t k = 0;
+
+  for (; k + 4 <= n; k += 4) {
+    __m512i v = _mm512_loadu_si512(cells + 16 * k);
+    unsigned long long r = _mm512_test_epi8_mask(v, one);
+    unsigned long long b = _mm512_test_epi8_mask(v, two);
+
+    out[k] = (unsigned int)(r & 0xffffU) | (unsigned int)(b & 0xffffU) << 16;
+    out[k + 1] = (unsigned int)((r >> 16) & 0xffffU) |
+                 (unsigned int)((b >> 16) & 0xffffU) << 16;
+    out[k + 2] = (unsigned int)((r >> 32) & 0xffffU) |
+                 (unsigned int)((b >> 32) & 0xffffU) << 16;
+    out[k + 3] = (unsigned int)(r >> 48) | (unsigned int)(b >> 48) << 16;
+  }
+  s_blocks_avx2(cells + 16 * k, n - k, out + k);
+}
+
+/* s_expand_avx512(*row, n, *cell_sq, *wall_sq)
+
+   Expand 64 cells at a time.  The unpacks work within each 128-bit
+   quarter, so the quarters of their results are put back in order
+   with a two-source permute of 64-bit words.
+ */
+
+TARGET("avx512f,avx512bw")
+static void s_expand_avx512(const maze_node *row, size_t n,
+                            unsigned char *cell_sq, unsigned char *wall_sq) {
+  const __m512i one = _mm512_set1_epi8(1), zero = _mm512_setzero_si512();
+  const __m512i first = _mm512_set_epi64(11, 10, 3, 2, 9, 8, 1, 0);
+  const __m512i second = _mm512_set_epi64(15, 14, 7, 6, 13, 12, 5, 4);
+  size_t c = 0;
+
+  for (; c + 64 <= n; c += 64) {
+    __m512i v = _mm512_loadu_si512(row + c);
+    __m512i rw = _mm512_and_si512(v, one);
+    __m512i bw = _mm512_and_si512(_mm512_srli_epi16(v, 1), one);
+    __m512i lo = _mm512_unpacklo_epi8(zero, rw);
+    __m512i hi = _mm512_unpackhi_epi8(zero, rw);
+
+    _mm512_storeu_si512(cell_sq + 2 * c,
+                        _mm512_permutex2var_epi64(lo, first, hi));
+    _mm512_storeu_si512(cell_sq + 2 * c + 64,
+                        _mm512_permutex2var_epi64(lo, second, hi));
+    lo = _mm512_unpacklo_epi8(bw, one);
+    hi = _mm512_unpackhi_epi8(bw, one);
+    _mm512_storeu_si512(wall_sq + 2 * c,
+                        _mm512_permutex2var_epi64(lo, first, hi));
+    _mm512_storeu_si512(wall_sq + 2 * c + 64,
+                        _mm512_permutex2var_epi64(lo, second, hi));
+  }
+  s_expand_avx2(row + c, n - c, cell_sq + 2 * c, wall_sq + 2 * c);
+}
+
+/* s_pack_avx512(*sq, n, *out)
+
+   Pack 64 squares at a time with a byte test.
+ */
+
+TARGET("avx512f,avx512bw")
+static void s_pack_avx512(const unsigned char *sq, size_t n,
+                          unsigned char *out) {
+  const __m512i one = _mm512_set1_epi8(1);
+  size_t x = 0;
+
+  for (; x + 64 <= n; x += 64) {
+    unsigned long long m =
+        _mm512_test_epi8_mask(_mm512_loadu_si512(sq + x), one);
+
+    memcpy(out + x / 8, &m, 8);
+  }
+  s_pack_avx2(sq + x, n - x, out + x / 8);
+}
+
+/* s_spread_avx512(*cur, *right, *down, *nxt, stride, n_rows, lanes,
+                   *diff)
+
+   Spread the reached cells of eight lanes at a time.
+ */
+
+TARGET("avx512f")
+static void s_spread_avx512(const unsigned long long *cur,
+                            const unsigned long long *right,
+                            const unsigned long long *down,
+                            unsigned long long *nxt, size_t stride,
+                            size_t n_rows, unsigned int lanes,
+                            unsigned long long *diff) {
+  const unsigned long long *cur_up = cur - stride, *cur_dn = cur + stride;
+  const unsigned long long *down_up = down - stride;
+  size_t r, x;
+  unsigned int l;
+
+  for (l = 0; l < lanes; l += 8) {
+    __m512i acc = _mm512_setzero_si512();
+
+    for (r = 0, x = l; r < n_rows; ++r, x += stride) {
+      __m512i c = _mm512_loadu_si512(cur + x);
+      __m512i e = _mm512_loadu_si512(right + x), n;
+
+      n = _mm512_or_si512(c, _mm512_slli_epi64(_mm512_and_si512(c, e), 1));
+      n = _mm512_or_si512(n, _mm512_and_si512(_mm512_srli_epi64(c, 1), e));
+      n = _mm512_or_si512(
+          n, _mm512_or_si512(_mm512_and_si512(_mm512_loadu_si512(cur_up + x),
+                                              _mm512_loadu_si512(down_up + x)),
+                             _mm512_and_si512(_mm512_loadu_si512(cur_dn + x),
+                                              _mm512_loadu_si512(down + x))));
+      _mm512_storeu_si512(nxt + x, n);
+      acc = _mm512_or_si512(acc, _mm512_xor_si512(n, c));
+    }
+    _mm512_storeu_si512(diff + l, acc);
+  }
+}
+#endif /* CPU_X86 */
+
+/* The kernels of each instruction set; those not built are empty. */
+static const maze_kernels_t cpu_kernels[MAZE_ISA_COUNT] = {
+    {MAZE_ISA_SCALAR, s_walls_scalar, s_blocks_scalar, s_expand_scalar,
+     s_pack_scalar, s_spread_scalar},
+#ifdef CPU_X86
+    {MAZE_ISA_SSE2, s_walls_sse2, s_blocks_sse2, s_expand_sse2, s_pack_sse2,
+     s_spread_sse2},
+    {MAZE_ISA_AVX2, s_walls_avx2, s_blocks_avx2, s_expand_avx2, s_pack_avx2,
+     s_spread_avx2},
+    {MAZE_ISA_AVX512, s_walls_avx512, s_blocks_avx512, s_expand_avx512,
+     s_pack_avx512, s_spread_avx512},
+#endif
+};
+
+/* The kernels in use, or NULL until they are first needed */
+static const maze_kernels_t *g_kernels = NULL;
+
+/* s_supported(isa)
+
+   Report whether the kernels of an instruction set were built, and can
+   run on this processor.
+ */
+
+static int s_supported(int isa) {
+  if (isa < 0 || isa >= MAZE_ISA_COUNT || cpu_kernels[isa].walls == NULL)
+    return 0;
+  if (isa == MAZE_ISA_SCALAR) return 1;
+  if (sizeof(maze_node) != 1) return 0;
+
+#ifdef CPU_X86
+  __builtin_cpu_init();
+  switch (isa) {
+    case MAZE_ISA_SSE2:
+      return __builtin_cpu_supports("sse2");
+    case MAZE_ISA_AVX2:
+      return __builtin_cpu_supports("avx2");
+    case MAZE_ISA_AVX512:
+      return __builtin_cpu_supports("avx512f") &&
+             __builtin_cpu_supports("avx512bw");
+    default:
+      break;
+  }
+#endif
+  return 0;
+}
+
+/* s_choose()
+
+   Choose the kernels for this processor, or those named by MAZE_ISA
+   if they can run here.
+ */
+
+static const maze_kernels_t *s_choose(void) {
+  const char *env = getenv("MAZE_ISA");
+  int isa = maze_cpu_best(), want;
+
+  if (env == NULL || *env == '\0') return &cpu_kernels[isa];
+
+  for (want = 0; want < MAZE_ISA_COUNT; ++want)
+    if (strcmp(env, cpu_names[want]) == 0) break;
+
+  if (want == MAZE_ISA_COUNT) {
+    fprintf(stderr, "maze_kernels:  unknown MAZE_ISA '%s', using %s\n", env,
+            cpu_names[isa]);
+  } else if (!s_supported(want)) {
+    while (want > isa || !s_supported(want)) --want;
+    fprintf(stderr, "maze_kernels:  %s is not supported here, using %s\n",
+            env, cpu_names[want]);
+    isa = want;
+  } else {
+    isa = want;
+  }
+  return &cpu_kernels[isa];
+}
+
+/* maze_kernels()
+
+   The choice is made once, on the first call.  Threads that race to
+   make it all make the same one.
+ */
+
+const maze_kernels_t *maze_kernels(void) {
+  const maze_kernels_t *kp = __atomic_load_n(&g_kernels, __ATOMIC_ACQUIRE);
+
+  if (kp == NULL) {
+    kp = s_choose();
+    __atomic_store_n(&g_kernels, kp, __ATOMIC_RELEASE);
+  }
+  return kp;
+}
+
+/* maze_cpu_isa()
+
+   Return the instruction set of the kernels in use.
+ */
+
+int maze_cpu_isa(void) {
+  return maze_kernels()->isa;
+}
+
+/* maze_cpu_best()
+
+   Return the most capable instruction set that can run here.  The
+   scalar kernels always can.
+ */
+
+int maze_cpu_best(void) {
+  int isa = MAZE_ISA_COUNT - 1;
+
+  while (isa > MAZE_ISA_SCALAR && !s_supported(isa)) --isa;
+  return isa;
+}
+
+/* maze_cpu_force(isa)
+
+   Switch to the kernels of the given instruction set, if they can run
+   here.
+ */
+
+int maze_cpu_force(int isa) {
+  if (!s_supported(isa)) return 0;
+
+  __atomic_store_n(&g_kernels, &cpu_kernels[isa], __ATOMIC_RELEASE);
+  return 1;
+}
+
+/* maze_cpu_name(isa)
+
+   Return the name of an instruction set, or "unknown".
+ */
+
+const char *maze_cpu_name(int isa) {
+  if (isa < 0 || isa >= MAZE_ISA_COUNT) return "unknown";
+
+  return cpu_names[isa];
+}
+
+/* Here there be dragons */
@@ -0,0 +1,118 @@
+/*
+  Name:     mazecpu.h
+  Purpose:  Vector kernels chosen for the processor at run time.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#ifndef MAZECPU_H_
+#define MAZECPU_H_
+
+#include "maze.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The few loops of the library that work on many cells at once --
+   packing walls into bits for the batch solver and the hash, drawing
+   occupancy grids, and spreading the reached cells of a batch solve --
+   have a variant for each instruction set below.  On x86 with GCC or
+   Clang, the best one the processor supports is chosen the first time
+   any is needed, so one build runs well everywhere; elsewhere only the
+   scalar variants exist.  Setting MAZE_ISA in the environment to the
+   name of a variant chooses that one instead, or the best supported
+   one below it.  Every variant gives exactly the same results. */
+
+/** Instruction sets with kernel variants, from least to most capable. */
+enum {
+  MAZE_ISA_SCALAR = 0, /* Portable C                     */
+  MAZE_ISA_SSE2 = 1,   /* 16 bytes at a time             */
+  MAZE_ISA_AVX2 = 2,   /* 32 bytes at a time             */
+  MAZE_ISA_AVX512 = 3, /* 64 bytes at a time (AVX-512BW) */
+  MAZE_ISA_COUNT
+};
+
+/** The kernels of one instruction set.  Each relies on GCC allocating
+    the bit-fields of a maze_node from the low bit, so that r_wall is
+    bit 0 and b_wall bit 1 of a one-byte cell; where that is not so,
+    only the scalar kernels are used. */
+typedef struct {
+  int isa; /* Which instruction set, a MAZE_ISA_ constant */
+
+  /** Return the right walls of n cells, at most 64, as bit i for cell
+      i, and store their bottom walls the same way in *below. */
+  unsigned long long (*walls)(const maze_node *cells, unsigned int n,
+                              unsigned long long *below);
+
+  /** Pack the walls of n blocks of 16 cells into a word each, with
+      the right wall of cell i of the block in bit i and its bottom
+      wall in bit 16 + i; see mazehash.h. */
+  void (*blocks)(const maze_node *cells, size_t n, unsigned int *out);
+
+  /** Expand n cells of a row into occupancy grid squares: for cell c,
+      squares 2c and 2c + 1 of cell_sq are 0 and its right wall, and
+      those of wall_sq its bottom wall and 1. */
+  void (*expand)(const maze_node *row, size_t n, unsigned char *cell_sq,
+                 unsigned char *wall_sq);
+
+  /** Pack bit 0 of each of n bytes, a multiple of 8, into bits, byte x
+      in bit x % 8 of out[x / 8]. */
+  void (*pack)(const unsigned char *sq, size_t n, unsigned char *out);
+
+  /** One step of a batch solve over n_rows rows of lanes words each,
+      stride words apart: a cell is reached in nxt if it is in cur, or
+      an open neighbour is.  The row before the first and after the
+      last must be readable, and lanes may be rounded up to the vector
+      width as long as that is at most stride.  The bits that changed
+      in each lane are stored in diff. */
+  void (*spread)(const unsigned long long *cur,
+                 const unsigned long long *right,
+                 const unsigned long long *down, unsigned long long *nxt,
+                 size_t stride, size_t n_rows, unsigned int lanes,
+                 unsigned long long *diff);
+} maze_kernels_t;
+
+/** Return the kernels in use, choosing them on the first call. */
+const maze_kernels_t *maze_kernels(void);
+
+/** Return the instruction set of the kernels in use. */
+int maze_cpu_isa(void);
+
+/** Return the most capable instruction set this processor supports. */
+int maze_cpu_best(void);
+
+/** Use the kernels of the given instruction set from now on, for
+    testing and benchmarks.  This is not safe while other threads are
+    using the library.  Returns false, changing nothing, if the
+    processor or the build does not support it. */
+int maze_cpu_force(int isa);
+
+/** Return the name of an instruction set, as MAZE_ISA takes it:
+    "scalar", "sse2", "avx2", or "avx512". */
+const char *maze_cpu_name(int isa);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end MAZECPU_H_ */
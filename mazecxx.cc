@@ -0,0 +1,224 @@
+/*
+  Name:     mazecxx.cc
+  Purpose:  Timing the C++ interface of maze.hpp against the C calls.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <unistd.h> /* for getopt() */
+
+#include "maze.hpp"
+
+/* Each operation is timed through the C interface and through the
+   C++ one on the same maze, in alternate runs, and the best run of
+   each is reported.  The two should take the same time. */
+
+static const char *g_usage = "Usage: mazecxx [-d RxC] [-n runs]\n";
+
+static double randomizer() {
+  static const double w = (double)INT_MAX + 1.0;
+
+  return random() / w;
+}
+
+static double now_msec() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* The state shared by the timed operations */
+struct bench_t {
+  rowcol_t rows, cols;
+  maze_t *mp;            /* A maze, for the C interface   */
+  maze::owner *op;       /* The same maze, for the C++ one */
+  std::vector<char> buf; /* Room for the text of the maze */
+  std::string text;      /* The same room, for an iterator */
+  unsigned long sink;    /* Keeps results from being optimized away */
+};
+
+typedef void (*op_f)(bench_t *bp);
+
+static void c_generate(bench_t *bp) {
+  maze_t m;
+
+  if (!maze_init(&m, bp->rows, bp->cols)) abort();
+  srandom(1);
+  if (!maze_generate(&m, randomizer)) abort();
+  bp->sink += m.cells[0].r_wall;
+  maze_clear(&m);
+}
+
+static void cxx_generate(bench_t *bp) {
+  maze::owner m(bp->rows, bp->cols);
+
+  srandom(1);
+  m.generate(randomizer);
+  bp->sink += m(0, 0).r_wall;
+}
+
+static void c_solve(bench_t *bp) {
+  maze_find_path(bp->mp, 0, 0, bp->rows - 1, bp->cols - 1);
+  maze_unmark(bp->mp);
+}
+
+static void cxx_solve(bench_t *bp) {
+  bp->op->find_path(0, 0, bp->rows - 1, bp->cols - 1);
+  bp->op->unmark();
+}
+
+static void c_walk(bench_t *bp) {
+  rowcol_t r, c;
+
+  for (r = 0; r < bp->mp->n_rows; ++r) {
+    for (c = 0; c < bp->mp->n_cols; ++c)
+      bp->sink += CELLV(bp->mp, r, c).r_wall;
+  }
+}
+
+static void cxx_walk(bench_t *bp) {
+  for (maze::row_view row : maze::view(*bp->op)) {
+    for (const maze_node &n : row) bp->sink += n.r_wall;
+  }
+}
+
+static void c_text(bench_t *bp) {
+  maze_buf_sink_t bs;
+  maze_sink_t *sp = maze_buf_sink(&bs, bp->buf.data(), bp->buf.size());
+
+  if (!maze_emit_text(bp->mp, sp, 0, 0)) abort();
+  bp->sink += bs.len;
+}
+
+static void cxx_text(bench_t *bp) {
+  std::size_t n =
+      maze::write_to(*bp->op, maze::TEXT, bp->buf.data(), bp->buf.size());
+
+  if (n == 0) abort();
+  bp->sink += n;
+}
+
+static void cxx_text_iter(bench_t *bp) {
+  bp->text.clear();
+  maze::write(*bp->op, maze::TEXT, std::back_inserter(bp->text));
+  bp->sink += bp->text.size();
+}
+
+/* time_op(op, *bp)
+
+   Return the time in milliseconds of one run of op.
+ */
+
+static double time_op(op_f op, bench_t *bp) {
+  double start = now_msec();
+
+  op(bp);
+  return now_msec() - start;
+}
+
+int main(int argc, char *argv[]) {
+  static const struct {
+    const char *name;
+    op_f c_op, cxx_op;
+  } ops[] = {
+      {"generate", c_generate, cxx_generate},
+      {"solve", c_solve, cxx_solve},
+      {"walk cells", c_walk, cxx_walk},
+      {"text, buffer", c_text, cxx_text},
+      {"text, iterator", c_text, cxx_text_iter},
+  };
+  unsigned long rows = 1000, cols = 1000;
+  int opt, n_runs = 5;
+  std::size_t i;
+  bench_t b;
+  maze_t m;
+
+  while ((opt = getopt(argc, argv, "d:n:h")) != EOF) {
+    switch (opt) {
+      case 'd':
+        if (sscanf(optarg, "%lux%lu", &rows, &cols) != 2 || rows == 0 ||
+            cols == 0) {
+          fprintf(stderr,
+                  "Error:  Incorrect format for maze dimensions\n"
+                  "  -- use RRxCC format\n\n");
+          return 1;
+        }
+        break;
+      case 'n':
+        if ((n_runs = atoi(optarg)) < 1) {
+          fprintf(stderr, "Error:  Number of runs must be at least 1\n\n");
+          return 1;
+        }
+        break;
+      default:
+        fputs(g_usage, stderr);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (!maze_init(&m, rows, cols)) {
+    fprintf(stderr, "Error:  Insufficient memory for %lux%lu maze\n\n", rows,
+            cols);
+    return 1;
+  }
+  maze::owner om(rows, cols);
+
+  srandom(1);
+  maze_generate(&m, randomizer);
+  srandom(1);
+  om.generate(randomizer);
+
+  b.rows = rows;
+  b.cols = cols;
+  b.mp = &m;
+  b.op = &om;
+  b.sink = 0;
+  b.buf.resize((4 * cols + 2) * (2 * rows + 1));
+  b.text.reserve(b.buf.size());
+
+  printf("%lux%lu maze, best of %d runs\n\n", rows, cols, n_runs);
+  printf("%-16s %10s %10s %8s\n", "Operation", "C (ms)", "C++ (ms)", "Ratio");
+  for (i = 0; i < sizeof(ops) / sizeof(*ops); ++i) {
+    double tc = 0, tx = 0, t;
+    int k;
+
+    /* Runs alternate, so both sides see the same conditions */
+    for (k = 0; k < n_runs; ++k) {
+      if ((t = time_op(ops[i].c_op, &b)) < tc || k == 0) tc = t;
+      if ((t = time_op(ops[i].cxx_op, &b)) < tx || k == 0) tx = t;
+    }
+
+    printf("%-16s %10.3f %10.3f %8.3f\n", ops[i].name, tc, tx, tx / tc);
+  }
+
+  maze_clear(&m);
+  return b.sink == 0; /* Never true, but the compiler cannot tell */
+}
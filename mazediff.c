@@ -0,0 +1,333 @@
+/*
+  Name:     mazediff.c
+  Purpose:  Compact differences between versions of a maze.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#include "mazediff.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mazehash.h"
+
+#define DIFF_HDR_SIZE 56
+#define DIFF_VERSION 1
+
+/* Changes at most this many unchanged cells apart share a run, which
+   costs no more than starting a new one */
+#define DIFF_GAP 4
+
+/* Cells compared a block at a time, as raw bytes, before looking at
+   the walls of each one */
+#define DIFF_BLOCK 64
+
+static const char diff_magic[4] = {'M', 'Z', 'D', 'F'};
+
+/* Output is collected in a small buffer and passed on as it fills. */
+typedef struct {
+  maze_sink_t *sink;
+  size_t len;
+  int ok;
+  unsigned char buf[4096];
+} s_out_t;
+
+/* s_out_drain(*op)
+
+   Pass the buffered output to the sink.  After an error, output is
+   discarded.
+ */
+
+static void s_out_drain(s_out_t *op) {
+  if (op->len > 0 && op->ok && !op->sink->write(op->sink, op->buf, op->len))
+    op->ok = 0;
+  op->len = 0;
+}
+
+static void s_out_byte(s_out_t *op, unsigned int b) {
+  if (op->len == sizeof(op->buf)) s_out_drain(op);
+  op->buf[op->len++] = (unsigned char)b;
+}
+
+static void s_out_le(s_out_t *op, uint64_t v, int n) {
+  while (n-- > 0) {
+    s_out_byte(op, v & 0xff);
+    v >>= 8;
+  }
+}
+
+static void s_out_num(s_out_t *op, rowcol_t v) {
+  while (v >= 0x80) {
+    s_out_byte(op, (v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  s_out_byte(op, v);
+}
+
+/* s_walls(n)
+
+   Return the walls of a cell as two bits, right wall first.
+ */
+
+static unsigned int s_walls(maze_node n) { return n.r_wall | (n.b_wall << 1); }
+
+/* s_out_run(*op, *mp, gap, start, end)
+
+   Write the run of cells of mp from start to end, which begins gap
+   cells after the previous one.
+ */
+
+static void s_out_run(s_out_t *op, const maze_t *mp, rowcol_t gap,
+                      rowcol_t start, rowcol_t end) {
+  unsigned int b = 0;
+  rowcol_t pos;
+
+  s_out_num(op, gap);
+  s_out_num(op, end - start);
+  for (pos = start; pos < end; ++pos) {
+    b |= s_walls(mp->cells[pos]) << (2 * ((pos - start) % 4));
+    if ((pos - start) % 4 == 3 || pos + 1 == end) {
+      s_out_byte(op, b);
+      b = 0;
+    }
+  }
+}
+
+/* maze_diff(*old, *mp, *sp)
+
+   Cells are compared a block at a time first, since a block whose
+   bytes match has no changed walls; most of an edited maze is skipped
+   this way.
+ */
+
+int maze_diff(const maze_t *old, const maze_t *mp, maze_sink_t *sp) {
+  rowcol_t n_cells = mp->n_rows * mp->n_cols, pos = 0, start = 0, end = 0;
+  rowcol_t last = 0;
+  unsigned long long hash[2];
+  s_out_t out;
+  int i;
+
+  if (old->n_rows != mp->n_rows || old->n_cols != mp->n_cols) {
+    fprintf(stderr, "maze_diff:  mazes are of different sizes\n");
+    return 0;
+  }
+  out.sink = sp;
+  out.len = 0;
+  out.ok = 1;
+  for (i = 0; i < 4; ++i) s_out_byte(&out, diff_magic[i]);
+  s_out_le(&out, DIFF_VERSION, 4);
+  s_out_le(&out, mp->n_rows, 4);
+  s_out_le(&out, mp->n_cols, 4);
+  s_out_le(&out, mp->exit_1, 4);
+  s_out_le(&out, mp->exit_2, 4);
+  maze_hash(old, hash);
+  s_out_le(&out, hash[0], 8);
+  s_out_le(&out, hash[1], 8);
+  maze_hash(mp, hash);
+  s_out_le(&out, hash[0], 8);
+  s_out_le(&out, hash[1], 8);
+
+  while (pos < n_cells) {
+    if (pos % DIFF_BLOCK == 0 && n_cells - pos >= DIFF_BLOCK &&
+        memcmp(old->cells + pos, mp->cells + pos,
+               DIFF_BLOCK * sizeof(maze_node)) == 0) {
+      pos += DIFF_BLOCK;
+      continue;
+    }
+    if (s_walls(old->cells[pos]) != s_walls(mp->cells[pos])) {
+      if (end > start && pos - end <= DIFF_GAP) {
+        end = pos + 1;
+      } else {
+        if (end > start) {
+          s_out_run(&out, mp, start - last, start, end);
+          last = end;
+        }
+        start = pos;
+        end = pos + 1;
+      }
+    }
+    ++pos;
+  }
+  if (end > start) s_out_run(&out, mp, start - last, start, end);
+  s_out_num(&out, 0);
+  s_out_num(&out, 0);
+
+  s_out_drain(&out);
+  if (out.ok && sp->flush != NULL && !sp->flush(sp)) out.ok = 0;
+  return out.ok;
+}
+
+/* s_get_le(*p, n)
+
+   Read an n-byte little-endian number.
+ */
+
+static uint64_t s_get_le(const unsigned char *p, int n) {
+  uint64_t v = 0;
+
+  while (n-- > 0) v = (v << 8) | p[n];
+  return v;
+}
+
+/* s_get_num(**pp, *end, *out)
+
+   Read an unsigned LEB128 number of at most 32 bits at *pp, before
+   end, and advance *pp past it.  Returns false if it is damaged.
+ */
+
+static int s_get_num(const unsigned char **pp, const unsigned char *end,
+                     rowcol_t *out) {
+  uint64_t v = 0;
+  int shift;
+
+  for (shift = 0; *pp < end && shift < 35; shift += 7) {
+    unsigned int b = *(*pp)++;
+
+    v |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      *out = (rowcol_t)v;
+      return v <= UINT32_MAX;
+    }
+  }
+  return 0;
+}
+
+/* s_runs(*p, *end, n_cells, *n_run)
+
+   Check that the runs of a diff starting at p fit in a maze of
+   n_cells cells and end exactly at end, and set *n_run to the number
+   of cells they cover.  Returns false if they do not.
+ */
+
+static int s_runs(const unsigned char *p, const unsigned char *end,
+                  rowcol_t n_cells, rowcol_t *n_run) {
+  rowcol_t gap, n, pos = 0;
+
+  *n_run = 0;
+  for (;;) {
+    if (!s_get_num(&p, end, &gap) || !s_get_num(&p, end, &n)) return 0;
+    if (n == 0) return gap == 0 && p == end;
+    if (gap > n_cells - pos || n > n_cells - pos - gap ||
+        (size_t)(end - p) < n / 4 + (n % 4 != 0))
+      return 0;
+
+    pos += gap + n;
+    *n_run += n;
+    p += n / 4 + (n % 4 != 0);
+  }
+}
+
+/* maze_patch(*mp, *diff, len)
+
+   The diff is checked through before the maze is touched, and the
+   old walls of every cell in its runs are kept until the new hash has
+   been checked, so that they can be put back.  The hash is kept up to
+   date cell by cell with maze_hash_edit(), so after the first pass
+   over the maze to check the old version, the work is in proportion
+   to the size of the diff.
+ */
+
+int maze_patch(maze_t *mp, const void *diff, size_t len) {
+  const unsigned char *p = diff, *end = p + len;
+  rowcol_t n_cells = mp->n_rows * mp->n_cols, n_run, gap = 0, n = 0, pos = 0;
+  rowcol_t k = 0, i, old_exit_1 = mp->exit_1, old_exit_2 = mp->exit_2;
+  unsigned long long hash[2];
+  maze_node *saved, *np;
+  maze_hash_t hs;
+
+  if (len < DIFF_HDR_SIZE || memcmp(p, diff_magic, 4) != 0 ||
+      s_get_le(p + 4, 4) != DIFF_VERSION) {
+    fprintf(stderr, "maze_patch:  not a maze diff\n");
+    return 0;
+  }
+  if (s_get_le(p + 8, 4) != mp->n_rows || s_get_le(p + 12, 4) != mp->n_cols) {
+    fprintf(stderr, "maze_patch:  diff is for a %ux%u maze, not %ux%u\n",
+            (rowcol_t)s_get_le(p + 8, 4), (rowcol_t)s_get_le(p + 12, 4),
+            mp->n_rows, mp->n_cols);
+    return 0;
+  }
+  if (!s_runs(p + DIFF_HDR_SIZE, end, n_cells, &n_run)) {
+    fprintf(stderr, "maze_patch:  diff is damaged\n");
+    return 0;
+  }
+
+  maze_hash_init(mp, &hs);
+  maze_hash_digest(mp, &hs, hash);
+  if (hash[0] != s_get_le(p + 24, 8) || hash[1] != s_get_le(p + 32, 8)) {
+    fprintf(stderr, "maze_patch:  maze is not the version the diff is from\n");
+    return 0;
+  }
+  if ((saved = malloc((n_run ? n_run : 1) * sizeof(maze_node))) == NULL) {
+    fprintf(stderr, "maze_patch:  insufficient memory\n");
+    return 0;
+  }
+
+  mp->exit_1 = (rowcol_t)s_get_le(p + 16, 4);
+  mp->exit_2 = (rowcol_t)s_get_le(p + 20, 4);
+  p += DIFF_HDR_SIZE;
+  for (;;) {
+    s_get_num(&p, end, &gap);
+    s_get_num(&p, end, &n);
+    if (n == 0) break;
+
+    pos += gap;
+    for (i = 0; i < n; ++i, ++pos) {
+      unsigned int w = (p[i / 4] >> (2 * (i % 4))) & 0x3;
+
+      np = mp->cells + pos;
+      saved[k++] = *np;
+      if (s_walls(*np) != w) {
+        np->r_wall = w & 1;
+        np->b_wall = w >> 1;
+        maze_hash_edit(mp, &hs, pos / mp->n_cols, pos % mp->n_cols,
+                       saved[k - 1]);
+      }
+    }
+    p += n / 4 + (n % 4 != 0);
+  }
+
+  maze_hash_digest(mp, &hs, hash);
+  p = diff;
+  if (hash[0] != s_get_le(p + 40, 8) || hash[1] != s_get_le(p + 48, 8)) {
+    /* Put the old walls back, run by run */
+    p += DIFF_HDR_SIZE;
+    pos = k = 0;
+    for (;;) {
+      s_get_num(&p, end, &gap);
+      s_get_num(&p, end, &n);
+      if (n == 0) break;
+
+      for (pos += gap, i = 0; i < n; ++i) mp->cells[pos++] = saved[k++];
+      p += n / 4 + (n % 4 != 0);
+    }
+    mp->exit_1 = old_exit_1;
+    mp->exit_2 = old_exit_2;
+    free(saved);
+    fprintf(stderr, "maze_patch:  patched maze does not match the diff\n");
+    return 0;
+  }
+
+  free(saved);
+  return 1;
+}
@@ -0,0 +1,83 @@
+/*
+  Name:     mazediff.h
+  Purpose:  Compact differences between versions of a maze.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#ifndef MAZEDIFF_H_
+#define MAZEDIFF_H_
+
+#include "maze.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A diff carries the walls of the cells that changed between two
+   versions of a maze of the same size, so that a copy of the first
+   can be brought up to date with traffic in proportion to the edits.
+   Markers and visit flags are not carried.  All numbers are
+   little-endian:
+
+     bytes 0-3     the tag "MZDF"
+     bytes 4-7     uint32 format version (1)
+     bytes 8-15    uint32 height, width
+     bytes 16-23   uint32 entrance and exit of the new version
+     bytes 24-39   uint64[2] structural hash of the old version
+     bytes 40-55   uint64[2] structural hash of the new version
+     then          runs of changed cells, in row major order
+
+   A run is two unsigned LEB128 numbers, the count of unchanged cells
+   since the end of the previous run (or the start of the maze) and
+   the count n of cells in the run, followed by (n + 3) / 4 bytes of
+   walls: cell i of the run has its right wall in bit 2 * (i % 4) and
+   its bottom wall in the next bit of byte i / 4.  Changes a few cells
+   apart share a run, with the cells between them as they are.  A run
+   of zero cells after zero unchanged ones ends the diff.  The hashes
+   are those of maze_hash() (see mazehash.h). */
+
+/** Write the difference between two versions of a maze, which must
+    have the same size, to a sink.  Returns false in case of a write
+    error, or with a diagnostic if the sizes differ.
+
+    @param old   Pointer to the earlier version.
+    @param mp    Pointer to the later version.
+    @param sp    Sink to write the diff to.
+ */
+int maze_diff(const maze_t *old, const maze_t *mp, maze_sink_t *sp);
+
+/** Apply a diff of len bytes at diff, written by maze_diff(), to a
+    maze, which must be the version it was taken from.  The maze is
+    checked against the hash of that version before anything is
+    changed, and against the hash of the new version afterward; if
+    either check fails, or the diff is damaged, the maze is left as it
+    was.  Markers are left as they are.  Returns false with a
+    diagnostic on error.
+ */
+int maze_patch(maze_t *mp, const void *diff, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end MAZEDIFF_H_ */
@@ -0,0 +1,403 @@
+/*
+  Name:     mazefb.c
+  Purpose:  Incremental drawing of a maze into a framebuffer.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#include "mazefb.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+const unsigned char maze_fb_palette[9] = {0,   0,   0,   255, 255,
+                                          255, 102, 102, 255};
+
+/* A rectangle of pixels being drawn, with inclusive bounds */
+typedef struct {
+  long x1, y1, x2, y2;
+} s_clip_t;
+
+/* s_fb_cell(*mp, r, c)
+
+   Return the cell at row r and column c as it should be drawn, with
+   its right or bottom wall removed if one of the exits passes
+   through it, as the writers in maze.c do.
+ */
+
+static maze_node s_fb_cell(const maze_t *mp, rowcol_t r, rowcol_t c) {
+  maze_node n = CELLV(mp, r, c);
+
+  if (c == mp->n_cols - 1 &&
+      (mp->exit_1 == EXIT(r, DIR_R) || mp->exit_2 == EXIT(r, DIR_R)))
+    n.r_wall = 0;
+  if (r == mp->n_rows - 1 &&
+      (mp->exit_1 == EXIT(c, DIR_D) || mp->exit_2 == EXIT(c, DIR_D)))
+    n.b_wall = 0;
+
+  return n;
+}
+
+/* s_fb_box(*fp, *cp, x1, y1, x2, y2, clr)
+
+   Set every pixel of the rectangle with corners (x1, y1) and (x2, y2)
+   that lies within clip cp, the same way GD draws the lines and
+   rectangles of maze_write_png().
+ */
+
+static void s_fb_box(maze_fb_t *fp, const s_clip_t *cp, long x1, long y1,
+                     long x2, long y2, int clr) {
+  long y, t;
+
+  if (x1 > x2) {
+    t = x1;
+    x1 = x2;
+    x2 = t;
+  }
+  if (y1 > y2) {
+    t = y1;
+    y1 = y2;
+    y2 = t;
+  }
+  if (x1 < cp->x1) x1 = cp->x1;
+  if (x2 > cp->x2) x2 = cp->x2;
+  if (y1 < cp->y1) y1 = cp->y1;
+  if (y2 > cp->y2) y2 = cp->y2;
+  if (x1 > x2 || y1 > y2) return;
+
+  for (y = y1; y <= y2; ++y)
+    memset(fp->pixels + (size_t)y * fp->width + x1, clr, x2 - x1 + 1);
+}
+
+/* s_fb_range(lo, hi, wid, n, *first, *last)
+
+   Find the cells along one axis, of n cells wid pixels wide, whose
+   drawing can reach pixels lo to hi.  A cell k draws from pixel
+   (k - 1) * wid - 2 to (k + 2) * wid + 2 at most, counting the path
+   markers that reach into its neighbours.
+ */
+
+static void s_fb_range(long lo, long hi, long wid, rowcol_t n, long *first,
+                       long *last) {
+  *first = (wid == 0 || lo < 2 * wid + 2) ? 0 : (lo - 2) / wid - 2;
+  *last = (wid == 0) ? (long)n - 1 : (hi + 2) / wid + 1;
+  if (*last > (long)n - 1) *last = (long)n - 1;
+}
+
+/* s_fb_paint(*fp, *mp, *cp)
+
+   Draw every pixel within clip cp afresh: the background, then the
+   top and left walls, then the walls and path markers of the cells,
+   in the same order as maze_write_png(), but only those that can
+   reach the clip.  Since each piece is drawn as it would be for the
+   whole image, the pixels come out the same.
+ */
+
+static void s_fb_paint(maze_fb_t *fp, const maze_t *mp, const s_clip_t *cp) {
+  long h_wid = fp->h_wid, v_wid = fp->v_wid, h_base, v_base;
+  long r, c, r_lo, r_hi, c_lo, c_hi, y;
+
+  for (y = cp->y1; y <= cp->y2; ++y)
+    memset(fp->pixels + (size_t)y * fp->width + cp->x1, FB_WHITE,
+           cp->x2 - cp->x1 + 1);
+
+  s_fb_range(cp->x1, cp->x2, h_wid, mp->n_cols, &c_lo, &c_hi);
+  s_fb_range(cp->y1, cp->y2, v_wid, mp->n_rows, &r_lo, &r_hi);
+
+  if (cp->y1 == 0) {
+    for (c = c_lo; c <= c_hi; ++c) {
+      if (mp->exit_1 != EXIT(c, DIR_U) && mp->exit_2 != EXIT(c, DIR_U))
+        s_fb_box(fp, cp, c * h_wid, 0, c * h_wid + h_wid, 0, FB_BLACK);
+    }
+  }
+  if (cp->x1 == 0) {
+    for (r = r_lo; r <= r_hi; ++r) {
+      if (mp->exit_1 != EXIT(r, DIR_L) && mp->exit_2 != EXIT(r, DIR_L))
+        s_fb_box(fp, cp, 0, r * v_wid, 0, r * v_wid + v_wid, FB_BLACK);
+    }
+  }
+
+  for (r = r_lo; r <= r_hi; ++r) {
+    v_base = r * v_wid;
+
+    for (c = c_lo; c <= c_hi; ++c) {
+      maze_node n = s_fb_cell(mp, r, c);
+
+      h_base = c * h_wid;
+
+      if (n.r_wall)
+        s_fb_box(fp, cp, h_base + h_wid, v_base, h_base + h_wid,
+                 v_base + v_wid, FB_BLACK);
+
+      if (n.b_wall)
+        s_fb_box(fp, cp, h_base, v_base + v_wid, h_base + h_wid,
+                 v_base + v_wid, FB_BLACK);
+
+      if (n.visit) {
+        long left = 0, top = 0, width = 0, height = 0;
+
+        switch (n.marker) {
+          case DIR_U:
+          case DIR_D:
+            width = h_wid - 4;
+            height = 2 * v_wid - 4;
+            break;
+          case DIR_L:
+          case DIR_R:
+            width = 2 * h_wid - 4;
+            height = v_wid - 4;
+            break;
+        }
+
+        switch (n.marker) {
+          case DIR_R:
+          case DIR_D:
+            left = h_base + 2;
+            top = v_base + 2;
+            break;
+          case DIR_L:
+            left = h_base - h_wid + 2;
+            top = v_base + 2;
+            break;
+          case DIR_U:
+            left = h_base + 2;
+            top = v_base - v_wid + 2;
+            break;
+        }
+
+        s_fb_box(fp, cp, left, top, left + width, top + height, FB_PATH);
+      }
+    }
+  }
+}
+
+/* s_fb_touch_exit(*fp, exit)
+
+   Touch the cell whose border an exit opens, if it is in the maze.
+ */
+
+static void s_fb_touch_exit(maze_fb_t *fp, rowcol_t exit) {
+  rowcol_t pos = EPOS(exit);
+
+  switch (EDIR(exit)) {
+    case DIR_U:
+      if (pos < fp->n_cols) maze_fb_touch(fp, 0, pos);
+      break;
+    case DIR_L:
+      if (pos < fp->n_rows) maze_fb_touch(fp, pos, 0);
+      break;
+    case DIR_R:
+      if (pos < fp->n_rows) maze_fb_touch(fp, pos, fp->n_cols - 1);
+      break;
+    default:
+      if (pos < fp->n_cols) maze_fb_touch(fp, fp->n_rows - 1, pos);
+      break;
+  }
+}
+
+/* s_fb_tile_cells(*fp, t, *r0, *r1, *c0, *c1)
+
+   Find the first and last rows and columns of cells in tile t.
+ */
+
+static void s_fb_tile_cells(const maze_fb_t *fp, unsigned int t, rowcol_t *r0,
+                            rowcol_t *r1, rowcol_t *c0, rowcol_t *c1) {
+  *r0 = (t / fp->t_cols) * MAZE_FB_TILE;
+  *c0 = (t % fp->t_cols) * MAZE_FB_TILE;
+  *r1 = (fp->n_rows - *r0 > MAZE_FB_TILE) ? *r0 + MAZE_FB_TILE - 1
+                                          : fp->n_rows - 1;
+  *c1 = (fp->n_cols - *c0 > MAZE_FB_TILE) ? *c0 + MAZE_FB_TILE - 1
+                                          : fp->n_cols - 1;
+}
+
+/* s_cmp_tile(*a, *b)
+
+   Order tile numbers for qsort().
+ */
+
+static int s_cmp_tile(const void *a, const void *b) {
+  unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* maze_fb_init(*fp, *mp, h_res, v_res)
+
+   Every array is allocated here at its largest, so that an update
+   never needs memory.
+ */
+
+int maze_fb_init(maze_fb_t *fp, const maze_t *mp, unsigned int h_res,
+                 unsigned int v_res) {
+  size_t n_cells = (size_t)mp->n_rows * mp->n_cols, n_tiles;
+  s_clip_t all;
+
+  memset(fp, 0, sizeof(*fp));
+  if ((size_t)h_res + 1 > SIZE_MAX / ((size_t)v_res + 1)) return 0;
+
+  fp->width = h_res + 1;
+  fp->height = v_res + 1;
+  fp->h_wid = h_res / mp->n_cols;
+  fp->v_wid = v_res / mp->n_rows;
+  fp->n_rows = mp->n_rows;
+  fp->n_cols = mp->n_cols;
+  fp->exit_1 = mp->exit_1;
+  fp->exit_2 = mp->exit_2;
+  fp->t_rows = (mp->n_rows + MAZE_FB_TILE - 1) / MAZE_FB_TILE;
+  fp->t_cols = (mp->n_cols + MAZE_FB_TILE - 1) / MAZE_FB_TILE;
+  n_tiles = (size_t)fp->t_rows * fp->t_cols;
+
+  fp->pixels = malloc((size_t)fp->width * fp->height);
+  fp->drawn = malloc(n_cells * sizeof(maze_node));
+  fp->dirty = calloc(n_tiles, 1);
+  fp->pending = malloc(n_tiles * sizeof(*fp->pending));
+  fp->rects = malloc(n_tiles * sizeof(*fp->rects));
+  if (fp->pixels == NULL || fp->drawn == NULL || fp->dirty == NULL ||
+      fp->pending == NULL || fp->rects == NULL) {
+    maze_fb_clear(fp);
+    return 0;
+  }
+
+  memcpy(fp->drawn, mp->cells, n_cells * sizeof(maze_node));
+  all.x1 = all.y1 = 0;
+  all.x2 = fp->width - 1;
+  all.y2 = fp->height - 1;
+  s_fb_paint(fp, mp, &all);
+  return 1;
+}
+
+/* maze_fb_clear(*fp)
+
+   Release the arrays.
+ */
+
+void maze_fb_clear(maze_fb_t *fp) {
+  free(fp->pixels);
+  free(fp->drawn);
+  free(fp->dirty);
+  free(fp->pending);
+  free(fp->rects);
+  memset(fp, 0, sizeof(*fp));
+}
+
+/* maze_fb_touch(*fp, r, c)
+
+   Mark the tile holding the cell, once.
+ */
+
+void maze_fb_touch(maze_fb_t *fp, rowcol_t r, rowcol_t c) {
+  unsigned int t = (r / MAZE_FB_TILE) * fp->t_cols + c / MAZE_FB_TILE;
+
+  if (!fp->dirty[t]) {
+    fp->dirty[t] = 1;
+    fp->pending[fp->n_pending++] = t;
+  }
+}
+
+/* maze_fb_scan(*fp, *mp)
+
+   Compare the maze with the cells as last drawn, a tile at a time,
+   skipping tiles already marked.
+ */
+
+void maze_fb_scan(maze_fb_t *fp, const maze_t *mp) {
+  rowcol_t r0, r1, c0, c1, r;
+  unsigned int t;
+
+  for (t = 0; t < fp->t_rows * fp->t_cols; ++t) {
+    if (fp->dirty[t]) continue;
+
+    s_fb_tile_cells(fp, t, &r0, &r1, &c0, &c1);
+    for (r = r0; r <= r1; ++r) {
+      if (memcmp(CELLP(mp, r, c0), fp->drawn + (size_t)r * fp->n_cols + c0,
+                 (c1 - c0 + 1) * sizeof(maze_node)) != 0) {
+        maze_fb_touch(fp, r, c0);
+        break;
+      }
+    }
+  }
+}
+
+/* maze_fb_update(*fp, *mp, **rects)
+
+   Marked tiles are sorted, so that neighbours in a row of tiles can
+   be drawn together as one rectangle.  Each rectangle covers its
+   tiles' cells and everything they can draw on, which reaches a cell
+   beyond them on every side.
+ */
+
+unsigned int maze_fb_update(maze_fb_t *fp, const maze_t *mp,
+                            const maze_rect_t **rects) {
+  long h_wid = fp->h_wid, v_wid = fp->v_wid;
+  unsigned int i, j, k, n_rects = 0;
+  rowcol_t r0, r1, c0, c1, a0, a1, r;
+  s_clip_t clip;
+
+  if (mp->exit_1 != fp->exit_1 || mp->exit_2 != fp->exit_2) {
+    s_fb_touch_exit(fp, fp->exit_1);
+    s_fb_touch_exit(fp, fp->exit_2);
+    s_fb_touch_exit(fp, mp->exit_1);
+    s_fb_touch_exit(fp, mp->exit_2);
+    fp->exit_1 = mp->exit_1;
+    fp->exit_2 = mp->exit_2;
+  }
+
+  qsort(fp->pending, fp->n_pending, sizeof(*fp->pending), s_cmp_tile);
+  for (i = 0; i < fp->n_pending; i = j) {
+    unsigned int row = fp->pending[i] / fp->t_cols;
+
+    for (j = i + 1; j < fp->n_pending; ++j) {
+      if (fp->pending[j] != fp->pending[j - 1] + 1 ||
+          fp->pending[j] / fp->t_cols != row)
+        break;
+    }
+
+    s_fb_tile_cells(fp, fp->pending[i], &r0, &r1, &c0, &a1);
+    s_fb_tile_cells(fp, fp->pending[j - 1], &a0, &a1, &a0, &c1);
+
+    clip.x1 = ((long)c0 - 1) * h_wid - 2;
+    clip.x2 = ((long)c1 + 2) * h_wid + 2;
+    clip.y1 = ((long)r0 - 1) * v_wid - 2;
+    clip.y2 = ((long)r1 + 2) * v_wid + 2;
+    if (clip.x1 < 0) clip.x1 = 0;
+    if (clip.y1 < 0) clip.y1 = 0;
+    if (clip.x2 > (long)fp->width - 1) clip.x2 = fp->width - 1;
+    if (clip.y2 > (long)fp->height - 1) clip.y2 = fp->height - 1;
+    s_fb_paint(fp, mp, &clip);
+
+    fp->rects[n_rects].x = clip.x1;
+    fp->rects[n_rects].y = clip.y1;
+    fp->rects[n_rects].w = clip.x2 - clip.x1 + 1;
+    fp->rects[n_rects].h = clip.y2 - clip.y1 + 1;
+    ++n_rects;
+
+    for (r = r0; r <= r1; ++r)
+      memcpy(fp->drawn + (size_t)r * fp->n_cols + c0, CELLP(mp, r, c0),
+             (c1 - c0 + 1) * sizeof(maze_node));
+    for (k = i; k < j; ++k) fp->dirty[fp->pending[k]] = 0;
+  }
+
+  fp->n_pending = 0;
+  *rects = fp->rects;
+  return n_rects;
+}
@@ -0,0 +1,119 @@
+/*
+  Name:     mazefb.h
+  Purpose:  Incremental drawing of a maze into a framebuffer.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#ifndef MAZEFB_H_
+#define MAZEFB_H_
+
+#include "maze.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A framebuffer holds the image maze_write_png() would draw for a
+   maze, as one byte per pixel giving an index into maze_fb_palette.
+   When cells change, only the pixels they can reach are drawn again,
+   and the rectangles that were drawn are handed back, for a caller
+   that keeps a copy of the image elsewhere (a texture, a window) to
+   bring just those parts up to date.
+
+   The image is divided into tiles of MAZE_FB_TILE x MAZE_FB_TILE
+   cells.  maze_fb_touch() marks the tile of a changed cell, in
+   constant time; maze_fb_update() redraws each marked tile, with a
+   margin for the walls and path markers that reach into it from its
+   neighbours, so the cost of a frame goes with the number of tiles
+   changed rather than the size of the maze. */
+
+#define MAZE_FB_TILE 16 /* Cells on a side of a tile */
+
+/** Palette indices of the pixels. */
+enum { FB_BLACK = 0, FB_WHITE = 1, FB_PATH = 2 };
+
+/** Red, green, and blue of each palette index, as in PNG output. */
+extern const unsigned char maze_fb_palette[9];
+
+/** A rectangle of pixels, with its top left corner at (x, y). */
+typedef struct {
+  unsigned int x, y;
+  unsigned int w, h;
+} maze_rect_t;
+
+/** A framebuffer for a maze. */
+typedef struct {
+  unsigned char *pixels; /* height rows of width pixels           */
+  unsigned int width;
+  unsigned int height;
+  unsigned int h_wid; /* Pixels per cell across                   */
+  unsigned int v_wid; /* Pixels per cell down                     */
+  rowcol_t n_rows;
+  rowcol_t n_cols;
+  rowcol_t exit_1; /* Exits as last drawn                         */
+  rowcol_t exit_2;
+  maze_node *drawn;       /* Cells as last drawn                  */
+  unsigned char *dirty;   /* Flag for each tile, if marked        */
+  unsigned int *pending;  /* Marked tiles, in order of marking    */
+  unsigned int n_pending;
+  unsigned int t_rows; /* Tiles down and across                   */
+  unsigned int t_cols;
+  maze_rect_t *rects; /* Rectangles drawn by the last update      */
+} maze_fb_t;
+
+/** Set up a framebuffer for a maze, drawn in an area of h_res by
+    v_res pixels as by maze_write_png(), so the image is one pixel
+    wider and taller than that.  The whole maze is drawn at once.
+    Release it with maze_fb_clear().  Returns false if memory is
+    exhausted.
+ */
+int maze_fb_init(maze_fb_t *fp, const maze_t *mp, unsigned int h_res,
+                 unsigned int v_res);
+
+/** Release the memory held by a framebuffer. */
+void maze_fb_clear(maze_fb_t *fp);
+
+/** Note that the cell at row r and column c has changed, in its walls
+    or its path marker, since the last update. */
+void maze_fb_touch(maze_fb_t *fp, rowcol_t r, rowcol_t c);
+
+/** Compare every cell of a maze with the cells as last drawn, and
+    touch those that differ, for changes that were not tracked as they
+    were made, such as a new solution.  This reads the whole maze, but
+    draws nothing.
+ */
+void maze_fb_scan(maze_fb_t *fp, const maze_t *mp);
+
+/** Redraw the parts of a framebuffer touched since the last update,
+    and any a change of exits affects, from the maze it was set up
+    for.  Sets *rects to the rectangles drawn, and returns how many
+    there are; they may overlap.
+ */
+unsigned int maze_fb_update(maze_fb_t *fp, const maze_t *mp,
+                            const maze_rect_t **rects);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end MAZEFB_H_ */
@@ -26,14 +26,28 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <getopt.h>
 #include <limits.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <termios.h>
 #include <time.h>
-#include <unistd.h> /* for getopt() */
+#include <unistd.h>
 
 #include "maze.h"
+#include "mazebatch.h"
+#include "mazediff.h"
+#include "mazehash.h"
+#include "mazepack.h"
+#include "mazeplan.h"
+#include "mazeshard.h"
+#include "mazeshm.h"
+#include "mazeview.h"
 
 typedef struct {
   unsigned int x;
@@ -135,42 +149,1075 @@ static int parse_exit_pos(const char *str, rowcol_t *out) {
   return 1;
 }
 
+/* parse_size(*str, *out)
+
+   Parse a size in bytes, with an optional suffix K, M, G, or T for
+   binary multiples.  Returns true if the parse was successful and
+   the size is positive.
+ */
+
+static int parse_size(const char *str, double *out) {
+  char *end;
+  double v = strtod(str, &end);
+
+  switch (*end) {
+    case 'T':
+    case 't':
+      v *= 1024.0;
+      /* fall through */
+    case 'G':
+    case 'g':
+      v *= 1024.0;
+      /* fall through */
+    case 'M':
+    case 'm':
+      v *= 1024.0;
+      /* fall through */
+    case 'K':
+    case 'k':
+      v *= 1024.0;
+      ++end;
+      break;
+  }
+  if (end == str || *end != '\0' || !(v > 0)) return 0;
+
+  *out = v;
+  return 1;
+}
+
 /* randomizer()
 
    Return a pseudo-random double precision value in the half-open
    interval [0, 1).
  */
 
-static double randomizer(void) {
-  static const double w = (double)INT_MAX + 1.0;
-  double v = random();
+static double randomizer(void) {
+  static const double w = (double)INT_MAX + 1.0;
+  double v = random();
+
+  return v / w;
+}
+
+/* State for random().  This is the same size as the default state,
+   so a given seed produces the same mazes as plain srandom() would,
+   but keeping it here lets a checkpoint save and restore it. */
+static char g_rng_state[128];
+
+/* set_seed(seed)
+
+   Seed the random number generator.
+ */
+
+static void set_seed(unsigned long seed) {
+  initstate(seed, g_rng_state, sizeof(g_rng_state));
+}
+
+/* Checkpoint files written by mazegen begin with this tag. */
+static const char ckpt_tag[4] = {'M', 'Z', 'R', 'S'};
+
+/* write_checkpoint(*path, seed, *mp, *gp)
+
+   Save the state of a generation in progress, including the random
+   generator, to the named file.  The checkpoint is written to a
+   temporary file which then replaces the old one, so that a crash
+   part way through never leaves a damaged checkpoint behind.
+   Returns false with a diagnostic on error.
+ */
+
+static int write_checkpoint(const char *path, unsigned long seed,
+                            const maze_t *mp, const maze_gen_t *gp) {
+  char *tmp = malloc(strlen(path) + 5);
+  FILE *ofp;
+  int ok;
+
+  if (tmp == NULL) return 0;
+  sprintf(tmp, "%s.tmp", path);
+
+  if ((ofp = fopen(tmp, "wb")) == NULL) {
+    fprintf(stderr,
+            "Error:  Unable to open checkpoint file '%s'\n"
+            "  -- %s\n\n",
+            tmp, strerror(errno));
+    free(tmp);
+    return 0;
+  }
+
+  /* Switching to the current state stores its position in the state
+     array, which makes the array a complete snapshot. */
+  setstate(g_rng_state);
+
+  ok = fwrite(ckpt_tag, sizeof(ckpt_tag), 1, ofp) == 1 &&
+       fwrite(&seed, sizeof(seed), 1, ofp) == 1 &&
+       fwrite(g_rng_state, sizeof(g_rng_state), 1, ofp) == 1 &&
+       maze_gen_save(mp, gp, ofp) && fflush(ofp) == 0 &&
+       fsync(fileno(ofp)) == 0;
+  ok = (fclose(ofp) == 0) && ok && rename(tmp, path) == 0;
+
+  if (!ok) {
+    fprintf(stderr,
+            "Error:  Unable to write checkpoint file '%s'\n"
+            "  -- %s\n\n",
+            path, strerror(errno));
+    remove(tmp);
+  }
+  free(tmp);
+  return ok;
+}
+
+/* read_checkpoint(*path, *seed, *mp, *gp)
+
+   Restore a generation in progress, and the random generator, from
+   a checkpoint written by write_checkpoint().  Returns false with a
+   diagnostic on error.
+ */
+
+static int read_checkpoint(const char *path, unsigned long *seed, maze_t *mp,
+                           maze_gen_t *gp) {
+  static char scratch[sizeof(g_rng_state)];
+  char tag[sizeof(ckpt_tag)];
+  FILE *ifp;
+  int ok;
+
+  /* Switching states stores the position of the outgoing state in its
+     array, so the restored array must not be current when it is
+     switched to, or it is overwritten first. */
+  initstate(1, scratch, sizeof(scratch));
+
+  if ((ifp = fopen(path, "rb")) == NULL) {
+    fprintf(stderr,
+            "Error:  Unable to open checkpoint file '%s'\n"
+            "  -- %s\n\n",
+            path, strerror(errno));
+    return 0;
+  }
+
+  ok = fread(tag, sizeof(tag), 1, ifp) == 1 &&
+       memcmp(tag, ckpt_tag, sizeof(tag)) == 0 &&
+       fread(seed, sizeof(*seed), 1, ifp) == 1 &&
+       fread(g_rng_state, sizeof(g_rng_state), 1, ifp) == 1 &&
+       maze_gen_restore(mp, gp, ifp);
+  fclose(ifp);
+
+  if (!ok) {
+    fprintf(stderr, "Error:  Unable to resume from checkpoint '%s'\n\n",
+            path);
+    return 0;
+  }
+
+  setstate(g_rng_state);
+  return 1;
+}
+
+/* generate(*mp, *gp, seed, *ckpt, interval)
+
+   Carry a generation begun with maze_gen_begin() (or restored from a
+   checkpoint) through to completion.  If ckpt is not NULL, a
+   checkpoint is written there every interval seconds, and removed
+   once the maze is finished.  Returns false on error.
+ */
+
+static int generate(maze_t *mp, maze_gen_t *gp, unsigned long seed,
+                    const char *ckpt, double interval) {
+  static const rowcol_t chunk = 1 << 20; /* work between clock checks */
+  time_t last = time(NULL);
+
+  while (!maze_gen_step(mp, gp, randomizer, chunk)) {
+    if (ckpt != NULL && difftime(time(NULL), last) >= interval) {
+      if (!write_checkpoint(ckpt, seed, mp, gp)) return 0;
+      last = time(NULL);
+    }
+  }
+
+  if (ckpt != NULL) remove(ckpt);
+  return 1;
+}
+
+/* patch_maze(*mp, *path)
+
+   Apply the diff in the named file to a maze.  Returns false with a
+   diagnostic on error.
+ */
+
+static int patch_maze(maze_t *mp, const char *path) {
+  size_t len = 0, cap = 0, n = 1;
+  char *buf = NULL, *p;
+  FILE *ifp;
+  int ok;
+
+  if ((ifp = fopen(path, "rb")) == NULL) {
+    fprintf(stderr,
+            "Error:  Unable to open diff file '%s'\n"
+            "  -- %s\n\n",
+            path, strerror(errno));
+    return 0;
+  }
+  while (n > 0) {
+    if (len == cap) {
+      cap = cap ? 2 * cap : 65536;
+      if ((p = realloc(buf, cap)) == NULL) {
+        fprintf(stderr, "Error:  Insufficient memory to read '%s'\n\n", path);
+        free(buf);
+        fclose(ifp);
+        return 0;
+      }
+      buf = p;
+    }
+    len += (n = fread(buf + len, 1, cap - len, ifp));
+  }
+  fclose(ifp);
+
+  if (!(ok = maze_patch(mp, buf, len)))
+    fprintf(stderr, "Error:  Unable to apply diff '%s'\n\n", path);
+  free(buf);
+  return ok;
+}
+
+/* write_diff(*mp, *path, *ofp)
+
+   Write the diff from the stored maze in the named file to maze mp.
+   Returns false with a diagnostic on error.
+ */
+
+static int write_diff(const maze_t *mp, const char *path, FILE *ofp) {
+  maze_file_sink_t fs;
+  maze_t base;
+  FILE *ifp;
+  int ok;
+
+  if ((ifp = fopen(path, "rt")) == NULL) {
+    fprintf(stderr,
+            "Error:  Unable to open base maze '%s'\n"
+            "  -- %s\n\n",
+            path, strerror(errno));
+    return 0;
+  }
+  ok = maze_load(&base, ifp);
+  fclose(ifp);
+  if (!ok) {
+    fprintf(stderr, "Error:  Unable to load base maze '%s'\n\n", path);
+    return 0;
+  }
+
+  if (base.n_rows != mp->n_rows || base.n_cols != mp->n_cols) {
+    fprintf(stderr,
+            "Error:  Base maze is %ux%u\n"
+            "  -- maze dimensions are %ux%u\n\n",
+            base.n_rows, base.n_cols, mp->n_rows, mp->n_cols);
+    ok = 0;
+  } else if (!(ok = maze_diff(&base, mp, maze_file_sink(&fs, ofp)))) {
+    fprintf(stderr, "Error:  Unable to write diff\n\n");
+  }
+  maze_clear(&base);
+  return ok;
+}
+
+static const char *g_usage = "Usage: mazegen [options] [output-file]\n";
+
+/* exit_cell(exit, n_rows, n_cols, *out)
+
+   Find the cell of an n_rows x n_cols maze next to the given exit.
+ */
+
+static void exit_cell(rowcol_t exit, rowcol_t n_rows, rowcol_t n_cols,
+                      dims_t *out) {
+  rowcol_t pos = EPOS(exit);
+
+  switch (EDIR(exit)) {
+    case DIR_U:
+      out->x = 0;
+      out->y = pos;
+      break;
+    case DIR_D:
+      out->x = n_rows - 1;
+      out->y = pos;
+      break;
+    case DIR_L:
+      out->x = pos;
+      out->y = 0;
+      break;
+    case DIR_R:
+      out->x = pos;
+      out->y = n_cols - 1;
+      break;
+  }
+}
+
+/* Where emit_cell() writes the cells of a route, and how many. */
+typedef struct {
+  FILE *ofp;
+  unsigned long n_cells;
+} route_t;
+
+/* emit_cell(r, c, *arg)
+
+   Write one cell of a route found by maze_shard_route() as a line of
+   the form RxC (1-based).
+ */
+
+static void emit_cell(rowcol_t r, rowcol_t c, void *arg) {
+  route_t *rp = arg;
+
+  fprintf(rp->ofp, "%ux%u\n", r + 1, c + 1);
+  rp->n_cells++;
+}
+
+/* The cells of a route found by maze_shard_route(), for the path of a
+   viewer, as r * n_cols + c. */
+typedef struct {
+  unsigned long long *cells;
+  size_t n, cap;
+  rowcol_t n_cols;
+  int ok;
+} path_t;
+
+/* path_cell(r, c, *arg)
+
+   Add one cell of a route to a path_t, growing it as needed.
+ */
+
+static void path_cell(rowcol_t r, rowcol_t c, void *arg) {
+  path_t *pp = arg;
+
+  if (pp->n == pp->cap) {
+    size_t cap = pp->cap ? 2 * pp->cap : 1024;
+    unsigned long long *tmp = realloc(pp->cells, cap * sizeof(*tmp));
+
+    if (tmp == NULL) {
+      pp->ok = 0;
+      return;
+    }
+    pp->cells = tmp;
+    pp->cap = cap;
+  }
+  pp->cells[pp->n++] = (unsigned long long)r * pp->n_cols + c;
+}
+
+/* cmp_cell(*a, *b)
+
+   Order the cells of a path_t, for qsort().
+ */
+
+static int cmp_cell(const void *a, const void *b) {
+  unsigned long long x = *(const unsigned long long *)a;
+  unsigned long long y = *(const unsigned long long *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* Set when the terminal changes size, for view_maze() */
+static volatile sig_atomic_t g_resized = 1;
+
+static void on_resize(int sig) {
+  (void)sig;
+  g_resized = 1;
+}
+
+/* The terminal settings found by view_maze(), for on_stop() */
+static struct termios g_tty;
+
+/* Signals that kill or stop the process while view_maze() has the
+   terminal, and must give it back first */
+static const int stop_sigs[] = {SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGTSTP};
+
+/* raw_tty(*saved)
+
+   Read the terminal a key at a time without echo, starting from the
+   settings saved.
+ */
+
+static void raw_tty(const struct termios *saved) {
+  struct termios raw = *saved;
+
+  raw.c_lflag &= ~(ICANON | ECHO);
+  raw.c_cc[VMIN] = 1;
+  raw.c_cc[VTIME] = 0;
+  tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+}
+
+/* put_tty(*s)
+
+   Write the string s straight to standard output, bypassing stdio so
+   that it is safe in a signal handler.
+ */
+
+static void put_tty(const char *s) {
+  size_t len = strlen(s);
+  ssize_t n;
+
+  while (len > 0 && (n = write(STDOUT_FILENO, s, len)) > 0) {
+    s += n;
+    len -= (size_t)n;
+  }
+}
+
+/* on_stop(sig)
+
+   Give the terminal back as view_maze() found it -- settings, screen,
+   and cursor -- and then take sig as if it had not been caught.  If
+   that only stopped the process, take the terminal again once it
+   continues, and have the view redrawn.
+ */
+
+static void on_stop(int sig) {
+  static const char leave[] = "\033[r\033[?25h\033[?1049l";
+  static const char enter[] = "\033[?1049h\033[?25l";
+  int saved_errno = errno;
+  struct sigaction sa;
+  sigset_t mask;
+
+  put_tty(leave);
+  tcsetattr(STDIN_FILENO, TCSAFLUSH, &g_tty);
+
+  signal(sig, SIG_DFL);
+  sigemptyset(&mask);
+  sigaddset(&mask, sig);
+  sigprocmask(SIG_UNBLOCK, &mask, NULL);
+  raise(sig);
+
+  /* Continued after a stop */
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_stop;
+  sigaction(sig, &sa, NULL);
+  raw_tty(&g_tty);
+  put_tty(enter);
+  g_resized = 1;
+  errno = saved_errno;
+}
+
+/* Keys read by read_key(), besides plain characters */
+enum {
+  KEY_EOF = -1,
+  KEY_NONE = 0,
+  KEY_UP = 256,
+  KEY_DOWN,
+  KEY_LEFT,
+  KEY_RIGHT,
+  KEY_PGUP,
+  KEY_PGDN,
+  KEY_HOME,
+  KEY_END
+};
+
+/* Input read but not yet taken by read_key() */
+typedef struct {
+  char buf[64];
+  size_t pos, len;
+} keys_t;
+
+/* read_key(*kp)
+
+   Return the next key pressed, reading more input once what was read
+   before is used up.  The escape sequence sent for a cursor or paging
+   key is taken as one key.  Returns KEY_NONE if interrupted by a
+   signal, and KEY_EOF at the end of input.
+ */
+
+static int read_key(keys_t *kp) {
+  static const struct {
+    const char *seq;
+    int key;
+  } seqs[] = {{"\033[A", KEY_UP},   {"\033[B", KEY_DOWN},
+              {"\033[C", KEY_RIGHT}, {"\033[D", KEY_LEFT},
+              {"\033OA", KEY_UP},   {"\033OB", KEY_DOWN},
+              {"\033OC", KEY_RIGHT}, {"\033OD", KEY_LEFT},
+              {"\033[5~", KEY_PGUP}, {"\033[6~", KEY_PGDN},
+              {"\033[H", KEY_HOME},  {"\033[F", KEY_END},
+              {"\033[1~", KEY_HOME}, {"\033[4~", KEY_END}};
+  size_t k, n;
+
+  if (kp->pos == kp->len) {
+    ssize_t got = read(STDIN_FILENO, kp->buf, sizeof(kp->buf));
+
+    if (got < 0 && errno == EINTR) return KEY_NONE;
+    if (got <= 0) return KEY_EOF;
+    kp->pos = 0;
+    kp->len = (size_t)got;
+  }
+
+  for (k = 0; kp->buf[kp->pos] == '\033' && k < sizeof(seqs) / sizeof(*seqs);
+       ++k) {
+    n = strlen(seqs[k].seq);
+    if (kp->len - kp->pos >= n &&
+        memcmp(kp->buf + kp->pos, seqs[k].seq, n) == 0) {
+      kp->pos += n;
+      return seqs[k].key;
+    }
+  }
+  return (unsigned char)kp->buf[kp->pos++];
+}
+
+/* term_size(*rows, *cols)
+
+   Find the size of the terminal on standard output, or from LINES and
+   COLUMNS if it is not a terminal, or 24 x 80 failing that.
+ */
+
+static void term_size(unsigned int *rows, unsigned int *cols) {
+  struct winsize ws;
+  const char *env;
+
+  *rows = 24;
+  *cols = 80;
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 1 &&
+      ws.ws_col > 0) {
+    *rows = ws.ws_row;
+    *cols = ws.ws_col;
+    return;
+  }
+  if ((env = getenv("LINES")) != NULL && atoi(env) > 1) *rows = atoi(env);
+  if ((env = getenv("COLUMNS")) != NULL && atoi(env) > 0) *cols = atoi(env);
+}
+
+/* view_maze(*vp, *source)
+
+   Browse a maze in the terminal until q or escape is pressed, or the
+   input ends, with the line below the view showing where it is.  On
+   a terminal, the input is read a key at a time without echo, and the
+   view is drawn on the alternate screen, so the shell's screen comes
+   back afterward -- also if the viewer is interrupted or suspended
+   (see on_stop()).  Writes a summary to standard error at the end.
+   Returns false with a diagnostic on error.
+ */
+
+static int view_maze(maze_view_t *vp, const char *source) {
+  int tty = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO);
+  unsigned int rows = 0, cols = 0;
+  unsigned long frames = 0;
+  unsigned long long bytes = 0;
+  char status[160], shown[160] = "", zoom[32];
+  keys_t keys = {{0}, 0, 0};
+  struct sigaction sa;
+  size_t k;
+  maze_mem_sink_t ms;
+  rowcol_t r0, c0, r1, c1;
+  dims_t cell;
+  int key = KEY_NONE, ok = 1;
+  long long sy, sx;
+
+  if (tty && tcgetattr(STDIN_FILENO, &g_tty) == 0) {
+    raw_tty(&g_tty);
+
+    /* No SA_RESTART, so that a resize interrupts the wait for a key */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_resize;
+    sigaction(SIGWINCH, &sa, NULL);
+    sa.sa_handler = on_stop;
+    for (k = 0; k < sizeof(stop_sigs) / sizeof(*stop_sigs); ++k)
+      sigaction(stop_sigs[k], &sa, NULL);
+    fputs("\033[?1049h\033[?25l", stdout);
+  } else {
+    tty = 0;
+  }
+
+  maze_mem_sink(&ms);
+  while (key != 'q' && key != '\033' && key != KEY_EOF) {
+    if (g_resized) {
+      g_resized = 0;
+      term_size(&rows, &cols);
+      if (!maze_view_resize(vp, rows - 1, cols)) {
+        fprintf(stderr, "Error:  Insufficient memory for the view\n\n");
+        ok = 0;
+        break;
+      }
+    }
+
+    sy = (vp->level <= VIEW_GRID) ? 2 : 1;
+    sx = (vp->level == VIEW_TEXT) ? 4 : sy;
+    switch (key) {
+      case KEY_UP:
+      case 'k':
+        maze_view_scroll(vp, -sy, 0);
+        break;
+      case KEY_DOWN:
+      case 'j':
+        maze_view_scroll(vp, sy, 0);
+        break;
+      case KEY_LEFT:
+      case 'h':
+        maze_view_scroll(vp, 0, -sx);
+        break;
+      case KEY_RIGHT:
+      case 'l':
+        maze_view_scroll(vp, 0, sx);
+        break;
+      case KEY_PGUP:
+      case 'b':
+        maze_view_scroll(vp, 1 - (long long)vp->s_rows, 0);
+        break;
+      case KEY_PGDN:
+      case ' ':
+        maze_view_scroll(vp, (long long)vp->s_rows - 1, 0);
+        break;
+      case '<':
+        maze_view_scroll(vp, 0, 1 - (long long)vp->s_cols);
+        break;
+      case '>':
+        maze_view_scroll(vp, 0, (long long)vp->s_cols - 1);
+        break;
+      case KEY_HOME:
+      case 'g':
+        maze_view_goto(vp, 0, 0);
+        break;
+      case KEY_END:
+      case 'G':
+        maze_view_goto(vp, vp->n_rows - 1, vp->n_cols - 1);
+        break;
+      case '+':
+      case '=':
+        maze_view_zoom(vp, vp->level - 1);
+        break;
+      case '-':
+      case '_':
+        maze_view_zoom(vp, vp->level + 1);
+        break;
+      case 's':
+        vp->show_path = !vp->show_path;
+        break;
+      case 'e':
+      case 'x':
+        exit_cell(key == 'e' ? vp->exit_1 : vp->exit_2, vp->n_rows,
+                  vp->n_cols, &cell);
+        maze_view_goto(vp, cell.x, cell.y);
+        break;
+    }
+
+    ms.len = 0;
+    if (vp->fresh) shown[0] = '\0';
+    if (!maze_view_draw(vp, &ms.sink)) {
+      fprintf(stderr, "Error:  Unable to read the maze for the view\n\n");
+      ok = 0;
+      break;
+    }
+
+    /* The status line, if it has changed */
+    maze_view_extent(vp, &r0, &c0, &r1, &c1);
+    if (vp->level == VIEW_TEXT)
+      strcpy(zoom, "text");
+    else if (vp->level == VIEW_GRID)
+      strcpy(zoom, "grid");
+    else
+      sprintf(zoom, "1:%llu", 1ULL << (vp->level - 1));
+    snprintf(status, sizeof(status),
+             " %ux%u  rows %u-%u  cols %u-%u  zoom %s%s  "
+             "[arrows +/- s e x q]",
+             vp->n_rows, vp->n_cols, r0 + 1, r1 + 1, c0 + 1, c1 + 1, zoom,
+             vp->show_path ? "" : "  no path");
+    if (strlen(status) >= cols) status[cols - 1] = '\0';
+    if (strcmp(status, shown) != 0) {
+      char move[32];
+      int n = sprintf(move, "\033[%u;1H", rows);
+
+      ok = ms.sink.write(&ms.sink, move, n) &&
+           ms.sink.write(&ms.sink, status, strlen(status)) &&
+           ms.sink.write(&ms.sink, "\033[K", 3);
+      strcpy(shown, status);
+    }
+
+    if (!ok || fwrite(ms.buf, 1, ms.len, stdout) != ms.len ||
+        fflush(stdout) != 0) {
+      fprintf(stderr, "Error:  Unable to write the view\n\n");
+      ok = 0;
+      break;
+    }
+    frames++;
+    bytes += ms.len;
+    key = read_key(&keys);
+  }
+
+  fputs("\033[r", stdout);
+  if (tty) {
+    for (k = 0; k < sizeof(stop_sigs) / sizeof(*stop_sigs); ++k)
+      signal(stop_sigs[k], SIG_DFL);
+    fputs("\033[?25h\033[?1049l", stdout);
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &g_tty);
+  } else {
+    fprintf(stdout, "\033[%u;1H\n", rows);
+  }
+  fflush(stdout);
+  free(ms.buf);
+
+  fprintf(stderr,
+          "Maze parameters:\n"
+          "  Dimensions:  %ux%u\n"
+          "      Source:  %s\n"
+          "      Frames:  %lu (%llu bytes)\n"
+          "  Cells read:  %llu\n",
+          vp->n_rows, vp->n_cols, source, frames, bytes, vp->n_read);
+  return ok;
+}
+
+/* run_shards(*lp, seed, *dir, jobs)
+
+   Generate every shard of the layout as a separate process, running
+   at most jobs processes at a time, then stitch the shards together.
+   Shard k (in row major order, from zero) uses seed + k + 1, the same
+   as if it were generated alone with --shard.  Returns false if any
+   part fails.
+ */
+
+static int run_shards(const maze_layout_t *lp, unsigned long seed,
+                      const char *dir, int jobs) {
+  rowcol_t k = 0, n = lp->sh_rows * lp->sh_cols;
+  int running = 0, failed = 0;
+
+  while ((k < n && !failed) || running > 0) {
+    if (k < n && !failed && running < jobs) {
+      pid_t pid = fork();
+
+      if (pid < 0) {
+        fprintf(stderr, "Error:  Unable to start shard process\n  -- %s\n\n",
+                strerror(errno));
+        failed = 1;
+        continue;
+      }
+      if (pid == 0) {
+        set_seed(seed + k + 1);
+        _exit(maze_shard_generate(lp, k / lp->sh_cols, k % lp->sh_cols,
+                                  randomizer, dir)
+                  ? 0
+                  : 1);
+      }
+      ++running;
+      ++k;
+    } else {
+      int status;
+
+      if (wait(&status) < 0) break;
+      --running;
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed = 1;
+    }
+  }
+
+  if (failed) {
+    fprintf(stderr, "Error:  Unable to generate all shards in '%s'\n\n", dir);
+    return 0;
+  }
+
+  set_seed(seed);
+  if (!maze_shard_stitch(dir, randomizer)) {
+    fprintf(stderr, "Error:  Unable to stitch shards in '%s'\n\n", dir);
+    return 0;
+  }
+  return 1;
+}
+
+/* remove_shards(*dir, *lp)
+
+   Remove the shard files of the layout, and the directory they are
+   in, for shards made only to be written out.
+ */
+
+static void remove_shards(const char *dir, const maze_layout_t *lp) {
+  rowcol_t i, j;
+
+  for (i = 0; i < lp->sh_rows; ++i) {
+    for (j = 0; j < lp->sh_cols; ++j) {
+      char *path = maze_shard_path(dir, i, j);
+
+      if (path != NULL) remove(path);
+      free(path);
+    }
+  }
+  rmdir(dir);
+}
+
+/* Long option codes, for options with no single-letter form */
+enum {
+  OPT_CHECKPOINT = 256,
+  OPT_INTERVAL,
+  OPT_RESUME,
+  OPT_SHARDS,
+  OPT_SHARD,
+  OPT_SHARD_DIR,
+  OPT_JOBS,
+  OPT_STITCH,
+  OPT_ASSEMBLE,
+  OPT_ROUTE,
+  OPT_CSR,
+  OPT_CSR_EDGES,
+  OPT_SHM,
+  OPT_ATTACH,
+  OPT_PACK,
+  OPT_COUNT,
+  OPT_UNPACK,
+  OPT_ID,
+  OPT_STREAM,
+  OPT_HASH,
+  OPT_GRID,
+  OPT_GRID_BITS,
+  OPT_BATCH,
+  OPT_BLOCKED,
+  OPT_AUTO,
+  OPT_MAX_MEM,
+  OPT_COSTS,
+  OPT_DRY_RUN,
+  OPT_DIFF,
+  OPT_PATCH,
+  OPT_VIEW,
+  OPT_TREE
+};
+
+static const struct option g_long_opts[] = {
+    {"checkpoint", required_argument, NULL, OPT_CHECKPOINT},
+    {"interval", required_argument, NULL, OPT_INTERVAL},
+    {"resume", required_argument, NULL, OPT_RESUME},
+    {"shards", required_argument, NULL, OPT_SHARDS},
+    {"shard", required_argument, NULL, OPT_SHARD},
+    {"shard-dir", required_argument, NULL, OPT_SHARD_DIR},
+    {"jobs", required_argument, NULL, OPT_JOBS},
+    {"stitch", no_argument, NULL, OPT_STITCH},
+    {"assemble", no_argument, NULL, OPT_ASSEMBLE},
+    {"route", no_argument, NULL, OPT_ROUTE},
+    {"csr", no_argument, NULL, OPT_CSR},
+    {"csr-edges", no_argument, NULL, OPT_CSR_EDGES},
+    {"shm", required_argument, NULL, OPT_SHM},
+    {"attach", required_argument, NULL, OPT_ATTACH},
+    {"pack", required_argument, NULL, OPT_PACK},
+    {"count", required_argument, NULL, OPT_COUNT},
+    {"unpack", required_argument, NULL, OPT_UNPACK},
+    {"id", required_argument, NULL, OPT_ID},
+    {"stream", no_argument, NULL, OPT_STREAM},
+    {"hash", no_argument, NULL, OPT_HASH},
+    {"grid", no_argument, NULL, OPT_GRID},
+    {"grid-bits", no_argument, NULL, OPT_GRID_BITS},
+    {"batch", required_argument, NULL, OPT_BATCH},
+    {"blocked", no_argument, NULL, OPT_BLOCKED},
+    {"auto", no_argument, NULL, OPT_AUTO},
+    {"max-mem", required_argument, NULL, OPT_MAX_MEM},
+    {"costs", required_argument, NULL, OPT_COSTS},
+    {"dry-run", no_argument, NULL, OPT_DRY_RUN},
+    {"diff", required_argument, NULL, OPT_DIFF},
+    {"patch", required_argument, NULL, OPT_PATCH},
+    {"view", no_argument, NULL, OPT_VIEW},
+    {"tree", required_argument, NULL, OPT_TREE},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}};
+
+/* Output format selectors */
+#define FORMAT_TEXT 0
+#define FORMAT_PNG 1
+#define FORMAT_EPS 2
+#define FORMAT_COMP 3
+#define FORMAT_CSR 4
+#define FORMAT_HASH 5
+#define FORMAT_GRID 6
+#define FORMAT_DIFF 7
+
+/* Solution selectors */
+#define SOLN_NONE 0
+#define SOLN_DEFAULT 1
+#define SOLN_CHOSEN 2
+
+/* push_row(*row, *arg)
+
+   Pass a row from maze_shard_rows() on to the row writer in arg.
+ */
+
+static int push_row(const maze_node *row, void *arg) {
+  return maze_rows_push(arg, row);
+}
+
+/* pack_batch(*pw, *cells, lanes, count, seed, *in, *out)
+
+   Generate count mazes with a batch of the given number of lanes and
+   add them to a pack, with ids counting up from seed.  Each maze comes
+   from its own lane, seeded with its id, so it does not depend on the
+   number of lanes.  Exits are set from in and out where they are not
+   NULL.  Returns false on error.
+ */
+
+static int pack_batch(maze_pack_writer_t *pw, const dims_t *cells,
+                      unsigned long lanes, unsigned long count,
+                      unsigned long seed, const rowcol_t *in,
+                      const rowcol_t *out) {
+  unsigned long k, l, n;
+  maze_batch_t b;
+  maze_t m;
+  int ok = 1;
+
+  if (!maze_batch_init(&b, lanes, cells->x, cells->y)) return 0;
+  if (!maze_init(&m, cells->x, cells->y)) {
+    maze_batch_clear(&b);
+    return 0;
+  }
+  if (in != NULL) m.exit_1 = *in;
+  if (out != NULL) m.exit_2 = *out;
+
+  for (k = 0; ok && k < count; k += n) {
+    n = (count - k < lanes) ? count - k : lanes;
+    for (l = 0; l < n; ++l) maze_batch_seed(&b, l, seed + k + l);
+
+    maze_batch_generate(&b);
+    for (l = 0; ok && l < n; ++l)
+      ok = maze_batch_get(&b, l, &m) && maze_pack_add(pw, seed + k + l, &m);
+  }
+
+  maze_clear(&m);
+  maze_batch_clear(&b);
+  return ok;
+}
+
+/* Names of the row writer formats, for the parameter summary */
+static const char *rows_names[] = {"Text", "PostScript", "PNG", "Grid",
+                                   "Grid (bits)"};
+
+/* rows_format(format, grid_bits)
+
+   Return the row writer format (see maze_rows_t) for an output
+   format, or -1 if the format cannot be written a row at a time.
+ */
+
+static int rows_format(int format, int grid_bits) {
+  switch (format) {
+    case FORMAT_TEXT:
+      return ROWS_TEXT;
+    case FORMAT_PNG:
+      return ROWS_PNG;
+    case FORMAT_EPS:
+      return ROWS_EPS;
+    case FORMAT_GRID:
+      return grid_bits ? ROWS_GRID_BITS : ROWS_GRID;
+    default:
+      return -1;
+  }
+}
+
+/* read_source(*ifp, *dir, *lp)
+
+   Read the size and exits of a stored maze without loading it: the
+   dimension line from ifp if it is not NULL, otherwise the layout of
+   the shards in dir.  For a stored maze the shard grid is 0x0.
+   Returns false with a diagnostic on error.
+ */
+
+static int read_source(FILE *ifp, const char *dir, maze_layout_t *lp) {
+  int ok;
+
+  memset(lp, 0, sizeof(*lp));
+  if (ifp != NULL) {
+    ok = maze_load_header(ifp, &lp->n_rows, &lp->n_cols, &lp->exit_1,
+                          &lp->exit_2);
+  } else {
+    maze_shard_t first;
+    char *path = maze_shard_path(dir, 0, 0);
+
+    if ((ok = (path != NULL && maze_shard_info(path, &first)))) {
+      *lp = first.lay;
+      maze_shard_clear(&first);
+    }
+    free(path);
+  }
+  if (!ok) {
+    fprintf(stderr, "Error:  Unable to read maze from %s\n\n",
+            (ifp != NULL) ? "input stream" : dir);
+    return 0;
+  }
+  return 1;
+}
+
+/* load_rows(*mp, *ifp, *lp)
+
+   Load the rest of a stored maze whose dimension line has been read
+   by read_source() into *lp.  Returns false with a diagnostic on
+   error.
+ */
+
+static int load_rows(maze_t *mp, FILE *ifp, const maze_layout_t *lp) {
+  rowcol_t r;
 
-  return v / w;
+  if (!maze_init(mp, lp->n_rows, lp->n_cols)) {
+    fprintf(stderr, "Error:  Insufficient memory to load %u x %u maze\n\n",
+            lp->n_rows, lp->n_cols);
+    return 0;
+  }
+  mp->exit_1 = lp->exit_1;
+  mp->exit_2 = lp->exit_2;
+
+  for (r = 0; r < lp->n_rows; ++r) {
+    if (!maze_load_row(ifp, lp->n_cols, CELLP(mp, r, 0))) {
+      fprintf(stderr, "Error:  Unable to load maze from input stream\n\n");
+      maze_clear(mp);
+      return 0;
+    }
+  }
+  return 1;
 }
 
-/* set_seed(seed)
+/* stream_maze(*ifp, *dir, *lp, format, *ofp, *area, *plan)
 
-   Seed the random number generator.  Right now, this is just a
-   wrapper.
+   Write a maze to ofp one row at a time, without loading all of it:
+   the stored maze on ifp if it is not NULL, whose dimension line has
+   been read into *lp, otherwise the stitched shards in dir.  The
+   format is one of the ROWS_ formats.  The plan, if not NULL, is
+   shown with the parameters.  Returns false with a diagnostic on
+   error.
  */
 
-static void set_seed(unsigned long seed) { srandom(seed); }
+static int stream_maze(FILE *ifp, const char *dir, const maze_layout_t *lp,
+                       int format, FILE *ofp, const dims_t *area,
+                       const char *plan) {
+  maze_file_sink_t fs;
+  maze_rows_t w;
+  maze_node *row;
+  rowcol_t r;
+  int ok;
 
-static const char *g_usage = "Usage: mazegen [options] [output-file]\n";
+  fprintf(stderr,
+          "Maze parameters:\n"
+          "  Dimensions:  %ux%u\n"
+          " Output area:  %ux%u\n"
+          "      Format:  %s\n"
+          "      Source:  %s\n",
+          lp->n_rows, lp->n_cols, area->x, area->y, rows_names[format],
+          (ifp != NULL) ? "<input stream>" : dir);
+  if (plan != NULL) fprintf(stderr, "        Plan:  %s\n", plan);
+
+  if (!maze_rows_begin(&w, format, maze_file_sink(&fs, ofp), lp->n_rows,
+                       lp->n_cols, lp->exit_1, lp->exit_2, area->x,
+                       area->y)) {
+    fprintf(stderr, "Error:  Unable to start writing the maze\n\n");
+    return 0;
+  }
 
-extern char *optarg;
-extern int optind;
+  if (ifp == NULL) {
+    ok = maze_shard_rows(dir, push_row, &w);
+  } else if ((row = malloc(lp->n_cols * sizeof(*row))) == NULL) {
+    ok = 0;
+  } else {
+    for (r = 0, ok = 1; ok && r < lp->n_rows; ++r)
+      ok = maze_load_row(ifp, lp->n_cols, row) && maze_rows_push(&w, row);
+    free(row);
+  }
 
-/* Output format selectors */
-#define FORMAT_TEXT 0
-#define FORMAT_PNG 1
-#define FORMAT_EPS 2
-#define FORMAT_COMP 3
+  if (!maze_rows_end(&w) || !ok) {
+    fprintf(stderr, "Error:  Unable to write the maze\n\n");
+    return 0;
+  }
+  return 1;
+}
 
-/* Solution selectors */
-#define SOLN_NONE 0
-#define SOLN_DEFAULT 1
-#define SOLN_CHOSEN 2
+/* Names of the output formats, for the parameter summary */
+static const char *format_names[] = {"Text", "PNG",  "PostScript", "Compact",
+                                     "CSR",  "Hash", "Grid",       "Diff"};
+
+/* plan_writer(format)
+
+   Return the way a maze planner should expect a maze to be written
+   in the given output format; see maze_costs_output().
+ */
+
+static int plan_writer(int format) {
+  switch (format) {
+    case FORMAT_PNG:
+      return PLAN_OUT_IMAGE;
+    case FORMAT_EPS:
+      return PLAN_OUT_EPS;
+    case FORMAT_CSR:
+      return PLAN_OUT_GRAPH;
+    default:
+      return PLAN_OUT_CELLS;
+  }
+}
 
 int main(int argc, char *argv[]) {
   int opt, format = FORMAT_TEXT, solution = SOLN_NONE;
@@ -181,9 +1228,33 @@ int main(int argc, char *argv[]) {
   unsigned long rnd_seed = (unsigned long)time(NULL);
   FILE *ofp = stdout, *ifp = NULL;
   maze_t the_maze;
+  maze_gen_t the_gen;
   rowcol_t in, out;
-
-  while ((opt = getopt(argc, argv, "d:z:r:m:e:x:L:cgpsth")) != EOF) {
+  const char *ckpt_path = NULL, *resume_path = NULL;
+  double ckpt_interval = 60.0;
+  dims_t shards = {0, 0}, shard = {0, 0};
+  const char *shard_dir = ".", *shm_name = NULL, *attach_name = NULL;
+  const char *pack_path = NULL, *unpack_path = NULL;
+  unsigned long pack_count = 1, batch_lanes = 0;
+  unsigned long long pack_id = 0, hash[2];
+  int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN), stitch = 0, assemble = 0;
+  int route = 0, csr_edges = 0, grid_bits = 0, stream = 0;
+  int gen_order = GEN_ORDER_RANDOM, auto_plan = 0;
+  const char *cost_path = NULL, *diff_path = NULL, *patch_path = NULL;
+  char plan_text[128], tmp_dir[32] = "";
+  double max_mem = 0, tree_mix = -1;
+  int dry_run = 0, fits = 1, view = 0;
+  maze_layout_t src_lay;
+  maze_plan_req_t req;
+  maze_plan_t plan;
+  maze_costs_t costs;
+  maze_pack_t pack;
+  maze_file_sink_t fs;
+  maze_sink_t *sink;
+  maze_view_t the_view;
+
+  while ((opt = getopt_long(argc, argv, "d:z:r:m:e:x:L:cgpsth", g_long_opts,
+                            NULL)) != EOF) {
     switch (opt) {
       case 'd':
         if (parse_dims(optarg, &cells) == 0) {
@@ -267,6 +1338,141 @@ int main(int argc, char *argv[]) {
       case 'c':
         format = FORMAT_COMP;
         break;
+      case OPT_CHECKPOINT:
+        ckpt_path = optarg;
+        break;
+      case OPT_INTERVAL:
+        if ((ckpt_interval = strtod(optarg, NULL)) < 0) {
+          fprintf(stderr,
+                  "Error:  Checkpoint interval must not be negative\n\n");
+          return 1;
+        }
+        break;
+      case OPT_RESUME:
+        resume_path = optarg;
+        break;
+      case OPT_SHARDS:
+        if (parse_dims(optarg, &shards) == 0 || shards.x == 0 ||
+            shards.y == 0) {
+          fprintf(stderr,
+                  "Error:  Incorrect format for shard grid\n"
+                  "  -- use RRxCC format\n\n");
+          return 1;
+        }
+        break;
+      case OPT_SHARD:
+        if (parse_dims(optarg, &shard) == 0 || shard.x == 0 || shard.y == 0) {
+          fprintf(stderr,
+                  "Error:  Incorrect format for shard position\n"
+                  "  -- use RxC format (1-based)\n\n");
+          return 1;
+        }
+        break;
+      case OPT_SHARD_DIR:
+        shard_dir = optarg;
+        break;
+      case OPT_JOBS:
+        if ((jobs = atoi(optarg)) <= 0) {
+          fprintf(stderr,
+                  "Error:  Number of jobs must be a positive integer\n\n");
+          return 1;
+        }
+        break;
+      case OPT_STITCH:
+        stitch = 1;
+        break;
+      case OPT_ASSEMBLE:
+        assemble = 1;
+        break;
+      case OPT_ROUTE:
+        route = 1;
+        break;
+      case OPT_CSR_EDGES:
+        csr_edges = 1;
+        /* fall through */
+      case OPT_CSR:
+        format = FORMAT_CSR;
+        break;
+      case OPT_SHM:
+        shm_name = optarg;
+        break;
+      case OPT_ATTACH:
+        attach_name = optarg;
+        break;
+      case OPT_PACK:
+        pack_path = optarg;
+        break;
+      case OPT_COUNT:
+        if ((pack_count = strtoul(optarg, NULL, 0)) == 0) {
+          fprintf(stderr,
+                  "Error:  Number of mazes must be a positive integer\n\n");
+          return 1;
+        }
+        break;
+      case OPT_BATCH:
+        if ((batch_lanes = strtoul(optarg, NULL, 0)) == 0 ||
+            batch_lanes > MAZE_BATCH_LANES) {
+          fprintf(stderr,
+                  "Error:  Number of lanes must be from 1 to %u\n\n",
+                  MAZE_BATCH_LANES);
+          return 1;
+        }
+        break;
+      case OPT_UNPACK:
+        unpack_path = optarg;
+        break;
+      case OPT_ID:
+        pack_id = strtoull(optarg, NULL, 0);
+        break;
+      case OPT_STREAM:
+        stream = 1;
+        break;
+      case OPT_HASH:
+        format = FORMAT_HASH;
+        break;
+      case OPT_GRID_BITS:
+        grid_bits = 1;
+        /* fall through */
+      case OPT_GRID:
+        format = FORMAT_GRID;
+        break;
+      case OPT_BLOCKED:
+        gen_order = GEN_ORDER_BLOCKED;
+        break;
+      case OPT_AUTO:
+        auto_plan = 1;
+        break;
+      case OPT_MAX_MEM:
+        if (parse_size(optarg, &max_mem) == 0) {
+          fprintf(stderr,
+                  "Error:  Incorrect format for memory limit\n"
+                  "  -- use a number of bytes, with K, M, G, or T\n\n");
+          return 1;
+        }
+        break;
+      case OPT_COSTS:
+        cost_path = optarg;
+        break;
+      case OPT_DRY_RUN:
+        dry_run = 1;
+        break;
+      case OPT_DIFF:
+        diff_path = optarg;
+        format = FORMAT_DIFF;
+        break;
+      case OPT_PATCH:
+        patch_path = optarg;
+        break;
+      case OPT_VIEW:
+        view = 1;
+        break;
+      case OPT_TREE:
+        tree_mix = strtod(optarg, NULL);
+        if (!(tree_mix >= 0 && tree_mix <= 1)) {
+          fprintf(stderr, "Error:  Growing tree mix must be from 0 to 1\n\n");
+          return 1;
+        }
+        break;
       case 'h':
         fputs(g_usage, stderr);
         fprintf(
@@ -284,7 +1490,39 @@ int main(int argc, char *argv[]) {
             "  -p         : write output in EPS format\n"
             "  -t         : write output in text format (default)\n"
             "  -s         : include a solution (entrance to exit)\n"
-            "  -h         : display this help message\n\n"
+            "  -h         : display this help message\n"
+            "  --checkpoint file : periodically save generation state\n"
+            "  --interval secs   : seconds between checkpoints (default 60)\n"
+            "  --resume file     : continue generation from a checkpoint\n"
+            "  --shards RxC      : generate as a grid of separate shards\n"
+            "  --shard RxC       : generate only the given shard (1-based)\n"
+            "  --shard-dir dir   : directory for shard files (default .)\n"
+            "  --jobs n          : shard processes to run at once\n"
+            "  --stitch          : join the shards in the shard directory\n"
+            "  --assemble        : load the maze from the shard directory\n"
+            "  --route           : list the path cells using the shards\n"
+            "  --csr             : write the passage graph in binary CSR form\n"
+            "  --csr-edges       : like --csr, with an edge list as well\n"
+            "  --shm name        : generate into a shared memory segment\n"
+            "  --attach name     : read the maze from shared memory\n"
+            "  --pack file       : write a pack of --count mazes\n"
+            "  --count n         : number of mazes for --pack (default 1)\n"
+            "  --batch n         : generate --pack mazes n at a time\n"
+            "  --unpack file     : read maze --id from a pack file\n"
+            "  --id n            : id of the maze for --unpack\n"
+            "  --stream          : write -L or --assemble input row by row\n"
+            "  --hash            : write the structural hash of the maze\n"
+            "  --grid            : write an occupancy grid, a byte a square\n"
+            "  --grid-bits       : like --grid, with a bit per square\n"
+            "  --blocked         : generate tile by tile, for large mazes\n"
+            "  --auto            : choose how to generate the maze\n"
+            "  --max-mem size    : most memory to use (K, M, G, or T)\n"
+            "  --costs file      : engine costs for --auto (mazebench -P)\n"
+            "  --dry-run         : estimate memory and time, and stop\n"
+            "  --diff file       : write the changes from a stored maze\n"
+            "  --patch file      : apply changes written by --diff\n"
+            "  --view            : browse the maze in the terminal\n"
+            "  --tree mix        : grow the maze as a tree (mix 0 to 1)\n\n"
 
             "Output is written to standard output, unless an alternative\n"
             "output file name is given.  For PNG output, area is interpreted\n"
@@ -293,7 +1531,102 @@ int main(int argc, char *argv[]) {
 
             "Entrance and exit positions are given by specifying an edge and\n"
             "a position on that edge.  Edges are T, L, B, R.  Positions are\n"
-            "indexed from one to the length of the edge in question.\n\n");
+            "indexed from one to the length of the edge in question.\n\n"
+
+            "With --checkpoint, the state of the generator is saved to the\n"
+            "given file as it runs, and removed when the maze is done.  If\n"
+            "the run is interrupted, --resume continues from the checkpoint\n"
+            "(with its own dimensions, exits, and seed) and produces the same\n"
+            "maze as an uninterrupted run.\n\n"
+
+            "With --shards, the maze is generated as a grid of shard files\n"
+            "in the shard directory, one process per shard, which are then\n"
+            "stitched into a single maze.  With --shard as well, only that\n"
+            "shard is generated, so shards can be made by separate processes\n"
+            "or machines sharing the directory; run --stitch once they are\n"
+            "all done.  Use --assemble to read the stitched maze back for\n"
+            "output in any format.  With --route, the path given by -m (or\n"
+            "from entrance to exit) is found by loading only the shards it\n"
+            "passes through, and written as one RxC cell per line.\n\n"
+
+            "With --csr, the output is the graph of passages between cells\n"
+            "as binary offset and neighbor arrays, which can be mapped into\n"
+            "memory as is; see maze_write_csr() in maze.h for the layout.\n\n"
+
+            "With --shm, the maze is generated directly in the named POSIX\n"
+            "shared memory segment instead of being written out, and is\n"
+            "published with a new sequence number when complete.  Other\n"
+            "programs can map it with maze_attach(), or --attach reads it\n"
+            "back for output in any format.\n\n"
+
+            "With --pack, --count mazes are generated with seeds counting up\n"
+            "from the random seed, and written to one pack file, indexed by\n"
+            "seed.  Use --unpack with --id to read one back for output.\n"
+            "With --batch as well, up to 16 mazes are generated at once,\n"
+            "each from its own generator seeded with its id; these mazes\n"
+            "differ from those made without --batch.\n\n"
+
+            "With --stream, a maze read with -L or --assemble is written in\n"
+            "text, PNG, or EPS format one row at a time as it is read, so\n"
+            "memory use does not depend on the height of the maze.  No new\n"
+            "solution can be marked, but one already stored is drawn.\n"
+            "Occupancy grids can be streamed as well.\n\n"
+
+            "With --grid, the output is a binary grid of 2R+1 by 2C+1\n"
+            "squares for the cells, walls, and posts, with 1 for a wall or\n"
+            "post and 0 for an open square; see maze_write_grid() in maze.h\n"
+            "for the layout.\n\n"
+
+            "With --hash, the output is a 128-bit hash of the maze's size,\n"
+            "exits, and walls, as 32 hex digits; marked paths do not change\n"
+            "it.  Equal mazes have equal hashes on every host.\n\n"
+
+            "With --diff, the output is the walls that differ between the\n"
+            "stored maze in the given file and this one, with the hashes\n"
+            "of both, in a binary form described in mazediff.h.  --patch\n"
+            "applies such a diff to a maze before it is written, if the\n"
+            "maze has the hash of the one the diff was taken from.\n\n"
+
+            "With --blocked, cells are joined one 32x32 tile at a time, in\n"
+            "a random order of tiles, rather than all over the maze at\n"
+            "once.  This is much faster for mazes too large for the cache,\n"
+            "but makes a different maze from the same seed.\n\n"
+
+            "With --tree, the maze is grown outward from one cell, each\n"
+            "step extending the newest cell that can still grow with\n"
+            "probability mix, or else a random one.  A mix of 1 makes long\n"
+            "winding passages with few branches; a mix of 0 makes many\n"
+            "short branches; values between blend the two.\n\n"
+
+            "With --auto, the way to generate a new maze or --pack is\n"
+            "chosen from its size, the number of processors (or --jobs),\n"
+            "and --max-mem: random or blocked order, batches for a pack of\n"
+            "small mazes, or shards in parallel, which are then written out\n"
+            "row by row.  The choice is estimated from the costs measured\n"
+            "by `mazebench -P', if given with --costs, and is shown as the\n"
+            "plan.  Each choice makes a different maze from the same seed,\n"
+            "so follow the plan with explicit options to repeat a maze.\n\n"
+
+            "With --max-mem, the memory a run needs is estimated before\n"
+            "anything large is allocated: the maze and its generator, and\n"
+            "the writer for the output, which for PNG draws the whole image\n"
+            "in memory.  If that is too much, the image is drawn a band of\n"
+            "rows at a time, shards are made in fewer jobs, and a maze read\n"
+            "with -L or --assemble is streamed as with --stream, as need\n"
+            "be; if it still does not fit, mazegen stops before it starts.\n"
+            "The limit is not checked for --stitch, --route, or --resume.\n"
+            "With --dry-run, the estimate of memory and time is written\n"
+            "out, and nothing is made.\n\n"
+
+            "With --view, the maze is shown in the terminal instead of being\n"
+            "written out, and only the part on screen is drawn.  Arrow keys\n"
+            "or hjkl scroll, space and b page down and up, < and > page\n"
+            "across, g and G go to the corners, e and x to the entrance and\n"
+            "exit, + and - zoom in and out, s shows or hides the path, and q\n"
+            "quits.  A maze stored in a file with -L, or in shards with\n"
+            "--assemble, is read only as it comes into view; with --assemble,\n"
+            "-s or -m marks the path found as for --route.  The zoomed-out\n"
+            "views read every cell they cover while the path is shown.\n\n");
         return 0;
       default:
         fputs(g_usage, stderr);
@@ -315,7 +1648,341 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
-  if (optind < argc) {
+  if (shards.x > cells.x || shards.y > cells.y) {
+    fprintf(stderr,
+            "Error:  Shard grid %ux%u is larger than the maze\n"
+            "  -- maze dimensions are %ux%u\n\n",
+            shards.x, shards.y, cells.x, cells.y);
+    return 1;
+  }
+  if (shard.x > shards.x || shard.y > shards.y) {
+    fprintf(stderr,
+            "Error:  Shard %ux%u out of range\n"
+            "  -- shard grid is %ux%u\n\n",
+            shard.x, shard.y, shards.x, shards.y);
+    return 1;
+  }
+  if (shm_name != NULL &&
+      (attach_name != NULL || unpack_path != NULL || assemble || ifp != NULL ||
+       resume_path != NULL)) {
+    fprintf(stderr,
+            "Error:  A shared memory maze must be newly generated\n"
+            "  -- --shm cannot be used with --attach, --unpack, --assemble,"
+            " -L, or --resume\n\n");
+    return 1;
+  }
+  if (attach_name != NULL && (solution != SOLN_NONE || patch_path != NULL)) {
+    fprintf(stderr,
+            "Error:  Cannot mark a solution on or patch an attached maze\n"
+            "  -- it is mapped read-only\n\n");
+    return 1;
+  }
+  if (stream && ifp == NULL && !assemble) {
+    fprintf(stderr,
+            "Error:  Nothing to stream\n"
+            "  -- --stream needs -L or --assemble\n\n");
+    return 1;
+  }
+  if (stream && (rows_format(format, grid_bits) < 0 ||
+                 solution != SOLN_NONE || patch_path != NULL)) {
+    fprintf(stderr,
+            "Error:  Cannot stream this output\n"
+            "  -- --stream writes text, PNG, EPS, or a grid without a "
+            "new solution or patch\n\n");
+    return 1;
+  }
+  if (view && (shm_name != NULL || pack_path != NULL || stitch || route ||
+               stream || shards.x != 0 || auto_plan || dry_run ||
+               optind < argc)) {
+    fprintf(stderr,
+            "Error:  Cannot view this maze\n"
+            "  -- --view cannot be used with --shm, --pack, --stitch, --route,"
+            "\n     --stream, --shards, --auto, --dry-run, or an output file"
+            "\n\n");
+    return 1;
+  }
+  if (tree_mix >= 0 &&
+      (ckpt_path != NULL || resume_path != NULL || shards.x != 0 ||
+       batch_lanes != 0 || gen_order != GEN_ORDER_RANDOM || auto_plan)) {
+    fprintf(stderr,
+            "Error:  Cannot grow this maze as a tree\n"
+            "  -- --tree cannot be used with --checkpoint, --resume,"
+            " --shards,\n     --batch, --blocked, or --auto\n\n");
+    return 1;
+  }
+  if (dry_run && (stitch || route || resume_path != NULL)) {
+    fprintf(stderr,
+            "Error:  Nothing to estimate\n"
+            "  -- --dry-run cannot be used with --stitch, --route, or "
+            "--resume\n\n");
+    return 1;
+  }
+
+  /* Find the size of a maze that already exists, without loading it,
+     so that the cost of writing it can be estimated first */
+  memset(&req, 0, sizeof(req));
+  memset(&src_lay, 0, sizeof(src_lay));
+  req.source = PLAN_SRC_LOADED;
+  if (unpack_path != NULL) {
+    unsigned long long k;
+
+    /* The pack stays mapped until the program exits */
+    if (!maze_pack_open(&pack, unpack_path)) return 1;
+    if ((k = maze_pack_find(&pack, pack_id)) == pack.n_mazes) {
+      fprintf(stderr, "Error:  No maze with id %llu in '%s'\n\n", pack_id,
+              unpack_path);
+      return 1;
+    }
+
+    /* The pack is mapped read-only, so a maze to be marked is copied */
+    if (solution == SOLN_NONE && patch_path == NULL) {
+      maze_pack_view(&pack, k, &the_maze);
+      req.source = PLAN_SRC_MAPPED;
+    } else if (!maze_pack_copy(&pack, k, &the_maze)) {
+      return 1;
+    }
+    src_lay.n_rows = the_maze.n_rows;
+    src_lay.n_cols = the_maze.n_cols;
+  } else if (attach_name != NULL) {
+    if (!maze_attach(&the_maze, attach_name)) {
+      fprintf(stderr, "Error:  Unable to attach maze '%s'\n\n", attach_name);
+      return 1;
+    }
+    src_lay.n_rows = the_maze.n_rows;
+    src_lay.n_cols = the_maze.n_cols;
+    req.source = PLAN_SRC_MAPPED;
+  } else if (assemble || ifp != NULL) {
+    if (!read_source(ifp, shard_dir, &src_lay)) return 1;
+  } else {
+    src_lay.n_rows = cells.x;
+    src_lay.n_cols = cells.y;
+    req.source = PLAN_SRC_NEW;
+  }
+
+  if (cost_path == NULL)
+    maze_costs_default(&costs);
+  else if (!maze_costs_load(&costs, cost_path))
+    return 1;
+
+  req.n_rows = src_lay.n_rows;
+  req.n_cols = src_lay.n_cols;
+  req.count = pack_path != NULL ? pack_count : 1;
+  req.cores = jobs;
+  req.max_mem = max_mem;
+  req.stream = pack_path == NULL && shm_name == NULL && ckpt_path == NULL &&
+               solution == SOLN_NONE && rows_format(format, grid_bits) >= 0;
+  req.writer = (pack_path != NULL || shm_name != NULL) ? PLAN_OUT_NONE
+                                                        : plan_writer(format);
+  req.h_res = area.x;
+  req.v_res = area.y;
+
+  memset(&plan, 0, sizeof(plan));
+  if (auto_plan) {
+    if (req.source != PLAN_SRC_NEW || resume_path != NULL || stitch ||
+        route || shards.x != 0 || batch_lanes != 0 ||
+        gen_order != GEN_ORDER_RANDOM) {
+      fprintf(stderr,
+              "Error:  --auto chooses how to generate a new maze\n"
+              "  -- it cannot be used with --shards, --batch, --blocked,\n"
+              "     or on a maze that already exists\n\n");
+      return 1;
+    }
+    if (!maze_plan(&plan, &costs, &req)) {
+      fprintf(stderr,
+              "Error:  No way to generate a %u x %u maze fits in %.0f MiB\n"
+              "  -- raise --max-mem\n\n",
+              cells.x, cells.y, max_mem / 1048576.0);
+      return 1;
+    }
+
+    gen_order = plan.order;
+    batch_lanes = plan.lanes;
+    if (plan.layout == PLAN_SHARDS) {
+      shards.x = plan.sh_rows;
+      shards.y = plan.sh_cols;
+      jobs = plan.jobs;
+    }
+  } else if (resume_path == NULL && !stitch && !route && !view) {
+    /* Estimate the engines asked for, within the memory limit */
+    plan.order = gen_order;
+    plan.lanes = batch_lanes;
+    plan.jobs = jobs;
+    plan.sh_rows = src_lay.sh_rows;
+    if (stream) {
+      plan.layout = PLAN_STREAM;
+    } else if (shards.x != 0 && shard.x == 0) {
+      plan.layout = PLAN_SHARDS;
+      plan.sh_rows = shards.x;
+      plan.sh_cols = shards.y;
+      req.writer = PLAN_OUT_NONE;
+    } else if (shards.x != 0) {
+      req.n_rows = (cells.x + shards.x - 1) / shards.x;
+      req.n_cols = (cells.y + shards.y - 1) / shards.y;
+      req.writer = PLAN_OUT_NONE;
+    }
+    if (!maze_plan_fit(&plan, &costs, &req)) {
+      fprintf(stderr,
+              "Error:  A %u x %u maze needs about %.4g MiB here\n"
+              "  -- more than --max-mem allows; raise it%s\n\n",
+              src_lay.n_rows, src_lay.n_cols, plan.bytes / 1048576.0,
+              req.source == PLAN_SRC_NEW && req.stream && shards.x == 0
+                  ? ", or use --auto to make it in shards"
+                  : "");
+      if (!dry_run) return 1;
+      fits = 0;
+    }
+    if (plan.layout == PLAN_SHARDS) jobs = plan.jobs;
+    if (plan.layout == PLAN_STREAM) stream = 1;
+  }
+  if (auto_plan || max_mem > 0 || dry_run)
+    maze_plan_describe(&plan, plan_text, sizeof(plan_text));
+
+  if (dry_run) {
+    printf("Estimate:\n"
+           "  Dimensions:  %ux%u\n",
+           src_lay.n_rows, src_lay.n_cols);
+    if (pack_path != NULL) printf("       Mazes:  %lu\n", pack_count);
+    if (req.writer != PLAN_OUT_NONE)
+      printf(" Output area:  %ux%u\n"
+             "      Format:  %s\n",
+             area.x, area.y, format_names[format]);
+    printf("        Plan:  %s\n"
+           " Peak memory:  %.4g MiB\n"
+           "        Time:  ~%.3g s\n",
+           plan_text, plan.bytes / 1048576.0, plan.nsec / 1e9);
+    if (max_mem > 0)
+      printf("       Limit:  %.4g MiB (%s)\n", max_mem / 1048576.0,
+             fits ? "fits" : "too small");
+    return fits ? 0 : 1;
+  }
+
+  /* Unless told where, shards made only to be written out go in a
+     directory of their own, removed afterward */
+  if (auto_plan && plan.layout == PLAN_SHARDS && strcmp(shard_dir, ".") == 0) {
+    strcpy(tmp_dir, "/tmp/mazegen-XXXXXX");
+    if (mkdtemp(tmp_dir) == NULL) {
+      fprintf(stderr,
+              "Error:  Unable to create shard directory\n"
+              "  -- %s\n\n",
+              strerror(errno));
+      return 1;
+    }
+    shard_dir = tmp_dir;
+  }
+
+  if (shards.x != 0) {
+    maze_layout_t lay;
+    int ok;
+
+    if (mkdir(shard_dir, 0777) != 0 && errno != EEXIST) {
+      fprintf(stderr,
+              "Error:  Unable to create shard directory '%s'\n"
+              "  -- %s\n\n",
+              shard_dir, strerror(errno));
+      return 1;
+    }
+
+    lay.n_rows = cells.x;
+    lay.n_cols = cells.y;
+    lay.sh_rows = shards.x;
+    lay.sh_cols = shards.y;
+    lay.exit_1 = set_exit_1 ? in : EXIT(0, DIR_L);
+    lay.exit_2 = set_exit_2 ? out : EXIT(cells.x - 1, DIR_R);
+
+    fprintf(stderr,
+            "Maze parameters:\n"
+            "  Dimensions:  %ux%u\n"
+            "      Shards:  %ux%u\n"
+            " Random seed:  %ld\n"
+            "   Shard dir:  %s\n",
+            cells.x, cells.y, shards.x, shards.y, rnd_seed, shard_dir);
+    if (auto_plan || max_mem > 0)
+      fprintf(stderr, "        Plan:  %s\n", plan_text);
+
+    if (shard.x != 0) {
+      rowcol_t k = (shard.x - 1) * shards.y + (shard.y - 1);
+
+      set_seed(rnd_seed + k + 1);
+      return maze_shard_generate(&lay, shard.x - 1, shard.y - 1, randomizer,
+                                 shard_dir)
+                 ? 0
+                 : 1;
+    }
+    ok = run_shards(&lay, rnd_seed, shard_dir, jobs);
+    if (!ok || !auto_plan) {
+      if (tmp_dir[0] != '\0') remove_shards(tmp_dir, &lay);
+      return ok ? 0 : 1;
+    }
+
+    /* A planned maze is written out from its shards */
+    if (optind < argc && (ofp = fopen(argv[optind], "wb")) == NULL) {
+      fprintf(stderr,
+              "Error:  Unable to open output file '%s'\n"
+              "  -- %s\n\n",
+              argv[optind], strerror(errno));
+      ok = 0;
+    } else {
+      ok = stream_maze(NULL, shard_dir, &lay, rows_format(format, grid_bits),
+                       ofp, &area, NULL);
+      if (fclose(ofp) != 0) ok = 0;
+    }
+    if (tmp_dir[0] != '\0') remove_shards(tmp_dir, &lay);
+    return ok ? 0 : 1;
+  }
+
+  if (pack_path != NULL) {
+    maze_pack_writer_t pw;
+    unsigned long k;
+    int ok;
+
+    fprintf(stderr,
+            "Maze parameters:\n"
+            "  Dimensions:  %ux%u\n"
+            "       Mazes:  %lu\n"
+            " Random seed:  %ld to %ld\n"
+            "        Pack:  %s\n",
+            cells.x, cells.y, pack_count, rnd_seed,
+            rnd_seed + pack_count - 1, pack_path);
+    if (auto_plan || max_mem > 0)
+      fprintf(stderr, "        Plan:  %s\n", plan_text);
+
+    if (!maze_pack_begin(&pw, pack_path)) return 1;
+    ok = batch_lanes == 0 ||
+         pack_batch(&pw, &cells, batch_lanes, pack_count, rnd_seed,
+                    set_exit_1 ? &in : NULL, set_exit_2 ? &out : NULL);
+    for (k = 0; batch_lanes == 0 && ok && k < pack_count; ++k) {
+      if (!maze_init(&the_maze, cells.x, cells.y)) {
+        ok = 0;
+        break;
+      }
+      if (set_exit_1) the_maze.exit_1 = in;
+      if (set_exit_2) the_maze.exit_2 = out;
+
+      set_seed(rnd_seed + k);
+      ok = (tree_mix >= 0
+                ? maze_generate_tree(&the_maze, randomizer, tree_mix)
+                : maze_generate_order(&the_maze, randomizer, gen_order)) &&
+           maze_pack_add(&pw, rnd_seed + k, &the_maze);
+      maze_clear(&the_maze);
+    }
+    if (!maze_pack_end(&pw) || !ok) {
+      fprintf(stderr, "Error:  Unable to write pack file '%s'\n\n",
+              pack_path);
+      return 1;
+    }
+    return 0;
+  }
+
+  if (stitch) {
+    if (!maze_shard_stitch(shard_dir, randomizer)) {
+      fprintf(stderr, "Error:  Unable to stitch shards in '%s'\n\n",
+              shard_dir);
+      return 1;
+    }
+    return 0;
+  }
+
+  if (optind < argc && shm_name == NULL) {
     if ((ofp = fopen(argv[optind], "wb")) == NULL) {
       fprintf(stderr,
               "Error:  Unable to open output file '%s'\n"
@@ -325,72 +1992,160 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  if (ifp != NULL) {
-    if (!maze_load(&the_maze, ifp)) {
-      fprintf(stderr, "Error:  Unable to load maze from input stream\n\n");
+  if (route) {
+    maze_shard_t first;
+    route_t rt = {ofp, 0};
+    rowcol_t loaded = 0;
+    char *path;
+    int ok;
+
+    if ((path = maze_shard_path(shard_dir, 0, 0)) == NULL ||
+        !maze_shard_info(path, &first)) {
+      fprintf(stderr, "Error:  Unable to read shards in '%s'\n\n", shard_dir);
+      free(path);
+      return 1;
+    }
+    free(path);
+    maze_shard_clear(&first);
+
+    if (solution != SOLN_CHOSEN) {
+      exit_cell(first.lay.exit_1, first.lay.n_rows, first.lay.n_cols, &src);
+      exit_cell(first.lay.exit_2, first.lay.n_rows, first.lay.n_cols, &dst);
+    }
+
+    fprintf(stderr,
+            "Maze parameters:\n"
+            "  Dimensions:  %ux%u\n"
+            "      Shards:  %ux%u\n"
+            "   Shard dir:  %s\n"
+            "       Route:  (%u x %u) to (%u x %u)\n",
+            first.lay.n_rows, first.lay.n_cols, first.lay.sh_rows,
+            first.lay.sh_cols, shard_dir, src.x + 1, src.y + 1, dst.x + 1,
+            dst.y + 1);
+
+    ok = maze_shard_route(shard_dir, src.x, src.y, dst.x, dst.y, emit_cell,
+                          &rt, &loaded);
+    if (fclose(ofp) != 0) ok = 0;
+    if (!ok) {
+      fprintf(stderr, "Error:  Unable to find route in '%s'\n\n", shard_dir);
+      return 1;
+    }
+    fprintf(stderr,
+            " Path length:  %lu\n"
+            " Shards read:  %u of %u\n",
+            rt.n_cells, loaded, first.lay.sh_rows * first.lay.sh_cols);
+    return 0;
+  }
+
+  /* A stored maze or shards can be viewed without loading them */
+  if (view && patch_path == NULL &&
+      (assemble || (ifp != NULL && solution == SOLN_NONE))) {
+    path_t pv = {NULL, 0, 0, 0, 1};
+    int ok;
+
+    if (assemble) {
+      if (!maze_view_shards(&the_view, shard_dir)) {
+        fprintf(stderr, "Error:  Unable to read shards in '%s'\n\n",
+                shard_dir);
+        return 1;
+      }
+      if (solution == SOLN_DEFAULT) {
+        exit_cell(the_view.exit_1, the_view.n_rows, the_view.n_cols, &src);
+        exit_cell(the_view.exit_2, the_view.n_rows, the_view.n_cols, &dst);
+      }
+      pv.n_cols = the_view.n_cols;
+      if (solution != SOLN_NONE &&
+          (!maze_shard_route(shard_dir, src.x, src.y, dst.x, dst.y,
+                             path_cell, &pv, NULL) ||
+           !pv.ok)) {
+        fprintf(stderr, "Error:  Unable to find route in '%s'\n\n",
+                shard_dir);
+        maze_view_clear(&the_view);
+        free(pv.cells);
+        return 1;
+      }
+      qsort(pv.cells, pv.n, sizeof(*pv.cells), cmp_cell);
+      maze_view_path(&the_view, pv.cells, pv.n);
+
+      ok = view_maze(&the_view, shard_dir);
+      maze_view_clear(&the_view);
+      free(pv.cells);
+      return ok ? 0 : 1;
+    }
+
+    /* If the input cannot be seeked, it is loaded as usual */
+    if (maze_view_store(&the_view, ifp, src_lay.n_rows, src_lay.n_cols,
+                        src_lay.exit_1, src_lay.exit_2)) {
+      ok = view_maze(&the_view, "<input stream>");
+      maze_view_clear(&the_view);
+      return ok ? 0 : 1;
+    }
+  }
+
+  if (stream) {
+    int ok = stream_maze(ifp, shard_dir, &src_lay,
+                         rows_format(format, grid_bits), ofp, &area,
+                         max_mem > 0 ? plan_text : NULL);
+
+    if (fclose(ofp) != 0) ok = 0;
+    return ok ? 0 : 1;
+  }
+
+  if (req.source == PLAN_SRC_MAPPED || unpack_path != NULL) {
+    /* Already mapped or copied, from a pack or shared memory */
+  } else if (assemble) {
+    if (!maze_shard_assemble(shard_dir, &the_maze)) {
+      fprintf(stderr, "Error:  Unable to load maze from '%s'\n\n",
+              shard_dir);
       return 1;
     }
-  } else if (maze_init(&the_maze, cells.x, cells.y)) {
+  } else if (ifp != NULL) {
+    if (!load_rows(&the_maze, ifp, &src_lay)) return 1;
+  } else if (resume_path != NULL) {
+    if (!read_checkpoint(resume_path, &rnd_seed, &the_maze, &the_gen)) return 1;
+    if (set_exit_1) the_maze.exit_1 = in;
+    if (set_exit_2) the_maze.exit_2 = out;
+
+    /* Keep checkpointing to the same file unless told otherwise */
+    if (ckpt_path == NULL) ckpt_path = resume_path;
+
+    if (!generate(&the_maze, &the_gen, rnd_seed, ckpt_path, ckpt_interval))
+      return 1;
+    maze_gen_end(&the_maze, &the_gen);
+  } else if (shm_name != NULL
+                 ? maze_shm_create(&the_maze, shm_name, cells.x, cells.y)
+                 : maze_init(&the_maze, cells.x, cells.y)) {
     if (set_exit_1) the_maze.exit_1 = in;
     if (set_exit_2) the_maze.exit_2 = out;
 
-    if (!maze_generate(&the_maze, randomizer)) {
+    if (tree_mix >= 0 ? !maze_generate_tree(&the_maze, randomizer, tree_mix)
+                      : !maze_gen_begin_order(&the_maze, &the_gen, gen_order)) {
       fprintf(stderr,
               "Error:  Insufficient memory to generate %u x %u maze\n\n",
               the_maze.n_rows, the_maze.n_cols);
       maze_clear(&the_maze);
       return 1;
     }
+    if (tree_mix < 0) {
+      if (!generate(&the_maze, &the_gen, rnd_seed, ckpt_path, ckpt_interval))
+        return 1;
+      maze_gen_end(&the_maze, &the_gen);
+    }
+  } else if (shm_name != NULL) {
+    fprintf(stderr, "Error:  Unable to create maze in shared memory '%s'\n\n",
+            shm_name);
+    return 1;
   } else {
     fprintf(stderr, "Error:  Insufficient memory to create %u x %u maze\n\n",
             cells.x, cells.y);
     return 1;
   }
 
-  if (solution == SOLN_DEFAULT) {
-    rowcol_t pos, dir;
-
-    pos = EPOS(the_maze.exit_1);
-    dir = EDIR(the_maze.exit_1);
-    switch (dir) {
-      case DIR_U:
-        src.x = 0;
-        src.y = pos;
-        break;
-      case DIR_D:
-        src.x = the_maze.n_rows - 1;
-        src.y = pos;
-        break;
-      case DIR_L:
-        src.x = pos;
-        src.y = 0;
-        break;
-      case DIR_R:
-        src.x = pos;
-        src.y = the_maze.n_cols - 1;
-        break;
-    }
+  if (patch_path != NULL && !patch_maze(&the_maze, patch_path)) return 1;
 
-    pos = EPOS(the_maze.exit_2);
-    dir = EDIR(the_maze.exit_2);
-    switch (dir) {
-      case DIR_U:
-        dst.x = 0;
-        dst.y = pos;
-        break;
-      case DIR_D:
-        dst.x = the_maze.n_rows - 1;
-        dst.y = pos;
-        break;
-      case DIR_L:
-        dst.x = pos;
-        dst.y = 0;
-        break;
-      case DIR_R:
-        dst.x = pos;
-        dst.y = the_maze.n_cols - 1;
-        break;
-    }
+  if (solution == SOLN_DEFAULT) {
+    exit_cell(the_maze.exit_1, the_maze.n_rows, the_maze.n_cols, &src);
+    exit_cell(the_maze.exit_2, the_maze.n_rows, the_maze.n_cols, &dst);
   }
 
   if (solution != SOLN_NONE) {
@@ -411,6 +2166,20 @@ int main(int argc, char *argv[]) {
     maze_find_path(&the_maze, src.x, src.y, dst.x, dst.y);
   }
 
+  if (view) {
+    int ok;
+
+    maze_view_init(&the_view, &the_maze);
+    ok = view_maze(&the_view, unpack_path != NULL   ? unpack_path
+                              : attach_name != NULL ? attach_name
+                              : assemble            ? shard_dir
+                              : ifp != NULL         ? "<input stream>"
+                                                    : "<new maze>");
+    maze_view_clear(&the_view);
+    maze_clear(&the_maze);
+    return ok ? 0 : 1;
+  }
+
   fprintf(stderr,
           "Maze parameters:\n"
           "  Dimensions:  %ux%u\n"
@@ -419,12 +2188,10 @@ int main(int argc, char *argv[]) {
           " Random seed:  %ld\n"
           "      Target:  %s\n",
           the_maze.n_rows, the_maze.n_cols, area.x, area.y,
-          ((format == FORMAT_TEXT)
-               ? "Text"
-               : ((format == FORMAT_PNG)
-                      ? "PNG"
-                      : (format == FORMAT_COMP) ? "Compact" : "PostScript")),
-          rnd_seed, (ofp == stdout) ? "<standard output>" : argv[optind]);
+          format_names[format], rnd_seed,
+          (shm_name != NULL)
+              ? shm_name
+              : (ofp == stdout) ? "<standard output>" : argv[optind]);
 
   if (solution == SOLN_NONE) {
     fputs("    Solution:  NONE\n", stderr);
@@ -432,6 +2199,20 @@ int main(int argc, char *argv[]) {
     fprintf(stderr, "    Solution:  (%u x %u) to (%u x %u)\n", src.x + 1,
             src.y + 1, dst.x + 1, dst.y + 1);
   }
+  if (auto_plan || max_mem > 0)
+    fprintf(stderr, "        Plan:  %s\n", plan_text);
+  else if (gen_order == GEN_ORDER_BLOCKED)
+    fputs("       Order:  Blocked\n", stderr);
+  else if (tree_mix >= 0)
+    fprintf(stderr, "       Order:  Growing tree, mix %g\n", tree_mix);
+  if (patch_path != NULL) fprintf(stderr, "       Patch:  %s\n", patch_path);
+
+  if (shm_name != NULL) {
+    maze_shm_publish(&the_maze);
+    fprintf(stderr, "    Sequence:  %llu\n", maze_shm_sync(&the_maze));
+    maze_clear(&the_maze);
+    return 0;
+  }
 
   switch (format) {
     case FORMAT_TEXT:
@@ -439,7 +2220,14 @@ int main(int argc, char *argv[]) {
       break;
 
     case FORMAT_PNG:
-      maze_write_png(&the_maze, ofp, area.x, area.y);
+      /* Drawn by rows if the whole image would not fit in --max-mem */
+      sink = maze_file_sink(&fs, ofp);
+      if (plan.writer == PLAN_OUT_ROWS
+              ? !maze_emit_rows(&the_maze, ROWS_PNG, sink, area.x, area.y)
+              : !maze_emit_png(&the_maze, sink, area.x, area.y)) {
+        fprintf(stderr, "Error:  Unable to write PNG image\n\n");
+        return 1;
+      }
       break;
 
     case FORMAT_EPS:
@@ -450,6 +2238,29 @@ int main(int argc, char *argv[]) {
       maze_store(&the_maze, ofp);
       break;
 
+    case FORMAT_CSR:
+      if (!maze_write_csr(&the_maze, ofp, csr_edges)) {
+        fprintf(stderr, "Error:  Unable to write CSR graph\n\n");
+        return 1;
+      }
+      break;
+
+    case FORMAT_GRID:
+      if (!maze_write_grid(&the_maze, ofp, grid_bits)) {
+        fprintf(stderr, "Error:  Unable to write occupancy grid\n\n");
+        return 1;
+      }
+      break;
+
+    case FORMAT_HASH:
+      maze_hash(&the_maze, hash);
+      fprintf(ofp, "%016llx%016llx\n", hash[0], hash[1]);
+      break;
+
+    case FORMAT_DIFF:
+      if (!write_diff(&the_maze, diff_path, ofp)) return 1;
+      break;
+
     default:
       assert(0 &&
              "Unknown format code in switch(format) "
@@ -0,0 +1,171 @@
+/*
+  Name:     mazehash.c
+  Purpose:  Structural hashing of mazes.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#include "mazehash.h"
+
+#include <stdint.h>
+
+#include "mazecpu.h"
+
+#define HASH_BLOCK 16 /* Cells per block */
+#define HASH_GROUP 64 /* Blocks gathered at a time */
+
+/* Keys for the two words of the hash */
+static const uint64_t hash_key[2] = {0x9e3779b97f4a7c15ULL,
+                                     0xc2b2ae3d27d4eb4fULL};
+
+/* s_mix(x)
+
+   The SplitMix64 finalizer: a cheap bijection of 64-bit words in
+   which every bit of the input affects every bit of the output.
+ */
+
+static uint64_t s_mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+/* s_block_walls(*cells, n)
+
+   Pack the walls of up to HASH_BLOCK cells into a word, right walls in
+   the low half and bottom walls in the high half.  Missing cells at
+   the end of the maze count as having no walls.
+ */
+
+static uint32_t s_block_walls(const maze_node *cells, rowcol_t n) {
+  uint32_t w = 0;
+  rowcol_t i;
+
+  for (i = 0; i < n; ++i)
+    w |= ((uint32_t)cells[i].r_wall << i) |
+         ((uint32_t)cells[i].b_wall << (HASH_BLOCK + i));
+  return w;
+}
+
+/* s_share(b, w, j)
+
+   Return the share of block b, whose walls are w, in word j of the
+   running sum.
+ */
+
+static uint64_t s_share(uint64_t b, uint32_t w, int j) {
+  return s_mix(((b << 32) | w) ^ hash_key[j]);
+}
+
+/* maze_hash_init(*mp, *hp)
+
+   Sum the shares of all the blocks.  The walls of the full blocks are
+   packed HASH_GROUP blocks at a time by the blocks kernel (see
+   mazecpu.h), and then mixed.
+ */
+
+void maze_hash_init(const maze_t *mp, maze_hash_t *hp) {
+  const maze_kernels_t *kp = maze_kernels();
+  uint64_t n_cells = (uint64_t)mp->n_rows * mp->n_cols, b, i, n, full;
+  uint64_t s0 = 0, s1 = 0;
+  unsigned int w[HASH_GROUP];
+
+  full = n_cells / HASH_BLOCK;
+  for (b = 0; b < full; b += n) {
+    n = full - b < HASH_GROUP ? full - b : HASH_GROUP;
+    kp->blocks(mp->cells + b * HASH_BLOCK, n, w);
+    for (i = 0; i < n; ++i) {
+      s0 += s_share(b + i, w[i], 0);
+      s1 += s_share(b + i, w[i], 1);
+    }
+  }
+  if (b * HASH_BLOCK < n_cells) {
+    uint32_t v = s_block_walls(mp->cells + b * HASH_BLOCK,
+                               (rowcol_t)(n_cells - b * HASH_BLOCK));
+
+    s0 += s_share(b, v, 0);
+    s1 += s_share(b, v, 1);
+  }
+
+  hp->sum[0] = s0;
+  hp->sum[1] = s1;
+}
+
+/* maze_hash_edit(*mp, *hp, r, c, old)
+
+   Replace the share of the block holding the cell: its walls now are
+   read from the maze, and its walls before are the same except for
+   the one cell.
+ */
+
+void maze_hash_edit(const maze_t *mp, maze_hash_t *hp, rowcol_t r, rowcol_t c,
+                    maze_node old) {
+  uint64_t n_cells = (uint64_t)mp->n_rows * mp->n_cols;
+  uint64_t pos = OFFSET(mp, (uint64_t)r, c), b = pos / HASH_BLOCK;
+  uint64_t n = n_cells - b * HASH_BLOCK;
+  unsigned int i = (unsigned int)(pos % HASH_BLOCK);
+  uint32_t w_new, w_old;
+  int j;
+
+  w_new = s_block_walls(mp->cells + b * HASH_BLOCK,
+                        n < HASH_BLOCK ? (rowcol_t)n : HASH_BLOCK);
+  w_old = w_new & ~((1U << i) | (1U << (HASH_BLOCK + i)));
+  w_old |= ((uint32_t)old.r_wall << i) |
+           ((uint32_t)old.b_wall << (HASH_BLOCK + i));
+
+  for (j = 0; j < 2; ++j)
+    hp->sum[j] += s_share(b, w_new, j) - s_share(b, w_old, j);
+}
+
+/* maze_hash_digest(*mp, *hp, out)
+
+   Mix the dimensions and exits of the maze into each word of the
+   running sum.
+ */
+
+void maze_hash_digest(const maze_t *mp, const maze_hash_t *hp,
+                      unsigned long long out[2]) {
+  uint64_t dims = ((uint64_t)mp->n_rows << 32) | mp->n_cols;
+  uint64_t exits = ((uint64_t)mp->exit_1 << 32) | mp->exit_2;
+  int j;
+
+  for (j = 0; j < 2; ++j)
+    out[j] = s_mix(hp->sum[j] + s_mix(dims ^ hash_key[j]) +
+                   s_mix(exits + hash_key[j]));
+}
+
+/* maze_hash(*mp, out)
+
+   Compute the whole hash of a maze at once.
+ */
+
+void maze_hash(const maze_t *mp, unsigned long long out[2]) {
+  maze_hash_t h;
+
+  maze_hash_init(mp, &h);
+  maze_hash_digest(mp, &h, out);
+}
+
+/* Here there be dragons */
@@ -0,0 +1,83 @@
+/*
+  Name:     mazehash.h
+  Purpose:  Structural hashing of mazes.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#ifndef MAZEHASH_H_
+#define MAZEHASH_H_
+
+#include "maze.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The structural hash of a maze depends only on its dimensions, its
+   exits, and the walls of its cells; markers and visit flags left by
+   path finding are ignored, so a solved maze hashes the same as the
+   bare one.  The hash is 128 bits, as two 64-bit words; either word
+   alone serves as a 64-bit hash.  It is the same on every host.
+
+   The cells are taken in row major order in blocks of 16, and the
+   walls of each block packed into a 32-bit word w, with the right
+   wall of the i-th cell in bit i and its bottom wall in bit 16 + i.
+   Block b contributes mix((b << 32 | w) ^ K[j]) to word j of the
+   running sum, modulo 2^64, where mix() is the SplitMix64 finalizer.
+   Because the sum does not depend on the order of the blocks, it can
+   be updated when a wall changes by replacing one block's share. */
+
+/** The running state of a structural hash. */
+typedef struct {
+  unsigned long long sum[2];
+} maze_hash_t;
+
+/** Compute the running state of the hash of a maze from scratch. */
+void maze_hash_init(const maze_t *mp, maze_hash_t *hp);
+
+/** Update the running state of a hash after the walls of one cell
+    have changed.  This takes constant time.
+
+    @param mp    Pointer to the maze, with the cell already changed.
+    @param hp    Running state, matching the maze before the change.
+    @param r     Row of the changed cell.
+    @param c     Column of the changed cell.
+    @param old   Value of the cell before the change.
+ */
+void maze_hash_edit(const maze_t *mp, maze_hash_t *hp, rowcol_t r, rowcol_t c,
+                    maze_node old);
+
+/** Finish a hash, combining the running state with the dimensions and
+    exits of the maze, and store the result in out.
+ */
+void maze_hash_digest(const maze_t *mp, const maze_hash_t *hp,
+                      unsigned long long out[2]);
+
+/** Compute the structural hash of a maze and store it in out. */
+void maze_hash(const maze_t *mp, unsigned long long out[2]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end MAZEHASH_H_ */
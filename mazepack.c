@@ -0,0 +1,339 @@
+/*
+  Name:     mazepack.c
+  Purpose:  Packs of many mazes in one file, served by mmap.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#include "mazepack.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The header at the start of a pack file. */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint64_t n_mazes;
+  uint64_t index_off; /* File offset of the index          */
+  uint32_t node_size; /* sizeof(maze_node) on the writer   */
+  char reserved[36];
+} s_pack_hdr_t;
+
+/* An entry of the index. */
+typedef struct {
+  uint64_t id;
+  uint64_t off; /* File offset of the first cell */
+  uint32_t n_rows;
+  uint32_t n_cols;
+  uint32_t exit_1;
+  uint32_t exit_2;
+} s_pack_ent_t;
+
+#define PACK_HDR_SIZE 64
+#define PACK_VERSION 1
+#define PACK_ALIGN 64 /* Alignment of each maze's cells */
+
+static const char pack_magic[4] = {'M', 'Z', 'P', 'K'};
+
+/* Fails to compile if the layout is not the size the format expects */
+typedef char s_pack_size_ok[(sizeof(s_pack_hdr_t) == PACK_HDR_SIZE &&
+                             sizeof(s_pack_ent_t) == 32)
+                                ? 1
+                                : -1];
+
+/* s_write_header(*wp)
+
+   Write the header of a pack at the start of its file.
+ */
+
+static int s_write_header(maze_pack_writer_t *wp) {
+  s_pack_hdr_t hdr;
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, pack_magic, sizeof(pack_magic));
+  hdr.version = PACK_VERSION;
+  hdr.n_mazes = wp->n_mazes;
+  hdr.index_off = wp->off;
+  hdr.node_size = sizeof(maze_node);
+
+  return fseek(wp->ofp, 0, SEEK_SET) == 0 &&
+         fwrite(&hdr, sizeof(hdr), 1, wp->ofp) == 1;
+}
+
+/* maze_pack_begin(*wp, *path)
+
+   Create the file with a provisional header, which maze_pack_end()
+   rewrites once the index is in place.
+ */
+
+int maze_pack_begin(maze_pack_writer_t *wp, const char *path) {
+  if ((wp->ofp = fopen(path, "w+b")) == NULL) {
+    fprintf(stderr, "maze_pack_begin:  unable to create '%s': %s\n", path,
+            strerror(errno));
+    return 0;
+  }
+
+  wp->index = NULL;
+  wp->n_mazes = 0;
+  wp->cap = 0;
+  wp->off = PACK_HDR_SIZE;
+
+  if (!s_write_header(wp)) {
+    fprintf(stderr, "maze_pack_begin:  unable to write '%s': %s\n", path,
+            strerror(errno));
+    fclose(wp->ofp);
+    return 0;
+  }
+  return 1;
+}
+
+/* maze_pack_add(*wp, id, *mp)
+
+   Append the cells of the maze as they lie in memory, padded so that
+   the next maze starts on an aligned offset, and note them in the
+   index.
+ */
+
+int maze_pack_add(maze_pack_writer_t *wp, unsigned long long id,
+                  const maze_t *mp) {
+  static const char pad[PACK_ALIGN] = {0};
+  size_t n_cells = (size_t)mp->n_rows * mp->n_cols, n_pad;
+  s_pack_ent_t *ent;
+
+  if (wp->n_mazes > 0 &&
+      ((s_pack_ent_t *)wp->index)[wp->n_mazes - 1].id >= id) {
+    fprintf(stderr, "maze_pack_add:  id %llu is out of order\n", id);
+    return 0;
+  }
+
+  if (wp->n_mazes == wp->cap) {
+    unsigned long long cap = wp->cap ? 2 * wp->cap : 64;
+    void *tmp = realloc(wp->index, cap * sizeof(s_pack_ent_t));
+
+    if (tmp == NULL) return 0;
+    wp->index = tmp;
+    wp->cap = cap;
+  }
+
+  n_pad = (PACK_ALIGN - (n_cells * sizeof(maze_node)) % PACK_ALIGN) %
+          PACK_ALIGN;
+  if (fwrite(mp->cells, sizeof(maze_node), n_cells, wp->ofp) != n_cells ||
+      fwrite(pad, 1, n_pad, wp->ofp) != n_pad) {
+    fprintf(stderr, "maze_pack_add:  write error: %s\n", strerror(errno));
+    return 0;
+  }
+
+  ent = (s_pack_ent_t *)wp->index + wp->n_mazes++;
+  ent->id = id;
+  ent->off = wp->off;
+  ent->n_rows = mp->n_rows;
+  ent->n_cols = mp->n_cols;
+  ent->exit_1 = mp->exit_1;
+  ent->exit_2 = mp->exit_2;
+  wp->off += n_cells * sizeof(maze_node) + n_pad;
+
+  return 1;
+}
+
+/* maze_pack_end(*wp)
+
+   Write the index after the last maze, then the final header.
+ */
+
+int maze_pack_end(maze_pack_writer_t *wp) {
+  int ok = fwrite(wp->index, sizeof(s_pack_ent_t), wp->n_mazes, wp->ofp) ==
+               wp->n_mazes &&
+           s_write_header(wp);
+
+  if (fclose(wp->ofp) != 0) ok = 0;
+  if (!ok)
+    fprintf(stderr, "maze_pack_end:  write error: %s\n", strerror(errno));
+
+  free(wp->index);
+  wp->index = NULL;
+  wp->ofp = NULL;
+  return ok;
+}
+
+/* maze_pack_open(*pp, *path)
+
+   Map the whole file privately, and check that the header and index
+   describe mazes written on a compatible host, inside the file.
+ */
+
+int maze_pack_open(maze_pack_t *pp, const char *path) {
+  const s_pack_hdr_t *hp;
+  const s_pack_ent_t *ent;
+  struct stat st;
+  unsigned long long k;
+  void *map;
+  int fd;
+
+  if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "maze_pack_open:  unable to open '%s': %s\n", path,
+            strerror(errno));
+    if (fd >= 0) close(fd);
+    return 0;
+  }
+  if ((size_t)st.st_size < PACK_HDR_SIZE) {
+    fprintf(stderr, "maze_pack_open:  '%s' is not a pack file\n", path);
+    close(fd);
+    return 0;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "maze_pack_open:  unable to map '%s': %s\n", path,
+            strerror(errno));
+    return 0;
+  }
+
+  hp = map;
+  if (memcmp(hp->magic, pack_magic, sizeof(pack_magic)) != 0 ||
+      hp->version != PACK_VERSION || hp->node_size != sizeof(maze_node) ||
+      hp->index_off > (uint64_t)st.st_size ||
+      ((uint64_t)st.st_size - hp->index_off) / sizeof(s_pack_ent_t) <
+          hp->n_mazes) {
+    fprintf(stderr, "maze_pack_open:  '%s' is not a pack for this host\n",
+            path);
+    munmap(map, st.st_size);
+    return 0;
+  }
+
+  ent = (const s_pack_ent_t *)((const char *)map + hp->index_off);
+  for (k = 0; k < hp->n_mazes; ++k) {
+    if (ent[k].n_rows == 0 || ent[k].n_cols == 0 ||
+        ent[k].off > hp->index_off ||
+        (hp->index_off - ent[k].off) / ent[k].n_cols / sizeof(maze_node) <
+            ent[k].n_rows) {
+      fprintf(stderr, "maze_pack_open:  '%s' has a bad index entry %llu\n",
+              path, k);
+      munmap(map, st.st_size);
+      return 0;
+    }
+  }
+
+  pp->map = map;
+  pp->map_len = st.st_size;
+  pp->n_mazes = hp->n_mazes;
+  pp->index = ent;
+  return 1;
+}
+
+/* maze_pack_find(*pp, id)
+
+   Binary search of the index, which is in ascending order of id.
+ */
+
+unsigned long long maze_pack_find(const maze_pack_t *pp,
+                                  unsigned long long id) {
+  const s_pack_ent_t *ent = pp->index;
+  unsigned long long lo = 0, hi = pp->n_mazes;
+
+  while (lo < hi) {
+    unsigned long long mid = lo + (hi - lo) / 2;
+
+    if (ent[mid].id < id)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return (lo < pp->n_mazes && ent[lo].id == id) ? lo : pp->n_mazes;
+}
+
+/* maze_pack_id(*pp, k)
+
+   Look up the id of a maze by position.
+ */
+
+unsigned long long maze_pack_id(const maze_pack_t *pp, unsigned long long k) {
+  return ((const s_pack_ent_t *)pp->index)[k].id;
+}
+
+/* maze_pack_view(*pp, k, *mp)
+
+   Point mp at the cells of maze k where they lie in the mapping.  The
+   mapping belongs to the pack, so the view has a map_len of zero and
+   maze_clear() leaves it alone.
+ */
+
+int maze_pack_view(const maze_pack_t *pp, unsigned long long k, maze_t *mp) {
+  const s_pack_ent_t *ent;
+
+  if (k >= pp->n_mazes) return 0;
+  ent = (const s_pack_ent_t *)pp->index + k;
+
+  mp->cells = (maze_node *)((char *)pp->map + ent->off);
+  mp->sets = NULL;
+  mp->n_rows = ent->n_rows;
+  mp->n_cols = ent->n_cols;
+  mp->exit_1 = ent->exit_1;
+  mp->exit_2 = ent->exit_2;
+  mp->map = pp->map;
+  mp->map_len = 0;
+  return 1;
+}
+
+/* maze_pack_copy(*pp, k, *mp)
+
+   Copy the cells of maze k out of the mapping into a maze of its own.
+ */
+
+int maze_pack_copy(const maze_pack_t *pp, unsigned long long k, maze_t *mp) {
+  maze_t v;
+
+  if (!maze_pack_view(pp, k, &v)) return 0;
+  if (!maze_init(mp, v.n_rows, v.n_cols)) {
+    fprintf(stderr, "maze_pack_copy:  insufficient memory for maze %llu\n",
+            maze_pack_id(pp, k));
+    return 0;
+  }
+
+  memcpy(mp->cells, v.cells, (size_t)v.n_rows * v.n_cols * sizeof(maze_node));
+  mp->exit_1 = v.exit_1;
+  mp->exit_2 = v.exit_2;
+  return 1;
+}
+
+/* maze_pack_close(*pp)
+
+   Release the mapping.
+ */
+
+void maze_pack_close(maze_pack_t *pp) {
+  if (pp->map != NULL) munmap(pp->map, pp->map_len);
+  pp->map = NULL;
+  pp->map_len = 0;
+  pp->n_mazes = 0;
+  pp->index = NULL;
+}
+
+/* Here there be dragons */
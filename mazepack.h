@@ -0,0 +1,125 @@
+/*
+  Name:     mazepack.h
+  Purpose:  Packs of many mazes in one file, served by mmap.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#ifndef MAZEPACK_H_
+#define MAZEPACK_H_
+
+#include <stdio.h>
+
+#include "maze.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A pack file holds many mazes one after another, each as its cells in
+   the in-memory form of the host that wrote it, followed by an index
+   of fixed-size entries giving the id, offset, dimensions, and exits
+   of every maze in ascending order of id.  A pack is read by mapping
+   the whole file, after which any maze can be used in place. */
+
+/** State for writing a pack file; see maze_pack_begin(). */
+typedef struct {
+  FILE *ofp;
+  void *index;            /* Index entries so far */
+  unsigned long long n_mazes;
+  unsigned long long cap; /* Room in the index     */
+  unsigned long long off; /* File offset of the next maze */
+} maze_pack_writer_t;
+
+/** A pack file mapped into memory; see maze_pack_open(). */
+typedef struct {
+  void *map;
+  size_t map_len;
+  unsigned long long n_mazes;
+  const void *index;
+} maze_pack_t;
+
+/** Begin writing a new pack file.  Returns false with a diagnostic on
+    error.
+
+    @param wp    Pointer to an uninitialized pack writer.
+    @param path  Name of the pack file to create.
+ */
+int maze_pack_begin(maze_pack_writer_t *wp, const char *path);
+
+/** Add a maze to a pack being written.  Ids must be given in strictly
+    ascending order.  Returns false with a diagnostic on error.
+
+    @param wp    Pointer to the pack writer.
+    @param id    Identifier of the maze, for maze_pack_find().
+    @param mp    Pointer to the maze to add.
+ */
+int maze_pack_add(maze_pack_writer_t *wp, unsigned long long id,
+                  const maze_t *mp);
+
+/** Finish a pack file by writing its index, and release the writer.
+    Returns false with a diagnostic on error.
+ */
+int maze_pack_end(maze_pack_writer_t *wp);
+
+/** Map a pack file into memory.  Returns false with a diagnostic on
+    error.
+
+    @param pp    Pointer to an uninitialized pack structure.
+    @param path  Name of the pack file to open.
+ */
+int maze_pack_open(maze_pack_t *pp, const char *path);
+
+/** Return the position in a pack of the maze with the given id, or
+    the number of mazes in the pack if there is none.
+ */
+unsigned long long maze_pack_find(const maze_pack_t *pp,
+                                  unsigned long long id);
+
+/** Return the id of the maze at position k of a pack. */
+unsigned long long maze_pack_id(const maze_pack_t *pp, unsigned long long k);
+
+/** Set up mp as a view of the maze at position k of a pack, without
+    copying its cells.  The pack is mapped read-only, so a view can be
+    given to the writers and to maze_trace_path() from any number of
+    threads, but not marked or patched; use maze_pack_copy() for that,
+    or for maze_find_path().  The view needs no release of its own and
+    must not be used after maze_pack_close().  Returns false if k is
+    out of range.
+ */
+int maze_pack_view(const maze_pack_t *pp, unsigned long long k, maze_t *mp);
+
+/** Initialize mp as a copy of the maze at position k of a pack, which
+    can be changed like any other maze and must be released with
+    maze_clear().  Returns false if k is out of range, or with a
+    diagnostic if memory runs out.
+ */
+int maze_pack_copy(const maze_pack_t *pp, unsigned long long k, maze_t *mp);
+
+/** Unmap a pack file, invalidating all of its views. */
+void maze_pack_close(maze_pack_t *pp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end MAZEPACK_H_ */
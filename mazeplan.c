@@ -0,0 +1,419 @@
+/*
+  Name:     mazeplan.c
+  Purpose:  Choosing how to generate a maze.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#include "mazeplan.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "mazebatch.h"
+
+/* Costs measured with `mazebench -P' on an x86-64 virtual machine.
+   The effective cache size is fitted to the timings; it is much less
+   than the machine claims to have, as is usual. */
+static const maze_costs_t plan_defaults = {
+    230.0, 820.0, /* random order  */
+    215.0, 260.0, /* blocked order */
+    100.0,        /* batches       */
+    180.0, 6.5e5, /* shards        */
+    8388608.0,    /* cache, 8 MiB  */
+    25.0, 800.0, 22.0, /* writing out */
+    70.0, 7.5, 1.2     /* drawing PNG */
+};
+
+/* The costs, by name, as they appear in a cost file */
+static const struct {
+  const char *name;
+  size_t offset;
+} cost_names[] = {
+    {"random_ns", offsetof(maze_costs_t, random_ns)},
+    {"random_big_ns", offsetof(maze_costs_t, random_big_ns)},
+    {"blocked_ns", offsetof(maze_costs_t, blocked_ns)},
+    {"blocked_big_ns", offsetof(maze_costs_t, blocked_big_ns)},
+    {"batch_ns", offsetof(maze_costs_t, batch_ns)},
+    {"shard_ns", offsetof(maze_costs_t, shard_ns)},
+    {"shard_fixed_ns", offsetof(maze_costs_t, shard_fixed_ns)},
+    {"cache_bytes", offsetof(maze_costs_t, cache_bytes)},
+    {"write_ns", offsetof(maze_costs_t, write_ns)},
+    {"eps_ns", offsetof(maze_costs_t, eps_ns)},
+    {"graph_ns", offsetof(maze_costs_t, graph_ns)},
+    {"draw_ns", offsetof(maze_costs_t, draw_ns)},
+    {"pixel_ns", offsetof(maze_costs_t, pixel_ns)},
+    {"band_ns", offsetof(maze_costs_t, band_ns)},
+};
+
+#define N_COSTS (int)(sizeof(cost_names) / sizeof(*cost_names))
+
+#define PLAN_MAX_GRID 64 /* Most shards down or across a maze     */
+#define PLAN_MARGIN 0.95 /* More shards must save at least 5%     */
+#define PLAN_IO_BYTES 65536.0   /* Buffers of a writer and its stream */
+#define PLAN_ZLIB_BYTES 294912.0 /* A deflate stream and its buffer   */
+
+/* s_cost(*cp, offset)
+
+   Return a pointer to the cost with the given offset in *cp.
+ */
+
+static double *s_cost(maze_costs_t *cp, size_t offset) {
+  return (double *)((char *)cp + offset);
+}
+
+/* maze_costs_default(*cp)
+
+   Fill in the default costs.
+ */
+
+void maze_costs_default(maze_costs_t *cp) { *cp = plan_defaults; }
+
+/* maze_costs_load(*cp, *path)
+
+   Read "name value" lines from the given file into the costs, which
+   start from the defaults.  Blank lines and lines beginning with '#'
+   are skipped.
+ */
+
+int maze_costs_load(maze_costs_t *cp, const char *path) {
+  char line[256], name[64];
+  FILE *ifp;
+  double v;
+  int k, n_line = 0, ok = 1;
+
+  maze_costs_default(cp);
+  if ((ifp = fopen(path, "r")) == NULL) {
+    fprintf(stderr, "maze_costs_load:  unable to open '%s'\n", path);
+    return 0;
+  }
+
+  while (ok && fgets(line, sizeof(line), ifp) != NULL) {
+    ++n_line;
+    if (line[strspn(line, " \t\r\n")] == '\0' || line[0] == '#') continue;
+
+    if (sscanf(line, "%63s %lf", name, &v) != 2 || !(v > 0)) {
+      fprintf(stderr, "maze_costs_load:  bad cost at '%s' line %d\n", path,
+              n_line);
+      ok = 0;
+      break;
+    }
+    for (k = 0; k < N_COSTS; ++k) {
+      if (strcmp(name, cost_names[k].name) == 0)
+        *s_cost(cp, cost_names[k].offset) = v;
+    }
+  }
+
+  fclose(ifp);
+  return ok;
+}
+
+/* maze_costs_save(*cp, *ofp)
+
+   Write the costs as "name value" lines.
+ */
+
+int maze_costs_save(const maze_costs_t *cp, FILE *ofp) {
+  maze_costs_t c = *cp;
+  int k;
+
+  for (k = 0; k < N_COSTS; ++k) {
+    if (fprintf(ofp, "%s %.6g\n", cost_names[k].name,
+                *s_cost(&c, cost_names[k].offset)) < 0)
+      return 0;
+  }
+  return fflush(ofp) == 0;
+}
+
+/* maze_costs_gen(*cp, order, cells)
+
+   Estimate the time to generate a maze of the given number of cells
+   in the given order.  The cost per cell moves from its value in
+   cache to its value far beyond cache in proportion to the fraction
+   of the working set which does not fit.
+ */
+
+double maze_costs_gen(const maze_costs_t *cp, int order, double cells) {
+  double ws = cells * MAZE_PLAN_CELL_BYTES, miss = 0;
+  double small = cp->random_ns, big = cp->random_big_ns;
+
+  if (order == GEN_ORDER_BLOCKED) {
+    small = cp->blocked_ns;
+    big = cp->blocked_big_ns;
+  }
+  if (ws > cp->cache_bytes) miss = 1.0 - cp->cache_bytes / ws;
+
+  return cells * (small + (big - small) * miss);
+}
+
+/* maze_costs_output(*cp, writer, nr, nc, h_res, v_res, *bytes)
+
+   Estimate the time and memory to write a maze out.  Drawing an image
+   costs for the pixels of each cell's walls, and for every pixel of
+   the image.  A row writer
+   keeps a few rows of output, and for PNG the window of pixel rows
+   that one row of cells can reach, with a deflate stream; a whole
+   image takes a byte per pixel and a pointer per pixel row, and its
+   encoded form is allowed an eighth as much again.
+ */
+
+double maze_costs_output(const maze_costs_t *cp, int writer, rowcol_t nr,
+                         rowcol_t nc, unsigned int h_res, unsigned int v_res,
+                         double *bytes) {
+  double cells = (double)nr * nc, width = h_res + 1.0, height = v_res + 1.0;
+  double row = 8.0 * (nc + 1) + PLAN_IO_BYTES;
+  double walls = cells * ((double)(h_res / nc) + v_res / nr + 1);
+
+  switch (writer) {
+    case PLAN_OUT_CELLS:
+      *bytes = row;
+      return cells * cp->write_ns;
+    case PLAN_OUT_EPS:
+      *bytes = row;
+      return cells * cp->eps_ns;
+    case PLAN_OUT_IMAGE:
+      *bytes = 1.125 * width * height + height * sizeof(void *) + row;
+      return walls * cp->draw_ns + width * height * cp->pixel_ns;
+    case PLAN_OUT_ROWS:
+      *bytes = (3.0 * (v_res / nr) + 5) * width + width / 4 + row +
+               PLAN_ZLIB_BYTES;
+      return walls * cp->draw_ns + width * height * cp->band_ns;
+    case PLAN_OUT_GRAPH:
+      *bytes = 16.0 * (cells + 1) + row;
+      return cells * cp->graph_ns;
+    default:
+      *bytes = 0;
+      return 0;
+  }
+}
+
+/* s_plan_memory(*pp, *cp, *rp)
+
+   Estimate a plan that holds each maze whole in memory: generated,
+   loaded, or already mapped.  The generator's sets and queue are
+   freed before the maze is written, so the peak is the larger of the
+   two.
+ */
+
+static int s_plan_memory(maze_plan_t *pp, const maze_costs_t *cp,
+                         const maze_plan_req_t *rp) {
+  double cells = (double)rp->n_rows * rp->n_cols, held, gen = 0, out;
+  double t_out;
+
+  held = rp->source == PLAN_SRC_MAPPED ? 0 : cells * sizeof(maze_node);
+  if (rp->source == PLAN_SRC_MAPPED) {
+    pp->nsec = 0;
+  } else if (rp->source == PLAN_SRC_LOADED) {
+    pp->nsec = cells * cp->write_ns;
+  } else if (pp->lanes > 0) {
+    pp->nsec = rp->count * cells * cp->batch_ns;
+    gen = pp->lanes * cells * MAZE_PLAN_CELL_BYTES;
+  } else {
+    pp->nsec = rp->count * maze_costs_gen(cp, pp->order, cells);
+    gen = cells * MAZE_PLAN_CELL_BYTES;
+  }
+
+  pp->writer = rp->writer;
+  t_out = maze_costs_output(cp, pp->writer, rp->n_rows, rp->n_cols,
+                            rp->h_res, rp->v_res, &out);
+  if (rp->max_mem > 0 && pp->writer == PLAN_OUT_IMAGE &&
+      held + out > rp->max_mem) {
+    pp->writer = PLAN_OUT_ROWS;
+    t_out = maze_costs_output(cp, pp->writer, rp->n_rows, rp->n_cols,
+                              rp->h_res, rp->v_res, &out);
+  }
+
+  pp->solver = PLAN_FIND_PATH;
+  pp->jobs = 1;
+  pp->nsec += t_out;
+  pp->bytes = held + out > gen ? held + out : gen;
+
+  return rp->max_mem <= 0 || pp->bytes <= rp->max_mem;
+}
+
+/* s_plan_stream(*pp, *cp, *rp)
+
+   Estimate a plan that reads a maze a row at a time and writes each
+   row out as it goes.  From shards, a band of them is read at once.
+ */
+
+static int s_plan_stream(maze_plan_t *pp, const maze_costs_t *cp,
+                         const maze_plan_req_t *rp) {
+  rowcol_t nr = rp->n_rows, nc = rp->n_cols;
+  rowcol_t band = pp->sh_rows > 0 ? (nr + pp->sh_rows - 1) / pp->sh_rows : 1;
+  double out;
+
+  pp->writer = rp->writer == PLAN_OUT_IMAGE ? PLAN_OUT_ROWS : rp->writer;
+  pp->solver = PLAN_FIND_PATH;
+  pp->jobs = 1;
+  pp->nsec = (double)nr * nc * cp->write_ns +
+             maze_costs_output(cp, pp->writer, nr, nc, rp->h_res, rp->v_res,
+                               &out);
+  pp->bytes = (double)band * nc * sizeof(maze_node) + out;
+
+  return rp->max_mem <= 0 || pp->bytes <= rp->max_mem;
+}
+
+/* s_plan_shards(*pp, *cp, *rp)
+
+   Estimate a plan that makes a maze in shards, in as many jobs at
+   once as are asked for and fit in memory.  The shards are written
+   out a band at a time once they are all made, so an image can only
+   be drawn by rows.
+ */
+
+static int s_plan_shards(maze_plan_t *pp, const maze_costs_t *cp,
+                         const maze_plan_req_t *rp) {
+  rowcol_t nr = rp->n_rows, nc = rp->n_cols;
+  rowcol_t gr = pp->sh_rows, gc = pp->sh_cols, band = (nr + gr - 1) / gr;
+  double cells = (double)nr * nc, out, t_out;
+  double sh_cells = (double)band * ((nc + gc - 1) / gc);
+  double sh_bytes = sh_cells * MAZE_PLAN_CELL_BYTES;
+  unsigned int waves;
+
+  pp->writer = rp->writer == PLAN_OUT_IMAGE ? PLAN_OUT_ROWS : rp->writer;
+  t_out = maze_costs_output(cp, pp->writer, nr, nc, rp->h_res, rp->v_res,
+                            &out);
+  out += (double)band * nc * sizeof(maze_node);
+
+  if (pp->jobs > (int)(gr * gc)) pp->jobs = (int)(gr * gc);
+  if (rp->max_mem > 0 && pp->jobs * sh_bytes > rp->max_mem)
+    pp->jobs = (int)(rp->max_mem / sh_bytes);
+  if (pp->jobs < 1) pp->jobs = 1;
+
+  waves = (gr * gc + pp->jobs - 1) / pp->jobs;
+  pp->solver = PLAN_ROUTE;
+  pp->nsec = waves * maze_costs_gen(cp, GEN_ORDER_RANDOM, sh_cells) +
+             cells * cp->shard_ns + gr * gc * cp->shard_fixed_ns + t_out;
+  pp->bytes = pp->jobs * sh_bytes;
+  if (out > pp->bytes) pp->bytes = out;
+
+  return rp->max_mem <= 0 || pp->bytes <= rp->max_mem;
+}
+
+/* maze_plan_fit(*pp, *cp, *rp)
+
+   Estimate the cost of a plan whose engines are already chosen.  A
+   loaded maze which does not fit in memory is streamed instead, if
+   the request allows.
+ */
+
+int maze_plan_fit(maze_plan_t *pp, const maze_costs_t *cp,
+                  const maze_plan_req_t *rp) {
+  pp->source = rp->source;
+  switch (pp->layout) {
+    case PLAN_SHARDS:
+      return s_plan_shards(pp, cp, rp);
+    case PLAN_STREAM:
+      return s_plan_stream(pp, cp, rp);
+    default:
+      if (s_plan_memory(pp, cp, rp)) return 1;
+      if (rp->source != PLAN_SRC_LOADED || !rp->stream) return 0;
+
+      pp->layout = PLAN_STREAM;
+      return s_plan_stream(pp, cp, rp);
+  }
+}
+
+/* maze_plan(*pp, *cp, *rp)
+
+   Estimate the time and memory of each candidate plan, and keep the
+   fastest which fits: each order in memory, batches for many small
+   mazes, and square grids of shards of every size up to
+   PLAN_MAX_GRID, each run in as many processes as there are cores
+   and memory for.
+ */
+
+int maze_plan(maze_plan_t *pp, const maze_costs_t *cp,
+              const maze_plan_req_t *rp) {
+  rowcol_t nr = rp->n_rows, nc = rp->n_cols, g;
+  int found = 0, order;
+  maze_plan_t cand;
+
+  /* One maze at a time, in memory */
+  for (order = GEN_ORDER_RANDOM; order <= GEN_ORDER_BLOCKED; ++order) {
+    memset(&cand, 0, sizeof(cand));
+    cand.layout = PLAN_MEMORY;
+    cand.order = order;
+    if (maze_plan_fit(&cand, cp, rp) && (!found || cand.nsec < pp->nsec)) {
+      *pp = cand;
+      found = 1;
+    }
+  }
+
+  /* Many small mazes, in batches */
+  if (rp->count > 1 && nr <= MAZE_BATCH_CELLS / nc) {
+    memset(&cand, 0, sizeof(cand));
+    cand.layout = PLAN_MEMORY;
+    cand.lanes =
+        rp->count < MAZE_BATCH_LANES ? rp->count : MAZE_BATCH_LANES;
+    if (maze_plan_fit(&cand, cp, rp) && (!found || cand.nsec < pp->nsec)) {
+      *pp = cand;
+      found = 1;
+    }
+  }
+
+  /* A single maze, in shards */
+  for (g = 2; rp->stream && rp->count == 1 && g <= PLAN_MAX_GRID; ++g) {
+    memset(&cand, 0, sizeof(cand));
+    cand.layout = PLAN_SHARDS;
+    cand.sh_rows = g < nr ? g : nr;
+    cand.sh_cols = g < nc ? g : nc;
+    cand.jobs = rp->cores;
+    if (cand.sh_rows * cand.sh_cols < 2) break;
+
+    if (maze_plan_fit(&cand, cp, rp) &&
+        (!found || cand.nsec < PLAN_MARGIN * pp->nsec)) {
+      *pp = cand;
+      found = 1;
+    }
+  }
+
+  return found;
+}
+
+/* maze_plan_describe(*pp, *buf, len)
+
+   Write a one-line description of a plan into buf.
+ */
+
+void maze_plan_describe(const maze_plan_t *pp, char *buf, size_t len) {
+  char what[64];
+
+  if (pp->layout == PLAN_SHARDS)
+    snprintf(what, sizeof(what), "%ux%u shards, %d job%s", pp->sh_rows,
+             pp->sh_cols, pp->jobs, pp->jobs == 1 ? "" : "s");
+  else if (pp->layout == PLAN_STREAM)
+    snprintf(what, sizeof(what), "streamed a row at a time");
+  else if (pp->source != PLAN_SRC_NEW)
+    snprintf(what, sizeof(what), "%s in memory",
+             pp->source == PLAN_SRC_LOADED ? "loaded" : "mapped");
+  else if (pp->lanes > 0)
+    snprintf(what, sizeof(what), "batches of %u in memory, 1 job", pp->lanes);
+  else
+    snprintf(what, sizeof(what), "%s order in memory, 1 job",
+             pp->order == GEN_ORDER_BLOCKED ? "blocked" : "random");
+
+  snprintf(buf, len, "%s%s, ~%.3g s, %.4g MiB", what,
+           pp->writer == PLAN_OUT_ROWS ? ", PNG by rows" : "", pp->nsec / 1e9,
+           pp->bytes / 1048576.0);
+}
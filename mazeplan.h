@@ -0,0 +1,192 @@
+/*
+  Name:     mazeplan.h
+  Purpose:  Choosing how to generate a maze.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#ifndef MAZEPLAN_H_
+#define MAZEPLAN_H_
+
+#include <stdio.h>
+
+#include "maze.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A plan says which of the library's engines to use for a maze of a
+   given size: whether to generate it in memory, in random or blocked
+   order, or as shards in parallel processes; whether to generate many
+   small mazes in batches; and how to solve it.  The choice is made by
+   estimating the time each candidate takes from a handful of costs,
+   discarding those that would need more memory than allowed, and
+   taking the fastest.  Every engine makes a different maze from the
+   same seed, so a plan must be followed exactly to reproduce a maze.
+
+   A cost model for random access assumes that the fraction of
+   accesses missing the cache is 1 - cache / working set, so that the
+   cost per cell moves from its in-cache value to its out-of-cache
+   value as the maze outgrows the last level cache.
+
+   Writing the maze out is estimated as well, since a PNG image drawn
+   whole can take far more memory than the maze: a plan for a maze
+   that is written out counts the writer's memory and time, and draws
+   the image a band of rows at a time if the whole of it would not fit
+   in the memory allowed. */
+
+/** Costs of the engines, in nanoseconds per cell unless noted.
+    Defaults come from maze_costs_default(); `mazebench -P' measures
+    them on the machine at hand and writes them out for
+    maze_costs_load().
+ */
+typedef struct {
+  double random_ns;      /* Random order, maze in cache            */
+  double random_big_ns;  /* Random order, maze far beyond cache    */
+  double blocked_ns;     /* Blocked order, maze in cache           */
+  double blocked_big_ns; /* Blocked order, maze far beyond cache   */
+  double batch_ns;       /* Batch generation of small mazes        */
+  double shard_ns;       /* Writing, stitching and reading shards  */
+  double shard_fixed_ns; /* The same, and a process, per shard     */
+  double cache_bytes;    /* Effective size of the cache, in bytes  */
+  double write_ns;       /* Reading or writing a maze as text      */
+  double eps_ns;         /* Writing it as EPS                      */
+  double graph_ns;       /* Writing it as a CSR graph              */
+  double draw_ns;        /* Drawing walls in a PNG image, per pixel
+                            of wall                                */
+  double pixel_ns;       /* Filling and encoding the image whole,
+                            per pixel                              */
+  double band_ns;        /* The same, by rows, per pixel           */
+} maze_costs_t;
+
+/** Where a plan puts the maze: whole in memory, in shards, or a row
+    at a time as it is read from its source and written out. */
+enum { PLAN_MEMORY = 0, PLAN_SHARDS = 1, PLAN_STREAM = 2 };
+
+/** Where the maze comes from: generated, read from a file or shards,
+    or already in memory mapped from a pack or shared memory. */
+enum { PLAN_SRC_NEW = 0, PLAN_SRC_LOADED = 1, PLAN_SRC_MAPPED = 2 };
+
+/** How a plan solves the maze. */
+enum { PLAN_FIND_PATH = 0, PLAN_ROUTE = 1 };
+
+/** How the maze is written out once it is made. */
+enum {
+  PLAN_OUT_NONE = 0,  /* Not written, as for a pack or shared memory */
+  PLAN_OUT_CELLS = 1, /* A row at a time: text, compact, grid, hash  */
+  PLAN_OUT_EPS = 2,   /* EPS, a row at a time                        */
+  PLAN_OUT_IMAGE = 3, /* PNG drawn whole, as by maze_write_png()     */
+  PLAN_OUT_ROWS = 4,  /* PNG drawn by rows, as by maze_emit_rows()   */
+  PLAN_OUT_GRAPH = 5  /* CSR arrays, as by maze_write_csr()          */
+};
+
+/** Bytes of memory per cell while a maze is generated: the cell, its
+    path set, and its place in the queue. */
+#define MAZE_PLAN_CELL_BYTES 9
+
+/** What is to be made and written, and with what resources. */
+typedef struct {
+  rowcol_t n_rows;     /* Size of each maze                        */
+  rowcol_t n_cols;
+  unsigned long count; /* Number of mazes, as for a pack; 1 for one */
+  int cores;           /* Number of processors available           */
+  double max_mem;      /* Most memory to use in bytes, 0 for any   */
+  int source;          /* One of the PLAN_SRC_ values              */
+  int stream;          /* True if the maze may be written by rows,
+                          never held whole: made in shards, or
+                          streamed from where it is loaded         */
+  int writer;          /* One of the PLAN_OUT_ values              */
+  unsigned int h_res;  /* Output area, for PLAN_OUT_IMAGE          */
+  unsigned int v_res;
+} maze_plan_req_t;
+
+/** The engines chosen for a maze, with estimates of their cost. */
+typedef struct {
+  int layout;          /* One of the PLAN_ layouts                 */
+  int source;          /* One of the PLAN_SRC_ values              */
+  int order;           /* GEN_ORDER_RANDOM or GEN_ORDER_BLOCKED    */
+  int solver;          /* PLAN_FIND_PATH or PLAN_ROUTE             */
+  int writer;          /* PLAN_OUT_ value used to write the maze   */
+  unsigned int lanes;  /* Mazes per batch, or 0 for one at a time  */
+  rowcol_t sh_rows;    /* Shard grid, for PLAN_SHARDS, or of the
+                          shards streamed from, for PLAN_STREAM    */
+  rowcol_t sh_cols;
+  int jobs;            /* Processes generating at once             */
+  double nsec;         /* Estimated time to make and write them    */
+  double bytes;        /* Estimated peak memory                    */
+} maze_plan_t;
+
+/** Fill in the default costs, measured on a typical machine. */
+void maze_costs_default(maze_costs_t *cp);
+
+/** Read costs from a file of "name value" lines, as written by
+    maze_costs_save(), over the defaults.  Names not recognized are
+    ignored.  Returns false with a diagnostic on error.
+ */
+int maze_costs_load(maze_costs_t *cp, const char *path);
+
+/** Write costs to a stream in the form read by maze_costs_load().
+    Returns false in case of a write error.
+ */
+int maze_costs_save(const maze_costs_t *cp, FILE *ofp);
+
+/** Estimate the time in nanoseconds to generate a maze of the given
+    number of cells in memory, in the given order. */
+double maze_costs_gen(const maze_costs_t *cp, int order, double cells);
+
+/** Estimate the time in nanoseconds to write a maze of the given
+    size with the given PLAN_OUT_ writer, and store in *bytes the
+    memory it takes beyond the maze itself. */
+double maze_costs_output(const maze_costs_t *cp, int writer, rowcol_t nr,
+                         rowcol_t nc, unsigned int h_res, unsigned int v_res,
+                         double *bytes);
+
+/** Choose the engines for making and writing the new mazes of a
+    request.  Shards are only considered for a single maze, and only
+    if the request allows streaming; a sharded maze can be streamed
+    out or routed, but not held in memory.  Returns false if no plan
+    fits in the memory limit.
+ */
+int maze_plan(maze_plan_t *pp, const maze_costs_t *cp,
+              const maze_plan_req_t *rp);
+
+/** Estimate the cost of a plan whose layout, order, lanes, shard grid
+    and jobs are already set, filling in its solver, writer, time and
+    memory.  To fit the memory limit, shards are run in fewer jobs, an
+    image is drawn by rows, and a loaded maze is streamed if the
+    request allows, as need be.  Returns false if the plan does not
+    fit even so.
+ */
+int maze_plan_fit(maze_plan_t *pp, const maze_costs_t *cp,
+                  const maze_plan_req_t *rp);
+
+/** Describe a plan in a line of text, without a newline, such as
+    "blocked order in memory, 1 job, ~2.4 s, 137 MiB".
+ */
+void maze_plan_describe(const maze_plan_t *pp, char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end MAZEPLAN_H_ */
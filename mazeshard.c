@@ -0,0 +1,1729 @@
+/*
+  Name:     mazeshard.c
+  Purpose:  Sharded generation of very large mazes.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#include "mazeshard.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A shard file consists of a tag, a header of HDR_WORDS rowcol_t
+   values, the border component array, and then one byte per cell in
+   row major order, encoded as for maze_store().  Once stitched, the
+   cells are followed by the portal summary: the border index of each
+   portal, where the links of each portal start (and where the last
+   ends), and the links -- pairs of another portal in the same
+   component and the steps to it.  All values are in the native byte
+   order.  The header words are: */
+enum {
+  H_VERSION,
+  H_MAZE_ROWS,
+  H_MAZE_COLS,
+  H_SHARD_ROWS,
+  H_SHARD_COLS,
+  H_EXIT_1,
+  H_EXIT_2,
+  H_SI,
+  H_SJ,
+  H_ROW0,
+  H_COL0,
+  H_ROWS,
+  H_COLS,
+  H_N_COMP,
+  H_STITCHED,
+  H_N_PORTALS,
+  HDR_WORDS
+};
+
+static const char shard_magic[4] = {'M', 'Z', 'S', 'H'};
+#define SHARD_VERSION 3
+
+/* Marks a cell not (yet) assigned to a component */
+#define NO_COMP ((rowcol_t)-1)
+
+/* Trees left in a generated shard with n cells on its seams -- two
+   for every three -- which stitches to about the density of open
+   walls elsewhere in the maze; see s_generate_forest() */
+#define SHARD_TREES(n) ((2 * (n) + 2) / 3)
+
+/* s_border_len(*sp)
+
+   Return the number of entries in the border array of a shard.
+ */
+
+static rowcol_t s_border_len(const maze_shard_t *sp) {
+  return 2 * sp->n_cols + 2 * sp->n_rows;
+}
+
+/* s_border_pos(*sp, i)
+
+   Return the position within shard sp of the cell at index i of its
+   border array.
+ */
+
+static rowcol_t s_border_pos(const maze_shard_t *sp, rowcol_t i) {
+  if (i < SHARD_BOTTOM(sp))
+    return i;
+  else if (i < SHARD_LEFT(sp))
+    return (sp->n_rows - 1) * sp->n_cols + (i - SHARD_BOTTOM(sp));
+  else if (i < SHARD_RIGHT(sp))
+    return (i - SHARD_LEFT(sp)) * sp->n_cols;
+  else
+    return (i - SHARD_RIGHT(sp)) * sp->n_cols + sp->n_cols - 1;
+}
+
+/* s_cell_offset(*sp, pos)
+
+   Return the file offset of the cell at position pos of a shard.
+ */
+
+static long s_cell_offset(const maze_shard_t *sp, rowcol_t pos) {
+  return (long)sizeof(shard_magic) + HDR_WORDS * sizeof(rowcol_t) +
+         s_border_len(sp) * sizeof(rowcol_t) + pos;
+}
+
+/* maze_shard_extent(*lp, si, sj, *sp)
+
+   Fill in the position and size of shard (si, sj).  The rows and
+   columns of the maze are divided as evenly as possible.
+ */
+
+void maze_shard_extent(const maze_layout_t *lp, rowcol_t si, rowcol_t sj,
+                       maze_shard_t *sp) {
+  unsigned long long r0, r1, c0, c1;
+
+  assert(si < lp->sh_rows && sj < lp->sh_cols);
+
+  r0 = (unsigned long long)si * lp->n_rows / lp->sh_rows;
+  r1 = (unsigned long long)(si + 1) * lp->n_rows / lp->sh_rows;
+  c0 = (unsigned long long)sj * lp->n_cols / lp->sh_cols;
+  c1 = (unsigned long long)(sj + 1) * lp->n_cols / lp->sh_cols;
+
+  sp->lay = *lp;
+  sp->si = si;
+  sp->sj = sj;
+  sp->row0 = (rowcol_t)r0;
+  sp->col0 = (rowcol_t)c0;
+  sp->n_rows = (rowcol_t)(r1 - r0);
+  sp->n_cols = (rowcol_t)(c1 - c0);
+  sp->n_comp = 0;
+  sp->stitched = 0;
+  sp->border = NULL;
+  sp->n_portals = 0;
+  sp->portals = NULL;
+  sp->first = NULL;
+  sp->links = NULL;
+}
+
+/* maze_shard_path(*dir, si, sj)
+
+   Return the file name for shard (si, sj) in dir.  Shard files are
+   named with one-based grid positions, to match the command line.
+ */
+
+char *maze_shard_path(const char *dir, rowcol_t si, rowcol_t sj) {
+  size_t len = strlen(dir) + 32;
+  char *out = malloc(len);
+
+  if (out != NULL)
+    snprintf(out, len, "%s/shard-%u-%u.mzs", dir, si + 1, sj + 1);
+
+  return out;
+}
+
+/* s_neighbors(*mp, cur, next)
+
+   Store in next the positions of the cells reachable in one step from
+   position cur of mp, without leaving mp.  Returns how many there are.
+ */
+
+static rowcol_t s_neighbors(const maze_t *mp, rowcol_t cur, rowcol_t next[4]) {
+  rowcol_t r = cur / mp->n_cols, c = cur % mp->n_cols, n_next = 0;
+
+  if (r > 0 && !mp->cells[cur - mp->n_cols].b_wall)
+    next[n_next++] = cur - mp->n_cols;
+  if (r < mp->n_rows - 1 && !mp->cells[cur].b_wall)
+    next[n_next++] = cur + mp->n_cols;
+  if (c > 0 && !mp->cells[cur - 1].r_wall) next[n_next++] = cur - 1;
+  if (c < mp->n_cols - 1 && !mp->cells[cur].r_wall) next[n_next++] = cur + 1;
+
+  return n_next;
+}
+
+/* s_label_border(*mp, *sp)
+
+   Assign a component number to every border cell of the maze, which
+   holds the cells of shard sp.  Components are found by flooding
+   outward from each unlabelled border cell in turn, so components
+   that do not touch the border are never numbered.  Returns false if
+   memory is exhausted.
+ */
+
+static int s_label_border(const maze_t *mp, maze_shard_t *sp) {
+  rowcol_t n_cells = mp->n_rows * mp->n_cols, nb = s_border_len(sp);
+  rowcol_t *label, *queue, i;
+
+  label = malloc(n_cells * sizeof(*label));
+  queue = malloc(n_cells * sizeof(*queue));
+  sp->border = malloc(nb * sizeof(*(sp->border)));
+  if (label == NULL || queue == NULL || sp->border == NULL) {
+    free(label);
+    free(queue);
+    free(sp->border);
+    sp->border = NULL;
+    return 0;
+  }
+
+  for (i = 0; i < n_cells; ++i) label[i] = NO_COMP;
+  sp->n_comp = 0;
+
+  for (i = 0; i < nb; ++i) {
+    rowcol_t pos = s_border_pos(sp, i), head = 0, tail = 0;
+
+    if (label[pos] == NO_COMP) {
+      label[pos] = sp->n_comp++;
+      queue[tail++] = pos;
+
+      while (head < tail) {
+        rowcol_t cur = queue[head++], next[4], k;
+        rowcol_t n_next = s_neighbors(mp, cur, next);
+
+        for (k = 0; k < n_next; ++k) {
+          if (label[next[k]] == NO_COMP) {
+            label[next[k]] = label[pos];
+            queue[tail++] = next[k];
+          }
+        }
+      }
+    }
+    sp->border[i] = label[pos];
+  }
+
+  free(label);
+  free(queue);
+  return 1;
+}
+
+/* s_flood(*mp, src, *dist, *queue)
+
+   Fill in dist with the number of steps from position src of mp to
+   each cell that can be reached from it, all of which must be marked
+   SHARD_NO_PATH to begin with.  The cells reached are left in the
+   queue, which must have room for every cell of mp, and their number
+   is returned.
+ */
+
+static rowcol_t s_flood(const maze_t *mp, rowcol_t src, rowcol_t *dist,
+                        rowcol_t *queue) {
+  rowcol_t head = 0, tail = 0;
+
+  dist[src] = 0;
+  queue[tail++] = src;
+
+  while (head < tail) {
+    rowcol_t cur = queue[head++], next[4], k;
+    rowcol_t n_next = s_neighbors(mp, cur, next);
+
+    for (k = 0; k < n_next; ++k) {
+      if (dist[next[k]] == SHARD_NO_PATH) {
+        dist[next[k]] = dist[cur] + 1;
+        queue[tail++] = next[k];
+      }
+    }
+  }
+  return tail;
+}
+
+/* s_distances(*mp, src, *dist, *queue)
+
+   Fill dist with the number of steps from position src of mp to each
+   cell, or SHARD_NO_PATH for cells that cannot be reached.  The queue
+   must have room for every cell of mp.
+ */
+
+static void s_distances(const maze_t *mp, rowcol_t src, rowcol_t *dist,
+                        rowcol_t *queue) {
+  rowcol_t n_cells = mp->n_rows * mp->n_cols, i;
+
+  for (i = 0; i < n_cells; ++i) dist[i] = SHARD_NO_PATH;
+  s_flood(mp, src, dist, queue);
+}
+
+/* s_find(*sets, x)
+
+   Find the representative of x in a union-find forest, halving the
+   path along the way.
+ */
+
+static rowcol_t s_find(rowcol_t *sets, rowcol_t x) {
+  while (sets[x] != x) {
+    sets[x] = sets[sets[x]];
+    x = sets[x];
+  }
+  return x;
+}
+
+/* s_inner(*sp, pos)
+
+   Return true if position pos of shard sp lies on a side of the shard
+   that faces another shard, rather than the edge of the whole maze.
+ */
+
+static int s_inner(const maze_shard_t *sp, rowcol_t pos) {
+  rowcol_t r = pos / sp->n_cols, c = pos % sp->n_cols;
+
+  return (r == 0 && sp->si > 0) ||
+         (r == sp->n_rows - 1 && sp->si + 1 < sp->lay.sh_rows) ||
+         (c == 0 && sp->sj > 0) ||
+         (c == sp->n_cols - 1 && sp->sj + 1 < sp->lay.sh_cols);
+}
+
+/* s_generate_forest(*mp, *sp, random)
+
+   Generate the cells of shard sp in mp as a random spanning forest,
+   in the same way as maze_generate(): the cells are shuffled and
+   scanned, each joining the set of a random neighbour not yet joined
+   to it, until a scan joins nothing.  A set is "inner" once it holds
+   a cell on a side facing another shard.  Two inner sets are joined
+   only while there are more than SHARD_TREES() of them, so the shard
+   ends as that many trees, each reaching the seams, for
+   maze_shard_stitch() to join.  Were the shard one tree, as
+   maze_generate() would make it, the stitch could open only one wall
+   between each pair of shards.  Returns false if memory is exhausted.
+ */
+
+static int s_generate_forest(maze_t *mp, const maze_shard_t *sp,
+                             rand_f random) {
+  rowcol_t n_cells = mp->n_rows * mp->n_cols, n_cols = mp->n_cols;
+  rowcol_t *sets, *queue, pos, k, n_keep, n_sets;
+  rowcol_t n_inner = 0; /* Sets holding a cell on a seam */
+  unsigned char *inner; /* Whether each set is one of them */
+
+  sets = malloc(n_cells * sizeof(*sets));
+  queue = malloc(n_cells * sizeof(*queue));
+  inner = malloc(n_cells);
+  if (sets == NULL || queue == NULL || inner == NULL) {
+    free(sets);
+    free(queue);
+    free(inner);
+    return 0;
+  }
+
+  maze_reset(mp);
+  for (pos = 0; pos < n_cells; ++pos) {
+    sets[pos] = pos;
+    queue[pos] = pos;
+    inner[pos] = (unsigned char)s_inner(sp, pos);
+    n_inner += inner[pos];
+  }
+  n_keep = SHARD_TREES(n_inner);
+
+  /* Some set can be joined to another until all are inner and there
+     are only n_keep of them, so the forest is done exactly when that
+     many sets are left. */
+  n_sets = n_cells;
+  if (n_keep == 0) n_keep = 1;
+  while (n_sets > n_keep) {
+    for (k = n_cells; k > 1; --k) {
+      rowcol_t exch = (rowcol_t)(random() * k), t = queue[k - 1];
+
+      queue[k - 1] = queue[exch];
+      queue[exch] = t;
+    }
+
+    for (k = 0; k < n_cells && n_sets > n_keep; ++k) {
+      rowcol_t cur = queue[k], a = s_find(sets, cur), adj[4], n_adj = 0;
+      rowcol_t r = cur / n_cols, c = cur % n_cols, pick, b, d;
+
+      /* Neighbours in other sets that may be joined */
+      if (r > 0) adj[n_adj++] = cur - n_cols;
+      if (c + 1 < n_cols) adj[n_adj++] = cur + 1;
+      if (r + 1 < mp->n_rows) adj[n_adj++] = cur + n_cols;
+      if (c > 0) adj[n_adj++] = cur - 1;
+      for (d = 0, pick = 0; d < n_adj; ++d) {
+        b = s_find(sets, adj[d]);
+        if (b != a && (!inner[a] || !inner[b] || n_inner > n_keep))
+          adj[pick++] = adj[d];
+      }
+      if (pick == 0) continue;
+
+      /* Kick down the wall to a random one of them */
+      b = adj[(pick > 1) ? (rowcol_t)(random() * pick) : 0];
+      if (b + n_cols == cur)
+        mp->cells[b].b_wall = 0;
+      else if (b == cur + n_cols)
+        mp->cells[cur].b_wall = 0;
+      else if (b > cur)
+        mp->cells[cur].r_wall = 0;
+      else
+        mp->cells[b].r_wall = 0;
+
+      b = s_find(sets, b);
+      if (inner[a] && inner[b]) --n_inner;
+      inner[b] |= inner[a];
+      sets[a] = b;
+      --n_sets;
+    }
+  }
+
+  free(sets);
+  free(queue);
+  free(inner);
+  return 1;
+}
+
+/* s_write_shard(*path, *sp, *mp)
+
+   Write a shard file for the shard sp, whose cells are in mp.
+   Returns false on error.
+ */
+
+static int s_write_shard(const char *path, const maze_shard_t *sp,
+                         const maze_t *mp) {
+  rowcol_t hdr[HDR_WORDS] = {0}, pos, n_cells = mp->n_rows * mp->n_cols;
+  FILE *ofp;
+  int ok;
+
+  if ((ofp = fopen(path, "wb")) == NULL) return 0;
+
+  hdr[H_VERSION] = SHARD_VERSION;
+  hdr[H_MAZE_ROWS] = sp->lay.n_rows;
+  hdr[H_MAZE_COLS] = sp->lay.n_cols;
+  hdr[H_SHARD_ROWS] = sp->lay.sh_rows;
+  hdr[H_SHARD_COLS] = sp->lay.sh_cols;
+  hdr[H_EXIT_1] = sp->lay.exit_1;
+  hdr[H_EXIT_2] = sp->lay.exit_2;
+  hdr[H_SI] = sp->si;
+  hdr[H_SJ] = sp->sj;
+  hdr[H_ROW0] = sp->row0;
+  hdr[H_COL0] = sp->col0;
+  hdr[H_ROWS] = sp->n_rows;
+  hdr[H_COLS] = sp->n_cols;
+  hdr[H_N_COMP] = sp->n_comp;
+  hdr[H_STITCHED] = sp->stitched;
+  hdr[H_N_PORTALS] = 0;
+
+  ok = fwrite(shard_magic, sizeof(shard_magic), 1, ofp) == 1 &&
+       fwrite(hdr, sizeof(hdr), 1, ofp) == 1 &&
+       fwrite(sp->border, sizeof(*(sp->border)), s_border_len(sp), ofp) ==
+           s_border_len(sp);
+
+  for (pos = 0; ok && pos < n_cells; ++pos) {
+    maze_node cell = mp->cells[pos];
+    int v = cell.r_wall | (cell.b_wall << 1) | (cell.marker << 2) |
+            (cell.visit << 4);
+
+    ok = putc(v, ofp) != EOF;
+  }
+
+  return (fclose(ofp) == 0) && ok;
+}
+
+/* maze_shard_generate(*lp, si, sj, random, *dir)
+
+   Generate shard (si, sj) as a spanning forest of the shard's size
+   (see s_generate_forest()), and write it with its border components
+   to the shard file in dir.
+ */
+
+int maze_shard_generate(const maze_layout_t *lp, rowcol_t si, rowcol_t sj,
+                        rand_f random, const char *dir) {
+  maze_shard_t sh;
+  maze_t m;
+  char *path;
+  int ok;
+
+  maze_shard_extent(lp, si, sj, &sh);
+  if (sh.n_rows == 0 || sh.n_cols == 0) {
+    fprintf(stderr, "maze_shard_generate:  shard %u,%u is empty\n", si + 1,
+            sj + 1);
+    return 0;
+  }
+
+  if (!maze_init(&m, sh.n_rows, sh.n_cols)) return 0;
+  if (!s_generate_forest(&m, &sh, random) || !s_label_border(&m, &sh)) {
+    maze_clear(&m);
+    return 0;
+  }
+
+  if ((path = maze_shard_path(dir, si, sj)) == NULL) {
+    ok = 0;
+  } else if (!(ok = s_write_shard(path, &sh, &m))) {
+    fprintf(stderr, "maze_shard_generate:  unable to write '%s': %s\n", path,
+            strerror(errno));
+  }
+
+  free(path);
+  maze_shard_clear(&sh);
+  maze_clear(&m);
+  return ok;
+}
+
+/* s_read_header(*ifp, *path, *sp)
+
+   Read the header and border array of a shard file.  Returns false
+   with a diagnostic on error.
+ */
+
+static int s_read_header(FILE *ifp, const char *path, maze_shard_t *sp) {
+  char magic[sizeof(shard_magic)];
+  rowcol_t hdr[HDR_WORDS], nb;
+
+  if (fread(magic, sizeof(magic), 1, ifp) != 1 ||
+      memcmp(magic, shard_magic, sizeof(magic)) != 0 ||
+      fread(hdr, sizeof(hdr), 1, ifp) != 1) {
+    fprintf(stderr, "maze_shard_info:  '%s' is not a shard file\n", path);
+    return 0;
+  }
+  if (hdr[H_VERSION] != SHARD_VERSION) {
+    fprintf(stderr, "maze_shard_info:  '%s' has unsupported version %u\n",
+            path, hdr[H_VERSION]);
+    return 0;
+  }
+
+  sp->lay.n_rows = hdr[H_MAZE_ROWS];
+  sp->lay.n_cols = hdr[H_MAZE_COLS];
+  sp->lay.sh_rows = hdr[H_SHARD_ROWS];
+  sp->lay.sh_cols = hdr[H_SHARD_COLS];
+  sp->lay.exit_1 = hdr[H_EXIT_1];
+  sp->lay.exit_2 = hdr[H_EXIT_2];
+  sp->si = hdr[H_SI];
+  sp->sj = hdr[H_SJ];
+  sp->row0 = hdr[H_ROW0];
+  sp->col0 = hdr[H_COL0];
+  sp->n_rows = hdr[H_ROWS];
+  sp->n_cols = hdr[H_COLS];
+  sp->n_comp = hdr[H_N_COMP];
+  sp->stitched = hdr[H_STITCHED];
+  sp->n_portals = hdr[H_N_PORTALS];
+  sp->portals = NULL;
+  sp->first = NULL;
+  sp->links = NULL;
+
+  nb = s_border_len(sp);
+  if ((sp->border = malloc(nb * sizeof(*(sp->border)))) == NULL) return 0;
+
+  if (fread(sp->border, sizeof(*(sp->border)), nb, ifp) != nb) {
+    fprintf(stderr, "maze_shard_info:  '%s' is truncated\n", path);
+    maze_shard_clear(sp);
+    return 0;
+  }
+
+  return 1;
+}
+
+/* s_read_summary(*ifp, *path, *sp)
+
+   Read the portal summary of a shard, which follows its cells.  The
+   file must be positioned just after the last cell.  Returns false
+   with a diagnostic on error.
+ */
+
+static int s_read_summary(FILE *ifp, const char *path, maze_shard_t *sp) {
+  rowcol_t np = sp->n_portals, n_links, i;
+  int ok;
+
+  if (np == 0) return 1;
+
+  sp->portals = malloc(np * sizeof(*(sp->portals)));
+  sp->first = malloc((np + 1) * sizeof(*(sp->first)));
+  if (sp->portals == NULL || sp->first == NULL) return 0;
+
+  if (fread(sp->portals, sizeof(*(sp->portals)), np, ifp) != np ||
+      fread(sp->first, sizeof(*(sp->first)), np + 1, ifp) != np + 1) {
+    fprintf(stderr, "maze_shard_info:  '%s' has a truncated summary\n", path);
+    return 0;
+  }
+
+  /* Each portal links to at most every other, and only to portals */
+  ok = sp->first[0] == 0;
+  for (i = 0; ok && i < np; ++i)
+    ok = sp->first[i] <= sp->first[i + 1] &&
+         sp->first[i + 1] - sp->first[i] < np;
+  n_links = ok ? sp->first[np] : 0;
+  if ((sp->links = malloc((2 * n_links + 1) * sizeof(*(sp->links)))) == NULL)
+    return 0;
+  if (fread(sp->links, 2 * sizeof(*(sp->links)), n_links, ifp) != n_links) {
+    fprintf(stderr, "maze_shard_info:  '%s' has a truncated summary\n", path);
+    return 0;
+  }
+  for (i = 0; ok && i < n_links; ++i) ok = sp->links[2 * i] < np;
+
+  if (!ok)
+    fprintf(stderr, "maze_shard_info:  '%s' has a corrupt summary\n", path);
+  return ok;
+}
+
+/* maze_shard_info(*path, *sp)
+
+   Read the description of a shard, including its portal summary,
+   without its cells.
+ */
+
+int maze_shard_info(const char *path, maze_shard_t *sp) {
+  FILE *ifp = fopen(path, "rb");
+  int ok;
+
+  if (ifp == NULL) {
+    fprintf(stderr, "maze_shard_info:  unable to open '%s': %s\n", path,
+            strerror(errno));
+    return 0;
+  }
+
+  ok = s_read_header(ifp, path, sp);
+  if (ok && sp->n_portals > 0) {
+    long off = s_cell_offset(sp, sp->n_rows * sp->n_cols);
+
+    ok = fseek(ifp, off, SEEK_SET) == 0 && s_read_summary(ifp, path, sp);
+    if (!ok) maze_shard_clear(sp);
+  }
+  fclose(ifp);
+  return ok;
+}
+
+/* s_decode_cell(v)
+
+   Return the cell stored in a shard file as the byte v.
+ */
+
+static maze_node s_decode_cell(int v) {
+  maze_node cell = {0, 0, DIR_U, 0};
+
+  cell.r_wall = v & 1;
+  cell.b_wall = (v >> 1) & 1;
+  cell.marker = (v >> 2) & 3;
+  cell.visit = (v >> 4) & 1;
+  return cell;
+}
+
+/* maze_shard_load(*path, *sp, *mp)
+
+   Read a shard file completely, loading its cells into mp.
+ */
+
+int maze_shard_load(const char *path, maze_shard_t *sp, maze_t *mp) {
+  FILE *ifp = fopen(path, "rb");
+  rowcol_t pos, n_cells;
+
+  if (ifp == NULL) {
+    fprintf(stderr, "maze_shard_load:  unable to open '%s': %s\n", path,
+            strerror(errno));
+    return 0;
+  }
+
+  if (!s_read_header(ifp, path, sp)) {
+    fclose(ifp);
+    return 0;
+  }
+  if (!maze_init(mp, sp->n_rows, sp->n_cols)) {
+    maze_shard_clear(sp);
+    fclose(ifp);
+    return 0;
+  }
+
+  n_cells = sp->n_rows * sp->n_cols;
+  for (pos = 0; pos < n_cells; ++pos) {
+    int ch = getc(ifp);
+
+    if (ch == EOF) {
+      fprintf(stderr, "maze_shard_load:  '%s' is truncated\n", path);
+      maze_clear(mp);
+      maze_shard_clear(sp);
+      fclose(ifp);
+      return 0;
+    }
+    mp->cells[pos] = s_decode_cell(ch);
+  }
+
+  if (!s_read_summary(ifp, path, sp)) {
+    maze_clear(mp);
+    maze_shard_clear(sp);
+    fclose(ifp);
+    return 0;
+  }
+
+  fclose(ifp);
+  return 1;
+}
+
+/* maze_shard_clear(*sp)
+
+   Release the border array and summary of a shard description.
+ */
+
+void maze_shard_clear(maze_shard_t *sp) {
+  free(sp->border);
+  free(sp->portals);
+  free(sp->first);
+  free(sp->links);
+  sp->border = NULL;
+  sp->portals = NULL;
+  sp->first = NULL;
+  sp->links = NULL;
+}
+
+/* s_load_all(*dir, **out)
+
+   Read the descriptions of all the shards in dir into a newly
+   allocated array in grid order, checking that they belong to the
+   same maze.  Returns the number of shards, or zero on error.
+ */
+
+static rowcol_t s_load_all(const char *dir, maze_shard_t **out) {
+  maze_shard_t first, *shards;
+  rowcol_t i, j, n;
+  char *path;
+  int ok;
+
+  if ((path = maze_shard_path(dir, 0, 0)) == NULL) return 0;
+  ok = maze_shard_info(path, &first);
+  free(path);
+  if (!ok) return 0;
+
+  n = first.lay.sh_rows * first.lay.sh_cols;
+  if ((shards = calloc(n, sizeof(*shards))) == NULL) {
+    maze_shard_clear(&first);
+    return 0;
+  }
+  shards[0] = first;
+
+  for (i = 0; i < first.lay.sh_rows; ++i) {
+    for (j = 0; j < first.lay.sh_cols; ++j) {
+      maze_shard_t *sp = shards + i * first.lay.sh_cols + j;
+
+      if (i == 0 && j == 0) continue;
+
+      if ((path = maze_shard_path(dir, i, j)) == NULL) {
+        ok = 0;
+      } else if ((ok = maze_shard_info(path, sp)) &&
+                 (memcmp(&sp->lay, &first.lay, sizeof(first.lay)) != 0 ||
+                  sp->si != i || sp->sj != j)) {
+        fprintf(stderr, "maze_shard_stitch:  '%s' is from a different maze\n",
+                path);
+        ok = 0;
+      }
+      free(path);
+
+      if (!ok) {
+        for (i = 0; i < n; ++i) maze_shard_clear(shards + i);
+        free(shards);
+        return 0;
+      }
+    }
+  }
+
+  *out = shards;
+  return n;
+}
+
+/* A candidate opening: the wall in direction dir (DIR_R or DIR_D) of
+   cell pos in shard a, which faces shard b (or a itself, for a wall
+   between two border cells of a), and would join global components
+   ca and cb. */
+typedef struct {
+  rowcol_t a, b, pos, dir, ca, cb;
+} s_seam_t;
+
+/* s_open_walls(*dir, *sp, *seams, n)
+
+   Open the walls of the n seams, all of which belong to shard sp, by
+   patching its file, and mark the shard as stitched.  Returns false
+   with a diagnostic on error.
+ */
+
+static int s_open_walls(const char *dir, const maze_shard_t *sp,
+                        const s_seam_t *seams, rowcol_t n) {
+  rowcol_t i, stitched = 1;
+  char *path = maze_shard_path(dir, sp->si, sp->sj);
+  FILE *fp;
+  int ok = 1;
+
+  if (path == NULL) return 0;
+  if ((fp = fopen(path, "r+b")) == NULL) {
+    fprintf(stderr, "maze_shard_stitch:  unable to open '%s': %s\n", path,
+            strerror(errno));
+    free(path);
+    return 0;
+  }
+
+  for (i = 0; ok && i < n; ++i) {
+    long off = s_cell_offset(sp, seams[i].pos);
+    int v, mask = (seams[i].dir == DIR_R) ? 1 : 2;
+
+    ok = fseek(fp, off, SEEK_SET) == 0 && (v = getc(fp)) != EOF &&
+         fseek(fp, off, SEEK_SET) == 0 && putc(v & ~mask, fp) != EOF;
+  }
+
+  if (ok)
+    ok = fseek(fp, sizeof(shard_magic) + H_STITCHED * sizeof(rowcol_t),
+               SEEK_SET) == 0 &&
+         fwrite(&stitched, sizeof(stitched), 1, fp) == 1;
+
+  if (fclose(fp) != 0 || !ok) {
+    fprintf(stderr, "maze_shard_stitch:  unable to update '%s': %s\n", path,
+            strerror(errno));
+    ok = 0;
+  }
+  free(path);
+  return ok;
+}
+
+/* s_summarize(*dir, *sp, *portals, np)
+
+   Load the stitched shard sp, whose np portals are listed in ascending
+   order of border index, and append its portal distance summary to its
+   file.  A shard is a forest until it is stitched, and stays one within
+   its own cells, so each portal is linked only to the portals it can
+   reach, found by flooding just its own tree.  Returns false with a
+   diagnostic on error.
+ */
+
+static int s_summarize(const char *dir, const maze_shard_t *sp,
+                       const rowcol_t *portals, rowcol_t np) {
+  rowcol_t *dist = NULL, *queue = NULL, *first = NULL, *links = NULL;
+  rowcol_t p, q, i, n_cells, n_links = 0, max_links = np;
+  char *path = maze_shard_path(dir, sp->si, sp->sj);
+  maze_shard_t sh;
+  maze_t m;
+  FILE *fp;
+  int ok = 0;
+
+  if (path == NULL) return 0;
+  if (np == 0) {
+    free(path);
+    return 1;
+  }
+  if (!maze_shard_load(path, &sh, &m)) {
+    free(path);
+    return 0;
+  }
+
+  n_cells = sh.n_rows * sh.n_cols;
+  dist = malloc(n_cells * sizeof(*dist));
+  queue = malloc(n_cells * sizeof(*queue));
+  first = malloc((np + 1) * sizeof(*first));
+  links = malloc(2 * max_links * sizeof(*links));
+  if (dist == NULL || queue == NULL || first == NULL || links == NULL)
+    goto CLEANUP;
+
+  for (i = 0; i < n_cells; ++i) dist[i] = SHARD_NO_PATH;
+  for (p = 0; p < np; ++p) {
+    rowcol_t n_reached = s_flood(&m, s_border_pos(&sh, portals[p]), dist,
+                                 queue);
+
+    first[p] = n_links;
+    for (q = 0; q < np; ++q) {
+      rowcol_t d = dist[s_border_pos(&sh, portals[q])];
+
+      if (q == p || d == SHARD_NO_PATH) continue;
+      if (n_links == max_links) {
+        rowcol_t *more = realloc(links, 4 * max_links * sizeof(*links));
+
+        if (more == NULL) goto CLEANUP;
+        links = more;
+        max_links *= 2;
+      }
+      links[2 * n_links] = q;
+      links[2 * n_links + 1] = d;
+      ++n_links;
+    }
+    for (i = 0; i < n_reached; ++i) dist[queue[i]] = SHARD_NO_PATH;
+  }
+  first[np] = n_links;
+
+  if ((fp = fopen(path, "r+b")) == NULL) {
+    fprintf(stderr, "maze_shard_stitch:  unable to open '%s': %s\n", path,
+            strerror(errno));
+    goto CLEANUP;
+  }
+  ok = fseek(fp, s_cell_offset(&sh, n_cells), SEEK_SET) == 0 &&
+       fwrite(portals, sizeof(*portals), np, fp) == np &&
+       fwrite(first, sizeof(*first), np + 1, fp) == np + 1 &&
+       fwrite(links, 2 * sizeof(*links), n_links, fp) == n_links &&
+       fseek(fp, sizeof(shard_magic) + H_N_PORTALS * sizeof(rowcol_t),
+             SEEK_SET) == 0 &&
+       fwrite(&np, sizeof(np), 1, fp) == 1;
+  if (fclose(fp) != 0 || !ok) {
+    fprintf(stderr, "maze_shard_stitch:  unable to update '%s': %s\n", path,
+            strerror(errno));
+    ok = 0;
+  }
+
+CLEANUP:
+  free(dist);
+  free(queue);
+  free(first);
+  free(links);
+  free(path);
+  maze_shard_clear(&sh);
+  maze_clear(&m);
+  return ok;
+}
+
+/* s_border_walls(*sp, s, base, *out)
+
+   Store in out the walls between neighbouring border cells of shard
+   sp, which is shard s, whose ends lie in different components; base
+   is the global number of the shard's first component.  Returns the
+   number of walls stored, at most 2 * (n_rows - 1) + 2 * (n_cols - 1).
+ */
+
+static rowcol_t s_border_walls(const maze_shard_t *sp, rowcol_t s,
+                               rowcol_t base, s_seam_t *out) {
+  rowcol_t side, k, n = 0;
+
+  for (side = 0; side < 4; ++side) {
+    int across = side < 2; /* top and bottom run across the shard */
+    rowcol_t first = side * sp->n_cols, len = sp->n_cols;
+
+    if (!across) {
+      first = SHARD_LEFT(sp) + (side - 2) * sp->n_rows;
+      len = sp->n_rows;
+    }
+    for (k = 0; k + 1 < len; ++k) {
+      rowcol_t ca = sp->border[first + k], cb = sp->border[first + k + 1];
+
+      if (ca == cb) continue;
+      out[n].a = out[n].b = s;
+      out[n].pos = s_border_pos(sp, first + k);
+      out[n].dir = across ? DIR_R : DIR_D;
+      out[n].ca = base + ca;
+      out[n].cb = base + cb;
+      ++n;
+    }
+  }
+  return n;
+}
+
+/* s_cmp_rowcol(*a, *b)
+
+   Order rowcol_t values, for qsort() and bsearch().
+ */
+
+static int s_cmp_rowcol(const void *a, const void *b) {
+  rowcol_t x = *(const rowcol_t *)a, y = *(const rowcol_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* s_cmp_seam(*a, *b)
+
+   Order seams by the shard that owns their wall, for qsort().
+ */
+
+static int s_cmp_seam(const void *a, const void *b) {
+  const s_seam_t *x = a, *y = b;
+
+  if (x->a != y->a) return (x->a > y->a) - (x->a < y->a);
+  return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+/* maze_shard_stitch(*dir, random)
+
+   Every pair of cells facing each other across a shard boundary is a
+   candidate seam, and so is every pair of neighbouring cells along
+   the border of a shard that lie in different components.  The seams
+   are shuffled and then considered in turn, and a seam's wall is
+   opened only if it joins two components that are not yet connected
+   -- Kruskal's algorithm over the border components of the shards.
+   Since every component of a shard reaches its border, and the border
+   cells of a shard form a ring, the result is one perfect maze.  The
+   walls are always those of the cell on the left or above, so only
+   the border cells of a shard are ever patched.
+
+   Each opened seam makes a portal on both of its sides.  Once the
+   walls are open, every shard is loaded in turn to measure the
+   distances between its portals, for planning routes.
+ */
+
+int maze_shard_stitch(const char *dir, rand_f random) {
+  maze_shard_t *shards;
+  rowcol_t n, i, j, k, n_comp = 0, n_seams = 0, n_open = 0;
+  rowcol_t *base = NULL, *sets = NULL, *portals = NULL;
+  s_seam_t *seams = NULL;
+  int ok = 0;
+
+  if ((n = s_load_all(dir, &shards)) == 0) return 0;
+
+  for (i = 0; i < n; ++i) {
+    if (shards[i].stitched) {
+      fprintf(stderr, "maze_shard_stitch:  shard %u,%u is already stitched\n",
+              shards[i].si + 1, shards[i].sj + 1);
+      goto CLEANUP;
+    }
+    if (shards[i].sj + 1 < shards[i].lay.sh_cols)
+      n_seams += shards[i].n_rows;
+    if (shards[i].si + 1 < shards[i].lay.sh_rows)
+      n_seams += shards[i].n_cols;
+    n_seams += 2 * (shards[i].n_rows - 1) + 2 * (shards[i].n_cols - 1);
+  }
+
+  /* Number the components of all the shards consecutively */
+  if ((base = malloc(n * sizeof(*base))) == NULL) goto CLEANUP;
+  for (i = 0; i < n; ++i) {
+    base[i] = n_comp;
+    n_comp += shards[i].n_comp;
+  }
+
+  if ((sets = malloc(n_comp * sizeof(*sets))) == NULL ||
+      (seams = malloc((n_seams ? n_seams : 1) * sizeof(*seams))) == NULL)
+    goto CLEANUP;
+  for (k = 0; k < n_comp; ++k) sets[k] = k;
+
+  /* Collect the seams along the right and bottom of each shard */
+  n_seams = 0;
+  for (i = 0; i < n; ++i) {
+    const maze_shard_t *sp = shards + i;
+
+    if (sp->sj + 1 < sp->lay.sh_cols) {
+      const maze_shard_t *np = sp + 1;
+
+      for (k = 0; k < sp->n_rows; ++k) {
+        s_seam_t *seam = seams + n_seams++;
+
+        seam->a = i;
+        seam->b = i + 1;
+        seam->pos = k * sp->n_cols + sp->n_cols - 1;
+        seam->dir = DIR_R;
+        seam->ca = base[i] + sp->border[SHARD_RIGHT(sp) + k];
+        seam->cb = base[i + 1] + np->border[SHARD_LEFT(np) + k];
+      }
+    }
+    if (sp->si + 1 < sp->lay.sh_rows) {
+      const maze_shard_t *np = sp + sp->lay.sh_cols;
+
+      for (k = 0; k < sp->n_cols; ++k) {
+        s_seam_t *seam = seams + n_seams++;
+
+        seam->a = i;
+        seam->b = i + sp->lay.sh_cols;
+        seam->pos = (sp->n_rows - 1) * sp->n_cols + k;
+        seam->dir = DIR_D;
+        seam->ca = base[i] + sp->border[SHARD_BOTTOM(sp) + k];
+        seam->cb = base[i + sp->lay.sh_cols] + np->border[SHARD_TOP(np) + k];
+      }
+    }
+    n_seams += s_border_walls(sp, i, base[i], seams + n_seams);
+  }
+
+  /* Shuffle the seams, then keep those that join new components */
+  for (k = n_seams; k > 1; --k) {
+    rowcol_t exch = (rowcol_t)(random() * k);
+    s_seam_t t = seams[k - 1];
+
+    seams[k - 1] = seams[exch];
+    seams[exch] = t;
+  }
+
+  for (k = 0; k < n_seams; ++k) {
+    rowcol_t sa = s_find(sets, seams[k].ca), sb = s_find(sets, seams[k].cb);
+
+    if (sa != sb) {
+      sets[sa] = sb;
+      seams[n_open++] = seams[k];
+    }
+  }
+
+  if (n_open + 1 != n_comp) {
+    fprintf(stderr, "maze_shard_stitch:  shards cannot be joined\n");
+    goto CLEANUP;
+  }
+
+  /* Patch each shard file once, with all its openings */
+  qsort(seams, n_open, sizeof(*seams), s_cmp_seam);
+  for (i = 0, k = 0; i < n; ++i) {
+    for (j = k; j < n_open && seams[j].a == i; ++j)
+      ;
+    if (!s_open_walls(dir, shards + i, seams + k, j - k)) goto CLEANUP;
+    k = j;
+  }
+
+  /* List the portals of each shard, reusing base for the offset of
+     each shard's list and n_portals to count them */
+  if ((portals = malloc((2 * n_open + 1) * sizeof(*portals))) == NULL)
+    goto CLEANUP;
+  for (k = 0; k < n_open; ++k) {
+    if (seams[k].b == seams[k].a) continue;
+    shards[seams[k].a].n_portals++;
+    shards[seams[k].b].n_portals++;
+  }
+  for (i = 0, k = 0; i < n; ++i) {
+    base[i] = k;
+    k += shards[i].n_portals;
+    shards[i].n_portals = 0;
+  }
+  for (k = 0; k < n_open; ++k) {
+    const s_seam_t *seam = seams + k;
+    maze_shard_t *sp = shards + seam->a, *np = shards + seam->b;
+    rowcol_t a_idx, b_idx;
+
+    if (seam->b == seam->a) {
+      continue;
+    } else if (seam->dir == DIR_R) {
+      a_idx = SHARD_RIGHT(sp) + seam->pos / sp->n_cols;
+      b_idx = SHARD_LEFT(np) + seam->pos / sp->n_cols;
+    } else {
+      a_idx = SHARD_BOTTOM(sp) + seam->pos % sp->n_cols;
+      b_idx = SHARD_TOP(np) + seam->pos % sp->n_cols;
+    }
+    portals[base[seam->a] + sp->n_portals++] = a_idx;
+    portals[base[seam->b] + np->n_portals++] = b_idx;
+  }
+
+  for (i = 0; i < n; ++i) {
+    qsort(portals + base[i], shards[i].n_portals, sizeof(*portals),
+          s_cmp_rowcol);
+    if (!s_summarize(dir, shards + i, portals + base[i], shards[i].n_portals))
+      goto CLEANUP;
+  }
+  ok = 1;
+
+CLEANUP:
+  for (i = 0; i < n; ++i) maze_shard_clear(shards + i);
+  free(shards);
+  free(base);
+  free(sets);
+  free(seams);
+  free(portals);
+  return ok;
+}
+
+/* An entry of the priority queue used by maze_shard_route(). */
+typedef struct {
+  unsigned long long d;
+  rowcol_t node;
+} s_heap_t;
+
+/* s_heap_push(*heap, *n, d, node)
+
+   Add node with distance d to a binary min-heap of n entries.
+ */
+
+static void s_heap_push(s_heap_t *heap, rowcol_t *n, unsigned long long d,
+                        rowcol_t node) {
+  rowcol_t i = (*n)++;
+
+  while (i > 0 && heap[(i - 1) / 2].d > d) {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap[i].d = d;
+  heap[i].node = node;
+}
+
+/* s_heap_pop(*heap, *n)
+
+   Remove and return the entry with the least distance from a binary
+   min-heap of n > 0 entries.
+ */
+
+static s_heap_t s_heap_pop(s_heap_t *heap, rowcol_t *n) {
+  s_heap_t top = heap[0], last = heap[--(*n)];
+  rowcol_t i = 0, k;
+
+  while ((k = 2 * i + 1) < *n) {
+    if (k + 1 < *n && heap[k + 1].d < heap[k].d) ++k;
+    if (heap[k].d >= last.d) break;
+    heap[i] = heap[k];
+    i = k;
+  }
+  heap[i] = last;
+  return top;
+}
+
+/* s_locate(*shards, r, c, *pos)
+
+   Return the index of the shard holding cell (r, c) of the whole maze,
+   and set *pos to the position of the cell within that shard.
+ */
+
+static rowcol_t s_locate(const maze_shard_t *shards, rowcol_t r, rowcol_t c,
+                         rowcol_t *pos) {
+  const maze_layout_t *lp = &shards[0].lay;
+  rowcol_t si = 0, sj = 0;
+  const maze_shard_t *sp;
+
+  while (si + 1 < lp->sh_rows && shards[(si + 1) * lp->sh_cols].row0 <= r)
+    ++si;
+  while (sj + 1 < lp->sh_cols && shards[sj + 1].col0 <= c) ++sj;
+
+  sp = shards + si * lp->sh_cols + sj;
+  *pos = (r - sp->row0) * sp->n_cols + (c - sp->col0);
+  return si * lp->sh_cols + sj;
+}
+
+/* s_load_cells(*dir, *sp, *mp)
+
+   Load the cells of shard sp from its file in dir into mp.  Returns
+   false with a diagnostic on error.
+ */
+
+static int s_load_cells(const char *dir, const maze_shard_t *sp,
+                        maze_t *mp) {
+  char *path = maze_shard_path(dir, sp->si, sp->sj);
+  maze_shard_t sh;
+  int ok;
+
+  if (path == NULL) return 0;
+  if ((ok = maze_shard_load(path, &sh, mp))) maze_shard_clear(&sh);
+  free(path);
+  return ok;
+}
+
+/* s_partner(*shards, s, b, *ns)
+
+   Return the index in the portal list of its neighbor of the portal
+   facing border index b of shard s, or SHARD_NO_PATH if the neighbor
+   has no such portal.  The neighbor is stored in *ns.
+ */
+
+static rowcol_t s_partner(const maze_shard_t *shards, rowcol_t s, rowcol_t b,
+                          rowcol_t *ns) {
+  const maze_shard_t *sp = shards + s, *np;
+  rowcol_t nb, *hit;
+
+  if (b < SHARD_BOTTOM(sp)) {
+    np = sp - sp->lay.sh_cols;
+    nb = SHARD_BOTTOM(np) + b;
+  } else if (b < SHARD_LEFT(sp)) {
+    np = sp + sp->lay.sh_cols;
+    nb = SHARD_TOP(np) + (b - SHARD_BOTTOM(sp));
+  } else if (b < SHARD_RIGHT(sp)) {
+    np = sp - 1;
+    nb = SHARD_RIGHT(np) + (b - SHARD_LEFT(sp));
+  } else {
+    np = sp + 1;
+    nb = SHARD_LEFT(np) + (b - SHARD_RIGHT(sp));
+  }
+
+  *ns = np - shards;
+  hit = bsearch(&nb, np->portals, np->n_portals, sizeof(nb), s_cmp_rowcol);
+  return hit ? (rowcol_t)(hit - np->portals) : SHARD_NO_PATH;
+}
+
+/* maze_shard_route(*dir, start_row, start_col, end_row, end_col,
+                    emit, *arg, *n_loaded)
+
+   The route is planned by Dijkstra's algorithm over a graph whose
+   nodes are the portals of all the shards, plus the two endpoints.
+   Portals of the same shard are joined by the distances from its
+   summary, and each portal is one step from its partner across the
+   seam.  Only the shards holding the endpoints are loaded for the
+   plan, to find the distances from the endpoints to their portals.
+   Each leg of the route within a shard is then filled in by loading
+   that shard and walking down a breadth-first distance field.
+ */
+
+int maze_shard_route(const char *dir, rowcol_t start_row, rowcol_t start_col,
+                     rowcol_t end_row, rowcol_t end_col, maze_cell_f emit,
+                     void *arg, rowcol_t *n_loaded) {
+  maze_shard_t *shards;
+  maze_t m;
+  rowcol_t n, i, k, total, n_heap = 0, n_seq = 0, src, dst, loaded = 0;
+  rowcol_t s_shard, s_pos, d_shard, d_pos, cur_shard = SHARD_NO_PATH;
+  rowcol_t *base = NULL, *owner = NULL, *partner = NULL, *prev = NULL;
+  rowcol_t *seq = NULL, *dist = NULL, *queue = NULL, *d_src = NULL;
+  rowcol_t *d_dst = NULL, max_cells = 0, heap_size, direct;
+  unsigned long long *best = NULL;
+  s_heap_t *heap = NULL;
+  char *seen = NULL;
+  int ok = 0;
+
+  if ((n = s_load_all(dir, &shards)) == 0) return 0;
+
+  if (start_row >= shards[0].lay.n_rows || start_col >= shards[0].lay.n_cols ||
+      end_row >= shards[0].lay.n_rows || end_col >= shards[0].lay.n_cols) {
+    fprintf(stderr, "maze_shard_route:  cell is outside the maze\n");
+    goto CLEANUP;
+  }
+
+  /* Number the portals of all the shards consecutively */
+  if ((base = malloc((n + 1) * sizeof(*base))) == NULL ||
+      (seen = calloc(n, 1)) == NULL)
+    goto CLEANUP;
+  for (i = 0, total = 0; i < n; ++i) {
+    if (!shards[i].stitched) {
+      fprintf(stderr, "maze_shard_route:  shard %u,%u is not stitched\n",
+              shards[i].si + 1, shards[i].sj + 1);
+      goto CLEANUP;
+    }
+    base[i] = total;
+    total += shards[i].n_portals;
+    if (shards[i].n_rows * shards[i].n_cols > max_cells)
+      max_cells = shards[i].n_rows * shards[i].n_cols;
+  }
+  base[n] = total;
+  src = total;
+  dst = total + 1;
+
+  /* Each portal is pushed at most once for each link to it, once from
+     its partner, and once from the source, and the target once from
+     each portal */
+  heap_size = 2;
+  for (i = 0; i < n; ++i)
+    if (shards[i].n_portals > 0)
+      heap_size += shards[i].first[shards[i].n_portals] +
+                   3 * shards[i].n_portals;
+
+  if ((owner = malloc((total + 2) * sizeof(*owner))) == NULL ||
+      (partner = malloc((total + 1) * sizeof(*partner))) == NULL ||
+      (prev = malloc((total + 2) * sizeof(*prev))) == NULL ||
+      (seq = malloc((total + 2) * sizeof(*seq))) == NULL ||
+      (best = malloc((total + 2) * sizeof(*best))) == NULL ||
+      (heap = malloc(heap_size * sizeof(*heap))) == NULL ||
+      (dist = malloc(max_cells * sizeof(*dist))) == NULL ||
+      (queue = malloc(max_cells * sizeof(*queue))) == NULL)
+    goto CLEANUP;
+
+  for (i = 0; i < n; ++i) {
+    for (k = 0; k < shards[i].n_portals; ++k) {
+      rowcol_t ns, q = s_partner(shards, i, shards[i].portals[k], &ns);
+
+      owner[base[i] + k] = i;
+      partner[base[i] + k] = (q == SHARD_NO_PATH) ? q : base[ns] + q;
+    }
+  }
+
+  s_shard = s_locate(shards, start_row, start_col, &s_pos);
+  d_shard = s_locate(shards, end_row, end_col, &d_pos);
+  owner[src] = s_shard;
+  owner[dst] = d_shard;
+
+  /* Distances from each endpoint to the portals of its shard.  The
+     source shard is loaded last so that it is ready for the route. */
+  for (k = 0; k < 2; ++k) {
+    rowcol_t ep = k ? s_shard : d_shard, **out = k ? &d_src : &d_dst;
+    const maze_shard_t *sp = shards + ep;
+
+    if (cur_shard != ep) {
+      if (cur_shard != SHARD_NO_PATH) maze_clear(&m);
+      cur_shard = SHARD_NO_PATH;
+      if (!s_load_cells(dir, sp, &m)) goto CLEANUP;
+      cur_shard = ep;
+      loaded += !seen[ep];
+      seen[ep] = 1;
+    }
+
+    if ((*out = malloc((sp->n_portals + 1) * sizeof(**out))) == NULL)
+      goto CLEANUP;
+    s_distances(&m, k ? s_pos : d_pos, dist, queue);
+    for (i = 0; i < sp->n_portals; ++i)
+      (*out)[i] = dist[s_border_pos(sp, sp->portals[i])];
+  }
+  direct = (s_shard == d_shard) ? dist[d_pos] : SHARD_NO_PATH;
+
+  /* Plan the route through the portals */
+  for (i = 0; i < total + 2; ++i) {
+    best[i] = (unsigned long long)-1;
+    prev[i] = SHARD_NO_PATH;
+  }
+  best[src] = 0;
+  s_heap_push(heap, &n_heap, 0, src);
+
+  while (n_heap > 0) {
+    s_heap_t top = s_heap_pop(heap, &n_heap);
+    const maze_shard_t *sp = shards + owner[top.node];
+    rowcol_t u = top.node, np = sp->n_portals, b = base[owner[u]];
+
+    if (top.d > best[u]) continue;
+    if (u == dst) break;
+
+#define RELAX(V, W)                                        \
+  do {                                                     \
+    rowcol_t v_ = (V), w_ = (W);                           \
+    if (w_ != SHARD_NO_PATH && best[u] + w_ < best[v_]) {  \
+      best[v_] = best[u] + w_;                             \
+      prev[v_] = u;                                        \
+      s_heap_push(heap, &n_heap, best[v_], v_);            \
+    }                                                      \
+  } while (0)
+
+    if (u == src) {
+      for (k = 0; k < np; ++k) RELAX(b + k, d_src[k]);
+      RELAX(dst, direct);
+    } else {
+      rowcol_t p = u - b;
+
+      for (k = sp->first[p]; k < sp->first[p + 1]; ++k)
+        RELAX(b + sp->links[2 * k], sp->links[2 * k + 1]);
+      if (partner[u] != SHARD_NO_PATH) RELAX(partner[u], 1);
+      if (owner[u] == d_shard) RELAX(dst, d_dst[p]);
+    }
+#undef RELAX
+  }
+
+  if (prev[dst] == SHARD_NO_PATH) {
+    fprintf(stderr, "maze_shard_route:  no path between the cells\n");
+    goto CLEANUP;
+  }
+  for (k = dst; k != src; k = prev[k]) seq[n_seq++] = k;
+  seq[n_seq++] = src;
+
+  /* Fill in the cells along each leg of the route, from the source */
+  emit(start_row, start_col, arg);
+  for (k = n_seq - 1; k > 0; --k) {
+    rowcol_t u = seq[k], v = seq[k - 1], vs = owner[v], u_pos, v_pos;
+    const maze_shard_t *vp = shards + vs;
+
+    v_pos = (v == dst) ? d_pos : s_border_pos(vp, vp->portals[v - base[vs]]);
+    if (owner[u] != vs) {
+      emit(vp->row0 + v_pos / vp->n_cols, vp->col0 + v_pos % vp->n_cols, arg);
+      continue;
+    }
+    u_pos = (u == src) ? s_pos
+                       : s_border_pos(vp, vp->portals[u - base[vs]]);
+
+    if (cur_shard != vs) {
+      maze_clear(&m);
+      cur_shard = SHARD_NO_PATH;
+      if (!s_load_cells(dir, vp, &m)) goto CLEANUP;
+      cur_shard = vs;
+      loaded += !seen[vs];
+      seen[vs] = 1;
+    }
+
+    s_distances(&m, v_pos, dist, queue);
+    while (u_pos != v_pos) {
+      rowcol_t next[4], n_next = s_neighbors(&m, u_pos, next);
+
+      for (i = 0; i < n_next && dist[next[i]] + 1 != dist[u_pos]; ++i)
+        ;
+      assert(i < n_next);
+      u_pos = next[i];
+      emit(vp->row0 + u_pos / vp->n_cols, vp->col0 + u_pos % vp->n_cols, arg);
+    }
+  }
+
+  if (n_loaded != NULL) *n_loaded = loaded;
+  ok = 1;
+
+CLEANUP:
+  if (cur_shard != SHARD_NO_PATH) maze_clear(&m);
+  for (i = 0; i < n; ++i) maze_shard_clear(shards + i);
+  free(shards);
+  free(base);
+  free(owner);
+  free(partner);
+  free(prev);
+  free(seq);
+  free(best);
+  free(heap);
+  free(dist);
+  free(queue);
+  free(d_src);
+  free(d_dst);
+  free(seen);
+  return ok;
+}
+
+/* maze_shard_rows(*dir, emit, *arg)
+
+   The shards of each band of the shard grid are opened together, and
+   each row of the maze is put together from one row of each of them.
+   Shard files hold their cells in row major order straight after the
+   border array, so each file is read through once.
+ */
+
+int maze_shard_rows(const char *dir, maze_row_f emit, void *arg) {
+  maze_shard_t first, *band = NULL;
+  FILE **fps = NULL;
+  maze_node *row = NULL;
+  unsigned char *raw = NULL;
+  rowcol_t i, j, r, c, n_cols;
+  char *path;
+  int ok;
+
+  if ((path = maze_shard_path(dir, 0, 0)) == NULL) return 0;
+  ok = maze_shard_info(path, &first);
+  free(path);
+  if (!ok) return 0;
+  maze_shard_clear(&first);
+
+  n_cols = first.lay.n_cols;
+  band = calloc(first.lay.sh_cols, sizeof(*band));
+  fps = calloc(first.lay.sh_cols, sizeof(*fps));
+  row = malloc(n_cols * sizeof(*row));
+  raw = malloc(n_cols);
+  if (band == NULL || fps == NULL || row == NULL || raw == NULL) ok = 0;
+
+  for (i = 0; ok && i < first.lay.sh_rows; ++i) {
+    for (j = 0; ok && j < first.lay.sh_cols; ++j) {
+      if ((path = maze_shard_path(dir, i, j)) == NULL) {
+        ok = 0;
+        break;
+      }
+      if ((fps[j] = fopen(path, "rb")) == NULL) {
+        fprintf(stderr, "maze_shard_rows:  unable to open '%s': %s\n", path,
+                strerror(errno));
+        ok = 0;
+      } else if ((ok = s_read_header(fps[j], path, band + j))) {
+        if (memcmp(&band[j].lay, &first.lay, sizeof(first.lay)) != 0 ||
+            band[j].si != i || band[j].sj != j) {
+          fprintf(stderr, "maze_shard_rows:  '%s' is from a different maze\n",
+                  path);
+          ok = 0;
+        }
+        maze_shard_clear(band + j);
+      }
+      free(path);
+    }
+
+    for (r = 0; ok && r < band[0].n_rows; ++r) {
+      for (j = 0; ok && j < first.lay.sh_cols; ++j) {
+        if (fread(raw + band[j].col0, 1, band[j].n_cols, fps[j]) !=
+            band[j].n_cols) {
+          fprintf(stderr, "maze_shard_rows:  shard %u,%u is truncated\n",
+                  i + 1, j + 1);
+          ok = 0;
+        }
+      }
+      for (c = 0; ok && c < n_cols; ++c) row[c] = s_decode_cell(raw[c]);
+
+      if (ok) ok = emit(row, arg);
+    }
+
+    for (j = 0; j < first.lay.sh_cols; ++j) {
+      if (fps[j] != NULL) fclose(fps[j]);
+      fps[j] = NULL;
+    }
+  }
+
+  free(band);
+  free(fps);
+  free(row);
+  free(raw);
+  return ok;
+}
+
+/* maze_shard_assemble(*dir, *mp)
+
+   Read every shard of a maze and copy its cells into place.
+ */
+
+int maze_shard_assemble(const char *dir, maze_t *mp) {
+  maze_shard_t first, sh;
+  maze_t part;
+  rowcol_t i, j, r, c;
+  char *path;
+  int ok;
+
+  if ((path = maze_shard_path(dir, 0, 0)) == NULL) return 0;
+  ok = maze_shard_info(path, &first);
+  free(path);
+  if (!ok) return 0;
+  maze_shard_clear(&first);
+
+  if (!maze_init(mp, first.lay.n_rows, first.lay.n_cols)) return 0;
+  mp->exit_1 = first.lay.exit_1;
+  mp->exit_2 = first.lay.exit_2;
+
+  for (i = 0; i < first.lay.sh_rows; ++i) {
+    for (j = 0; j < first.lay.sh_cols; ++j) {
+      if ((path = maze_shard_path(dir, i, j)) == NULL) {
+        ok = 0;
+      } else if ((ok = maze_shard_load(path, &sh, &part))) {
+        if (memcmp(&sh.lay, &first.lay, sizeof(first.lay)) != 0) {
+          fprintf(stderr,
+                  "maze_shard_assemble:  '%s' is from a different maze\n",
+                  path);
+          ok = 0;
+        } else {
+          for (r = 0; r < sh.n_rows; ++r)
+            for (c = 0; c < sh.n_cols; ++c)
+              CELLV(mp, sh.row0 + r, sh.col0 + c) = CELLV(&part, r, c);
+        }
+        maze_shard_clear(&sh);
+        maze_clear(&part);
+      }
+      free(path);
+
+      if (!ok) {
+        maze_clear(mp);
+        return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+/* Most shard files a reader keeps open at once */
+#define READER_MAX_OPEN 256
+
+/* maze_shard_open(*rp, *dir)
+
+   Read the layout from the first shard, and make room to keep two
+   bands of shards open, so that reading a region row by row opens
+   each shard in it only once.
+ */
+
+int maze_shard_open(maze_shard_reader_t *rp, const char *dir) {
+  maze_shard_t first;
+  char *path;
+  int ok;
+
+  memset(rp, 0, sizeof(*rp));
+  if ((path = maze_shard_path(dir, 0, 0)) == NULL) return 0;
+  ok = maze_shard_info(path, &first);
+  free(path);
+  if (!ok) return 0;
+  maze_shard_clear(&first);
+
+  rp->lay = first.lay;
+  rp->n_slots = 2 * rp->lay.sh_cols;
+  if (rp->n_slots > READER_MAX_OPEN) rp->n_slots = READER_MAX_OPEN;
+
+  rp->dir = malloc(strlen(dir) + 1);
+  rp->slots = calloc(rp->n_slots, sizeof(*(rp->slots)));
+  if (rp->dir == NULL || rp->slots == NULL) {
+    maze_shard_close(rp);
+    return 0;
+  }
+  strcpy(rp->dir, dir);
+  return 1;
+}
+
+/* s_reader_slot(*rp, si, sj)
+
+   Return the slot holding shard (si, sj) open, opening it in place of
+   the one least recently read if need be, or NULL with a diagnostic
+   on error.
+ */
+
+static maze_shard_slot_t *s_reader_slot(maze_shard_reader_t *rp, rowcol_t si,
+                                        rowcol_t sj) {
+  maze_shard_slot_t *sp, *lru = rp->slots;
+  rowcol_t k;
+  char *path;
+  int ok;
+
+  for (k = 0; k < rp->n_slots; ++k) {
+    sp = rp->slots + k;
+    if (sp->fp != NULL && sp->sh.si == si && sp->sh.sj == sj) return sp;
+    if (lru->fp != NULL && (sp->fp == NULL || sp->used < lru->used)) lru = sp;
+  }
+
+  sp = lru;
+  if (sp->fp != NULL) fclose(sp->fp);
+  sp->fp = NULL;
+  if ((path = maze_shard_path(rp->dir, si, sj)) == NULL) return NULL;
+
+  if ((sp->fp = fopen(path, "rb")) == NULL) {
+    fprintf(stderr, "maze_shard_read:  unable to open '%s': %s\n", path,
+            strerror(errno));
+    ok = 0;
+  } else if ((ok = s_read_header(sp->fp, path, &sp->sh))) {
+    if (memcmp(&sp->sh.lay, &rp->lay, sizeof(rp->lay)) != 0 ||
+        sp->sh.si != si || sp->sh.sj != sj) {
+      fprintf(stderr, "maze_shard_read:  '%s' is from a different maze\n",
+              path);
+      ok = 0;
+    }
+    maze_shard_clear(&sp->sh);
+  }
+  free(path);
+
+  if (!ok) {
+    if (sp->fp != NULL) fclose(sp->fp);
+    sp->fp = NULL;
+    return NULL;
+  }
+  rp->n_opened++;
+  return sp;
+}
+
+/* maze_shard_read(*rp, r, c, n, *out)
+
+   The part of the run in each shard it crosses is read with a single
+   seek, since a shard file holds its cells in row major order.
+ */
+
+int maze_shard_read(maze_shard_reader_t *rp, rowcol_t r, rowcol_t c,
+                    rowcol_t n, maze_node *out) {
+  const maze_layout_t *lp = &rp->lay;
+  unsigned char raw[1024];
+  rowcol_t si, sj, m, k, got;
+
+  if (r >= lp->n_rows || c > lp->n_cols || n > lp->n_cols - c) {
+    fprintf(stderr, "maze_shard_read:  cells %u,%u+%u are out of range\n", r,
+            c, n);
+    return 0;
+  }
+
+  /* The last shard row and column whose first cell is at or before
+     row r and column c */
+  si = (rowcol_t)((((unsigned long long)r + 1) * lp->sh_rows - 1) /
+                  lp->n_rows);
+  while (n > 0) {
+    maze_shard_slot_t *sp;
+    rowcol_t pos;
+
+    sj = (rowcol_t)((((unsigned long long)c + 1) * lp->sh_cols - 1) /
+                    lp->n_cols);
+    if ((sp = s_reader_slot(rp, si, sj)) == NULL) return 0;
+    sp->used = ++rp->tick;
+
+    m = sp->sh.col0 + sp->sh.n_cols - c;
+    if (m > n) m = n;
+    pos = (r - sp->sh.row0) * sp->sh.n_cols + (c - sp->sh.col0);
+    if (fseek(sp->fp, s_cell_offset(&sp->sh, pos), SEEK_SET) != 0) m = 0;
+
+    for (k = 0; k < m; k += got) {
+      got = (m - k < sizeof(raw)) ? m - k : (rowcol_t)sizeof(raw);
+      if (fread(raw, 1, got, sp->fp) != got) break;
+      for (pos = 0; pos < got; ++pos) *out++ = s_decode_cell(raw[pos]);
+    }
+    if (m == 0 || k < m) {
+      fprintf(stderr, "maze_shard_read:  shard %u,%u is truncated\n", si + 1,
+              sj + 1);
+      return 0;
+    }
+    c += m;
+    n -= m;
+  }
+  return 1;
+}
+
+/* maze_shard_close(*rp)
+
+   Close the open shard files and release the reader's memory.
+ */
+
+void maze_shard_close(maze_shard_reader_t *rp) {
+  rowcol_t k;
+
+  for (k = 0; rp->slots != NULL && k < rp->n_slots; ++k) {
+    if (rp->slots[k].fp != NULL) fclose(rp->slots[k].fp);
+  }
+  free(rp->slots);
+  free(rp->dir);
+  rp->slots = NULL;
+  rp->dir = NULL;
+  rp->n_slots = 0;
+}
+
+/* Here there be dragons */
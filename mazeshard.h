@@ -0,0 +1,224 @@
+/*
+  Name:     mazeshard.h
+  Purpose:  Sharded generation of very large mazes.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#ifndef MAZESHARD_H_
+#define MAZESHARD_H_
+
+#include "maze.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** How a maze is divided into a grid of rectangular shards.  Shards
+    are numbered by row and column of the grid, from zero.  Rows and
+    columns of the maze are divided as evenly as possible.
+ */
+typedef struct {
+  rowcol_t n_rows;  /* Rows in the whole maze            */
+  rowcol_t n_cols;  /* Columns in the whole maze         */
+  rowcol_t sh_rows; /* Number of shards down the maze    */
+  rowcol_t sh_cols; /* Number of shards across the maze  */
+  rowcol_t exit_1;  /* Exits of the whole maze           */
+  rowcol_t exit_2;
+} maze_layout_t;
+
+/** Everything known about a shard without loading its cells: where
+    it lies in the whole maze, and which connected component each of
+    the cells on its border belongs to.
+ */
+typedef struct {
+  maze_layout_t lay;
+  rowcol_t si, sj;     /* Position of the shard in the shard grid */
+  rowcol_t row0, col0; /* Position of its top left cell in the maze */
+  rowcol_t n_rows;     /* Size of the shard                        */
+  rowcol_t n_cols;
+  rowcol_t n_comp;   /* Number of distinct border components */
+  rowcol_t stitched; /* True once the shard has been stitched  */
+  rowcol_t *border;  /* Component of each border cell: the top row,
+                        bottom row, left column, and right column */
+  rowcol_t n_portals; /* Border cells opened to other shards   */
+  rowcol_t *portals;  /* Border index of each portal cell       */
+  rowcol_t *first;    /* Where the links of each portal start,
+                         with one more entry for the end        */
+  rowcol_t *links;    /* Pairs of another portal reachable within
+                         the shard and the steps to it           */
+} maze_shard_t;
+
+/* Marks an unreachable portal in the distance summary of a shard. */
+#define SHARD_NO_PATH ((rowcol_t)-1)
+
+/* Offsets of each side within the border array of a shard. */
+#define SHARD_TOP(S) 0
+#define SHARD_BOTTOM(S) ((S)->n_cols)
+#define SHARD_LEFT(S) (2 * (S)->n_cols)
+#define SHARD_RIGHT(S) (2 * (S)->n_cols + (S)->n_rows)
+
+/** Compute the extent of a shard within the whole maze.
+
+    @param lp    Pointer to the shard layout.
+    @param si    Row of the shard in the shard grid.
+    @param sj    Column of the shard in the shard grid.
+    @param sp    Shard whose position and size are to be filled in.
+ */
+void maze_shard_extent(const maze_layout_t *lp, rowcol_t si, rowcol_t sj,
+                       maze_shard_t *sp);
+
+/** Return the name of the file holding a shard, in a newly allocated
+    string which the caller must free.  Returns NULL if memory is
+    exhausted.
+ */
+char *maze_shard_path(const char *dir, rowcol_t si, rowcol_t sj);
+
+/** Generate one shard of a maze at random and write it to its file in
+    the given directory.  The shard is a forest of trees, each of which
+    reaches a side facing another shard, and its border walls are left
+    closed; maze_shard_stitch() joins the trees across the seams into
+    one perfect maze.  Returns false with a diagnostic in case of
+    error.
+
+    @param lp     Pointer to the shard layout.
+    @param si     Row of the shard in the shard grid.
+    @param sj     Column of the shard in the shard grid.
+    @param random A random generator function (see rand_f).
+    @param dir    Directory to write the shard file in.
+ */
+int maze_shard_generate(const maze_layout_t *lp, rowcol_t si, rowcol_t sj,
+                        rand_f random, const char *dir);
+
+/** Read the header and border components of a shard file, without
+    its cells.  The border array must be released with
+    maze_shard_clear().  Returns false with a diagnostic on error.
+ */
+int maze_shard_info(const char *path, maze_shard_t *sp);
+
+/** Read a whole shard file, initializing mp with the shard's cells as
+    a maze in its own right.  Returns false with a diagnostic on error.
+ */
+int maze_shard_load(const char *path, maze_shard_t *sp, maze_t *mp);
+
+/** Release the storage used by a shard description. */
+void maze_shard_clear(maze_shard_t *sp);
+
+/** Join the shards in a directory into a single perfect maze.  Only
+    the border information of each shard is read; the walls to open
+    are chosen by a randomized union-find over the components of all
+    shards, and are opened by patching the shard files in place.  Each
+    shard is then given a summary of the distances between its portals
+    (the border cells opened to other shards) for maze_shard_route().
+    Returns false with a diagnostic on error.
+
+    @param dir    Directory holding all the shards of a maze.
+    @param random A random generator function (see rand_f).
+ */
+int maze_shard_stitch(const char *dir, rand_f random);
+
+/** A function to receive the cells of a path in order, given their
+    row and column in the whole maze. */
+typedef void (*maze_cell_f)(rowcol_t r, rowcol_t c, void *arg);
+
+/** Find the path between two cells of a stitched, sharded maze.  The
+    route through the shards is planned from their portal distance
+    summaries, and then only the shards along it are loaded, one at a
+    time, to fill in the cells.  Returns false with a diagnostic if
+    there is no path or in case of error.
+
+    @param dir       Directory holding all the shards of a maze.
+    @param start_row Row number of starting cell.
+    @param start_col Column number of starting cell.
+    @param end_row   Row number of ending cell.
+    @param end_col   Column number of ending cell.
+    @param emit      Function to call with each cell of the path.
+    @param arg       Passed through to emit.
+    @param n_loaded  If not NULL, receives the number of shards whose
+                     cells had to be loaded.
+ */
+int maze_shard_route(const char *dir, rowcol_t start_row, rowcol_t start_col,
+                     rowcol_t end_row, rowcol_t end_col, maze_cell_f emit,
+                     void *arg, rowcol_t *n_loaded);
+
+/** Read the cells of a stitched, sharded maze one row at a time, in
+    order, passing each row to emit; for example, to write the maze
+    with a row writer (see maze_rows_t).  Only one band of shards is
+    open at a time, and only one row of cells is held in memory.  The
+    size and exits of the maze can be found first from the description
+    of any shard with maze_shard_info().  Returns false with a
+    diagnostic on error, or if emit returns false.
+
+    @param dir    Directory holding all the shards of a maze.
+    @param emit   Function to call with each row of cells.
+    @param arg    Passed through to emit.
+ */
+int maze_shard_rows(const char *dir, maze_row_f emit, void *arg);
+
+/** Load all the shards in a directory into a single maze.  This needs
+    enough memory for the whole maze, so it is mainly useful for
+    modest sizes.  Returns false with a diagnostic on error.
+
+    @param dir    Directory holding all the shards of a maze.
+    @param mp     Pointer to an uninitialized maze structure.
+ */
+int maze_shard_assemble(const char *dir, maze_t *mp);
+
+/** One shard file held open by a shard reader. */
+typedef struct {
+  FILE *fp;           /* NULL if the slot is free          */
+  maze_shard_t sh;    /* Extent of the shard (no border)   */
+  unsigned long used; /* When last read, for eviction      */
+} maze_shard_slot_t;
+
+/** A reader for runs of cells anywhere in a stitched, sharded maze,
+    which reads only the cells asked for.  Shard files are opened as
+    they are needed, and kept open for the next read, up to two bands
+    of the shard grid at a time.
+ */
+typedef struct {
+  char *dir;
+  maze_layout_t lay; /* Layout of the maze, from its first shard */
+  maze_shard_slot_t *slots;
+  rowcol_t n_slots;
+  unsigned long tick;
+  unsigned long n_opened; /* Shard files opened so far */
+} maze_shard_reader_t;
+
+/** Set up a reader for the shards in a directory, reading the layout
+    of the maze from its first shard.  Returns false with a diagnostic
+    on error. */
+int maze_shard_open(maze_shard_reader_t *rp, const char *dir);
+
+/** Read n cells of row r of a sharded maze, from column c onward,
+    into out.  Returns false with a diagnostic on error. */
+int maze_shard_read(maze_shard_reader_t *rp, rowcol_t r, rowcol_t c,
+                    rowcol_t n, maze_node *out);
+
+/** Close the shard files held by a reader and release its memory. */
+void maze_shard_close(maze_shard_reader_t *rp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end MAZESHARD_H_ */
@@ -0,0 +1,297 @@
+/*
+  Name:     mazeshm.c
+  Purpose:  Sharing mazes between processes in POSIX shared memory.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+
+#include "mazeshm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The header at the start of a segment.  The cells begin right after
+   it, at offset SHM_HDR_SIZE, which keeps them cache line aligned. */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint64_t seq; /* Odd while the maze is being changed */
+  uint32_t n_rows;
+  uint32_t n_cols;
+  uint32_t exit_1;
+  uint32_t exit_2;
+  uint32_t node_size; /* sizeof(maze_node) on the writer */
+  char reserved[28];
+} s_shm_hdr_t;
+
+#define SHM_HDR_SIZE 64
+#define SHM_VERSION 1
+
+static const char shm_magic[4] = {'M', 'Z', 'S', 'M'};
+
+/* Fails to compile if the header is not the size the layout expects */
+typedef char s_shm_hdr_size_ok[sizeof(s_shm_hdr_t) == SHM_HDR_SIZE ? 1 : -1];
+
+/* s_shm_name(*name)
+
+   Return the segment name to pass to shm_open(), with a leading slash
+   added if it lacks one, in a newly allocated string.  Returns NULL
+   if memory is exhausted.
+ */
+
+static char *s_shm_name(const char *name) {
+  char *out = malloc(strlen(name) + 2);
+
+  if (out != NULL) sprintf(out, "%s%s", (name[0] == '/') ? "" : "/", name);
+  return out;
+}
+
+/* s_map_maze(*mp, *map, len, *hp)
+
+   Point maze mp at the cells of a mapped segment with header hp.
+ */
+
+static void s_map_maze(maze_t *mp, void *map, size_t len,
+                       const s_shm_hdr_t *hp) {
+  mp->cells = (maze_node *)((char *)map + SHM_HDR_SIZE);
+  mp->sets = NULL;
+  mp->n_rows = hp->n_rows;
+  mp->n_cols = hp->n_cols;
+  mp->exit_1 = hp->exit_1;
+  mp->exit_2 = hp->exit_2;
+  mp->map = map;
+  mp->map_len = len;
+}
+
+/* s_begin(*hp)
+
+   Make the sequence number in header hp odd before any cell changes.
+   The release fence keeps the cell stores from being seen before the
+   new number.
+ */
+
+static void s_begin(s_shm_hdr_t *hp) {
+  __atomic_store_n(&hp->seq, hp->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/* maze_shm_create(*mp, *name, nr, nc)
+
+   A new segment is sized for the maze and given a fresh header.  An
+   existing one is reused only if it already holds a maze of the same
+   size, since processes that have it mapped cannot follow a change of
+   size; its sequence number carries on from where it was.
+ */
+
+int maze_shm_create(maze_t *mp, const char *name, rowcol_t nr, rowcol_t nc) {
+  size_t len = SHM_HDR_SIZE + (size_t)nr * nc * sizeof(maze_node);
+  char *shm_name = s_shm_name(name);
+  s_shm_hdr_t *hp;
+  struct stat st;
+  void *map;
+  int fd;
+
+  if (shm_name == NULL) return 0;
+  fd = shm_open(shm_name, O_RDWR | O_CREAT, 0644);
+  free(shm_name);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "maze_shm_create:  unable to open '%s': %s\n", name,
+            strerror(errno));
+    if (fd >= 0) close(fd);
+    return 0;
+  }
+
+  if (st.st_size == 0 && ftruncate(fd, len) != 0) {
+    fprintf(stderr, "maze_shm_create:  unable to size '%s': %s\n", name,
+            strerror(errno));
+    close(fd);
+    return 0;
+  }
+  if (st.st_size != 0 && (size_t)st.st_size != len) {
+    fprintf(stderr, "maze_shm_create:  '%s' holds a maze of another size\n",
+            name);
+    close(fd);
+    return 0;
+  }
+
+  map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "maze_shm_create:  unable to map '%s': %s\n", name,
+            strerror(errno));
+    return 0;
+  }
+
+  hp = map;
+  if (st.st_size == 0) {
+    memcpy(hp->magic, shm_magic, sizeof(shm_magic));
+    hp->version = SHM_VERSION;
+    hp->seq = 0;
+    hp->node_size = sizeof(maze_node);
+  } else if (memcmp(hp->magic, shm_magic, sizeof(shm_magic)) != 0 ||
+             hp->version != SHM_VERSION ||
+             hp->node_size != sizeof(maze_node) || hp->n_rows != nr ||
+             hp->n_cols != nc) {
+    fprintf(stderr, "maze_shm_create:  '%s' holds a different maze\n", name);
+    munmap(map, len);
+    return 0;
+  }
+
+  if (!(hp->seq & 1)) s_begin(hp);
+  hp->n_rows = nr;
+  hp->n_cols = nc;
+  hp->exit_1 = EXIT(0, DIR_L);
+  hp->exit_2 = EXIT(nr - 1, DIR_R);
+
+  s_map_maze(mp, map, len, hp);
+  maze_reset(mp);
+  return 1;
+}
+
+/* maze_shm_begin(*mp)
+
+   Flag the maze as being changed, unless it already is.
+ */
+
+void maze_shm_begin(maze_t *mp) {
+  s_shm_hdr_t *hp = mp->map;
+
+  if (!(hp->seq & 1)) s_begin(hp);
+}
+
+/* maze_shm_publish(*mp)
+
+   Copy the exits into the header, then make the sequence number even
+   with a release store, so that a reader who sees the new number
+   also sees every cell and exit written before it.
+ */
+
+void maze_shm_publish(maze_t *mp) {
+  s_shm_hdr_t *hp = mp->map;
+
+  __atomic_store_n(&hp->exit_1, mp->exit_1, __ATOMIC_RELAXED);
+  __atomic_store_n(&hp->exit_2, mp->exit_2, __ATOMIC_RELAXED);
+  __atomic_store_n(&hp->seq, (hp->seq | 1) + 1, __ATOMIC_RELEASE);
+}
+
+/* maze_attach(*mp, *name)
+
+   Map the whole segment read-only and check that its header describes
+   a maze written on a compatible host, of the size the segment has.
+ */
+
+int maze_attach(maze_t *mp, const char *name) {
+  char *shm_name = s_shm_name(name);
+  const s_shm_hdr_t *hp;
+  struct stat st;
+  void *map;
+  int fd;
+
+  if (shm_name == NULL) return 0;
+  fd = shm_open(shm_name, O_RDONLY, 0);
+  free(shm_name);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "maze_attach:  unable to open '%s': %s\n", name,
+            strerror(errno));
+    if (fd >= 0) close(fd);
+    return 0;
+  }
+  if ((size_t)st.st_size < SHM_HDR_SIZE) {
+    fprintf(stderr, "maze_attach:  '%s' is not a maze\n", name);
+    close(fd);
+    return 0;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "maze_attach:  unable to map '%s': %s\n", name,
+            strerror(errno));
+    return 0;
+  }
+
+  hp = map;
+  if (memcmp(hp->magic, shm_magic, sizeof(shm_magic)) != 0 ||
+      hp->version != SHM_VERSION || hp->node_size != sizeof(maze_node) ||
+      hp->n_rows == 0 || hp->n_cols == 0 ||
+      SHM_HDR_SIZE + (size_t)hp->n_rows * hp->n_cols * sizeof(maze_node) !=
+          (size_t)st.st_size) {
+    fprintf(stderr, "maze_attach:  '%s' is not a maze for this host\n", name);
+    munmap(map, st.st_size);
+    return 0;
+  }
+
+  s_map_maze(mp, map, st.st_size, hp);
+  maze_shm_sync(mp);
+  return 1;
+}
+
+/* maze_shm_sync(*mp)
+
+   Read the exits between two acquiring loads of the sequence number,
+   retrying if a new version was published in between.
+ */
+
+unsigned long long maze_shm_sync(maze_t *mp) {
+  const s_shm_hdr_t *hp = mp->map;
+
+  for (;;) {
+    uint64_t seq = __atomic_load_n(&hp->seq, __ATOMIC_ACQUIRE);
+    rowcol_t exit_1, exit_2;
+
+    if (seq & 1) return seq;
+
+    exit_1 = __atomic_load_n(&hp->exit_1, __ATOMIC_RELAXED);
+    exit_2 = __atomic_load_n(&hp->exit_2, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    if (__atomic_load_n(&hp->seq, __ATOMIC_RELAXED) == seq) {
+      mp->exit_1 = exit_1;
+      mp->exit_2 = exit_2;
+      return seq;
+    }
+  }
+}
+
+/* maze_shm_remove(*name)
+
+   Unlink a segment by name.
+ */
+
+int maze_shm_remove(const char *name) {
+  char *shm_name = s_shm_name(name);
+  int ok;
+
+  if (shm_name == NULL) return 0;
+  ok = shm_unlink(shm_name) == 0;
+  free(shm_name);
+  return ok;
+}
+
+/* Here there be dragons */
@@ -0,0 +1,94 @@
+/*
+  Name:     mazeshm.h
+  Purpose:  Sharing mazes between processes in POSIX shared memory.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#ifndef MAZESHM_H_
+#define MAZESHM_H_
+
+#include "maze.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A maze in shared memory is a small header followed by its cells, in
+   the same in-memory form as a maze_t on the host that wrote it, so
+   another process can map the segment and use the cells where they
+   lie.  The header carries a sequence number, which is odd while the
+   maze is being changed and even once it is complete.  A reader that
+   sees the same even number before and after looking at the cells
+   has seen a complete maze. */
+
+/** Create a maze in a named shared memory segment, or reopen one of
+    the same size for a new maze.  The maze is initialized to "all
+    walls" as by maze_init(), and can be generated and marked as usual;
+    it is flagged as being updated until maze_shm_publish() is called.
+    Release it with maze_clear(), which leaves the segment in place.
+    Returns false with a diagnostic on error.
+
+    @param mp    Pointer to an uninitialized maze structure.
+    @param name  Name of the segment (see shm_open(3)).
+    @param nr    The number of rows the maze should have.
+    @param nc    The number of columns the maze should have.
+ */
+int maze_shm_create(maze_t *mp, const char *name, rowcol_t nr, rowcol_t nc);
+
+/** Mark the start of a change to a maze created by maze_shm_create(),
+    so that readers know its cells are not complete.
+ */
+void maze_shm_begin(maze_t *mp);
+
+/** Publish a maze created by maze_shm_create() once it is complete,
+    including its exits, and advance the sequence number.
+ */
+void maze_shm_publish(maze_t *mp);
+
+/** Map a maze in a named shared memory segment into this process,
+    read-only and without copying its cells.  The result can be used
+    with the path-free functions of the library, such as the writers,
+    but must not be generated or solved.  Release it with
+    maze_clear().  Returns false with a diagnostic on error.
+
+    @param mp    Pointer to an uninitialized maze structure.
+    @param name  Name of the segment (see shm_open(3)).
+ */
+int maze_attach(maze_t *mp, const char *name);
+
+/** Return the current sequence number of a maze in shared memory.  If
+    it is even, the exits of mp are brought up to date as well; if it
+    is odd, the maze is being changed and its exits are left alone.
+ */
+unsigned long long maze_shm_sync(maze_t *mp);
+
+/** Remove a named shared memory segment.  Processes that have it
+    mapped keep their mappings.  Returns false on error.
+ */
+int maze_shm_remove(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end MAZESHM_H_ */
@@ -0,0 +1,363 @@
+/*
+  Name:     mazesnap.c
+  Purpose:  Copy-on-write snapshots of a maze being edited.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#include "mazesnap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Every part of the table begins with its reference count.  A root is
+   referenced by the maze being edited and by each snapshot of it, a
+   leaf by each root that points to it, and a page by each leaf.  The
+   counts are only raised on the editing thread, through a reference
+   it already holds, so relaxed ordering will do.  They are lowered
+   with acquire-release ordering, and read with acquire ordering
+   before a part is changed in place, so the editor sees a count of
+   one only after every read made through the released references. */
+
+typedef struct {
+  long refs;
+  maze_node cells[MAZE_SNAP_PAGE];
+} s_page_t;
+
+typedef struct {
+  long refs;
+  s_page_t *pages[MAZE_SNAP_FAN]; /* NULL past the end of the maze */
+} s_leaf_t;
+
+struct maze_snap_root {
+  long refs;
+  rowcol_t exit_1;
+  rowcol_t exit_2;
+  rowcol_t n_leaves;
+  s_leaf_t *leaves[];
+};
+
+#define ROOT_SIZE(N) \
+  (sizeof(struct maze_snap_root) + (size_t)(N) * sizeof(s_leaf_t *))
+#define PAGE_OF(RP, POS) \
+  ((RP)->leaves[(POS) / MAZE_SNAP_PAGE / MAZE_SNAP_FAN] \
+       ->pages[(POS) / MAZE_SNAP_PAGE % MAZE_SNAP_FAN])
+
+/* s_hold(*refs), s_drop(*refs), s_shared(*refs)
+
+   Add a reference, drop one (returning true if it was the last), and
+   tell whether there is more than one.
+ */
+
+static void s_hold(long *refs) {
+  __atomic_add_fetch(refs, 1, __ATOMIC_RELAXED);
+}
+
+static int s_drop(long *refs) {
+  return __atomic_sub_fetch(refs, 1, __ATOMIC_ACQ_REL) == 0;
+}
+
+static int s_shared(long *refs) {
+  return __atomic_load_n(refs, __ATOMIC_ACQUIRE) > 1;
+}
+
+/* s_leaf_release(*lp)
+
+   Drop a reference to a leaf, releasing it and its pages when the
+   last one goes.  A NULL leaf is ignored.
+ */
+
+static void s_leaf_release(s_leaf_t *lp) {
+  int i;
+
+  if (lp == NULL || !s_drop(&lp->refs)) return;
+  for (i = 0; i < MAZE_SNAP_FAN; ++i) {
+    if (lp->pages[i] != NULL && s_drop(&lp->pages[i]->refs))
+      free(lp->pages[i]);
+  }
+  free(lp);
+}
+
+/* s_root_release(*rp)
+
+   Drop a reference to a root, releasing it and its leaves when the
+   last one goes.
+ */
+
+static void s_root_release(struct maze_snap_root *rp) {
+  rowcol_t i;
+
+  if (rp == NULL || !s_drop(&rp->refs)) return;
+  for (i = 0; i < rp->n_leaves; ++i) s_leaf_release(rp->leaves[i]);
+  free(rp);
+}
+
+/* s_own_root(*ep)
+
+   Return the root of a maze being edited, first replacing it with a
+   copy of its own if a snapshot shares it.  Returns NULL if memory is
+   exhausted.
+ */
+
+static struct maze_snap_root *s_own_root(maze_edit_t *ep) {
+  struct maze_snap_root *rp = ep->root, *np;
+  rowcol_t i;
+
+  if (!s_shared(&rp->refs)) return rp;
+  if ((np = malloc(ROOT_SIZE(rp->n_leaves))) == NULL) return NULL;
+
+  memcpy(np, rp, ROOT_SIZE(rp->n_leaves));
+  np->refs = 1;
+  for (i = 0; i < np->n_leaves; ++i) s_hold(&np->leaves[i]->refs);
+  ep->root = np;
+  s_root_release(rp);
+  return np;
+}
+
+/* s_own_cell(*ep, pos)
+
+   Return a pointer to the cell at offset pos of a maze being edited,
+   first copying the root, leaf, and page that hold it, if any of them
+   is shared.  Returns NULL if memory is exhausted.
+ */
+
+static maze_node *s_own_cell(maze_edit_t *ep, rowcol_t pos) {
+  rowcol_t k = pos / MAZE_SNAP_PAGE;
+  struct maze_snap_root *rp = s_own_root(ep);
+  s_leaf_t *lp, *nl;
+  s_page_t *pp, *np;
+  int i;
+
+  if (rp == NULL) return NULL;
+
+  lp = rp->leaves[k / MAZE_SNAP_FAN];
+  if (s_shared(&lp->refs)) {
+    if ((nl = malloc(sizeof(*nl))) == NULL) return NULL;
+    memcpy(nl, lp, sizeof(*nl));
+    nl->refs = 1;
+    for (i = 0; i < MAZE_SNAP_FAN; ++i) {
+      if (nl->pages[i] != NULL) s_hold(&nl->pages[i]->refs);
+    }
+    rp->leaves[k / MAZE_SNAP_FAN] = nl;
+    s_leaf_release(lp);
+    lp = nl;
+  }
+
+  pp = lp->pages[k % MAZE_SNAP_FAN];
+  if (s_shared(&pp->refs)) {
+    if ((np = malloc(sizeof(*np))) == NULL) return NULL;
+    memcpy(np, pp, sizeof(*np));
+    np->refs = 1;
+    lp->pages[k % MAZE_SNAP_FAN] = np;
+    if (s_drop(&pp->refs)) free(pp);
+    pp = np;
+    ++ep->n_copied;
+  }
+  return pp->cells + pos % MAZE_SNAP_PAGE;
+}
+
+/* maze_edit_init(*ep, *mp)
+
+   The table is built full size at once, with every page filled in.
+ */
+
+int maze_edit_init(maze_edit_t *ep, const maze_t *mp) {
+  rowcol_t n_cells = mp->n_rows * mp->n_cols, k, pos;
+  rowcol_t n_pages = n_cells / MAZE_SNAP_PAGE + (n_cells % MAZE_SNAP_PAGE != 0);
+  rowcol_t n_leaves = n_pages / MAZE_SNAP_FAN + (n_pages % MAZE_SNAP_FAN != 0);
+  struct maze_snap_root *rp = calloc(1, ROOT_SIZE(n_leaves));
+  s_leaf_t *lp = NULL;
+  s_page_t *pp;
+
+  if (rp == NULL) return 0;
+  rp->refs = 1;
+  rp->exit_1 = mp->exit_1;
+  rp->exit_2 = mp->exit_2;
+  rp->n_leaves = n_leaves;
+
+  for (k = 0; k < n_pages; ++k) {
+    if (k % MAZE_SNAP_FAN == 0) {
+      if ((lp = calloc(1, sizeof(*lp))) == NULL) goto FAIL;
+      lp->refs = 1;
+      rp->leaves[k / MAZE_SNAP_FAN] = lp;
+    }
+    if ((pp = malloc(sizeof(*pp))) == NULL) goto FAIL;
+    pp->refs = 1;
+    pos = k * MAZE_SNAP_PAGE;
+    memcpy(pp->cells, mp->cells + pos,
+           (n_cells - pos < MAZE_SNAP_PAGE ? n_cells - pos : MAZE_SNAP_PAGE) *
+               sizeof(maze_node));
+    lp->pages[k % MAZE_SNAP_FAN] = pp;
+  }
+
+  ep->root = rp;
+  ep->n_rows = mp->n_rows;
+  ep->n_cols = mp->n_cols;
+  ep->n_copied = 0;
+  return 1;
+
+FAIL:
+  s_root_release(rp);
+  return 0;
+}
+
+/* maze_edit_clear(*ep)
+
+   Drop the editor's reference to the root.
+ */
+
+void maze_edit_clear(maze_edit_t *ep) {
+  s_root_release(ep->root);
+  ep->root = NULL;
+}
+
+/* maze_edit_get(*ep, r, c)
+
+   Look up a cell through the table.
+ */
+
+maze_node maze_edit_get(const maze_edit_t *ep, rowcol_t r, rowcol_t c) {
+  rowcol_t pos = r * ep->n_cols + c;
+
+  return PAGE_OF(ep->root, pos)->cells[pos % MAZE_SNAP_PAGE];
+}
+
+/* maze_edit_set(*ep, r, c, n)
+
+   Store a cell once its page belongs to the editor alone.
+ */
+
+int maze_edit_set(maze_edit_t *ep, rowcol_t r, rowcol_t c, maze_node n) {
+  maze_node *np = s_own_cell(ep, r * ep->n_cols + c);
+
+  if (np == NULL) return 0;
+  *np = n;
+  return 1;
+}
+
+/* maze_edit_exits(*ep, exit_1, exit_2)
+
+   The exits live in the root, so changing them copies a shared root.
+ */
+
+int maze_edit_exits(maze_edit_t *ep, rowcol_t exit_1, rowcol_t exit_2) {
+  struct maze_snap_root *rp = s_own_root(ep);
+
+  if (rp == NULL) return 0;
+  rp->exit_1 = exit_1;
+  rp->exit_2 = exit_2;
+  return 1;
+}
+
+/* maze_snap_take(*sp, *ep)
+
+   Add a reference to the root.  The root cannot change while it is
+   shared, so its exits are copied out to the snapshot.
+ */
+
+void maze_snap_take(maze_snap_t *sp, const maze_edit_t *ep) {
+  s_hold(&ep->root->refs);
+  sp->root = ep->root;
+  sp->n_rows = ep->n_rows;
+  sp->n_cols = ep->n_cols;
+  sp->exit_1 = ep->root->exit_1;
+  sp->exit_2 = ep->root->exit_2;
+}
+
+/* maze_snap_release(*sp)
+
+   Drop the snapshot's reference to its root.
+ */
+
+void maze_snap_release(maze_snap_t *sp) {
+  s_root_release(sp->root);
+  sp->root = NULL;
+}
+
+/* maze_snap_get(*sp, r, c)
+
+   Look up a cell through the table.
+ */
+
+maze_node maze_snap_get(const maze_snap_t *sp, rowcol_t r, rowcol_t c) {
+  rowcol_t pos = r * sp->n_cols + c;
+
+  return PAGE_OF(sp->root, pos)->cells[pos % MAZE_SNAP_PAGE];
+}
+
+/* maze_snap_page(*sp, k, *len)
+
+   Only the last page of a maze may be short.
+ */
+
+const maze_node *maze_snap_page(const maze_snap_t *sp, rowcol_t k,
+                                rowcol_t *len) {
+  rowcol_t pos = k * MAZE_SNAP_PAGE, n_cells = sp->n_rows * sp->n_cols;
+
+  *len = n_cells - pos < MAZE_SNAP_PAGE ? n_cells - pos : MAZE_SNAP_PAGE;
+  return PAGE_OF(sp->root, pos)->cells;
+}
+
+/* maze_snap_rows(*sp, row, *arg)
+
+   Rows need not begin or end on a page boundary, so each one is
+   gathered from the pages that hold it into a buffer of its own.
+ */
+
+int maze_snap_rows(const maze_snap_t *sp, maze_row_f row, void *arg) {
+  maze_node *buf = malloc(sp->n_cols * sizeof(maze_node));
+  rowcol_t r, c, n, pos = 0;
+  int ok = 1;
+
+  if (buf == NULL) return 0;
+  for (r = 0; ok && r < sp->n_rows; ++r) {
+    for (c = 0; c < sp->n_cols; c += n, pos += n) {
+      n = MAZE_SNAP_PAGE - pos % MAZE_SNAP_PAGE;
+      if (n > sp->n_cols - c) n = sp->n_cols - c;
+      memcpy(buf + c, PAGE_OF(sp->root, pos)->cells + pos % MAZE_SNAP_PAGE,
+             n * sizeof(maze_node));
+    }
+    ok = (*row)(buf, arg);
+  }
+  free(buf);
+  return ok;
+}
+
+/* maze_snap_copy(*sp, *mp)
+
+   Copy the cells a page at a time.
+ */
+
+int maze_snap_copy(const maze_snap_t *sp, maze_t *mp) {
+  rowcol_t k, len, n_cells = sp->n_rows * sp->n_cols;
+  rowcol_t n_pages = n_cells / MAZE_SNAP_PAGE + (n_cells % MAZE_SNAP_PAGE != 0);
+
+  if (!maze_init(mp, sp->n_rows, sp->n_cols)) return 0;
+  for (k = 0; k < n_pages; ++k) {
+    const maze_node *cells = maze_snap_page(sp, k, &len);
+
+    memcpy(mp->cells + k * MAZE_SNAP_PAGE, cells, len * sizeof(maze_node));
+  }
+  mp->exit_1 = sp->exit_1;
+  mp->exit_2 = sp->exit_2;
+  return 1;
+}
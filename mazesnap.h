@@ -0,0 +1,130 @@
+/*
+  Name:     mazesnap.h
+  Purpose:  Copy-on-write snapshots of a maze being edited.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#ifndef MAZESNAP_H_
+#define MAZESNAP_H_
+
+#include "maze.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A maze being edited keeps its cells in pages of MAZE_SNAP_PAGE
+   cells, reached through a two-level table: a root holding the size
+   and exits of the maze points to leaves of MAZE_SNAP_FAN pages each.
+   Roots, leaves and pages carry reference counts.  Taking a snapshot
+   only adds a reference to the root.  The next change to the maze
+   copies whatever it touches that is still shared -- the root, one
+   leaf, and one page -- so the cost of a snapshot is proportional to
+   the pages changed while it is held, not to the size of the maze.
+
+   A maze is edited from one thread, which also takes the snapshots.
+   A snapshot can be handed to any other thread (with the usual
+   synchronization for the hand-off itself), read there while the
+   editing goes on, and released there. */
+
+#define MAZE_SNAP_PAGE 4096 /* Cells per page           */
+#define MAZE_SNAP_FAN 512   /* Pages per leaf of a table */
+
+struct maze_snap_root;
+
+/** A maze being edited, with its cells in shared pages. */
+typedef struct {
+  struct maze_snap_root *root;
+  rowcol_t n_rows;
+  rowcol_t n_cols;
+  unsigned long n_copied; /* Pages copied by edits so far */
+} maze_edit_t;
+
+/** An immutable snapshot of a maze being edited.  The exits are
+    those of the maze when the snapshot was taken. */
+typedef struct {
+  struct maze_snap_root *root;
+  rowcol_t n_rows;
+  rowcol_t n_cols;
+  rowcol_t exit_1;
+  rowcol_t exit_2;
+} maze_snap_t;
+
+/** Begin editing a copy of a maze, which is left alone.  Release the
+    copy with maze_edit_clear().  Returns false if memory is exhausted.
+ */
+int maze_edit_init(maze_edit_t *ep, const maze_t *mp);
+
+/** Release a maze being edited.  Snapshots taken of it are still
+    valid, and must be released separately. */
+void maze_edit_clear(maze_edit_t *ep);
+
+/** Return the cell at row r and column c of a maze being edited. */
+maze_node maze_edit_get(const maze_edit_t *ep, rowcol_t r, rowcol_t c);
+
+/** Replace the cell at row r and column c of a maze being edited,
+    first copying whatever part of it is shared with a snapshot.
+    Returns false if memory is exhausted, leaving the cell unchanged.
+ */
+int maze_edit_set(maze_edit_t *ep, rowcol_t r, rowcol_t c, maze_node n);
+
+/** Replace the exits of a maze being edited.  Returns false if memory
+    is exhausted, leaving them unchanged. */
+int maze_edit_exits(maze_edit_t *ep, rowcol_t exit_1, rowcol_t exit_2);
+
+/** Take a snapshot of a maze being edited, in constant time.  Release
+    it with maze_snap_release(). */
+void maze_snap_take(maze_snap_t *sp, const maze_edit_t *ep);
+
+/** Release a snapshot.  This may be done from any thread. */
+void maze_snap_release(maze_snap_t *sp);
+
+/** Return the cell at row r and column c of a snapshot. */
+maze_node maze_snap_get(const maze_snap_t *sp, rowcol_t r, rowcol_t c);
+
+/** Return the cells of page k of a snapshot, counting from zero in
+    row major order, and set *len to the number of cells on it.  Two
+    snapshots of the same maze return the same pointer for a page that
+    was not changed between them, and such a page can be skipped when
+    comparing them.
+ */
+const maze_node *maze_snap_page(const maze_snap_t *sp, rowcol_t k,
+                                rowcol_t *len);
+
+/** Pass the rows of a snapshot in order to a function, for example
+    to draw it with a row writer.  Returns false if memory is exhausted
+    or the function stops early.
+ */
+int maze_snap_rows(const maze_snap_t *sp, maze_row_f row, void *arg);
+
+/** Copy a snapshot into a new maze, for example to solve it, which
+    marks its cells.  Release the copy with maze_clear().  Returns
+    false if memory is exhausted.
+ */
+int maze_snap_copy(const maze_snap_t *sp, maze_t *mp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end MAZESNAP_H_ */
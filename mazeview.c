@@ -0,0 +1,807 @@
+/*
+  Name:     mazeview.c
+  Purpose:  Terminal viewer for large mazes.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#include "mazeview.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Cells read at a time when zoomed out past VIEW_GRID */
+#define VIEW_CHUNK 4096
+
+/* Most blocks whose marks are kept for one zoom level above VIEW_GRID.
+   A level with more blocks than this is read afresh for each frame,
+   which then reads fewer than n_cells / VIEW_CACHE cells for each
+   character on the screen. */
+#define VIEW_CACHE (1UL << 22)
+
+/* What is kept of a block: nothing yet, or whether it is on the path */
+enum { BLOCK_UNREAD = 0, BLOCK_OFF = 1, BLOCK_ON = 2 };
+
+/* Longest run of unchanged characters that is written over again
+   rather than skipped with a cursor movement, which takes about as
+   many bytes */
+#define VIEW_SKIP 6
+
+/* The cells read for a frame at VIEW_TEXT or VIEW_GRID: rows r0 and
+   onward, and n_cols columns from c0 */
+typedef struct {
+  const maze_node *cells;
+  rowcol_t r0, c0, n_cols;
+} s_win_t;
+
+/* Output of a frame, gathered into chunks for the sink */
+typedef struct {
+  maze_sink_t *sink;
+  int ok;
+  size_t len;
+  char buf[4096];
+} s_out_t;
+
+/* s_view_setup(*vp, n_rows, n_cols, exit_1, exit_2, source)
+
+   Set up the parts of a viewer common to every source.
+ */
+
+static void s_view_setup(maze_view_t *vp, rowcol_t n_rows, rowcol_t n_cols,
+                         rowcol_t exit_1, rowcol_t exit_2, int source) {
+  memset(vp, 0, sizeof(*vp));
+  vp->n_rows = n_rows;
+  vp->n_cols = n_cols;
+  vp->exit_1 = exit_1;
+  vp->exit_2 = exit_2;
+  vp->show_path = 1;
+  vp->fresh = 1;
+  vp->source = source;
+}
+
+/* maze_view_init(*vp, *mp)
+
+   Set up a viewer reading straight from a maze in memory.
+ */
+
+int maze_view_init(maze_view_t *vp, const maze_t *mp) {
+  s_view_setup(vp, mp->n_rows, mp->n_cols, mp->exit_1, mp->exit_2,
+               VIEW_SRC_MAZE);
+  vp->mp = mp;
+  return 1;
+}
+
+/* maze_view_store(*vp, *ifp, n_rows, n_cols, exit_1, exit_2)
+
+   maze_store() writes the cells of a maze as one character each, in
+   lines of a fixed length, so the offset of any cell can be worked
+   out from the length of the first line.
+ */
+
+int maze_view_store(maze_view_t *vp, FILE *ifp, rowcol_t n_rows,
+                    rowcol_t n_cols, rowcol_t exit_1, rowcol_t exit_2) {
+  long data = ftell(ifp);
+  unsigned long line = 0;
+  int ch;
+
+  if (data < 0) return 0;
+  while ((ch = getc(ifp)) != EOF && ch != '\n') ++line;
+  if (fseek(ifp, data, SEEK_SET) != 0 || line == 0) return 0;
+
+  s_view_setup(vp, n_rows, n_cols, exit_1, exit_2, VIEW_SRC_STORE);
+  vp->ifp = ifp;
+  vp->data = data;
+  vp->line = line;
+  return 1;
+}
+
+/* maze_view_shards(*vp, *dir)
+
+   Set up a viewer reading from a sharded maze.
+ */
+
+int maze_view_shards(maze_view_t *vp, const char *dir) {
+  maze_shard_reader_t rd;
+
+  if (!maze_shard_open(&rd, dir)) return 0;
+
+  s_view_setup(vp, rd.lay.n_rows, rd.lay.n_cols, rd.lay.exit_1,
+               rd.lay.exit_2, VIEW_SRC_SHARDS);
+  vp->shards = rd;
+  return 1;
+}
+
+/* maze_view_clear(*vp)
+
+   Release the screens and cells of a viewer, and its shard reader.
+ */
+
+void maze_view_clear(maze_view_t *vp) {
+  int k;
+
+  free(vp->screen);
+  free(vp->next);
+  free(vp->cells);
+  if (vp->source == VIEW_SRC_SHARDS) maze_shard_close(&vp->shards);
+  vp->screen = vp->next = NULL;
+  vp->cells = NULL;
+  for (k = 0; k < VIEW_LEVELS; ++k) {
+    free(vp->blocks[k]);
+    vp->blocks[k] = NULL;
+  }
+}
+
+/* s_view_read(*vp, r, c, n, *out)
+
+   Read n cells of row r from column c onward from the viewer's
+   source.
+ */
+
+static int s_view_read(maze_view_t *vp, rowcol_t r, rowcol_t c, rowcol_t n,
+                       maze_node *out) {
+  unsigned long long k = (unsigned long long)r * vp->n_cols + c;
+
+  vp->n_read += n;
+  switch (vp->source) {
+    case VIEW_SRC_MAZE:
+      memcpy(out, CELLP(vp->mp, r, c), n * sizeof(*out));
+      return 1;
+    case VIEW_SRC_STORE:
+      return fseek(vp->ifp, vp->data + (long)(k + k / vp->line), SEEK_SET) ==
+                 0 &&
+             maze_load_row(vp->ifp, n, out);
+    default:
+      return maze_shard_read(&vp->shards, r, c, n, out);
+  }
+}
+
+/* s_view_dims(*vp, level, *h, *w)
+
+   Find the height and width of the picture of the maze at a zoom
+   level, in characters.
+ */
+
+static void s_view_dims(const maze_view_t *vp, int level,
+                        unsigned long long *h, unsigned long long *w) {
+  unsigned long long b;
+
+  if (level <= VIEW_GRID) {
+    *h = 2ULL * vp->n_rows + 1;
+    *w = (level == VIEW_TEXT ? 4ULL : 2ULL) * vp->n_cols + 1;
+  } else {
+    b = 1ULL << (level - 1);
+    *h = (vp->n_rows + b - 1) / b;
+    *w = (vp->n_cols + b - 1) / b;
+  }
+}
+
+/* s_view_clamp(*vp)
+
+   Keep the screen within the picture, or at its top left corner if
+   the picture is smaller than the screen.
+ */
+
+static void s_view_clamp(maze_view_t *vp) {
+  unsigned long long h, w;
+
+  s_view_dims(vp, vp->level, &h, &w);
+  if (h <= vp->s_rows)
+    vp->top = 0;
+  else if (vp->top > h - vp->s_rows)
+    vp->top = h - vp->s_rows;
+  if (w <= vp->s_cols)
+    vp->left = 0;
+  else if (vp->left > w - vp->s_cols)
+    vp->left = w - vp->s_cols;
+}
+
+/* s_view_cell_at(*vp, y, x, *r, *c)
+
+   Find the cell drawn at row y and column x of the picture at the
+   current zoom level; on a wall, the cell below it or to its right,
+   and at a block, the cell at its top left corner.
+ */
+
+static void s_view_cell_at(const maze_view_t *vp, unsigned long long y,
+                           unsigned long long x, rowcol_t *r, rowcol_t *c) {
+  unsigned long long rr, cc;
+
+  if (vp->level <= VIEW_GRID) {
+    rr = y / 2;
+    cc = x / (vp->level == VIEW_TEXT ? 4 : 2);
+  } else {
+    rr = y << (vp->level - 1);
+    cc = x << (vp->level - 1);
+  }
+  *r = (rr < vp->n_rows) ? (rowcol_t)rr : vp->n_rows - 1;
+  *c = (cc < vp->n_cols) ? (rowcol_t)cc : vp->n_cols - 1;
+}
+
+/* maze_view_resize(*vp, s_rows, s_cols)
+
+   Reallocate the screens and the cells for a frame, and find the
+   zoom level at which the whole maze fits.
+ */
+
+int maze_view_resize(maze_view_t *vp, unsigned int s_rows,
+                     unsigned int s_cols) {
+  size_t n_chars = (size_t)s_rows * s_cols;
+  size_t n_cells = ((size_t)s_rows / 2 + 2) * ((size_t)s_cols / 2 + 2);
+  unsigned long long h, w;
+  int level;
+
+  if (s_rows == 0 || s_cols == 0) return 0;
+  if (n_cells < VIEW_CHUNK) n_cells = VIEW_CHUNK;
+
+  free(vp->screen);
+  free(vp->next);
+  free(vp->cells);
+  vp->screen = malloc(n_chars);
+  vp->next = malloc(n_chars);
+  vp->cells = malloc(n_cells * sizeof(*(vp->cells)));
+  if (vp->screen == NULL || vp->next == NULL || vp->cells == NULL) {
+    maze_view_clear(vp);
+    return 0;
+  }
+
+  /* Keep the same cell in the middle of the new screen */
+  level = vp->level;
+  if (vp->s_rows != 0) {
+    rowcol_t r, c;
+
+    s_view_cell_at(vp, vp->top + vp->s_rows / 2, vp->left + vp->s_cols / 2,
+                   &r, &c);
+    vp->s_rows = s_rows;
+    vp->s_cols = s_cols;
+    maze_view_goto(vp, r, c);
+  }
+  vp->s_rows = s_rows;
+  vp->s_cols = s_cols;
+  vp->n_cells = n_cells;
+  vp->fresh = 1;
+
+  for (vp->max_level = VIEW_GRID;; ++vp->max_level) {
+    s_view_dims(vp, vp->max_level, &h, &w);
+    if (h <= s_rows && w <= s_cols) break;
+  }
+  if (level > vp->max_level) maze_view_zoom(vp, vp->max_level);
+  s_view_clamp(vp);
+  return 1;
+}
+
+/* maze_view_zoom(*vp, level)
+
+   Find the cell in the middle of the screen, and bring it to the
+   middle again at the new level.
+ */
+
+void maze_view_zoom(maze_view_t *vp, int level) {
+  rowcol_t r, c;
+
+  if (level < VIEW_TEXT) level = VIEW_TEXT;
+  if (level > vp->max_level) level = vp->max_level;
+
+  s_view_cell_at(vp, vp->top + vp->s_rows / 2, vp->left + vp->s_cols / 2, &r,
+                 &c);
+  vp->level = level;
+  maze_view_goto(vp, r, c);
+}
+
+/* maze_view_scroll(*vp, dy, dx)
+
+   Move the screen over the picture, stopping at its edges.
+ */
+
+void maze_view_scroll(maze_view_t *vp, long long dy, long long dx) {
+  if (dy < 0 && (unsigned long long)-dy > vp->top)
+    vp->top = 0;
+  else
+    vp->top += dy;
+  if (dx < 0 && (unsigned long long)-dx > vp->left)
+    vp->left = 0;
+  else
+    vp->left += dx;
+  s_view_clamp(vp);
+}
+
+/* maze_view_goto(*vp, r, c)
+
+   Find where the middle of cell (r, c) is drawn, and put the middle
+   of the screen there.
+ */
+
+void maze_view_goto(maze_view_t *vp, rowcol_t r, rowcol_t c) {
+  unsigned long long y, x;
+
+  if (vp->level <= VIEW_GRID) {
+    y = 2ULL * r + 1;
+    x = (vp->level == VIEW_TEXT) ? 4ULL * c + 2 : 2ULL * c + 1;
+  } else {
+    y = r >> (vp->level - 1);
+    x = c >> (vp->level - 1);
+  }
+  vp->top = (y > vp->s_rows / 2) ? y - vp->s_rows / 2 : 0;
+  vp->left = (x > vp->s_cols / 2) ? x - vp->s_cols / 2 : 0;
+  s_view_clamp(vp);
+}
+
+/* maze_view_path(*vp, *cells, n)
+
+   Remember the list of extra path cells.
+ */
+
+void maze_view_path(maze_view_t *vp, const unsigned long long *cells,
+                    size_t n) {
+  vp->path = cells;
+  vp->n_path = n;
+}
+
+/* maze_view_extent(*vp, *r0, *c0, *r1, *c1)
+
+   Find the cells drawn at the top left and bottom right corners of
+   the part of the screen the picture covers.  Walls belong to the
+   cells above and to the left of them, and blocks to their last
+   cells at the bottom right.
+ */
+
+void maze_view_extent(const maze_view_t *vp, rowcol_t *r0, rowcol_t *c0,
+                      rowcol_t *r1, rowcol_t *c1) {
+  unsigned long long h, w, y1, x1;
+
+  s_view_dims(vp, vp->level, &h, &w);
+  y1 = (vp->top + vp->s_rows < h) ? vp->top + vp->s_rows - 1 : h - 1;
+  x1 = (vp->left + vp->s_cols < w) ? vp->left + vp->s_cols - 1 : w - 1;
+
+  s_view_cell_at(vp, vp->top, vp->left, r0, c0);
+  if (vp->level <= VIEW_GRID) {
+    s_view_cell_at(vp, y1 > 0 ? y1 - 1 : 0, x1 > 0 ? x1 - 1 : 0, r1, c1);
+  } else {
+    s_view_cell_at(vp, y1 + 1, x1 + 1, r1, c1);
+    if ((y1 + 1) << (vp->level - 1) < vp->n_rows) --*r1;
+    if ((x1 + 1) << (vp->level - 1) < vp->n_cols) --*c1;
+  }
+}
+
+/* s_lower_bound(*path, n, k)
+
+   Return the position of the first entry of a sorted path list that
+   is not less than k.
+ */
+
+static size_t s_lower_bound(const unsigned long long *path, size_t n,
+                            unsigned long long k) {
+  size_t lo = 0, hi = n;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if (path[mid] < k)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/* s_has_exit(*vp, exit)
+
+   Return true if exit is one of the maze's exits.
+ */
+
+static int s_has_exit(const maze_view_t *vp, rowcol_t exit) {
+  return vp->exit_1 == exit || vp->exit_2 == exit;
+}
+
+/* s_view_window(*vp, r0, r1, c0, c1, *wp)
+
+   Read rows r0 to r1 of columns c0 to c1 into the viewer's cells,
+   drawn as the writers draw them: with the walls of the exits
+   removed, and visit set only on the cells of the path, if it is to
+   be shown.
+ */
+
+static int s_view_window(maze_view_t *vp, rowcol_t r0, rowcol_t r1,
+                         rowcol_t c0, rowcol_t c1, s_win_t *wp) {
+  rowcol_t r, c, n = c1 - c0 + 1;
+  maze_node *row = vp->cells;
+  size_t k;
+
+  for (r = r0; r <= r1; ++r, row += n) {
+    unsigned long long base = (unsigned long long)r * vp->n_cols;
+
+    if (!s_view_read(vp, r, c0, n, row)) return 0;
+
+    for (c = 0; c < n; ++c) row[c].visit = row[c].visit && vp->show_path;
+    k = s_lower_bound(vp->path, vp->n_path, base + c0);
+    for (; vp->show_path && k < vp->n_path && vp->path[k] <= base + c1; ++k)
+      row[vp->path[k] - base - c0].visit = 1;
+
+    if (c1 == vp->n_cols - 1 && s_has_exit(vp, EXIT(r, DIR_R)))
+      row[n - 1].r_wall = 0;
+    if (r == vp->n_rows - 1) {
+      for (c = c0; c <= c1; ++c)
+        if (s_has_exit(vp, EXIT(c, DIR_D))) row[c - c0].b_wall = 0;
+    }
+  }
+
+  wp->cells = vp->cells;
+  wp->r0 = r0;
+  wp->c0 = c0;
+  wp->n_cols = n;
+  return 1;
+}
+
+/* s_win_cell(*wp, r, c)
+
+   Return cell (r, c) of a window.
+ */
+
+static maze_node s_win_cell(const s_win_t *wp, rowcol_t r, rowcol_t c) {
+  return wp->cells[(size_t)(r - wp->r0) * wp->n_cols + (c - wp->c0)];
+}
+
+/* s_text_char(*vp, *wp, y, x)
+
+   Return the character at row y and column x of the picture at
+   VIEW_TEXT, as maze_write_text() draws it.  Even rows hold the walls
+   along the tops of the cells, and odd rows the cells themselves,
+   with each cell's left wall at a column divisible by four.
+ */
+
+static char s_text_char(const maze_view_t *vp, const s_win_t *wp,
+                        unsigned long long y, unsigned long long x) {
+  rowcol_t r = (rowcol_t)(y / 2), c = (rowcol_t)(x / 4);
+
+  if (y % 2 == 0) {
+    if (x % 4 == 0) return '+';
+    if (r == 0) return s_has_exit(vp, EXIT(c, DIR_U)) ? ' ' : '-';
+    return s_win_cell(wp, r - 1, c).b_wall ? '-' : ' ';
+  }
+  if (x % 4 == 0) {
+    if (c == 0) return s_has_exit(vp, EXIT(r, DIR_L)) ? ' ' : '|';
+    return s_win_cell(wp, r, c - 1).r_wall ? '|' : ' ';
+  }
+  return (x % 4 == 2 && s_win_cell(wp, r, c).visit) ? '@' : ' ';
+}
+
+/* s_grid_char(*vp, *wp, y, x)
+
+   Return the character at row y and column x of the picture at
+   VIEW_GRID, a square of maze_write_grid(): '#' for a wall or post.
+   An open square is '@' if the cells on both sides of it are on the
+   path.
+ */
+
+static char s_grid_char(const maze_view_t *vp, const s_win_t *wp,
+                        unsigned long long y, unsigned long long x) {
+  rowcol_t r = (rowcol_t)(y / 2), c = (rowcol_t)(x / 2);
+  maze_node n;
+
+  if (y % 2 == 0 && x % 2 == 0) return '#';
+  if (y % 2 == 0) {
+    if (r == 0) return s_has_exit(vp, EXIT(c, DIR_U)) ? ' ' : '#';
+    if ((n = s_win_cell(wp, r - 1, c)).b_wall) return '#';
+    return (r < vp->n_rows && n.visit && s_win_cell(wp, r, c).visit) ? '@'
+                                                                      : ' ';
+  }
+  if (x % 2 == 0) {
+    if (c == 0) return s_has_exit(vp, EXIT(r, DIR_L)) ? ' ' : '#';
+    if ((n = s_win_cell(wp, r, c - 1)).r_wall) return '#';
+    return (c < vp->n_cols && n.visit && s_win_cell(wp, r, c).visit) ? '@'
+                                                                      : ' ';
+  }
+  return s_win_cell(wp, r, c).visit ? '@' : ' ';
+}
+
+/* s_view_walls(*vp, y1, x1)
+
+   Draw the picture at VIEW_TEXT or VIEW_GRID from the top left of
+   the screen to row y1 and column x1 of the picture, reading the
+   cells whose walls can show: for a wall, those on both sides of it.
+ */
+
+static int s_view_walls(maze_view_t *vp, unsigned long long y1,
+                        unsigned long long x1) {
+  unsigned long long y0 = vp->top, x0 = vp->left, y, x;
+  unsigned int per = (vp->level == VIEW_TEXT) ? 4 : 2;
+  rowcol_t r0, r1, c0, c1;
+  s_win_t win;
+
+  r0 = (rowcol_t)(y0 > 0 ? (y0 - 1) / 2 : 0);
+  r1 = (rowcol_t)(y1 / 2 < vp->n_rows ? y1 / 2 : vp->n_rows - 1);
+  c0 = (rowcol_t)(x0 > 0 ? (x0 - 1) / per : 0);
+  c1 = (rowcol_t)(x1 / per < vp->n_cols ? x1 / per : vp->n_cols - 1);
+  if (!s_view_window(vp, r0, r1, c0, c1, &win)) return 0;
+
+  for (y = y0; y <= y1; ++y) {
+    char *line = vp->next + (size_t)(y - y0) * vp->s_cols;
+
+    for (x = x0; x <= x1; ++x)
+      line[x - x0] = (vp->level == VIEW_TEXT) ? s_text_char(vp, &win, y, x)
+                                              : s_grid_char(vp, &win, y, x);
+  }
+  return 1;
+}
+
+/* s_view_kept(*vp, level)
+
+   Return what is kept of the blocks of a level above VIEW_GRID,
+   setting it up with every block unread the first time, or NULL if
+   the level has too many blocks or there is no room.
+ */
+
+static unsigned char *s_view_kept(maze_view_t *vp, int level) {
+  unsigned char **kept = vp->blocks + (level - VIEW_GRID - 1);
+  unsigned long long h, w;
+
+  s_view_dims(vp, level, &h, &w);
+  if (*kept == NULL && h * w <= VIEW_CACHE) *kept = calloc(h * w, 1);
+  return *kept;
+}
+
+/* s_view_band(*vp, y, xa, xb, *out)
+
+   Read every cell of blocks xa to xb of row y of the picture at the
+   current level above VIEW_GRID, and put '@' at out[x - xa] for each
+   block x holding a cell marked in the maze.  The same cells make up
+   whole blocks at each level in between, which are kept as well.
+ */
+
+static int s_view_band(maze_view_t *vp, unsigned long long y,
+                       unsigned long long xa, unsigned long long xb,
+                       char *out) {
+  unsigned int shift = vp->level - 1, sj;
+  unsigned char *fine[VIEW_LEVELS];
+  unsigned long long w[VIEW_LEVELS], h, yj;
+  rowcol_t r = (rowcol_t)(y << shift), r0 = r, r1, c, c0, c1, n, i;
+  int j;
+
+  r1 = ((y + 1) << shift < vp->n_rows) ? (rowcol_t)((y + 1) << shift) - 1
+                                       : vp->n_rows - 1;
+  c0 = (rowcol_t)(xa << shift);
+  c1 = ((xb + 1) << shift < vp->n_cols) ? (rowcol_t)((xb + 1) << shift) - 1
+                                        : vp->n_cols - 1;
+
+  for (j = 0, sj = 1; sj < shift; ++j, ++sj) {
+    if ((fine[j] = s_view_kept(vp, VIEW_GRID + 1 + j)) == NULL) continue;
+    s_view_dims(vp, VIEW_GRID + 1 + j, &h, &w[j]);
+    for (yj = r0 >> sj; yj <= r1 >> sj; ++yj)
+      memset(fine[j] + yj * w[j] + (c0 >> sj), BLOCK_OFF,
+             (c1 >> sj) - (c0 >> sj) + 1);
+  }
+
+  for (; r <= r1; ++r) {
+    for (c = c0; c <= c1; c += n) {
+      n = (c1 - c + 1 < VIEW_CHUNK) ? c1 - c + 1 : VIEW_CHUNK;
+      if (!s_view_read(vp, r, c, n, vp->cells)) return 0;
+      for (i = 0; i < n; ++i) {
+        if (!vp->cells[i].visit) continue;
+        out[((c + i) >> shift) - xa] = '@';
+        for (j = 0, sj = 1; sj < shift; ++j, ++sj)
+          if (fine[j] != NULL)
+            fine[j][(r >> sj) * w[j] + ((c + i) >> sj)] = BLOCK_ON;
+      }
+    }
+  }
+  return 1;
+}
+
+/* s_view_blocks(*vp, y1, x1)
+
+   Draw the picture at a level above VIEW_GRID from the top left of
+   the screen to row y1 and column x1 of the picture.  If the path is
+   shown, the cells of a block must be read to find whether the path
+   crosses it.  What was found is kept for each level that is small
+   enough, so that only blocks never read before are read; the blocks
+   of a larger level are read again for every frame.  If the path is
+   not shown, nothing need be read.
+ */
+
+static int s_view_blocks(maze_view_t *vp, unsigned long long y1,
+                         unsigned long long x1) {
+  unsigned long long y0 = vp->top, x0 = vp->left, y, x, xe, h, w, base;
+  unsigned int shift = vp->level - 1;
+  unsigned char *kept = NULL, *mk;
+  rowcol_t r, r1, c, c0 = (rowcol_t)(x0 << shift), c1;
+  size_t k;
+
+  c1 = ((x1 + 1) << shift < vp->n_cols) ? (rowcol_t)((x1 + 1) << shift) - 1
+                                        : vp->n_cols - 1;
+
+  s_view_dims(vp, vp->level, &h, &w);
+  if (vp->show_path) kept = s_view_kept(vp, vp->level);
+
+  for (y = y0; y <= y1; ++y) {
+    char *line = vp->next + (size_t)(y - y0) * vp->s_cols;
+
+    memset(line, '.', x1 - x0 + 1);
+    if (!vp->show_path) continue;
+
+    if (kept == NULL) {
+      if (!s_view_band(vp, y, x0, x1, line)) return 0;
+    } else {
+      mk = kept + y * w;
+      for (x = x0; x <= x1; x = xe) {
+        if (mk[x] != BLOCK_UNREAD) {
+          if (mk[x] == BLOCK_ON) line[x - x0] = '@';
+          xe = x + 1;
+          continue;
+        }
+        for (xe = x + 1; xe <= x1 && mk[xe] == BLOCK_UNREAD; ++xe)
+          ;
+        if (!s_view_band(vp, y, x, xe - 1, line + (x - x0))) return 0;
+        for (; x < xe; ++x)
+          mk[x] = (line[x - x0] == '@') ? BLOCK_ON : BLOCK_OFF;
+      }
+    }
+
+    r = (rowcol_t)(y << shift);
+    r1 = ((y + 1) << shift < vp->n_rows) ? (rowcol_t)((y + 1) << shift) - 1
+                                         : vp->n_rows - 1;
+    base = (unsigned long long)r * vp->n_cols;
+    k = s_lower_bound(vp->path, vp->n_path, base);
+    for (; k < vp->n_path && vp->path[k] / vp->n_cols <= r1; ++k) {
+      c = (rowcol_t)(vp->path[k] % vp->n_cols);
+      if (c >= c0 && c <= c1) line[(c >> shift) - x0] = '@';
+    }
+  }
+  return 1;
+}
+
+/* s_out_bytes(*op, *data, len)
+
+   Add len bytes to the output of a frame, passing full chunks to the
+   sink.
+ */
+
+static void s_out_bytes(s_out_t *op, const char *data, size_t len) {
+  while (len > 0) {
+    size_t n = sizeof(op->buf) - op->len;
+
+    if (n > len) n = len;
+    memcpy(op->buf + op->len, data, n);
+    op->len += n;
+    data += n;
+    len -= n;
+    if (op->len == sizeof(op->buf)) {
+      op->ok = op->ok && op->sink->write(op->sink, op->buf, op->len);
+      op->len = 0;
+    }
+  }
+}
+
+/* s_out_seq(*op, cmd, n1, n2)
+
+   Add the escape sequence ESC [ n1 ; n2 cmd, leaving out n2 if it is
+   zero, and n1 as well if both are.
+ */
+
+static void s_out_seq(s_out_t *op, char cmd, unsigned long long n1,
+                      unsigned long long n2) {
+  char seq[48];
+  int len;
+
+  if (n2 != 0)
+    len = sprintf(seq, "\033[%llu;%llu%c", n1, n2, cmd);
+  else if (n1 != 0)
+    len = sprintf(seq, "\033[%llu%c", n1, cmd);
+  else
+    len = sprintf(seq, "\033[%c", cmd);
+  s_out_bytes(op, seq, len);
+}
+
+/* s_view_scrolled(*vp, *op)
+
+   If the last frame was drawn at the same level and column, but a
+   different row, less than a screen away, have the terminal scroll
+   it into place, and scroll the copy of the screen to match.
+ */
+
+static void s_view_scrolled(maze_view_t *vp, s_out_t *op) {
+  size_t cols = vp->s_cols, d;
+
+  if (vp->d_level != vp->level || vp->d_left != vp->left ||
+      vp->d_top == vp->top)
+    return;
+
+  if (vp->top > vp->d_top && vp->top - vp->d_top < vp->s_rows) {
+    d = vp->top - vp->d_top;
+    s_out_seq(op, 'S', d, 0);
+    memmove(vp->screen, vp->screen + d * cols, (vp->s_rows - d) * cols);
+    memset(vp->screen + (vp->s_rows - d) * cols, ' ', d * cols);
+  } else if (vp->top < vp->d_top && vp->d_top - vp->top < vp->s_rows) {
+    d = vp->d_top - vp->top;
+    s_out_seq(op, 'T', d, 0);
+    memmove(vp->screen + d * cols, vp->screen, (vp->s_rows - d) * cols);
+    memset(vp->screen, ' ', d * cols);
+  }
+}
+
+/* maze_view_draw(*vp, *sp)
+
+   The new frame is drawn in full into next, then compared with the
+   screen row by row.  Each run of changed characters is written after
+   a cursor movement, or after the few unchanged characters before it
+   if that is shorter.  A write that reaches the right edge leaves the
+   cursor in doubt, so the next run always moves it.
+ */
+
+int maze_view_draw(maze_view_t *vp, maze_sink_t *sp) {
+  unsigned long long h, w, y1, x1;
+  size_t cols = vp->s_cols, y, x, end, cx;
+  s_out_t out;
+
+  if (vp->screen == NULL) return 0;
+
+  s_view_clamp(vp);
+  s_view_dims(vp, vp->level, &h, &w);
+  y1 = (vp->top + vp->s_rows < h) ? vp->top + vp->s_rows - 1 : h - 1;
+  x1 = (vp->left + vp->s_cols < w) ? vp->left + vp->s_cols - 1 : w - 1;
+
+  memset(vp->next, ' ', (size_t)vp->s_rows * cols);
+  if (!(vp->level <= VIEW_GRID ? s_view_walls(vp, y1, x1)
+                               : s_view_blocks(vp, y1, x1)))
+    return 0;
+
+  out.sink = sp;
+  out.ok = 1;
+  out.len = 0;
+  if (vp->fresh) {
+    s_out_seq(&out, 'r', 1, vp->s_rows);
+    s_out_seq(&out, 'H', 0, 0);
+    s_out_seq(&out, 'J', 2, 0);
+    memset(vp->screen, ' ', (size_t)vp->s_rows * cols);
+  } else {
+    s_view_scrolled(vp, &out);
+  }
+
+  for (y = 0; y < vp->s_rows; ++y) {
+    char *old = vp->screen + y * cols, *new = vp->next + y * cols;
+
+    for (x = 0, cx = cols; x < cols; ++x) {
+      if (old[x] == new[x]) continue;
+
+      if (x >= cx && x - cx <= VIEW_SKIP)
+        s_out_bytes(&out, new + cx, x - cx);
+      else
+        s_out_seq(&out, 'H', y + 1, x + 1);
+
+      for (end = x; end < cols && old[end] != new[end]; ++end)
+        ;
+      s_out_bytes(&out, new + x, end - x);
+      memcpy(old + x, new + x, end - x);
+      cx = end;
+      x = end - 1;
+    }
+  }
+
+  if (out.len > 0) out.ok = out.ok && sp->write(sp, out.buf, out.len);
+  if (sp->flush != NULL) out.ok = out.ok && sp->flush(sp);
+
+  vp->fresh = 0;
+  vp->d_level = vp->level;
+  vp->d_top = vp->top;
+  vp->d_left = vp->left;
+  return out.ok;
+}
+
+/* Here there be dragons */
@@ -0,0 +1,164 @@
+/*
+  Name:     mazeview.h
+  Purpose:  Terminal viewer for large mazes.
+  Author:   M. J. Fromberger <http://github.com/creachadair>
+
+  Copyright (C) 1998-2006 M. J. Fromberger, All Rights Reserved.
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+ */
+
+#ifndef MAZEVIEW_H_
+#define MAZEVIEW_H_
+
+#include "maze.h"
+#include "mazeshard.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A viewer shows the part of a maze that fits on a character
+   terminal, and keeps the terminal up to date with ANSI escape
+   sequences as the view is moved, writing only the characters that
+   change.  Only the cells in view are read, from a maze in memory,
+   a stored maze on a file that can be seeked, or a sharded maze, so a
+   maze far too large to print can be browsed without loading it.
+
+   The view is a window onto a picture of the maze at one of several
+   zoom levels.  At VIEW_TEXT the picture is the output of
+   maze_write_text(), four characters across and two down for each
+   cell.  At VIEW_GRID it is the occupancy grid of maze_write_grid(),
+   two characters each way per cell, with '#' for walls.  At level k
+   above that, each character stands for a block of 2^(k-1) cells on
+   a side, '@' if any of them is on the path and '.' if not.  Cells
+   on the path are those marked in the maze, and those listed with
+   maze_view_path().  Whether the marks reach a block is kept once its
+   cells are read, so that moving about a zoomed-out picture reads
+   only blocks not drawn before; the maze must not change while it is
+   viewed. */
+
+/** Zoom levels with a picture of every wall. */
+enum { VIEW_TEXT = 0, VIEW_GRID = 1 };
+
+/** Most zoom levels above VIEW_GRID, enough for any maze. */
+#define VIEW_LEVELS 32
+
+/** Where a viewer reads its cells from. */
+enum { VIEW_SRC_MAZE = 0, VIEW_SRC_STORE = 1, VIEW_SRC_SHARDS = 2 };
+
+/** A viewer for a maze. */
+typedef struct {
+  rowcol_t n_rows;
+  rowcol_t n_cols;
+  rowcol_t exit_1;
+  rowcol_t exit_2;
+  int level;     /* Zoom level, from VIEW_TEXT to max_level        */
+  int max_level; /* Level at which the whole maze fits on screen,
+                    or VIEW_GRID if that is higher               */
+  int show_path; /* True to draw the path, if there is one         */
+  unsigned long long top;  /* Picture row at the top of the screen  */
+  unsigned long long left; /* Picture column at the left            */
+  unsigned int s_rows; /* Size of the screen, in characters         */
+  unsigned int s_cols;
+  char *screen; /* What the terminal shows, s_rows x s_cols         */
+  char *next;   /* The frame being drawn                            */
+  int fresh;    /* True if the terminal must be cleared first       */
+  int d_level;  /* Level, top, and left of the frame last drawn     */
+  unsigned long long d_top, d_left;
+  maze_node *cells; /* Cells read for the frame being drawn          */
+  size_t n_cells;   /* Room in cells                                */
+  const unsigned long long *path; /* Extra path cells, r * n_cols + c */
+  size_t n_path;                  /* in ascending order              */
+  unsigned long long n_read;      /* Cells read for all frames        */
+  unsigned char *blocks[VIEW_LEVELS]; /* For each level above VIEW_GRID,
+                                         what is known of its blocks, or
+                                         NULL                          */
+  int source; /* One of the VIEW_SRC_ values                       */
+  const maze_t *mp;   /* VIEW_SRC_MAZE                              */
+  FILE *ifp;          /* VIEW_SRC_STORE: the file, the offset of    */
+  long data;          /* its first cell, and cells per line         */
+  unsigned long line;
+  maze_shard_reader_t shards; /* VIEW_SRC_SHARDS                    */
+} maze_view_t;
+
+/** Set up a viewer for a maze in memory, which it reads from but
+    does not own.  The screen has no size until maze_view_resize(),
+    for this and the other sources.  Returns true. */
+int maze_view_init(maze_view_t *vp, const maze_t *mp);
+
+/** Set up a viewer for a maze stored by maze_store() on ifp, whose
+    dimension line has already been read with maze_load_header().
+    Cells are read from the file as they come into view, so it must
+    be one that can be seeked.  Returns false if it cannot be.
+ */
+int maze_view_store(maze_view_t *vp, FILE *ifp, rowcol_t n_rows,
+                    rowcol_t n_cols, rowcol_t exit_1, rowcol_t exit_2);
+
+/** Set up a viewer for the stitched shards in a directory, which are
+    read with a shard reader as cells come into view.  Returns false
+    with a diagnostic on error. */
+int maze_view_shards(maze_view_t *vp, const char *dir);
+
+/** Release the memory held by a viewer, and close its shard files. */
+void maze_view_clear(maze_view_t *vp);
+
+/** Set the size of the screen, not counting any lines the caller
+    keeps for itself below it.  The next frame clears the terminal
+    and draws the whole screen.  Returns false if memory is exhausted.
+ */
+int maze_view_resize(maze_view_t *vp, unsigned int s_rows,
+                     unsigned int s_cols);
+
+/** Change the zoom level, keeping the cell at the middle of the
+    screen in the middle. */
+void maze_view_zoom(maze_view_t *vp, int level);
+
+/** Move the view by dy picture rows and dx picture columns. */
+void maze_view_scroll(maze_view_t *vp, long long dy, long long dx);
+
+/** Move the view so that the cell at row r and column c is in the
+    middle of the screen, or as near as the edges allow. */
+void maze_view_goto(maze_view_t *vp, rowcol_t r, rowcol_t c);
+
+/** Draw cells on the path besides those marked in the maze: the n
+    cells r * n_cols + c listed in ascending order at cells, which
+    must stay valid while the viewer uses them. */
+void maze_view_path(maze_view_t *vp, const unsigned long long *cells,
+                    size_t n);
+
+/** Find the first and last rows and columns of cells in view. */
+void maze_view_extent(const maze_view_t *vp, rowcol_t *r0, rowcol_t *c0,
+                      rowcol_t *r1, rowcol_t *c1);
+
+/** Draw the view as it now stands, writing to sp the escape sequences
+    and characters that bring the terminal from the last frame to
+    this one.  The first frame after maze_view_resize() clears the
+    terminal and sets its scrolling region to the rows of the screen,
+    so that a view moved up or down is scrolled by the terminal, and
+    only the rows uncovered are drawn.  Returns false in case of a
+    read or write error.
+ */
+int maze_view_draw(maze_view_t *vp, maze_sink_t *sp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end MAZEVIEW_H_ */